@@ -167,6 +167,14 @@ public:
     virtual void runBlockingIO() {};
 
     static void threadCallback(ActivityContext *context) {
+        // This helper thread does the work of the callback.
+        std::shared_ptr<oboe::AudioStream> stream = context->getOutputStream();
+        if (!stream) {
+            stream = context->getInputStream();
+        }
+        if (stream) {
+            oboe::applyThreadPlacement(stream->getHelperThreadPlacement());
+        }
         context->runBlockingIO();
     }
 
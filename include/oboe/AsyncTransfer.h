@@ -0,0 +1,158 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_ASYNC_TRANSFER_H
+#define OBOE_ASYNC_TRANSFER_H
+
+#include <cstdint>
+
+#include "oboe/AudioStream.h"
+#include "oboe/Definitions.h"
+#include "oboe/ResultWithValue.h"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define OBOE_COROUTINES_SUPPORTED 1
+#endif
+#endif
+
+namespace oboe {
+
+/**
+ * AsyncTransferCallback is called when a transfer started by AudioStream::writeAsync()
+ * or AudioStream::readAsync() finishes.
+ *
+ * It is called on one of a few threads that Oboe shares between all streams.
+ * So it should return quickly and must not block, eg. by calling a blocking read() or write().
+ * It may start the next transfer.
+ */
+class AsyncTransferCallback {
+public:
+    virtual ~AsyncTransferCallback() = default;
+
+    /**
+     * The transfer has finished.
+     *
+     * If the stream was closed while the transfer was pending then this is called
+     * by AudioStream::close() with Result::ErrorClosed.
+     *
+     * @param audioStream pointer to the associated stream
+     * @param result number of frames transferred, which is less than requested if the
+     *               transfer timed out, or Result::Error*
+     */
+    virtual void onTransferComplete(AudioStream *audioStream,
+                                    ResultWithValue<int32_t> result) = 0;
+};
+
+#ifdef OBOE_COROUTINES_SUPPORTED
+
+/**
+ * Awaitable returned by asyncWrite() and asyncRead().
+ * This is only available when compiling with C++20 coroutines.
+ */
+class AsyncTransferAwaitable : public AsyncTransferCallback {
+public:
+    AsyncTransferAwaitable(AudioStream &stream,
+                           void *readBuffer,
+                           const void *writeBuffer,
+                           int32_t numFrames,
+                           int64_t timeoutNanoseconds)
+            : mStream(stream)
+            , mReadBuffer(readBuffer)
+            , mWriteBuffer(writeBuffer)
+            , mNumFrames(numFrames)
+            , mTimeoutNanoseconds(timeoutNanoseconds) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        mHandle = handle;
+        Result result = (mReadBuffer != nullptr)
+                ? mStream.readAsync(mReadBuffer, mNumFrames, mTimeoutNanoseconds, this)
+                : mStream.writeAsync(mWriteBuffer, mNumFrames, mTimeoutNanoseconds, this);
+        if (result != Result::OK) {
+            mResult = static_cast<int32_t>(result);
+            return false; // resume now
+        }
+        // The transfer may already have finished on another thread so do not touch this.
+        return true;
+    }
+
+    ResultWithValue<int32_t> await_resume() const noexcept {
+        return ResultWithValue<int32_t>::createBasedOnSign(mResult);
+    }
+
+    void onTransferComplete(AudioStream * /* audioStream */,
+                            ResultWithValue<int32_t> result) override {
+        mResult = result ? result.value() : static_cast<int32_t>(result.error());
+        mHandle.resume();
+    }
+
+private:
+    AudioStream             &mStream;
+    void                    *mReadBuffer;
+    const void              *mWriteBuffer;
+    int32_t                  mNumFrames;
+    int64_t                  mTimeoutNanoseconds;
+    std::coroutine_handle<>  mHandle;
+    int32_t                  mResult = 0; // frames transferred or a negative Result
+};
+
+/**
+ * Write to a stream from a coroutine, for example:
+ *
+ *     auto result = co_await oboe::asyncWrite(*stream, buffer, numFrames, timeoutNanos);
+ *
+ * The coroutine is suspended without blocking a thread and resumed on one of the
+ * threads that Oboe shares between all streams. See AudioStream::writeAsync().
+ *
+ * @param stream an open output stream
+ * @param buffer frames to write, which must stay valid until the coroutine resumes
+ * @param numFrames number of frames to write
+ * @param timeoutNanoseconds maximum time to wait for the stream
+ * @return awaitable whose value is the number of frames written or Result::Error*
+ */
+inline AsyncTransferAwaitable asyncWrite(AudioStream &stream,
+                                         const void *buffer,
+                                         int32_t numFrames,
+                                         int64_t timeoutNanoseconds) {
+    return AsyncTransferAwaitable(stream, nullptr, buffer, numFrames, timeoutNanoseconds);
+}
+
+/**
+ * Read from a stream from a coroutine. See asyncWrite() and AudioStream::readAsync().
+ *
+ * @param stream an open input stream
+ * @param buffer space for the frames, which must stay valid until the coroutine resumes
+ * @param numFrames number of frames to read
+ * @param timeoutNanoseconds maximum time to wait for the stream
+ * @return awaitable whose value is the number of frames read or Result::Error*
+ */
+inline AsyncTransferAwaitable asyncRead(AudioStream &stream,
+                                        void *buffer,
+                                        int32_t numFrames,
+                                        int64_t timeoutNanoseconds) {
+    return AsyncTransferAwaitable(stream, buffer, nullptr, numFrames, timeoutNanoseconds);
+}
+
+#endif // OBOE_COROUTINES_SUPPORTED
+
+} // namespace oboe
+
+#endif //OBOE_ASYNC_TRANSFER_H
@@ -20,9 +20,13 @@
 #include <atomic>
 #include <cstdint>
 #include <ctime>
+#include <memory>
 #include <mutex>
+#include <pthread.h>
 #include "oboe/Definitions.h"
 #include "oboe/ResultWithValue.h"
+#include "oboe/CallbackTimingStats.h"
+#include "oboe/TimeHistogram.h"
 #include "oboe/AudioStreamBuilder.h"
 #include "oboe/AudioStreamBase.h"
 
@@ -38,14 +42,24 @@ namespace oboe {
  */
 constexpr int64_t kDefaultTimeoutNanos = (2000 * kNanosPerMillisecond);
 
+class AsyncTransferCallback;
+class CallbackBatcher;
+class CallbackTimingRecorder;
+class MemoryRegions;
+struct PendingTransfer;
+class PlaybackScheduler;
+class ScheduledEventCallback;
+class StreamArena;
+
 /**
  * Base class for Oboe C++ audio stream.
  */
 class AudioStream : public AudioStreamBase {
     friend class AudioStreamBuilder; // allow access to setWeakThis() and lockWeakThis()
+    friend class StreamMixer; // allow access to setWeakThis() and lockWeakThis()
 public:
 
-    AudioStream() {}
+    AudioStream();
 
     /**
      * Construct an `AudioStream` using the given `AudioStreamBuilder`
@@ -54,7 +68,7 @@ public:
      */
     explicit AudioStream(const AudioStreamBuilder &builder);
 
-    virtual ~AudioStream() = default;
+    virtual ~AudioStream();
 
     /**
      * Open a stream based on the current settings.
@@ -200,6 +214,151 @@ public:
      */
     virtual bool isXRunCountSupported() const = 0;
 
+    /**
+     * Get the number of input frames that were discarded to limit the latency.
+     * See AudioStreamBuilder::setLossyInputFifoFramesToKeep().
+     *
+     * @return a result which is either Result::OK with the number of frames as the value, or a
+     * Result::Error* code
+     */
+    virtual ResultWithValue<int64_t> getDiscardedFrameCount() {
+        return ResultWithValue<int64_t>(Result::ErrorUnimplemented);
+    }
+
+    /**
+     * Get a histogram of the time that frames spent in the stream's internal FIFO,
+     * between write() and the callback for output or between the callback and read() for input.
+     * Use TimeHistogram::getPercentileNanos() to get eg. the median and 99th percentile.
+     *
+     * See AudioStreamBuilder::setFifoResidencyTrackingEnabled().
+     *
+     * @return histogram or nullptr if the stream has no FIFO or tracking is not enabled
+     */
+    virtual const TimeHistogram *getFifoResidencyHistogram() const {
+        return nullptr;
+    }
+
+    /**
+     * Get the frames rendered and time taken by an offline stream since it was last started.
+     * This may be called while the stream is rendering.
+     *
+     * See AudioStreamBuilder::setOfflineSink().
+     *
+     * @return stats or Result::ErrorUnimplemented if the stream is not offline
+     */
+    virtual ResultWithValue<OfflineRenderStats> getOfflineRenderStats() {
+        return ResultWithValue<OfflineRenderStats>(Result::ErrorUnimplemented);
+    }
+
+    /**
+     * Get the timing of the data callback since the stream was opened or the stats were reset.
+     * This may be called from any thread, including the callback.
+     *
+     * See AudioStreamBuilder::setCallbackTimingEnabled().
+     *
+     * @return stats or Result::ErrorInvalidState if callback timing is not enabled
+     */
+    virtual ResultWithValue<CallbackTimingStats> getCallbackTimingStats();
+
+    /**
+     * Clear the callback timing stats. They are cleared by the callback thread before
+     * the next callback is measured, so the old stats may be returned until then.
+     *
+     * @return OK or Result::ErrorInvalidState if callback timing is not enabled
+     */
+    virtual Result resetCallbackTimingStats();
+
+    /*
+     * Get the lateness of the data callbacks since resetCallbackLatenessWindow().
+     * The lateness of a callback is its interval jitter plus its duration.
+     * This is kept apart from getCallbackTimingStats() so that the LatencyTuner can
+     * measure each of its periods without clearing the stats that the app reads.
+     * This should only be used internally.
+     *
+     * @return lateness in nanoseconds, Result::ErrorInvalidState if callback timing is not
+     *         enabled or Result::ErrorUnavailable if there was no callback in the window
+     */
+    virtual ResultWithValue<PercentileSummary> getCallbackLatenessWindow();
+
+    /*
+     * Start a new window for getCallbackLatenessWindow(). Like resetCallbackTimingStats(),
+     * the window is cleared by the callback thread before the next callback.
+     * This should only be used internally.
+     *
+     * @return OK or Result::ErrorInvalidState if callback timing is not enabled
+     */
+    virtual Result resetCallbackLatenessWindow();
+
+    /**
+     * Get how the data callback thread actually runs, after applying the placement from
+     * AudioStreamBuilder::setCallbackThreadPlacement(). This is measured before the first
+     * callback on each callback thread. It is not measured if no placement was requested,
+     * so that the callback does not make extra system calls.
+     *
+     * @return placement or Result::ErrorInvalidState if no placement was requested or
+     *         there has not been a callback yet
+     */
+    virtual ResultWithValue<EffectiveThreadPlacement> getEffectiveCallbackThreadPlacement();
+
+    /**
+     * Get the number of bytes of stream memory that were locked when the stream was opened.
+     * This may be less than the stream uses if the process is not allowed to lock more.
+     * It is 0 after the stream is closed.
+     *
+     * See AudioStreamBuilder::setMemoryLockEnabled().
+     *
+     * @return bytes or Result::ErrorInvalidState if memory locking is not enabled
+     */
+    virtual ResultWithValue<int64_t> getLockedMemoryBytes();
+
+    /**
+     * Get the number of bytes mapped for the internal buffers of the stream, such as FIFOs
+     * and conversion buffers. They are allocated together from one arena.
+     * Buffers owned by the audio service or the app are not included.
+     *
+     * See AudioStreamBuilder::setHugePageArenaEnabled().
+     *
+     * @return bytes, or 0 if the stream has no internal buffers
+     */
+    virtual int64_t getArenaSizeInBytes() const;
+
+    /**
+     * Get the number of frames passed to each data callback when the callbacks are batched
+     * to save power. See AudioStreamBuilder::setPowerSavingBatchMillis().
+     *
+     * @return frames per callback, or 0 if the callback is not batched
+     */
+    virtual int32_t getFramesPerCallbackBatch() const;
+
+    /**
+     * Get the quality of the sample rate conversion that Oboe is doing now.
+     * This differs from getSampleRateConversionQuality() when that is
+     * SampleRateConversionQuality::Auto. This may be called from any thread.
+     *
+     * @return quality, or SampleRateConversionQuality::None if Oboe does not convert the rate
+     */
+    virtual SampleRateConversionQuality getActiveSampleRateConversionQuality() {
+        return SampleRateConversionQuality::None;
+    }
+
+    /**
+     * Change the coefficients of one stage of the filter that was added with
+     * AudioStreamBuilder::setBiquadFilterStageCount().
+     *
+     * This may be called while the stream is running. The filter then ramps to the
+     * new coefficients over about 10 msec to avoid clicks. Changes made before the stream
+     * starts are used immediately. This is lock-free for the data callback.
+     * Do not call this from the data callback.
+     *
+     * @param stage index between 0 and getBiquadFilterStageCount() - 1
+     * @param coefficients see BiquadFilterCoefficients
+     * @return OK, ErrorInvalidState if the stream has no filter, or ErrorOutOfRange
+     */
+    virtual Result setBiquadFilterCoefficients(int32_t /* stage */,
+                                               const BiquadFilterCoefficients & /* coefficients */) {
+        return Result::ErrorInvalidState;
+    }
+
     /**
      * Query the number of frames that are read or written by the endpoint at one time.
      *
@@ -359,6 +518,99 @@ public:
         return ResultWithValue<int32_t>(Result::ErrorUnimplemented);
     }
 
+    /**
+     * Write data from the supplied buffer into the stream without blocking the calling thread.
+     * The frames are written by one of a few threads that Oboe shares between all streams.
+     * They wait for the stream without blocking, so many streams can be serviced.
+     *
+     * When the write is complete, or runs out of time, the callback is called on one of
+     * those threads with the number of frames written, or with Result::Error*.
+     * Only one read or write may be pending per stream, and the stream must not be
+     * written with write() until the callback has been called.
+     *
+     * Apps built with C++20 can use oboe::asyncWrite() from "oboe/AsyncTransfer.h"
+     * with `co_await` instead.
+     *
+     * @param buffer The address of the first sample. It must stay valid until the callback.
+     * @param numFrames Number of frames to write. Only complete frames will be written.
+     * @param timeoutNanoseconds Maximum number of nanoseconds to wait for completion.
+     * @param callback called when the write finishes
+     * @return OK if the write was started, Result::ErrorInvalidState if a transfer is
+     *         already pending, or another Result::Error*
+     */
+    Result writeAsync(const void *buffer,
+                      int32_t numFrames,
+                      int64_t timeoutNanoseconds,
+                      AsyncTransferCallback *callback);
+
+    /**
+     * Read data into the supplied buffer from the stream without blocking the calling thread.
+     * See writeAsync().
+     *
+     * @param buffer The address of the first sample. It must stay valid until the callback.
+     * @param numFrames Number of frames to read. Only complete frames will be read.
+     * @param timeoutNanoseconds Maximum number of nanoseconds to wait for completion.
+     * @param callback called when the read finishes
+     * @return OK if the read was started, Result::ErrorInvalidState if a transfer is
+     *         already pending, or another Result::Error*
+     */
+    Result readAsync(void *buffer,
+                     int32_t numFrames,
+                     int64_t timeoutNanoseconds,
+                     AsyncTransferCallback *callback);
+
+    // ============== Scheduling ===========================
+    /**
+     * Add a buffer to the output of the data callback, starting at an exact frame position.
+     * The stream must be opened with AudioStreamBuilder::setScheduledEventCapacity().
+     *
+     * The frame position counts the frames rendered since the stream was opened, like
+     * getFramesWritten(). Use getFramePositionAtTime() to start at a time instead.
+     * If the position has passed then the rest of the buffer is played from the next callback,
+     * so it stays aligned to the position.
+     *
+     * This may be called from any thread, including from a ScheduledEventCallback.
+     * It does not block the data callback.
+     *
+     * @param framePosition frame of the stream where the buffer starts
+     * @param buffer frames in the format and channel count of the stream.
+     *        It must stay valid until getFramesWritten() reaches framePosition + numFrames.
+     * @param numFrames number of frames in the buffer
+     * @return OK, ErrorInvalidState if the stream has no scheduler, ErrorNoFreeHandles if
+     *         too many buffers and events are scheduled, or another Result::Error*
+     */
+    Result scheduleBuffer(int64_t framePosition, const void *buffer, int32_t numFrames);
+
+    /**
+     * Call a ScheduledEventCallback from the data callback thread at an exact frame position.
+     * The data callback is split at that position so the callback can change what the app
+     * renders from that frame on. See scheduleBuffer().
+     *
+     * @param framePosition frame of the stream where the event happens
+     * @param callback called once at framePosition
+     * @return OK, ErrorInvalidState if the stream has no scheduler, ErrorNoFreeHandles if
+     *         too many buffers and events are scheduled, or another Result::Error*
+     */
+    Result scheduleEvent(int64_t framePosition, ScheduledEventCallback *callback);
+
+    /**
+     * Drop the buffers and events that were scheduled before this call, including the buffers
+     * that are playing. A buffer may still be read by a data callback that is running now.
+     *
+     * @return OK, or ErrorInvalidState if the stream has no scheduler
+     */
+    Result clearScheduledEvents();
+
+    /**
+     * Find the frame that will be presented at a time, using getTimestamp().
+     * Pass the result to scheduleBuffer() or scheduleEvent() to play something at that time.
+     * Do not call this from the data callback. See getTimestamp().
+     *
+     * @param timeNanoseconds time of the CLOCK_MONOTONIC clock
+     * @return frame position, or the error of getTimestamp(), eg. if the stream is not running
+     */
+    ResultWithValue<int64_t> getFramePositionAtTime(int64_t timeNanoseconds);
+
     /**
      * Get the underlying audio API which the stream uses.
      *
@@ -399,6 +651,13 @@ public:
      */
     virtual void updateFramesRead() = 0;
 
+    /*
+     * Call the data callback of the app, through the PlaybackScheduler if there is one.
+     * The data callback must not be null.
+     * This should only be used internally.
+     */
+    DataCallbackResult callDataCallback(void *audioData, int32_t numFrames);
+
     /*
      * Swap old callback for new callback.
      * This not atomic.
@@ -425,6 +684,16 @@ public:
         return previousCallback;
     }
 
+    /*
+     * Send the async transfer signals of this stream to another stream,
+     * eg. from a child stream to the FilterAudioStream that reads or writes it.
+     * This should only be used internally.
+     * @param owner stream whose pending transfer is signalled
+     */
+    void setAsyncTransferOwner(AudioStream *owner) {
+        mAsyncTransferOwner = owner;
+    }
+
     /**
      * @return number of frames of data currently in the buffer
      */
@@ -439,8 +708,8 @@ public:
      * @param timeoutNanoseconds
      * @return number of frames available, ErrorTimeout
      */
-    ResultWithValue<int32_t> waitForAvailableFrames(int32_t numFrames,
-                                                    int64_t timeoutNanoseconds);
+    virtual ResultWithValue<int32_t> waitForAvailableFrames(int32_t numFrames,
+                                                            int64_t timeoutNanoseconds);
 
     /**
      * @return last result passed from an error callback
@@ -485,6 +754,23 @@ protected:
         return DataCallbackResult::Stop;
     }
 
+    /**
+     * Add the buffers that this stream owns and uses while running.
+     * Subclasses that own buffers should add them, then call the superclass.
+     * This is called after open().
+     *
+     * @param regions list to add to
+     */
+    virtual void collectMemoryRegions(MemoryRegions &regions);
+
+    /**
+     * Memory for the internal buffers of the stream. Allocate from it while opening
+     * the stream. It is all freed when the stream is deleted.
+     *
+     * @return the arena of this stream
+     */
+    StreamArena &getArena();
+
     /**
      * Override this to provide your own behaviour for the audio callback
      *
@@ -495,6 +781,20 @@ protected:
      */
     DataCallbackResult fireDataCallback(void *audioData, int numFrames);
 
+    /**
+     * Wake the thread that services a pending writeAsync() or readAsync(), if any.
+     * Call this from the callback after frames have been moved to or from a FIFO
+     * that the app reads or writes. It does not lock.
+     */
+    void signalAsyncTransfer();
+
+    /**
+     * Cancel a pending writeAsync() or readAsync() and wait until it is not running.
+     * New transfers are refused after this.
+     * Subclasses call this at the start of close(), before anything is torn down.
+     */
+    void cancelAsyncTransfer();
+
     /**
      * @return true if callbacks may be called
      */
@@ -505,10 +805,9 @@ protected:
     /**
      * This can be set false internally to prevent callbacks
      * after DataCallbackResult::Stop has been returned.
+     * It is set true when the stream is started.
      */
-    void setDataCallbackEnabled(bool enabled) {
-        mDataCallbackEnabled = enabled;
-    }
+    void setDataCallbackEnabled(bool enabled);
 
     /*
      * Set a weak_ptr to this stream from the shared_ptr so that we can
@@ -559,8 +858,60 @@ private:
     void                 checkScheduler();
     int                  mPreviousScheduler = -1;
 
+    // Apply the callback thread placement, and prefault the stack and enable flush to zero
+    // if requested, when the callback is on a new thread.
+    void                 prepareCallbackThread();
+    pthread_t            mPlacedCallbackThread{}; // only used by the callback
+    bool                 mIsCallbackThreadPlaced = false; // only used by the callback
+    // The effective placement is written by the callback and read by the app, so it is
+    // published like a seqlock instead of with a lock.
+    std::atomic<uint32_t> mPlacementSequence{0}; // odd while being written, 0 if never written
+    std::atomic<uint64_t> mEffectiveCpuMask{0};
+    std::atomic<int32_t>  mEffectiveScheduler{0};
+    std::atomic<int32_t>  mEffectivePriority{0};
+    std::atomic<Result>   mEffectiveAffinityResult{Result::OK};
+    std::atomic<Result>   mEffectivePriorityResult{Result::OK};
+
     std::atomic<bool>    mDataCallbackEnabled{false};
     std::atomic<bool>    mErrorCallbackCalled{false};
+
+    // Only allocated if callback timing is enabled.
+    std::unique_ptr<CallbackTimingRecorder> mCallbackTimingRecorder;
+
+    // Prefault and maybe lock the memory from collectMemoryRegions().
+    // Called by the AudioStreamBuilder after the stream is opened.
+    void                 prepareMemoryForRealTime();
+    // Only allocated if memory locking is enabled. Unlocked by close().
+    std::unique_ptr<MemoryRegions> mLockedMemoryRegions;
+
+    // Created by the first call to getArena().
+    std::unique_ptr<StreamArena> mArena;
+
+    // Batch the data callbacks if a power saving stream asks for it.
+    // Called by the AudioStreamBuilder after the stream is opened.
+    void                 configureCallbackBatching();
+    // Only allocated if the data callbacks are batched. Its FIFO is in the arena.
+    std::unique_ptr<CallbackBatcher> mCallbackBatcher;
+
+    // Create a PlaybackScheduler if the builder asked for one. It is called by
+    // callDataCallback() and calls the data callback of the app.
+    // Called by the AudioStreamBuilder or StreamMixer after the stream is opened.
+    void                 configurePlaybackScheduler(int32_t capacity);
+    // Only allocated for an output callback stream with a scheduled event capacity.
+    std::unique_ptr<PlaybackScheduler> mPlaybackScheduler;
+
+    Result startAsyncTransfer(void *readBuffer,
+                              const void *writeBuffer,
+                              int32_t numFrames,
+                              int64_t timeoutNanoseconds,
+                              AsyncTransferCallback *callback);
+    // Created by the first async read or write. Only used by the AsyncExecutor.
+    std::unique_ptr<PendingTransfer> mPendingTransfer;
+    std::mutex           mPendingTransferLock; // locked to start or cancel a transfer
+    // Read by signalAsyncTransfer() from the callback.
+    std::atomic<PendingTransfer *> mPendingTransferToSignal{nullptr};
+    bool                 mAsyncTransferCancelled = false; // protected by mPendingTransferLock
+    AudioStream          *mAsyncTransferOwner = nullptr;
 };
 
 /**
@@ -20,7 +20,10 @@
 #include <memory>
 #include <string>
 #include "oboe/AudioStreamCallback.h"
+#include "oboe/BiquadFilter.h"
 #include "oboe/Definitions.h"
+#include "oboe/OfflineSink.h"
+#include "oboe/ThreadPlacement.h"
 
 namespace oboe {
 
@@ -178,6 +181,140 @@ public:
         return mSampleRateConversionQuality;
     }
 
+    /**
+     * @return fraction of real time that SampleRateConversionQuality::Auto may use
+     */
+    double getSampleRateConversionCpuBudget() const {
+        return mSampleRateConversionCpuBudget;
+    }
+
+    /**
+     * @return true if an internal FIFO capacity will be rounded up to a power of two.
+     */
+    bool isFifoCapacityRoundedToPowerOfTwo() const {
+        return mFifoCapacityRoundedToPowerOfTwo;
+    }
+
+    /**
+     * @return maximum frames kept in an internal input FIFO, or 0 if no frames are discarded.
+     */
+    int32_t getLossyInputFifoFramesToKeep() const {
+        return mLossyInputFifoFramesToKeep;
+    }
+
+    /**
+     * @return true if the time that frames spend in an internal FIFO will be measured.
+     */
+    bool isFifoResidencyTrackingEnabled() const {
+        return mFifoResidencyTrackingEnabled;
+    }
+
+    /**
+     * @return true if the timing of the data callback will be measured.
+     */
+    bool isCallbackTimingEnabled() const {
+        return mCallbackTimingEnabled;
+    }
+
+    /**
+     * @return placement requested for the data callback thread
+     */
+    const ThreadPlacement &getCallbackThreadPlacement() const {
+        return mCallbackThreadPlacement;
+    }
+
+    /**
+     * @return placement requested for threads created by Oboe, eg. to handle errors
+     */
+    const ThreadPlacement &getHelperThreadPlacement() const {
+        return mHelperThreadPlacement;
+    }
+
+    /**
+     * @return true if the stream memory and the callback stack will be touched before use
+     */
+    bool isPrefaultEnabled() const {
+        return mPrefaultEnabled;
+    }
+
+    /**
+     * @return true if the stream memory will be locked with mlock()
+     */
+    bool isMemoryLockEnabled() const {
+        return mMemoryLockEnabled;
+    }
+
+    /**
+     * @return true if the callback thread will flush denormal floats to zero
+     */
+    bool isFlushToZeroEnabled() const {
+        return mFlushToZeroEnabled;
+    }
+
+    /**
+     * @return duration of the blocks passed to the data callback of a power saving stream,
+     *         or 0 if the callback is called once per burst
+     */
+    int32_t getPowerSavingBatchMillis() const {
+        return mPowerSavingBatchMillis;
+    }
+
+    /**
+     * @return number of buffers and events that can be scheduled at once, or 0 for none
+     */
+    int32_t getScheduledEventCapacity() const {
+        return mScheduledEventCapacity;
+    }
+
+    /**
+     * @return number of biquad stages that Oboe runs on the data, or 0 for no filter
+     */
+    int32_t getBiquadFilterStageCount() const {
+        return mBiquadFilterStageCount;
+    }
+
+    /**
+     * @return true if the internal buffers will be allocated from huge pages
+     */
+    bool isHugePageArenaEnabled() const {
+        return mHugePageArenaEnabled;
+    }
+
+    /**
+     * @return frames per burst of an AudioApi::Null device, or kUnspecified for the default
+     */
+    int32_t getSimulatedFramesPerBurst() const {
+        return mSimulatedFramesPerBurst;
+    }
+
+    /**
+     * @return maximum random delay added to each wakeup of an AudioApi::Null device
+     */
+    int64_t getSimulatedJitterNanos() const {
+        return mSimulatedJitterNanos;
+    }
+
+    /**
+     * @return bursts between forced XRuns on an AudioApi::Null device, or 0 for none
+     */
+    int32_t getSimulatedXRunIntervalBursts() const {
+        return mSimulatedXRunIntervalBursts;
+    }
+
+    /**
+     * @return sink for an offline stream, or nullptr for a normal stream
+     */
+    OfflineSink *getOfflineSink() const {
+        return mOfflineSink;
+    }
+
+    /**
+     * @return frames rendered by an offline stream before it stops, or 0 for no limit
+     */
+    int64_t getOfflineFramesToRender() const {
+        return mOfflineFramesToRender;
+    }
+
 protected:
     /** The callback which will be fired when new data is ready to be read/written. **/
     AudioStreamDataCallback        *mDataCallback = nullptr;
@@ -229,6 +366,37 @@ protected:
     bool                            mFormatConversionAllowed = false;
     // Control whether and how Oboe can convert sample rates to achieve optimal results.
     SampleRateConversionQuality     mSampleRateConversionQuality = SampleRateConversionQuality::None;
+    double                          mSampleRateConversionCpuBudget = 0.25;
+    // Control whether an internal FIFO capacity is rounded up to a power of two.
+    bool                            mFifoCapacityRoundedToPowerOfTwo = false;
+    // If positive then an internal input FIFO discards its oldest frames to keep this many.
+    int32_t                         mLossyInputFifoFramesToKeep = 0;
+    // Control whether the time that frames spend in an internal FIFO is measured.
+    bool                            mFifoResidencyTrackingEnabled = false;
+    // Control whether the timing of the data callback is measured.
+    bool                            mCallbackTimingEnabled = false;
+    // CPUs and priority for the callback thread and for threads that Oboe creates.
+    ThreadPlacement                 mCallbackThreadPlacement;
+    ThreadPlacement                 mHelperThreadPlacement;
+    // Prepare the stream memory and the callback thread for real-time use.
+    bool                            mPrefaultEnabled = false;
+    bool                            mMemoryLockEnabled = false;
+    bool                            mFlushToZeroEnabled = false;
+    // Call a PowerSaving data callback with blocks of this duration instead of bursts.
+    int32_t                         mPowerSavingBatchMillis = 0;
+    // Buffers and events that can be scheduled with AudioStream::scheduleBuffer().
+    int32_t                         mScheduledEventCapacity = 0;
+    // Stages of a biquad filter that is added to the data conversion.
+    int32_t                         mBiquadFilterStageCount = 0;
+    // Back the arena that holds the internal buffers with transparent huge pages.
+    bool                            mHugePageArenaEnabled = false;
+    // Timing of the simulated device used by AudioApi::Null.
+    int32_t                         mSimulatedFramesPerBurst = kUnspecified;
+    int64_t                         mSimulatedJitterNanos = 0;
+    int32_t                         mSimulatedXRunIntervalBursts = 0;
+    // If set then the stream renders faster than real time into this sink.
+    OfflineSink                    *mOfflineSink = nullptr;
+    int64_t                         mOfflineFramesToRender = 0;
 
     /** Validate stream parameters that might not be checked in lower layers */
     virtual Result isValidConfig() {
@@ -244,6 +412,27 @@ protected:
                 return Result::ErrorInvalidFormat;
         }
 
+        if (mPowerSavingBatchMillis < 0) {
+            return Result::ErrorOutOfRange;
+        }
+
+        if (mScheduledEventCapacity < 0) {
+            return Result::ErrorOutOfRange;
+        }
+        // The scheduler is part of the data callback of an output stream.
+        if (mScheduledEventCapacity > 0
+                && (mDirection != Direction::Output || mDataCallback == nullptr)) {
+            return Result::ErrorIllegalArgument;
+        }
+
+        if (mBiquadFilterStageCount < 0 || mBiquadFilterStageCount > kMaxBiquadFilterStages) {
+            return Result::ErrorOutOfRange;
+        }
+
+        if (mSampleRateConversionCpuBudget <= 0.0 || mSampleRateConversionCpuBudget > 1.0) {
+            return Result::ErrorIllegalArgument;
+        }
+
         switch (mSampleRateConversionQuality) {
             case SampleRateConversionQuality::None:
             case SampleRateConversionQuality::Fastest:
@@ -251,6 +440,7 @@ protected:
             case SampleRateConversionQuality::Medium:
             case SampleRateConversionQuality::High:
             case SampleRateConversionQuality::Best:
+            case SampleRateConversionQuality::Auto:
                 return Result::OK;
             default:
                 return Result::ErrorIllegalArgument;
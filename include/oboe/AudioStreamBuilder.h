@@ -158,7 +158,11 @@ public:
      *
      * If the caller requests AAudio and it is supported then AAudio will be used.
      *
-     * @param audioApi Must be AudioApi::Unspecified, AudioApi::OpenSLES or AudioApi::AAudio.
+     * AudioApi::Null does not use any audio hardware. It can be used to run and measure
+     * the callback path on any POSIX system.
+     *
+     * @param audioApi Must be AudioApi::Unspecified, AudioApi::OpenSLES, AudioApi::AAudio
+     *                 or AudioApi::Null.
      * @return pointer to the builder so calls can be chained
      */
     AudioStreamBuilder *setAudioApi(AudioApi audioApi) {
@@ -211,6 +215,69 @@ public:
         return this;
     }
 
+    /**
+     * Call the data callback of a PerformanceMode::PowerSaving stream with large blocks of
+     * this many milliseconds, rounded up to whole bursts, instead of once per burst.
+     * The app then runs much less often, which saves CPU time for background playback.
+     *
+     * The data callback is called from a worker thread with normal priority, which is
+     * connected to the device callbacks by a FIFO of two blocks. So the app has about a
+     * block of time to render each block. The device still calls back once per burst but
+     * only copies a burst. It adds one to two blocks of latency.
+     * The worker uses the helper thread placement, see setHelperThreadPlacement().
+     * This is ignored if setFramesPerDataCallback() is used or for offline rendering.
+     * Use AudioStream::getFramesPerCallbackBatch() to get the actual size.
+     *
+     * Default is 0, which calls back once per burst.
+     *
+     * @param millis duration of each block, eg. 100
+     * @return pointer to the builder so calls can be chained
+     */
+    AudioStreamBuilder *setPowerSavingBatchMillis(int32_t millis) {
+        mPowerSavingBatchMillis = millis;
+        return this;
+    }
+
+    /**
+     * Allow buffers and events to be scheduled at exact frame positions with
+     * AudioStream::scheduleBuffer() and AudioStream::scheduleEvent().
+     * This is for sequencers and rhythm games that start sounds at exact times.
+     *
+     * The stream must be an output stream with a data callback. The data callback is then
+     * called with smaller blocks that end at the scheduled positions, even if
+     * setFramesPerDataCallback() was used.
+     * The space for the events is allocated when the stream is opened.
+     *
+     * Default is 0, which does not allow scheduling.
+     *
+     * @param numEvents maximum number of buffers and events that are scheduled or playing
+     * @return pointer to the builder so calls can be chained
+     */
+    AudioStreamBuilder *setScheduledEventCapacity(int32_t numEvents) {
+        mScheduledEventCapacity = numEvents;
+        return this;
+    }
+
+    /**
+     * Add a cascade of biquad filters to the data conversion that Oboe does, eg. for EQ or
+     * DC blocking. The filter runs at the sample rate and channel count of the app,
+     * after the data callback of an output stream or before the data callback of an input stream.
+     * This saves the app from filtering in its callback.
+     *
+     * The stages pass the data through unchanged until
+     * AudioStream::setBiquadFilterCoefficients() is called.
+     * This forces Oboe to convert the data, even if the device matches the stream.
+     *
+     * Default is 0, which adds no filter.
+     *
+     * @param numStages between 0 and kMaxBiquadFilterStages
+     * @return pointer to the builder so calls can be chained
+     */
+    AudioStreamBuilder *setBiquadFilterStageCount(int32_t numStages) {
+        mBiquadFilterStageCount = numStages;
+        return this;
+    }
+
 
     /**
      * Set the intended use case for an output stream.
@@ -429,6 +496,249 @@ public:
         return this;
     }
 
+    /**
+     * Set how much of the CPU time the sample rate converter may use when the quality is
+     * SampleRateConversionQuality::Auto. For example, with 0.25 the conversion for a callback
+     * should take no more than a quarter of the callback period.
+     *
+     * The cost is measured during the first seconds of the stream and then periodically.
+     * Use getActiveSampleRateConversionQuality() to see which quality was picked.
+     *
+     * Default is 0.25. It must be greater than 0.0 and no more than 1.0.
+     *
+     * @param fraction of real time
+     * @return pointer to the builder so calls can be chained
+     */
+    AudioStreamBuilder *setSampleRateConversionCpuBudget(double fraction) {
+        mSampleRateConversionCpuBudget = fraction;
+        return this;
+    }
+
+    /**
+     * If true then the capacity of a FIFO that Oboe allocates internally, for example
+     * for blocking reads and writes on an OpenSL ES stream, will be rounded up to a power of two.
+     * The FIFO can then use a mask instead of a modulo when wrapping, which is faster,
+     * especially on 32-bit ARM. It may increase the buffer capacity.
+     *
+     * Default is false.
+     */
+    AudioStreamBuilder *setFifoCapacityRoundedToPowerOfTwo(bool rounded) {
+        mFifoCapacityRoundedToPowerOfTwo = rounded;
+        return this;
+    }
+
+    /**
+     * Make an internal input FIFO discard the oldest frames instead of the newest frames
+     * when the app does not read in time. This is used for blocking reads on an
+     * OpenSL ES input stream.
+     *
+     * Normally, if the FIFO is full then new data is dropped. The app then reads old data
+     * and the latency stays high. If framesToKeep is positive then the FIFO will never hold
+     * more than framesToKeep frames, so the latency recovers right after a stall.
+     * The number of frames discarded can be queried with AudioStream::getDiscardedFrameCount().
+     *
+     * This is ignored for output streams.
+     *
+     * Default is 0, which does not discard old frames.
+     *
+     * @param framesToKeep maximum frames kept in the FIFO, eg. two bursts
+     */
+    AudioStreamBuilder *setLossyInputFifoFramesToKeep(int32_t framesToKeep) {
+        mLossyInputFifoFramesToKeep = framesToKeep;
+        return this;
+    }
+
+    /**
+     * If true then measure how long frames stay in a FIFO that Oboe allocates internally,
+     * for example for blocking reads and writes on an OpenSL ES stream.
+     * The results can be read with AudioStream::getFifoResidencyHistogram().
+     * This is cheap enough to leave on in production.
+     *
+     * Default is false.
+     */
+    AudioStreamBuilder *setFifoResidencyTrackingEnabled(bool enabled) {
+        mFifoResidencyTrackingEnabled = enabled;
+        return this;
+    }
+
+    /**
+     * Set the burst size of the simulated device used by AudioApi::Null.
+     * This is ignored by the other APIs.
+     *
+     * Default is kUnspecified, which uses DefaultStreamValues::FramesPerBurst.
+     *
+     * @param framesPerBurst frames processed by the simulated device in each period
+     */
+    AudioStreamBuilder *setSimulatedFramesPerBurst(int32_t framesPerBurst) {
+        mSimulatedFramesPerBurst = framesPerBurst;
+        return this;
+    }
+
+    /**
+     * Delay each wakeup of the AudioApi::Null device thread by a random time
+     * between zero and jitterNanos. This simulates scheduling latency.
+     * The device clock is not affected so large delays will cause XRuns
+     * unless the buffer size is increased, eg. by a LatencyTuner.
+     *
+     * Default is 0.
+     */
+    AudioStreamBuilder *setSimulatedJitterNanos(int64_t jitterNanos) {
+        mSimulatedJitterNanos = jitterNanos;
+        return this;
+    }
+
+    /**
+     * Make the AudioApi::Null device thread miss its deadline once every intervalBursts bursts,
+     * by long enough to cause an XRun at any buffer size.
+     *
+     * Default is 0, which never forces an XRun.
+     */
+    AudioStreamBuilder *setSimulatedXRunIntervalBursts(int32_t intervalBursts) {
+        mSimulatedXRunIntervalBursts = intervalBursts;
+        return this;
+    }
+
+    /**
+     * Render an output stream offline, as fast as possible, instead of in real time.
+     *
+     * The stream uses AudioApi::Null with its clock replaced by the render loop.
+     * The data callback is called back-to-back on a render thread and each block is passed
+     * to the sink, after the same format, channel and rate conversion that Oboe would
+     * apply for a real device. There is no jitter so the output is deterministic.
+     *
+     * The stream stops after getOfflineFramesToRender() frames, when the callback returns
+     * DataCallbackResult::Stop, or when the sink returns an error. Use
+     * AudioStream::waitForStateChange() to wait for it, and
+     * AudioStream::getOfflineRenderStats() to see how long it took.
+     *
+     * The sink must stay valid until the stream is closed.
+     * Default is nullptr, for a normal real-time stream.
+     *
+     * @param sink receives the rendered frames, eg. a WavFileOfflineSink
+     */
+    AudioStreamBuilder *setOfflineSink(OfflineSink *sink) {
+        mOfflineSink = sink;
+        return this;
+    }
+
+    /**
+     * Stop an offline stream after this many frames have been passed to the sink.
+     * The frames are counted at the rate of the sink.
+     *
+     * Default is 0, which renders until the callback returns DataCallbackResult::Stop.
+     */
+    AudioStreamBuilder *setOfflineFramesToRender(int64_t numFrames) {
+        mOfflineFramesToRender = numFrames;
+        return this;
+    }
+
+    /**
+     * If true then measure each call to the data callback: how long it takes, how regularly it
+     * is called, how many frames it gets and how often it misses its deadline.
+     * The results can be read with AudioStream::getCallbackTimingStats().
+     *
+     * Measuring reads the clock twice per callback and does not allocate or lock
+     * in the callback, so it is cheap enough to leave on in production.
+     *
+     * Default is false.
+     */
+    AudioStreamBuilder *setCallbackTimingEnabled(bool enabled) {
+        mCallbackTimingEnabled = enabled;
+        return this;
+    }
+
+    /**
+     * Set the CPUs, core type and priority of the thread that calls the data callback.
+     * They are applied by Oboe on that thread before the first callback, and again if
+     * the callback moves to a new thread, eg. after the stream is restarted.
+     * The result can be read with AudioStream::getEffectiveCallbackThreadPlacement().
+     *
+     * This replaces setting the affinity from inside the callback.
+     *
+     * Default is a ThreadPlacement that does not change anything.
+     *
+     * @param placement where and how to run the callback
+     */
+    AudioStreamBuilder *setCallbackThreadPlacement(const ThreadPlacement &placement) {
+        mCallbackThreadPlacement = placement;
+        return this;
+    }
+
+    /**
+     * Set the CPUs, core type and priority of threads that Oboe creates for a stream,
+     * such as the thread that calls the error callback. They are applied when each thread
+     * starts.
+     *
+     * Default is a ThreadPlacement that does not change anything.
+     *
+     * @param placement where and how to run the helper threads
+     */
+    AudioStreamBuilder *setHelperThreadPlacement(const ThreadPlacement &placement) {
+        mHelperThreadPlacement = placement;
+        return this;
+    }
+
+    /**
+     * If true then touch every page of the buffers that the stream owns when it is opened,
+     * and touch the stack of the callback thread before the first callback on that thread.
+     * Then the first callbacks do not stall on page faults.
+     *
+     * Buffers owned by the audio service or by the app are not touched.
+     *
+     * Default is false.
+     */
+    AudioStreamBuilder *setPrefaultEnabled(bool enabled) {
+        mPrefaultEnabled = enabled;
+        return this;
+    }
+
+    /**
+     * If true then lock the buffers that the stream owns into RAM with mlock() when it is
+     * opened, so they cannot be paged out. They are unlocked when the stream is closed.
+     * This also does what setPrefaultEnabled() does.
+     *
+     * Apps are normally limited to a small amount of locked memory by RLIMIT_MEMLOCK.
+     * Buffers that cannot be locked are skipped. Use AudioStream::getLockedMemoryBytes()
+     * to find out how much was locked.
+     *
+     * Default is false.
+     */
+    AudioStreamBuilder *setMemoryLockEnabled(bool enabled) {
+        mMemoryLockEnabled = enabled;
+        return this;
+    }
+
+    /**
+     * If true then set the FPU of the callback thread to flush denormal floats to zero,
+     * before the first callback on that thread. Math on denormals can be many times slower,
+     * eg. in the tail of a filter or a reverb.
+     *
+     * This changes the results of float math in the callback by a tiny amount. It is done
+     * on ARM and x86 CPUs.
+     *
+     * Default is false.
+     */
+    AudioStreamBuilder *setFlushToZeroEnabled(bool enabled) {
+        mFlushToZeroEnabled = enabled;
+        return this;
+    }
+
+    /**
+     * The internal buffers of a stream, such as FIFOs and conversion buffers, are allocated
+     * together from an arena owned by the stream. If true then the arena is mapped in
+     * 2 MiB chunks and the kernel is asked to back them with transparent huge pages.
+     * That can reduce TLB misses, but it uses at least 2 MiB per stream, and more if the
+     * memory is locked with setMemoryLockEnabled().
+     *
+     * The size of the arena can be read with AudioStream::getArenaSizeInBytes().
+     *
+     * Default is false.
+     */
+    AudioStreamBuilder *setHugePageArenaEnabled(bool enabled) {
+        mHugePageArenaEnabled = enabled;
+        return this;
+    }
+
     /**
     * Declare the name of the package creating the stream.
     *
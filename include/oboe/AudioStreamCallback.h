@@ -168,6 +168,27 @@ public:
 
 };
 
+/**
+ * ScheduledEventCallback is called at a frame position that was passed to
+ * AudioStream::scheduleEvent().
+ *
+ * It is called on the data callback thread between two calls of the data callback,
+ * so it must follow the same real-time rules as AudioStreamDataCallback::onAudioReady().
+ */
+class ScheduledEventCallback {
+public:
+    virtual ~ScheduledEventCallback() = default;
+
+    /**
+     * The next call of the data callback starts with the frame at framePosition.
+     * If the event was scheduled too late then that frame has already been rendered.
+     *
+     * @param audioStream pointer to the associated stream
+     * @param framePosition position that the event was scheduled for
+     */
+    virtual void onScheduledEvent(AudioStream *audioStream, int64_t framePosition) = 0;
+};
+
 /**
  * AudioStreamCallback defines a callback interface for:
  *
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef OBOE_BIQUAD_FILTER_H
+#define OBOE_BIQUAD_FILTER_H
+
+#include <stdint.h>
+
+namespace oboe {
+
+/**
+ * Maximum number of stages for AudioStreamBuilder::setBiquadFilterStageCount().
+ */
+constexpr int32_t kMaxBiquadFilterStages = 8;
+
+/**
+ * Coefficients for one stage of the filter that Oboe runs in its data conversion,
+ * normalized so that a0 is 1.0.
+ *
+ *     y[n] = b0 * x[n] + b1 * x[n-1] + b2 * x[n-2] - a1 * y[n-1] - a2 * y[n-2]
+ *
+ * The default coefficients pass the signal through unchanged.
+ * The factory methods use the formulas from Robert Bristow-Johnson's "Audio EQ Cookbook".
+ * Pass the sample rate of the stream, AudioStream::getSampleRate().
+ *
+ * See AudioStreamBuilder::setBiquadFilterStageCount().
+ */
+struct BiquadFilterCoefficients {
+    float b0 = 1.0f;
+    float b1 = 0.0f;
+    float b2 = 0.0f;
+    float a1 = 0.0f;
+    float a2 = 0.0f;
+
+    /**
+     * First order DC blocking filter, H(z) = (1 - z^-1) / (1 - pole * z^-1).
+     * @param pole close to but less than 1.0, eg. 0.995
+     */
+    static BiquadFilterCoefficients makeDcBlocker(float pole);
+
+    static BiquadFilterCoefficients makeLowPass(float sampleRate, float frequency, float q);
+
+    static BiquadFilterCoefficients makeHighPass(float sampleRate, float frequency, float q);
+
+    /**
+     * Boost or cut a band around the center frequency.
+     * @param gainDecibels positive to boost, negative to cut
+     */
+    static BiquadFilterCoefficients makePeaking(float sampleRate, float frequency, float q,
+                                                float gainDecibels);
+};
+
+} // namespace oboe
+
+#endif //OBOE_BIQUAD_FILTER_H
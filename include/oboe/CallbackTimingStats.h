@@ -0,0 +1,58 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_CALLBACK_TIMING_STATS_H
+#define OBOE_CALLBACK_TIMING_STATS_H
+
+#include <stdint.h>
+
+namespace oboe {
+
+/**
+ * Percentiles of a distribution. The percentiles come from a histogram
+ * so they are accurate to within about 12%. The maximum is exact.
+ */
+struct PercentileSummary {
+    int64_t p50 = 0;
+    int64_t p90 = 0;
+    int64_t p99 = 0;
+    int64_t max = 0;
+};
+
+/**
+ * Timing of the data callback, as seen by Oboe. See AudioStream::getCallbackTimingStats().
+ *
+ * The deadline of a callback is the time it takes the device to play or record
+ * the frames passed to the callback.
+ */
+struct CallbackTimingStats {
+    /** Number of callbacks measured. */
+    int64_t callbackCount = 0;
+    /** Number of callbacks that took longer than their deadline. */
+    int64_t deadlineOverrunCount = 0;
+    /** Time spent in the callback, in nanoseconds. */
+    PercentileSummary durationNanos;
+    /** Difference between the time since the previous callback and its deadline, in nanoseconds. */
+    PercentileSummary intervalJitterNanos;
+    /** Frames passed to the callback. */
+    PercentileSummary framesPerCallback;
+    /** Smallest number of frames passed to the callback. */
+    int32_t minFramesPerCallback = 0;
+};
+
+} // namespace oboe
+
+#endif //OBOE_CALLBACK_TIMING_STATS_H
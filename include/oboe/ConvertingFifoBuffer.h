@@ -0,0 +1,107 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_CONVERTING_FIFO_BUFFER_H
+#define OBOE_CONVERTING_FIFO_BUFFER_H
+
+#include <stdint.h>
+
+#include "oboe/Definitions.h"
+#include "oboe/FifoBuffer.h"
+
+namespace oboe {
+
+/**
+ * A FifoBuffer that is written in one audio format and read in another,
+ * eg. written with I16 data from an input stream and read as Float by the app.
+ *
+ * The data is stored in the write format. read() converts directly from the FIFO storage
+ * to the destination, so there is no temporary buffer and no second pass over the data.
+ *
+ * I16, I24, I32 and Float are supported in either direction.
+ * The conversions match the ones used by the Oboe flowgraph.
+ */
+class ConvertingFifoBuffer {
+public:
+    /**
+     * @param writeFormat format of the data passed to write()
+     * @param readFormat format of the data returned by read()
+     * @param channelCount samples per frame, the same on both sides
+     * @param capacityInFrames the capacity of frames in fifo
+     */
+    ConvertingFifoBuffer(AudioFormat writeFormat,
+                         AudioFormat readFormat,
+                         int32_t channelCount,
+                         uint32_t capacityInFrames);
+
+    /**
+     * Write framesToWrite or, if there is not enough room, then write as many as will fit.
+     *
+     * @param source frames in the write format
+     * @param framesToWrite number of frames requested
+     * @return number of frames actually written
+     */
+    int32_t write(const void *source, int32_t framesToWrite) {
+        return mFifoBuffer.write(source, framesToWrite);
+    }
+
+    /**
+     * Read framesToRead or, if not enough, then read as many as are available.
+     *
+     * @param destination buffer for frames in the read format
+     * @param framesToRead number of frames requested
+     * @return number of frames actually read
+     */
+    int32_t read(void *destination, int32_t framesToRead);
+
+    /**
+     * Convert samples between any of the supported formats.
+     * Source and destination must not overlap.
+     *
+     * @return Result::ErrorInvalidFormat if either format is not supported
+     */
+    static Result convert(const void *source,
+                          AudioFormat sourceFormat,
+                          void *destination,
+                          AudioFormat destinationFormat,
+                          int32_t numSamples);
+
+    AudioFormat getWriteFormat() const {
+        return mWriteFormat;
+    }
+
+    AudioFormat getReadFormat() const {
+        return mReadFormat;
+    }
+
+    /**
+     * @return the FifoBuffer, which holds data in the write format
+     */
+    FifoBuffer &getFifoBuffer() {
+        return mFifoBuffer;
+    }
+
+private:
+    const AudioFormat mWriteFormat;
+    const AudioFormat mReadFormat;
+    const int32_t     mChannelCount;
+    const int32_t     mBytesPerReadFrame;
+    FifoBuffer        mFifoBuffer;
+};
+
+} // namespace oboe
+
+#endif //OBOE_CONVERTING_FIFO_BUFFER_H
@@ -253,7 +253,14 @@ namespace oboe {
          * AAudio was first supported in Android 8, API 26 and above.
          * It is only recommended for API 27 and above.
          */
-        AAudio
+        AAudio,
+
+        /**
+         * Use a simulated device that discards output and captures silence.
+         * It is timed by CLOCK_MONOTONIC on a real-time thread.
+         * This works without audio hardware, eg. for benchmarks on a host.
+         */
+        Null
     };
 
     /**
@@ -278,6 +285,12 @@ namespace oboe {
          * Highest quality conversion, which may be expensive in terms of CPU.
          */
         Best,
+        /**
+         * Pick the best quality that the CPU can afford, by measuring the cost of the conversion
+         * while the stream runs. See AudioStreamBuilder::setSampleRateConversionCpuBudget().
+         * The quality may change later without a glitch if the cost changes.
+         */
+        Auto,
     };
 
     /**
@@ -17,15 +17,35 @@
 #ifndef OBOE_FIFOPROCESSOR_H
 #define OBOE_FIFOPROCESSOR_H
 
+#include <atomic>
 #include <memory>
 #include <stdint.h>
 
 #include "oboe/Definitions.h"
 
 #include "oboe/FifoControllerBase.h"
+#include "oboe/TimeHistogram.h"
 
 namespace oboe {
 
+class FifoResidencyTracker;
+
+/**
+ * Up to two contiguous regions of the FIFO storage, returned by FifoBuffer::acquireRead()
+ * and FifoBuffer::acquireWrite(). The second region is only used when the frames wrap
+ * around the end of the storage. Frames in the first region come before frames in the second.
+ */
+struct FifoSpan {
+    void    *data1 = nullptr;
+    int32_t  numFrames1 = 0;
+    void    *data2 = nullptr;
+    int32_t  numFrames2 = 0;
+
+    int32_t getNumFrames() const {
+        return numFrames1 + numFrames2;
+    }
+};
+
 class FifoBuffer {
 public:
 	/**
@@ -36,6 +56,16 @@ public:
 	 */
     FifoBuffer(uint32_t bytesPerFrame, uint32_t capacityInFrames);
 
+	/**
+	 * Construct a `FifoBuffer` with its own counters that stores the frames in memory
+	 * allocated by the caller, eg. from an arena. The memory is not freed by the `FifoBuffer`.
+	 *
+	 * @param bytesPerFrame amount of bytes for one frame
+	 * @param capacityInFrames capacity of frames in fifo
+	 * @param dataStorageAddress address of bytesPerFrame * capacityInFrames bytes
+	 */
+    FifoBuffer(uint32_t bytesPerFrame, uint32_t capacityInFrames, uint8_t *dataStorageAddress);
+
 	/**
 	 * Construct a `FifoBuffer`.
 	 * To be used if the storage allocation is done outside of FifoBuffer.
@@ -79,6 +109,87 @@ public:
 	 */
     int32_t write(const void *source, int32_t framesToWrite);
 
+    /**
+     * Get direct access to the frames that can be read, without copying them.
+     * Call commitRead() when done with them.
+     *
+     * This must only be called by the reading thread.
+     *
+     * @param maxFrames maximum number of frames wanted
+     * @return regions holding up to maxFrames of the oldest frames in the fifo
+     */
+    FifoSpan acquireRead(int32_t maxFrames);
+
+    /**
+     * Release frames that were obtained by acquireRead() so they can be written again.
+     *
+     * If the writer uses writeOverwritingOldest() then it may overwrite the oldest acquired
+     * frames while they are being read. Only the frames at the end of the span, as
+     * many as are returned, are known to be intact. Drop the frames before them.
+     *
+     * @param numFrames number of frames consumed, no more than were acquired
+     * @return number of the newest consumed frames that were not overwritten,
+     *         always numFrames unless writeOverwritingOldest() is used
+     */
+    int32_t commitRead(int32_t numFrames);
+
+    /**
+     * Write framesToWrite. If that would leave more than framesToKeep frames in the fifo
+     * then the oldest frames are discarded first, so the reader always gets the newest data.
+     * This can be used for input, where it is better to lose old data than to add latency.
+     *
+     * If the reader is reading the oldest frames at the same time then read() drops the
+     * frames that were overwritten and returns the rest. See commitRead().
+     *
+     * @param source
+     * @param framesToWrite number of frames requested
+     * @param framesToKeep maximum frames in the fifo after writing, limited to the capacity
+     * @return number of frames actually written
+     */
+    int32_t writeOverwritingOldest(const void *source, int32_t framesToWrite, int32_t framesToKeep);
+
+    /**
+     * @return total number of frames discarded by writeOverwritingOldest()
+     */
+    uint64_t getDiscardedFrameCount() const {
+        return mFramesDiscardedCount.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get direct access to the empty part of the fifo so a producer can write into it
+     * without an intermediate buffer. Call commitWrite() to publish the frames.
+     *
+     * This must only be called by the writing thread.
+     *
+     * @param maxFrames maximum number of frames wanted
+     * @return empty regions with room for up to maxFrames
+     */
+    FifoSpan acquireWrite(int32_t maxFrames);
+
+    /**
+     * Make frames written into the regions from acquireWrite() available to the reader.
+     *
+     * @param numFrames number of frames written, no more than were acquired
+     */
+    void commitWrite(int32_t numFrames);
+
+    /**
+     * Measure how long frames stay in the fifo. The time and position of every write
+     * are recorded beside the data. When the reader moves past the start of a block
+     * the time since it was written is added to the residency histogram.
+     *
+     * This must be called before the fifo is used by another thread.
+     *
+     * @param enabled true to start measuring
+     */
+    void setResidencyTrackingEnabled(bool enabled);
+
+    /**
+     * @return histogram of the time that blocks spent in the fifo,
+     *         or nullptr if residency tracking is not enabled
+     */
+    const TimeHistogram *getResidencyHistogram() const;
+
 	/**
 	 * Get the buffer capacity in frames.
 	 *
@@ -86,6 +197,15 @@ public:
 	 */
     uint32_t getBufferCapacityInFrames() const;
 
+    /**
+     * Get the memory that holds the frames.
+     *
+     * @return start of getBufferCapacityInFrames() * getBytesPerFrame() bytes
+     */
+    uint8_t *getStorage() const {
+        return mStorage;
+    }
+
     /**
      * Calls read(). If all of the frames cannot be read then the remainder of the buffer
      * is set to zero.
@@ -130,6 +250,7 @@ public:
 	 */
     void setReadCounter(uint64_t n) {
         mFifo->setReadCounter(n);
+        mCachedReadCounter = n;
     }
 
 	/**
@@ -148,15 +269,28 @@ public:
 	 */
     void setWriteCounter(uint64_t n) {
         mFifo->setWriteCounter(n);
+        mCachedWriteCounter = n;
     }
 
 private:
+    FifoSpan getSpan(uint32_t index, uint32_t numFrames) const;
+    uint32_t getFramesBetween(uint64_t readCounter, uint64_t writeCounter) const;
+
     uint32_t mBytesPerFrame;
     uint8_t* mStorage;
     bool     mStorageOwned; // did this object allocate the storage?
     std::unique_ptr<FifoControllerBase> mFifo;
+    std::unique_ptr<FifoResidencyTracker> mResidencyTracker;
     uint64_t mFramesReadCount;
     uint64_t mFramesUnderrunCount;
+
+    // Each side remembers the last counter it loaded from the other side.
+    // The shared counter only needs to be loaded again when the cached value
+    // does not leave enough frames, which saves a cache miss on most transfers.
+    alignas(FifoControllerBase::kCacheLineSize) uint64_t mCachedWriteCounter = 0; // reader only
+    uint64_t mAcquiredReadCounter = 0; // reader only, read counter when acquireRead() was called
+    alignas(FifoControllerBase::kCacheLineSize) uint64_t mCachedReadCounter = 0; // writer only
+    std::atomic<uint64_t> mFramesDiscardedCount{0}; // only changed by the writer
 };
 
 } // namespace oboe
@@ -17,6 +17,7 @@
 #ifndef NATIVEOBOE_FIFOCONTROLLERBASE_H
 #define NATIVEOBOE_FIFOCONTROLLERBASE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace oboe {
@@ -34,6 +35,12 @@ namespace oboe {
 class FifoControllerBase {
 
 public:
+    /**
+     * Counters written by different threads should be at least this far apart
+     * so that they do not share a cache line.
+     */
+    static constexpr size_t kCacheLineSize = 64;
+
    /**
 	 * Construct a `FifoControllerBase`.
 	 *
@@ -52,12 +59,23 @@ public:
      */
     uint32_t getFullFramesAvailable() const;
 
+    /**
+     * The index in a circular buffer of the frame at a counter value.
+     * Use this with a counter that was already loaded, so the index matches it.
+     *
+     * @param counter a read or write counter
+     * @return index of the frame
+     */
+    virtual uint32_t getIndexForCounter(uint64_t counter) const;
+
 	/**
      * The index in a circular buffer of the next frame to read.
      *
      * @return read index position
      */
-    uint32_t getReadIndex() const;
+    uint32_t getReadIndex() const {
+        return getIndexForCounter(getReadCounter());
+    }
 
    /**
 	* Advance read index from a number of frames.
@@ -79,7 +97,9 @@ public:
 	 *
 	 * @return index of the next frame to write
 	 */
-    uint32_t getWriteIndex() const;
+    uint32_t getWriteIndex() const {
+        return getIndexForCounter(getWriteCounter());
+    }
 
 	/**
      * Advance write index from a number of frames.
@@ -99,6 +119,14 @@ public:
     virtual uint64_t getReadCounter() const = 0;
     virtual void setReadCounter(uint64_t n) = 0;
     virtual void incrementReadCounter(uint64_t n) = 0;
+    /**
+     * Set the read counter to n unless it is already higher.
+     * This is atomic so the writer may call it to discard old frames while the reader is running.
+     *
+     * @param n minimum value of the read counter
+     * @return the read counter before this call
+     */
+    virtual uint64_t advanceReadCounterTo(uint64_t n) = 0;
     virtual uint64_t getWriteCounter() const = 0;
     virtual void setWriteCounter(uint64_t n) = 0;
     virtual void incrementWriteCounter(uint64_t n) = 0;
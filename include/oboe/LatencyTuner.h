@@ -37,10 +37,36 @@ namespace oboe {
  * If you want to see the ongoing results of this tuning process then call
  * stream->getBufferSize() periodically.
  *
+ * By default the latency only goes up. With Policy::Bidirectional it also comes back down
+ * after a period without glitches. See setPolicy().
  */
 class LatencyTuner {
 public:
 
+    /**
+     * How the tuner changes the buffer size.
+     */
+    enum class Policy {
+        /**
+         * Raise the buffer size after each XRun. Only a reset will lower it.
+         * This is the default.
+         */
+        IncreaseOnly,
+
+        /**
+         * Raise the buffer size after each XRun, and lower it by one increment after
+         * a period without XRuns. If an XRun follows soon after lowering the size
+         * then the tuner waits longer before trying again.
+         *
+         * If callback timing is enabled on the stream, see
+         * AudioStreamBuilder::setCallbackTimingEnabled(), then the size is only lowered
+         * if the measured callback lateness would still fit in the smaller buffer.
+         * Only the callbacks in the last period without XRuns are measured.
+         * The tuner does not reset the stats from AudioStream::getCallbackTimingStats().
+         */
+        Bidirectional,
+    };
+
     /**
      * Construct a new LatencyTuner object which will act on the given audio stream
      *
@@ -113,6 +139,35 @@ public:
         return mBufferSizeIncrement;
     }
 
+    /**
+     * Set whether the tuner may lower the buffer size. This should be called
+     * before the first call to tune(). The default is Policy::IncreaseOnly.
+     *
+     * @param policy
+     */
+    void setPolicy(Policy policy) {
+        mPolicy = policy;
+    }
+
+    Policy getPolicy() const {
+        return mPolicy;
+    }
+
+    /**
+     * Trade latency against robustness when using Policy::Bidirectional.
+     *
+     * At 0.0 the buffer size is lowered after one second without an XRun.
+     * At 1.0 it takes 30 seconds, and twice the measured callback lateness must fit
+     * in the smaller buffer. The default is 0.5.
+     *
+     * @param robustness between 0.0 and 1.0, clipped to that range
+     */
+    void setRobustness(float robustness);
+
+    float getRobustness() const {
+        return mRobustness;
+    }
+
 private:
 
     /**
@@ -123,6 +178,24 @@ private:
      */
     void reset();
 
+    // Raise the buffer size by one increment.
+    Result increaseBufferSize();
+
+    // Lower the buffer size by one increment if there have been no XRuns for long enough.
+    Result maybeDecreaseBufferSize();
+
+    // Is the measured callback lateness small enough for this buffer size?
+    bool hasTimingMarginFor(int32_t bufferSize);
+
+    // Start counting frames without an XRun, and a new window of callback lateness.
+    void startGlitchFreePeriod(int64_t framesProcessed);
+
+    // Frames that must pass without an XRun before the buffer size is lowered.
+    int64_t getGlitchFreeFrames() const;
+
+    // Frames written for output or read for input. Used as a clock.
+    int64_t getFramesProcessed();
+
     enum class State {
         Idle,
         Active,
@@ -133,6 +206,11 @@ private:
     // arbitrary number of calls to wait before bumping up the latency
     static constexpr int32_t kIdleCount = 8;
     static constexpr int32_t kDefaultNumBursts = 2;
+    // Time without XRuns before lowering the buffer size, at robustness 0.0 and 1.0.
+    static constexpr int32_t kMinGlitchFreeMillis = 1000;
+    static constexpr int32_t kMaxGlitchFreeMillis = 30000;
+    // Limit on how much longer to wait after lowering the size caused an XRun.
+    static constexpr int32_t kMaxBackoffFactor = 16;
 
     AudioStream           &mStream;
     State                 mState = State::Idle;
@@ -141,6 +219,12 @@ private:
     int32_t               mIdleCountDown = 0;
     int32_t               mMinimumBufferSize;
     int32_t               mBufferSizeIncrement;
+    Policy                mPolicy = Policy::IncreaseOnly;
+    float                 mRobustness = 0.5f;
+    // Used by Policy::Bidirectional.
+    int64_t               mGlitchFreeStartFrame = 0;
+    int64_t               mLastDecreaseFrame = -1;
+    int32_t               mBackoffFactor = 1;
     std::atomic<int32_t>  mLatencyTriggerRequests{0}; // TODO user atomic requester from AAudio
     std::atomic<int32_t>  mLatencyTriggerResponses{0};
 };
@@ -34,5 +34,15 @@
 #include "oboe/Version.h"
 #include "oboe/StabilizedCallback.h"
 #include "oboe/FifoBuffer.h"
+#include "oboe/ConvertingFifoBuffer.h"
+#include "oboe/SharedFifoBuffer.h"
+#include "oboe/TimeHistogram.h"
+#include "oboe/OfflineSink.h"
+#include "oboe/CallbackTimingStats.h"
+#include "oboe/RenderPool.h"
+#include "oboe/ThreadPlacement.h"
+#include "oboe/AsyncTransfer.h"
+#include "oboe/StreamMixer.h"
+#include "oboe/BiquadFilter.h"
 
 #endif //OBOE_OBOE_H
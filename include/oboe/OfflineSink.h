@@ -0,0 +1,135 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_OFFLINE_SINK_H
+#define OBOE_OFFLINE_SINK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "oboe/Definitions.h"
+
+namespace oboe {
+
+/**
+ * Receives the output of an offline stream, which runs faster than real time.
+ * See AudioStreamBuilder::setOfflineSink().
+ *
+ * onStart() is called by AudioStream::requestStart(). The other methods are called
+ * on the render thread.
+ */
+class OfflineSink {
+public:
+    virtual ~OfflineSink() = default;
+
+    /**
+     * Called when the stream is started, before any data.
+     * The data is in the format of the simulated device, after any conversion by Oboe.
+     *
+     * @return OK, or an error to prevent the stream from starting
+     */
+    virtual Result onStart(AudioFormat /* format */,
+                           int32_t /* channelCount */,
+                           int32_t /* sampleRate */) {
+        return Result::OK;
+    }
+
+    /**
+     * Called with each block of rendered frames.
+     *
+     * @return OK, or an error to stop the stream
+     */
+    virtual Result onData(const void *audioData, int32_t numFrames) = 0;
+
+    /**
+     * Called after the last block, when the stream stops for any reason.
+     */
+    virtual void onStop() {}
+};
+
+/**
+ * An OfflineSink that keeps everything in memory.
+ */
+class MemoryOfflineSink : public OfflineSink {
+public:
+    Result onStart(AudioFormat format, int32_t channelCount, int32_t sampleRate) override;
+
+    Result onData(const void *audioData, int32_t numFrames) override;
+
+    /**
+     * @return all the bytes rendered since the last start
+     */
+    const std::vector<uint8_t> &getData() const {
+        return mData;
+    }
+
+    int32_t getBytesPerFrame() const {
+        return mBytesPerFrame;
+    }
+
+private:
+    std::vector<uint8_t> mData;
+    int32_t              mBytesPerFrame = 0;
+};
+
+/**
+ * An OfflineSink that writes a WAV file.
+ * I16, I24, I32 and Float data are supported.
+ *
+ * The sizes in the header are limited to 4 GB, about three hours of stereo float at 48000 Hz.
+ * The data is still written after that but some readers will ignore it.
+ */
+class WavFileOfflineSink : public OfflineSink {
+public:
+    /**
+     * @param path file to create or overwrite when the stream is started
+     */
+    explicit WavFileOfflineSink(const char *path);
+
+    ~WavFileOfflineSink();
+
+    Result onStart(AudioFormat format, int32_t channelCount, int32_t sampleRate) override;
+
+    Result onData(const void *audioData, int32_t numFrames) override;
+
+    void onStop() override;
+
+private:
+    Result writeHeader(uint32_t dataSizeInBytes);
+
+    std::string mPath;
+    FILE       *mFile = nullptr;
+    AudioFormat mFormat = AudioFormat::Unspecified;
+    int32_t     mChannelCount = 0;
+    int32_t     mSampleRate = 0;
+    int32_t     mBytesPerFrame = 0;
+    uint64_t    mDataSizeInBytes = 0;
+};
+
+/**
+ * Work done by an offline stream since it was last started.
+ */
+struct OfflineRenderStats {
+    int64_t framesRendered = 0;
+    int64_t cpuTimeNanos = 0; // used by the render thread
+    int64_t elapsedNanos = 0;
+};
+
+} // namespace oboe
+
+#endif //OBOE_OFFLINE_SINK_H
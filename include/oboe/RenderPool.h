@@ -0,0 +1,261 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_RENDER_POOL_H
+#define OBOE_RENDER_POOL_H
+
+#include <atomic>
+#include <memory>
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+
+#include "oboe/Definitions.h"
+#include "oboe/ResultWithValue.h"
+
+namespace oboe {
+
+/**
+ * A piece of work that a RenderPool can run on any of its threads,
+ * for example rendering a group of voices into a private buffer.
+ */
+class RenderTask {
+public:
+    virtual ~RenderTask() = default;
+
+    /**
+     * Do the work. This must not block.
+     */
+    virtual void run() = 0;
+};
+
+/**
+ * Work done by one thread of a RenderPool since it was opened or the stats were reset.
+ */
+struct RenderWorkerStats {
+    int64_t tasksRun = 0;
+    int64_t busyNanos = 0; // time spent in RenderTask::run()
+    double  utilization = 0.0; // busyNanos divided by the elapsed time
+};
+
+/**
+ * A pool of worker threads that a data callback can use to spread heavy rendering
+ * over several CPUs.
+ *
+ * The callback calls fork() with an array of tasks, may do other work, then calls join()
+ * before returning. Workers claim tasks with a lock-free counter. Between forks they spin
+ * for a short time, then sleep on a futex, so a fork() that follows soon after
+ * a join() does not need a system call.
+ *
+ * If some tasks have not been claimed by the deadline passed to join(), because a worker
+ * was preempted or slow to wake up, then join() runs them in the calling thread.
+ *
+ * fork() and join() do not allocate or lock. They must be called by one thread at a time,
+ * normally the callback thread. The other methods must not be called from the callback.
+ *
+ * Example:
+ *
+ *     // When setting up
+ *     renderPool.setWorkerPriority(2);
+ *     renderPool.open(3);
+ *
+ *     // In onAudioReady()
+ *     renderPool.fork(mTasks, kNumTasks);
+ *     renderPool.join(callbackStartNanos + burstNanos / 2);
+ *     mixTaskOutputs(audioData, numFrames);
+ */
+class RenderPool {
+public:
+    RenderPool() = default;
+
+    /**
+     * Calls close().
+     */
+    ~RenderPool();
+
+    RenderPool(const RenderPool &) = delete;
+    RenderPool &operator=(const RenderPool &) = delete;
+
+    /**
+     * Run the workers with SCHED_FIFO at this priority. If the process is not allowed
+     * to use SCHED_FIFO then normal threads are used and a warning is logged.
+     * The default is 0, for normal threads. Call this before open().
+     *
+     * @param priority SCHED_FIFO priority, eg. 2 like an AAudio callback thread, or 0
+     */
+    void setWorkerPriority(int32_t priority) {
+        mWorkerPriority = priority;
+    }
+
+    /**
+     * Pin each worker to one CPU. Worker N is pinned to cpuIds[N % cpuIds.size()].
+     * By default the workers are not pinned. Call this before open().
+     *
+     * @param cpuIds CPU numbers as used by sched_setaffinity()
+     */
+    void setWorkerCpuIds(const std::vector<int32_t> &cpuIds) {
+        mWorkerCpuIds = cpuIds;
+    }
+
+    /**
+     * Set how long a worker spins waiting for the next fork() before it sleeps.
+     * Spinning uses more power but avoids the wakeup latency.
+     * The default is 100 microseconds. Call this before open().
+     *
+     * @param spinNanos time to spin, or 0 to sleep right away
+     */
+    void setSpinNanos(int64_t spinNanos) {
+        mSpinNanos = spinNanos;
+    }
+
+    /**
+     * Start the worker threads.
+     *
+     * @param numWorkers number of threads, not counting the caller of join(), up to kMaxWorkers
+     * @return OK, ErrorInvalidState if already open, ErrorOutOfRange or ErrorInternal
+     */
+    Result open(int32_t numWorkers);
+
+    /**
+     * Stop and join the worker threads. Any tasks not yet run are run by this thread.
+     *
+     * @return OK, or ErrorClosed if not open
+     */
+    Result close();
+
+    /**
+     * Give the tasks to the workers. They start running at once.
+     * The array and the tasks must stay valid until join() returns.
+     *
+     * @param tasks array of tasks
+     * @param numTasks number of tasks in the array, up to kMaxTasks
+     * @return OK, ErrorClosed if not open, ErrorInvalidState if the last fork()
+     *         has not been joined, ErrorNull or ErrorOutOfRange
+     */
+    Result fork(RenderTask * const *tasks, int32_t numTasks);
+
+    /**
+     * Wait until all the tasks given to fork() have run.
+     * After deadlineNanos any task that has not been claimed by a worker is run in this thread.
+     * Pass 0 to start helping the workers right away.
+     *
+     * A task that is already running cannot be taken back, so this may return after
+     * the deadline.
+     *
+     * @param deadlineNanos CLOCK_MONOTONIC time, eg. from the start of the callback
+     * @return OK, or ErrorInvalidState if there was no fork()
+     */
+    Result join(int64_t deadlineNanos);
+
+    /**
+     * @return number of worker threads, or 0 if not open
+     */
+    int32_t getNumWorkers() const {
+        return mNumWorkers;
+    }
+
+    /**
+     * @param workerIndex from 0 to getNumWorkers() - 1
+     * @return stats, or ErrorOutOfRange
+     */
+    ResultWithValue<RenderWorkerStats> getWorkerStats(int32_t workerIndex) const;
+
+    /**
+     * @return number of tasks run by the caller of join()
+     */
+    int64_t getInlineTaskCount() const {
+        return mInlineTaskCount.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return number of calls to join() that ran tasks in the calling thread
+     *         because they were not claimed by the deadline
+     */
+    int64_t getDeadlineFallbackCount() const {
+        return mDeadlineFallbackCount.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Clear the stats and restart the utilization measurement.
+     */
+    void resetStats();
+
+    static constexpr int32_t kMaxWorkers = 64;
+    static constexpr int32_t kMaxTasks = 0xFFFF;
+
+private:
+    // Entry point of a worker thread. The arg is a Worker.
+    static void *runWorkerThread(void *arg);
+
+    void runWorker(int32_t workerIndex);
+
+    // Run tasks from the fork with this generation until there are none left to claim.
+    // @return number of tasks run
+    int32_t runTasks(uint32_t generation, std::atomic<int64_t> *busyNanos);
+
+    // Spin then sleep until mCompletedCount is no longer equal to completedCount,
+    // or until the deadline.
+    void waitForCompletion(uint32_t completedCount, int64_t deadlineNanos);
+
+    // Spin then sleep until mGeneration is no longer equal to generation.
+    void waitForFork(uint32_t generation);
+
+    // Keep the counters of each worker in their own cache line.
+    struct alignas(64) Worker {
+        RenderPool          *pool = nullptr;
+        int32_t              index = 0;
+        pthread_t            thread;
+        bool                 threadCreated = false;
+        std::atomic<int64_t> tasksRun{0};
+        std::atomic<int64_t> busyNanos{0};
+    };
+
+    // A claim holds the generation of the fork, the number of tasks and the next task to run.
+    // A worker left over from an earlier fork cannot claim a task because the generation differs.
+    static uint64_t makeClaim(uint32_t generation, uint32_t numTasks, uint32_t nextTask) {
+        return (static_cast<uint64_t>(generation) << 32) | (numTasks << 16) | nextTask;
+    }
+
+    int32_t                      mWorkerPriority = 0;
+    std::vector<int32_t>         mWorkerCpuIds;
+    int64_t                      mSpinNanos = 100 * kNanosPerMicrosecond;
+
+    std::unique_ptr<Worker[]>    mWorkers;
+    int32_t                      mNumWorkers = 0;
+    bool                         mOpen = false;
+    bool                         mForked = false; // only used by the caller of fork()
+    std::atomic<bool>            mEnabled{false};
+
+    // Incremented by each fork(). Futex word that the workers sleep on.
+    std::atomic<uint32_t>        mGeneration{0};
+    uint32_t                     mOpenGeneration = 0;
+    std::atomic<int32_t>         mSleepingWorkers{0};
+    std::atomic<uint64_t>        mClaim{0}; // see makeClaim()
+    // Only read by a thread that has claimed a task, so it cannot change while being read.
+    RenderTask * const          *mTasks = nullptr;
+    int32_t                      mNumTasks = 0; // only used by the caller of fork()
+    // Tasks finished in this fork. Futex word that join() sleeps on.
+    std::atomic<uint32_t>        mCompletedCount{0};
+    std::atomic<bool>            mJoinWaiting{false};
+
+    std::atomic<int64_t>         mInlineTaskCount{0};
+    std::atomic<int64_t>         mDeadlineFallbackCount{0};
+    std::atomic<int64_t>         mStatsStartNanos{0};
+};
+
+} // namespace oboe
+
+#endif //OBOE_RENDER_POOL_H
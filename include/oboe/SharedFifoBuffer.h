@@ -0,0 +1,100 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_SHARED_FIFO_BUFFER_H
+#define OBOE_SHARED_FIFO_BUFFER_H
+
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "oboe/Definitions.h"
+#include "oboe/FifoBuffer.h"
+
+namespace oboe {
+
+/**
+ * A FifoBuffer whose counters and storage are in shared memory so that audio can be
+ * passed between processes, eg. between an app and a separate render process.
+ *
+ * One process calls create() and passes the file descriptor to the peer process,
+ * for example over a Unix domain socket or Binder. The peer then calls attach().
+ * After that, reads and writes do not make any system calls.
+ *
+ * The memory is sealed so that neither process can change its size. attach() rejects
+ * file descriptors without those seals and keeps the sizes that it checked, so a peer
+ * that changes the header cannot make this process access memory outside the region.
+ *
+ * As with FifoBuffer, one process may write and the other may read.
+ */
+class SharedFifoBuffer {
+public:
+    /**
+     * Create a shared memory region and map it into this process.
+     *
+     * @param bytesPerFrame amount of bytes for one frame
+     * @param capacityInFrames the capacity of frames in fifo
+     * @param sharedFifo set to the new object if successful
+     * @return OK or a Result::Error.
+     */
+    static Result create(uint32_t bytesPerFrame,
+                         uint32_t capacityInFrames,
+                         std::unique_ptr<SharedFifoBuffer> &sharedFifo);
+
+    /**
+     * Map a region that was created by create() in another process.
+     * The file descriptor is duplicated so the caller may close its copy.
+     *
+     * @param fileDescriptor from getFileDescriptor() in the other process
+     * @param sharedFifo set to the new object if successful
+     * @return OK or a Result::Error.
+     */
+    static Result attach(int fileDescriptor, std::unique_ptr<SharedFifoBuffer> &sharedFifo);
+
+    ~SharedFifoBuffer();
+
+    /**
+     * @return file descriptor to be passed to the peer process
+     */
+    int getFileDescriptor() const {
+        return mFileDescriptor;
+    }
+
+    /**
+     * @return FifoBuffer that reads and writes the shared memory
+     */
+    FifoBuffer &getFifoBuffer() {
+        return *mFifoBuffer;
+    }
+
+private:
+    SharedFifoBuffer(int fileDescriptor,
+                     void *address,
+                     size_t sizeInBytes,
+                     uint32_t bytesPerFrame,
+                     uint32_t capacityInFrames);
+
+    static Result map(int fileDescriptor, size_t sizeInBytes, void **address);
+
+    const int                   mFileDescriptor;
+    void * const                mAddress;
+    const size_t                mSizeInBytes;
+    std::unique_ptr<FifoBuffer> mFifoBuffer;
+};
+
+} // namespace oboe
+
+#endif //OBOE_SHARED_FIFO_BUFFER_H
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_STREAM_MIXER_H
+#define OBOE_STREAM_MIXER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include "oboe/AudioStream.h"
+#include "oboe/AudioStreamBuilder.h"
+#include "oboe/AudioStreamCallback.h"
+#include "oboe/Definitions.h"
+
+namespace oboe {
+
+class VirtualAudioStream;
+
+/**
+ * StreamMixer owns one output stream on the device and mixes several virtual output streams
+ * into it. This lets secondary sounds, such as UI sounds or a metronome, share an EXCLUSIVE
+ * MMAP stream instead of falling back to a shared stream with more latency.
+ *
+ * Each virtual stream is an AudioStream with its own data callback, format, channel count
+ * and sample rate. Its data is converted to the float format of the device stream and
+ * summed on the callback thread of the device stream.
+ *
+ * Example:
+ *
+ *     StreamMixer mixer;
+ *     AudioStreamBuilder deviceBuilder;
+ *     deviceBuilder.setPerformanceMode(PerformanceMode::LowLatency)
+ *             ->setSharingMode(SharingMode::Exclusive);
+ *     mixer.open(deviceBuilder);
+ *     mixer.start();
+ *
+ *     AudioStreamBuilder builder;
+ *     builder.setDataCallback(&clickCallback)->setSampleRate(44100)->setChannelCount(1);
+ *     std::shared_ptr<AudioStream> click;
+ *     mixer.openStream(builder, click);
+ *     click->requestStart();
+ *
+ * The virtual streams must be closed before the mixer, or are closed by StreamMixer::close().
+ * The methods of the mixer must not be called from a data callback.
+ */
+class StreamMixer : AudioStreamDataCallback, AudioStreamErrorCallback {
+public:
+    static constexpr int32_t kMaxStreams = 16;
+
+    StreamMixer() = default;
+
+    /**
+     * Calls close().
+     */
+    virtual ~StreamMixer();
+
+    StreamMixer(const StreamMixer &) = delete;
+    StreamMixer &operator=(const StreamMixer &) = delete;
+
+    /**
+     * Open the output stream on the device.
+     *
+     * The builder sets the device, sharing mode, performance mode, channel count and sample rate.
+     * The stream always uses AudioFormat::Float. The mixer sets the data callback.
+     * If the builder has an error callback then it is called for the device stream
+     * before the error callbacks of the virtual streams.
+     *
+     * @param builder describes the device stream
+     * @return OK, ErrorInvalidState if already open, or the result of opening the stream
+     */
+    Result open(const AudioStreamBuilder &builder);
+
+    /**
+     * Start the device stream. The virtual streams play when they are also started.
+     */
+    Result start();
+
+    /**
+     * Stop the device stream.
+     */
+    Result stop();
+
+    /**
+     * Close the virtual streams and the device stream.
+     *
+     * @return OK, or ErrorClosed if not open
+     */
+    Result close();
+
+    /**
+     * Open a virtual output stream that is mixed into the device stream.
+     *
+     * The builder must have a data callback. The channel count, sample rate and format
+     * default to those of the device stream. The audio API, device, sharing mode and
+     * performance mode are those of the device stream.
+     * If the sample rate differs from the device and no conversion quality was set
+     * then SampleRateConversionQuality::Medium is used.
+     *
+     * @param builder describes the virtual stream
+     * @param stream set to the new stream
+     * @return OK, ErrorInvalidState if the mixer is not open, ErrorIllegalArgument if the
+     *         builder is for input or has no data callback, ErrorNoFreeHandles if kMaxStreams
+     *         streams are open, or another Result::Error*
+     */
+    Result openStream(const AudioStreamBuilder &builder, std::shared_ptr<AudioStream> &stream);
+
+    /**
+     * @return the stream on the device, or nullptr if not open
+     */
+    AudioStream *getDeviceStream() const {
+        return mDeviceStream.get();
+    }
+
+    /**
+     * @return number of virtual streams that are open
+     */
+    int32_t getStreamCount() const;
+
+private:
+    friend class VirtualAudioStream;
+
+    DataCallbackResult onAudioReady(AudioStream *audioStream,
+                                    void *audioData,
+                                    int32_t numFrames) override;
+
+    bool onError(AudioStream *audioStream, Result error) override;
+    void onErrorBeforeClose(AudioStream *audioStream, Result error) override;
+    void onErrorAfterClose(AudioStream *audioStream, Result error) override;
+
+    // Called by VirtualAudioStream::close().
+    void removeStream(VirtualAudioStream *stream);
+
+    // Make shared pointers to the virtual streams so they are not deleted during an error callback.
+    std::vector<std::shared_ptr<AudioStream>> lockStreams();
+
+    // Return when the device callback is not mixing, so it does not use a stream
+    // that was just removed or stopped.
+    void waitForMixingToFinish() const;
+
+    std::shared_ptr<AudioStream>      mDeviceStream;
+    AudioStreamErrorCallback         *mDeviceErrorCallback = nullptr; // from the app
+    std::atomic<VirtualAudioStream *> mStreams[kMaxStreams] = {};
+    std::mutex                        mLock; // for opening and closing streams
+    std::unique_ptr<float[]>          mStreamBuffer; // output of one virtual stream
+    int32_t                           mStreamBufferFrames = 0;
+    std::atomic<uint32_t>             mCallbackSequence{0}; // odd while mixing
+    int64_t                           mDeviceFramesMixed = 0; // only used by the callback
+};
+
+} // namespace oboe
+
+#endif //OBOE_STREAM_MIXER_H
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_THREAD_PLACEMENT_H
+#define OBOE_THREAD_PLACEMENT_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "oboe/Definitions.h"
+
+namespace oboe {
+
+/**
+ * The kind of CPU core a thread should run on, on devices with cores of different speeds.
+ */
+enum class CoreType : int32_t {
+    /**
+     * Any core.
+     */
+    Any,
+
+    /**
+     * The slowest cores, which use the least power.
+     */
+    Efficiency,
+
+    /**
+     * All the cores that are faster than the slowest ones.
+     * If all the cores are the same then this is every core.
+     */
+    Performance,
+};
+
+/**
+ * Where and how a thread should run. The default does not change anything.
+ *
+ * See AudioStreamBuilder::setCallbackThreadPlacement() and
+ * AudioStreamBuilder::setHelperThreadPlacement().
+ */
+struct ThreadPlacement {
+    /**
+     * CPUs the thread may run on, as used by sched_setaffinity(). CPUs 0 to 63 are supported.
+     * If empty then the CPUs are chosen by the coreType.
+     */
+    std::vector<int32_t> cpuIds;
+
+    /**
+     * If not Any then only use cores of this type. If cpuIds are also given then use the
+     * cpuIds that are of this type, or all the cpuIds if none of them are.
+     */
+    CoreType coreType = CoreType::Any;
+
+    /**
+     * If greater than zero then run the thread with SCHED_FIFO at this priority.
+     * Most apps are not allowed to do this. AAudio may already run the callback
+     * thread with SCHED_FIFO.
+     */
+    int32_t priority = 0;
+
+    bool isDefault() const {
+        return cpuIds.empty() && coreType == CoreType::Any && priority <= 0;
+    }
+};
+
+/**
+ * How a thread actually ran after a ThreadPlacement was applied.
+ */
+struct EffectiveThreadPlacement {
+    uint64_t cpuMask = 0; // bit N is set if the thread may run on CPU N
+    int32_t  scheduler = 0; // eg. SCHED_FIFO or SCHED_OTHER
+    int32_t  priority = 0; // SCHED_FIFO or SCHED_RR priority, otherwise 0
+    Result   affinityResult = Result::OK; // OK if the CPUs were set or none were requested
+    Result   priorityResult = Result::OK; // OK if the priority was set or none was requested
+};
+
+/**
+ * Apply a placement to the calling thread, then read back how the thread will run.
+ * Oboe calls this for its own threads. Apps can call it for their own threads.
+ *
+ * This does not allocate. It reads sysfs if the coreType is used for the first time,
+ * see getCpuMaskForCoreType().
+ *
+ * @param placement where and how to run
+ * @return effective placement, with the result of each change
+ */
+EffectiveThreadPlacement applyThreadPlacement(const ThreadPlacement &placement);
+
+/**
+ * Find the CPUs of a given type from their capacity, or their maximum frequency,
+ * in /sys/devices/system/cpu. The result is cached after the first call.
+ *
+ * @param coreType type of core
+ * @return bit N is set if CPU N is of that type, or all CPUs if the types are not known
+ */
+uint64_t getCpuMaskForCoreType(CoreType coreType);
+
+} // namespace oboe
+
+#endif //OBOE_THREAD_PLACEMENT_H
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_TIME_HISTOGRAM_H
+#define OBOE_TIME_HISTOGRAM_H
+
+#include <atomic>
+#include <stdint.h>
+
+namespace oboe {
+
+/**
+ * A histogram of durations that can be updated in a real-time thread and read from another.
+ *
+ * The bins are spaced logarithmically, with 8 bins per doubling of the duration,
+ * so a percentile is accurate to within about 12%. Durations are stored in microseconds,
+ * from 0 up to about 2 minutes. Longer durations are counted in the last bin.
+ *
+ * add() is lock-free and wait-free but must only be called by one thread at a time.
+ * The other methods may be called from any thread.
+ */
+class TimeHistogram {
+public:
+    /**
+     * Count one duration.
+     *
+     * @param nanoseconds negative values are counted as zero
+     */
+    void add(int64_t nanoseconds);
+
+    /**
+     * @return total number of durations counted
+     */
+    int64_t getCount() const;
+
+    /**
+     * Estimate a percentile of the durations, eg. 50.0 for the median.
+     *
+     * @param percentile between 0.0 and 100.0
+     * @return upper edge of the bin holding the percentile in nanoseconds, or 0 if empty
+     */
+    int64_t getPercentileNanos(double percentile) const;
+
+    /**
+     * @return the longest duration counted, in nanoseconds
+     */
+    int64_t getMaxNanos() const {
+        return mMaxNanos.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Clear the histogram. This must not be called while another thread is calling add().
+     */
+    void reset();
+
+private:
+    static constexpr int32_t kSubBinBits = 3; // 8 bins per octave
+    static constexpr int32_t kSubBins = 1 << kSubBinBits;
+    static constexpr int32_t kNumBins = 25 * kSubBins; // up to 2^27 microseconds
+
+    static int32_t getBinIndex(uint64_t micros);
+    static int64_t getBinUpperEdgeMicros(int32_t index);
+
+    std::atomic<uint32_t> mBins[kNumBins] = {};
+    std::atomic<int64_t>  mMaxNanos{0};
+};
+
+} // namespace oboe
+
+#endif //OBOE_TIME_HISTOGRAM_H
@@ -63,6 +63,9 @@ static aaudio_data_callback_result_t oboe_aaudio_data_callback_proc(
 static void oboe_aaudio_error_thread_proc(AudioStreamAAudio *oboeStream,
                                           Result error) {
     LOGD("%s(,%d) - entering >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>", __func__, error);
+    if (!oboeStream->getHelperThreadPlacement().isDefault()) {
+        applyThreadPlacement(oboeStream->getHelperThreadPlacement());
+    }
     AudioStreamErrorCallback *errorCallback = oboeStream->getErrorCallback();
     if (errorCallback == nullptr) return; // should be impossible
     bool isErrorHandled = errorCallback->onError(oboeStream, error);
@@ -321,6 +324,8 @@ error2:
 }
 
 Result AudioStreamAAudio::close() {
+    cancelAsyncTransfer();
+
     // Prevent two threads from closing the stream at the same time and crashing.
     // This could occur, for example, if an application called close() at the same
     // time that an onError callback was being executed because of a disconnect.
@@ -355,6 +360,9 @@ Result AudioStreamAAudio::close() {
 
 static void oboe_stop_thread_proc(AudioStream *oboeStream) {
     if (oboeStream != nullptr) {
+        if (!oboeStream->getHelperThreadPlacement().isDefault()) {
+            applyThreadPlacement(oboeStream->getHelperThreadPlacement());
+        }
         oboeStream->requestStop();
     }
 }
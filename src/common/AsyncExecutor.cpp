@@ -0,0 +1,201 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+#include "oboe/AsyncTransfer.h"
+#include "oboe/AudioStream.h"
+#include "AsyncExecutor.h"
+#include "AudioClock.h"
+#include "OboeDebug.h"
+
+namespace oboe {
+
+AsyncExecutor &AsyncExecutor::getInstance() {
+    static AsyncExecutor instance;
+    return instance;
+}
+
+AsyncExecutor::~AsyncExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+    }
+    wake();
+    mCondition.notify_all();
+    for (std::thread &thread : mThreads) {
+        thread.join();
+    }
+}
+
+void AsyncExecutor::startThreads_l() {
+    if (!mThreads.empty()) {
+        return;
+    }
+    LOGD("AsyncExecutor::%s() start %d threads", __func__, kNumThreads);
+    for (int32_t i = 0; i < kNumThreads; i++) {
+        mThreads.emplace_back(&AsyncExecutor::run, this);
+    }
+}
+
+Result AsyncExecutor::submit(PendingTransfer &transfer,
+                             void *readBuffer,
+                             const void *writeBuffer,
+                             int32_t numFrames,
+                             int64_t timeoutNanoseconds,
+                             AsyncTransferCallback *callback) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (transfer.pending) {
+        return Result::ErrorInvalidState;
+    }
+    startThreads_l();
+    transfer.readBuffer = readBuffer;
+    transfer.writeBuffer = writeBuffer;
+    transfer.numFrames = numFrames;
+    transfer.framesTransferred = 0;
+    transfer.deadlineNanos = AudioClock::getNanoseconds() + timeoutNanoseconds;
+    transfer.callback = callback;
+    transfer.pending = true;
+    transfer.retryNanos = 0; // try now
+    mTransfers.push_back(&transfer);
+    wake();
+    mCondition.notify_one();
+    return Result::OK;
+}
+
+void AsyncExecutor::cancel(PendingTransfer &transfer) {
+    std::unique_lock<std::mutex> lock(mLock);
+    mIdleCondition.wait(lock, [&transfer] { return !transfer.running; });
+    if (!transfer.pending) {
+        return;
+    }
+    mTransfers.erase(std::find(mTransfers.begin(), mTransfers.end(), &transfer));
+    transfer.pending = false;
+    AsyncTransferCallback *callback = transfer.callback;
+    lock.unlock();
+    callback->onTransferComplete(&transfer.stream, ResultWithValue<int32_t>(Result::ErrorClosed));
+}
+
+bool AsyncExecutor::tryTransfer(PendingTransfer &transfer, int32_t &result) {
+    AudioStream &stream = transfer.stream;
+    const int32_t framesLeft = transfer.numFrames - transfer.framesTransferred;
+    const int32_t byteOffset = transfer.framesTransferred * stream.getBytesPerFrame();
+    ResultWithValue<int32_t> framesDone = (transfer.readBuffer != nullptr)
+            ? stream.read(static_cast<uint8_t *>(transfer.readBuffer) + byteOffset,
+                          framesLeft, 0 /* timeout */)
+            : stream.write(static_cast<const uint8_t *>(transfer.writeBuffer) + byteOffset,
+                           framesLeft, 0 /* timeout */);
+    if (!framesDone) {
+        result = static_cast<int32_t>(framesDone.error());
+        return true;
+    }
+    transfer.framesTransferred += framesDone.value();
+    const int64_t now = AudioClock::getNanoseconds();
+    if (transfer.framesTransferred >= transfer.numFrames || now >= transfer.deadlineNanos) {
+        result = transfer.framesTransferred;
+        return true;
+    }
+    // If the stream does not signal then try again when it has had time to move a burst.
+    const int32_t framesWanted = std::min(transfer.numFrames - transfer.framesTransferred,
+                                          std::max(1, stream.getFramesPerBurst()));
+    const int64_t waitNanos = framesWanted * kNanosPerSecond
+            / std::max(1, stream.getSampleRate());
+    transfer.retryNanos = std::min(now + waitNanos, transfer.deadlineNanos);
+    return false;
+}
+
+void AsyncExecutor::waitForWork_l(std::unique_lock<std::mutex> &lock,
+                                  uint32_t wakeCount,
+                                  int64_t wakeNanos) {
+    if (mHasSignalWaiter) {
+        // Woken when the thread on mSignal wakes up, or by submit().
+        // The thread on mSignal may have a later deadline, so keep this one too.
+        if (wakeNanos == INT64_MAX) {
+            mCondition.wait(lock);
+        } else {
+            mCondition.wait_for(lock, std::chrono::nanoseconds(
+                    wakeNanos - AudioClock::getNanoseconds()));
+        }
+        return;
+    }
+    mHasSignalWaiter = true;
+    lock.unlock();
+    // Returns at once if wake() was called after the transfers were checked.
+    mSignal.waitForFrames(1, wakeNanos, [this, wakeCount] {
+        return (mWakeCount.load(std::memory_order_acquire) != wakeCount) ? 1 : 0;
+    });
+    lock.lock();
+    mHasSignalWaiter = false;
+    mCondition.notify_one(); // another idle thread can sleep on mSignal now
+}
+
+void AsyncExecutor::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mStopping) {
+        // Read before checking the transfers so that a later signal is not missed.
+        const uint32_t wakeCount = mWakeCount.load(std::memory_order_acquire);
+        const int64_t now = AudioClock::getNanoseconds();
+        PendingTransfer *ready = nullptr;
+        int64_t wakeNanos = INT64_MAX;
+        for (PendingTransfer *transfer : mTransfers) {
+            if (transfer->running) {
+                continue;
+            }
+            if (transfer->signalled.load(std::memory_order_acquire)
+                    || transfer->retryNanos <= now) {
+                ready = transfer;
+                break;
+            }
+            wakeNanos = std::min(wakeNanos, transfer->retryNanos);
+        }
+        if (ready == nullptr) {
+            waitForWork_l(lock, wakeCount, wakeNanos);
+            continue;
+        }
+
+        // Move it to the back so the other streams get a turn first next time.
+        mTransfers.erase(std::find(mTransfers.begin(), mTransfers.end(), ready));
+        mTransfers.push_back(ready);
+        ready->running = true;
+        // Clear before trying so that a callback during the attempt causes another one.
+        ready->signalled.store(false, std::memory_order_release);
+        lock.unlock();
+
+        int32_t result = 0;
+        const bool finished = tryTransfer(*ready, result);
+
+        lock.lock();
+        ready->running = false;
+        if (finished) {
+            mTransfers.erase(std::find(mTransfers.begin(), mTransfers.end(), ready));
+            ready->pending = false;
+            AudioStream *stream = &ready->stream;
+            AsyncTransferCallback *callback = ready->callback;
+            lock.unlock();
+            mIdleCondition.notify_all();
+            // The transfer is no longer pending so the callback may start the next one.
+            callback->onTransferComplete(stream,
+                                         ResultWithValue<int32_t>::createBasedOnSign(result));
+            lock.lock();
+        } else {
+            mIdleCondition.notify_all();
+        }
+    }
+}
+
+} // namespace oboe
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_ASYNC_EXECUTOR_H
+#define OBOE_ASYNC_EXECUTOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "oboe/Definitions.h"
+#include "oboe/ResultWithValue.h"
+#include "FrameSignal.h"
+
+namespace oboe {
+
+class AsyncTransferCallback;
+class AudioStream;
+
+/**
+ * State of the asynchronous read or write of one stream.
+ * Each stream has one, which is only used by the AsyncExecutor while a transfer is pending.
+ */
+struct PendingTransfer {
+    explicit PendingTransfer(AudioStream &audioStream) : stream(audioStream) {}
+
+    AudioStream           &stream;
+    void                  *readBuffer = nullptr;
+    const void            *writeBuffer = nullptr;
+    int32_t                numFrames = 0;
+    int32_t                framesTransferred = 0;
+    int64_t                deadlineNanos = 0;
+    AsyncTransferCallback *callback = nullptr;
+
+    // Set by the stream callback when frames become available. Cleared before each attempt.
+    std::atomic<bool>      signalled{false};
+
+    // These are protected by the AsyncExecutor lock.
+    bool                   pending = false;
+    bool                   running = false;    // a thread is reading or writing the stream
+    int64_t                retryNanos = 0;     // when to try again if not signalled
+};
+
+/**
+ * A few threads that do the asynchronous reads and writes of all streams.
+ *
+ * Each pending transfer is tried without blocking. If the stream is not ready then it is tried
+ * again when the stream callback signals that frames are available, eg. from the FIFO of an
+ * AudioStreamBuffered, or else after about one burst. So hundreds of streams can be serviced
+ * without a thread per stream.
+ *
+ * One idle thread sleeps on a FrameSignal, so the callback can wake it without a lock.
+ * The other idle threads wait on a condition until it is their turn.
+ */
+class AsyncExecutor {
+public:
+    static AsyncExecutor &getInstance();
+
+    ~AsyncExecutor();
+
+    /**
+     * Start a transfer. Pass either readBuffer or writeBuffer and set the other to nullptr.
+     *
+     * @return OK or Result::ErrorInvalidState if a transfer of the stream is already pending
+     */
+    Result submit(PendingTransfer &transfer,
+                  void *readBuffer,
+                  const void *writeBuffer,
+                  int32_t numFrames,
+                  int64_t timeoutNanoseconds,
+                  AsyncTransferCallback *callback);
+
+    /**
+     * Remove the transfer and call its callback with Result::ErrorClosed on this thread.
+     * This waits if the transfer is being tried by another thread.
+     * Nothing happens if the transfer is not pending.
+     */
+    void cancel(PendingTransfer &transfer);
+
+    /**
+     * Wake a thread to try the transfer again. This is called from the stream callback.
+     * It does not lock. It only makes a system call, a futex wake, if the first signal
+     * since the last attempt finds a thread sleeping.
+     */
+    void signal(PendingTransfer &transfer) {
+        if (!transfer.signalled.exchange(true, std::memory_order_acq_rel)) {
+            wake();
+        }
+    }
+
+private:
+    static constexpr int32_t kNumThreads = 2;
+
+    AsyncExecutor() = default;
+
+    void startThreads_l();
+    void run();
+    // Wake the thread that sleeps on mSignal. Lock-free.
+    void wake() {
+        mWakeCount.fetch_add(1, std::memory_order_release);
+        mSignal.notify(1);
+    }
+    // Sleep until wake() is called after wakeCount was read, or until wakeNanos.
+    void waitForWork_l(std::unique_lock<std::mutex> &lock, uint32_t wakeCount, int64_t wakeNanos);
+
+    // Read or write without blocking.
+    // @return true if the transfer is finished, with the frames transferred
+    //         or a negative Result in result
+    bool tryTransfer(PendingTransfer &transfer, int32_t &result);
+
+    std::mutex               mLock;
+    std::condition_variable  mCondition;     // wakes the threads that are not on mSignal
+    std::condition_variable  mIdleCondition; // notified when a transfer stops running
+    std::vector<PendingTransfer *> mTransfers; // pending
+    std::vector<std::thread> mThreads;
+    bool                     mStopping = false;
+    bool                     mHasSignalWaiter = false; // a thread is sleeping on mSignal
+    FrameSignal              mSignal;
+    std::atomic<uint32_t>    mWakeCount{0}; // incremented by wake()
+};
+
+} // namespace oboe
+
+#endif //OBOE_ASYNC_EXECUTOR_H
@@ -20,11 +20,10 @@ using namespace oboe;
 using namespace flowgraph;
 
 int32_t AudioSourceCaller::onProcessFixedBlock(uint8_t *buffer, int32_t numBytes) {
-    AudioStreamDataCallback *callback = mStream->getDataCallback();
     int32_t result = 0;
     int32_t numFrames = numBytes / mStream->getBytesPerFrame();
-    if (callback != nullptr) {
-        DataCallbackResult callbackResult = callback->onAudioReady(mStream, buffer, numFrames);
+    if (mStream->getDataCallback() != nullptr) {
+        DataCallbackResult callbackResult = mStream->callDataCallback(buffer, numFrames);
         // onAudioReady() does not return the number of bytes processed so we have to assume all.
         result = (callbackResult == DataCallbackResult::Continue)
                 ? numBytes
@@ -36,3 +35,9 @@ int32_t AudioSourceCaller::onProcessFixedBlock(uint8_t *buffer, int32_t numBytes
     }
     return result;
 }
+
+int32_t AudioSourceCaller::readFrames(void *buffer, int32_t numFrames) {
+    int32_t bytesPerFrame = mStream->getBytesPerFrame();
+    int32_t bytesRead = mBlockReader.read(static_cast<uint8_t *>(buffer), numFrames * bytesPerFrame);
+    return (bytesRead < 0) ? bytesRead : bytesRead / bytesPerFrame;
+}
@@ -22,6 +22,8 @@
 
 #include "flowgraph/FlowGraphNode.h"
 #include "FixedBlockReader.h"
+#include "MemoryRegions.h"
+#include "StreamArena.h"
 
 namespace oboe {
 
@@ -34,10 +36,25 @@ class AudioStream;
  */
 class AudioSourceCaller : public flowgraph::FlowGraphSource, public FixedBlockProcessor {
 public:
-    AudioSourceCaller(int32_t channelCount, int32_t framesPerCallback, int32_t bytesPerSample)
+    /**
+     * @param channelCount samples per frame
+     * @param framesPerCallback frames read from the stream at one time
+     * @param bytesPerSample size of a sample in the stream format
+     * @param arena memory for the block reader and any conversion buffer
+     */
+    AudioSourceCaller(int32_t channelCount, int32_t framesPerCallback, int32_t bytesPerSample,
+                      StreamArena &arena)
             : FlowGraphSource(channelCount)
             , mBlockReader(*this) {
-        mBlockReader.open(channelCount * framesPerCallback * bytesPerSample);
+        mBlockReader.setArena(&arena);
+        mBlockAllocated = mBlockReader.open(channelCount * framesPerCallback * bytesPerSample) >= 0;
+    }
+
+    /**
+     * @return false if a buffer could not be allocated from the arena
+     */
+    virtual bool isAllocated() const {
+        return mBlockAllocated;
     }
 
     /**
@@ -64,6 +81,16 @@ public:
         return mTimeoutNanos;
     }
 
+    /**
+     * Read frames in the stream's own format, bypassing the float output port.
+     * This is used when no float conversion is needed.
+     *
+     * @param buffer destination for numFrames frames of stream data
+     * @param numFrames number of frames requested
+     * @return number of frames read or a negative error
+     */
+    int32_t readFrames(void *buffer, int32_t numFrames);
+
     /**
      * Called internally for block size adaptation.
      * @param buffer
@@ -72,11 +99,21 @@ public:
      */
     int32_t onProcessFixedBlock(uint8_t *buffer, int32_t numBytes) override;
 
+    /**
+     * Add the buffers used to read from the stream that are not in the arena.
+     */
+    void collectMemoryRegions(MemoryRegions &regions) {
+        regions.add(output.getBuffer(), sizeof(float)
+                * static_cast<size_t>(output.getFramesPerBuffer())
+                * static_cast<size_t>(output.getSamplesPerFrame()));
+    }
+
 protected:
     oboe::AudioStream         *mStream = nullptr;
     int64_t                    mTimeoutNanos = 0;
 
     FixedBlockReader           mBlockReader;
+    bool                       mBlockAllocated = false;
 };
 
 }
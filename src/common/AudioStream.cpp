@@ -14,13 +14,20 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <sys/types.h>
 #include <pthread.h>
 #include <thread>
 
 #include <oboe/AudioStream.h>
 #include "OboeDebug.h"
+#include "AsyncExecutor.h"
 #include "AudioClock.h"
+#include "CallbackBatcher.h"
+#include "CallbackTimingRecorder.h"
+#include "MemoryRegions.h"
+#include "PlaybackScheduler.h"
+#include "StreamArena.h"
 #include <oboe/Utilities.h>
 
 namespace oboe {
@@ -28,14 +35,41 @@ namespace oboe {
 /*
  * AudioStream
  */
+AudioStream::AudioStream() = default;
+
 AudioStream::AudioStream(const AudioStreamBuilder &builder)
         : AudioStreamBase(builder) {
+    if (isCallbackTimingEnabled()) {
+        mCallbackTimingRecorder = std::make_unique<CallbackTimingRecorder>();
+    }
+    // Read the core types now so that sysfs is not read in the callback.
+    if (getCallbackThreadPlacement().coreType != CoreType::Any
+            || getHelperThreadPlacement().coreType != CoreType::Any) {
+        getCpuMaskForCoreType(CoreType::Any);
+    }
+}
+
+AudioStream::~AudioStream() {
+    // In case the stream was deleted without being closed.
+    if (mCallbackBatcher) {
+        mCallbackBatcher->close();
+    }
+    if (mPendingTransfer) {
+        AsyncExecutor::getInstance().cancel(*mPendingTransfer);
+    }
 }
 
 Result AudioStream::close() {
+    cancelAsyncTransfer(); // in case the subclass did not
+    if (mCallbackBatcher) {
+        mCallbackBatcher->close();
+    }
     // Update local counters so they can be read after the close.
     updateFramesWritten();
     updateFramesRead();
+    if (mLockedMemoryRegions) {
+        mLockedMemoryRegions->unlock();
+    }
     return Result::OK;
 }
 
@@ -52,25 +86,218 @@ void AudioStream::checkScheduler() {
     }
 }
 
+void AudioStream::prepareCallbackThread() {
+    pthread_t thread = pthread_self();
+    if (mIsCallbackThreadPlaced && pthread_equal(thread, mPlacedCallbackThread)) {
+        return;
+    }
+    mPlacedCallbackThread = thread;
+    mIsCallbackThreadPlaced = true;
+    if (isPrefaultEnabled() || isMemoryLockEnabled()) {
+        prefaultStack();
+    }
+    if (isFlushToZeroEnabled() && !enableFlushToZero()) {
+        LOGW("AudioStream::%s() flush to zero is not supported on this CPU", __func__);
+    }
+    if (getCallbackThreadPlacement().isDefault()) {
+        return;
+    }
+    EffectiveThreadPlacement placement = applyThreadPlacement(getCallbackThreadPlacement());
+    LOGD("AudioStream::%s() cpuMask = 0x%llX, scheduler = %d, priority = %d", __func__,
+         (unsigned long long) placement.cpuMask, placement.scheduler, placement.priority);
+    // Only the callback writes, so the sequence does not need a compare and swap.
+    mPlacementSequence.fetch_add(1, std::memory_order_relaxed); // now odd
+    std::atomic_thread_fence(std::memory_order_release);
+    mEffectiveCpuMask.store(placement.cpuMask, std::memory_order_relaxed);
+    mEffectiveScheduler.store(placement.scheduler, std::memory_order_relaxed);
+    mEffectivePriority.store(placement.priority, std::memory_order_relaxed);
+    mEffectiveAffinityResult.store(placement.affinityResult, std::memory_order_relaxed);
+    mEffectivePriorityResult.store(placement.priorityResult, std::memory_order_relaxed);
+    mPlacementSequence.fetch_add(1, std::memory_order_release); // now even
+}
+
 DataCallbackResult AudioStream::fireDataCallback(void *audioData, int32_t numFrames) {
     if (!isDataCallbackEnabled()) {
         LOGW("AudioStream::%s() called with data callback disabled!", __func__);
         return DataCallbackResult::Stop; // Should not be getting called
     }
 
+    prepareCallbackThread();
+
+    CallbackTimingRecorder *timingRecorder = mCallbackTimingRecorder.get();
+    const int64_t startNanos = (timingRecorder != nullptr) ? AudioClock::getNanoseconds() : 0;
+
     DataCallbackResult result;
-    if (mDataCallback) {
-        result = mDataCallback->onAudioReady(this, audioData, numFrames);
+    if (mCallbackBatcher) {
+        result = mCallbackBatcher->process(audioData, numFrames);
+    } else if (mDataCallback) {
+        result = callDataCallback(audioData, numFrames);
     } else {
         result = onDefaultCallback(audioData, numFrames);
     }
+
+    if (timingRecorder != nullptr) {
+        timingRecorder->record(startNanos, AudioClock::getNanoseconds(), numFrames,
+                               getSampleRate());
+    }
     // On Oreo, we might get called after returning stop.
     // So block that here.
-    setDataCallbackEnabled(result == DataCallbackResult::Continue);
+    if (result != DataCallbackResult::Continue) {
+        setDataCallbackEnabled(false);
+    }
 
     return result;
 }
 
+ResultWithValue<CallbackTimingStats> AudioStream::getCallbackTimingStats() {
+    if (mCallbackTimingRecorder == nullptr) {
+        return ResultWithValue<CallbackTimingStats>(Result::ErrorInvalidState);
+    }
+    return ResultWithValue<CallbackTimingStats>(mCallbackTimingRecorder->getStats());
+}
+
+ResultWithValue<EffectiveThreadPlacement> AudioStream::getEffectiveCallbackThreadPlacement() {
+    EffectiveThreadPlacement placement;
+    while (true) {
+        const uint32_t sequence = mPlacementSequence.load(std::memory_order_acquire);
+        if (sequence == 0) {
+            return ResultWithValue<EffectiveThreadPlacement>(Result::ErrorInvalidState);
+        }
+        if ((sequence & 1) != 0) {
+            std::this_thread::yield(); // the callback is writing it
+            continue;
+        }
+        placement.cpuMask = mEffectiveCpuMask.load(std::memory_order_relaxed);
+        placement.scheduler = mEffectiveScheduler.load(std::memory_order_relaxed);
+        placement.priority = mEffectivePriority.load(std::memory_order_relaxed);
+        placement.affinityResult = mEffectiveAffinityResult.load(std::memory_order_relaxed);
+        placement.priorityResult = mEffectivePriorityResult.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mPlacementSequence.load(std::memory_order_relaxed) == sequence) {
+            return ResultWithValue<EffectiveThreadPlacement>(placement);
+        }
+    }
+}
+
+ResultWithValue<int64_t> AudioStream::getLockedMemoryBytes() {
+    if (mLockedMemoryRegions == nullptr) {
+        return ResultWithValue<int64_t>(Result::ErrorInvalidState);
+    }
+    return ResultWithValue<int64_t>(mLockedMemoryRegions->getLockedBytes());
+}
+
+void AudioStream::collectMemoryRegions(MemoryRegions &regions) {
+    regions.add(mCallbackTimingRecorder.get(), sizeof(CallbackTimingRecorder));
+    if (mArena) {
+        mArena->collectMemoryRegions(regions);
+    }
+}
+
+StreamArena &AudioStream::getArena() {
+    if (mArena == nullptr) {
+        mArena = std::make_unique<StreamArena>();
+        mArena->setHugePagesEnabled(isHugePageArenaEnabled());
+    }
+    return *mArena;
+}
+
+int64_t AudioStream::getArenaSizeInBytes() const {
+    return mArena ? mArena->getCapacityInBytes() : 0;
+}
+
+int32_t AudioStream::getFramesPerCallbackBatch() const {
+    return mCallbackBatcher ? mCallbackBatcher->getFramesPerBatch() : 0;
+}
+
+void AudioStream::configureCallbackBatching() {
+    // Offline rendering does not wait for the worker so it would render silence.
+    if (getPerformanceMode() != PerformanceMode::PowerSaving
+            || getPowerSavingBatchMillis() <= 0
+            || mDataCallback == nullptr
+            || getOfflineSink() != nullptr) {
+        return;
+    }
+    const int32_t framesPerBatch = CallbackBatcher::calculateFramesPerBatch(
+            getPowerSavingBatchMillis(), getSampleRate(), getFramesPerBurst());
+    if (framesPerBatch <= getFramesPerBurst()) {
+        return; // the device already calls back with big enough blocks
+    }
+    auto batcher = std::make_unique<CallbackBatcher>(*this);
+    if (batcher->open(framesPerBatch, getArena()) != Result::OK) {
+        LOGW("AudioStream::%s() could not set up %d frames, not batching",
+             __func__, framesPerBatch);
+        return;
+    }
+    LOGD("AudioStream::%s() call back with %d frames", __func__, framesPerBatch);
+    mCallbackBatcher = std::move(batcher);
+}
+
+void AudioStream::setDataCallbackEnabled(bool enabled) {
+    // This is only enabled when the stream is started.
+    if (enabled && mCallbackBatcher) {
+        mCallbackBatcher->start();
+    }
+    mDataCallbackEnabled = enabled;
+}
+
+void AudioStream::configurePlaybackScheduler(int32_t capacity) {
+    if (capacity <= 0 || getDirection() != Direction::Output || mDataCallback == nullptr) {
+        return;
+    }
+    auto scheduler = std::make_unique<PlaybackScheduler>(*this, mDataCallback);
+    if (scheduler->open(capacity, getArena()) != Result::OK) {
+        LOGW("AudioStream::%s() could not allocate %d events, not scheduling",
+             __func__, capacity);
+        return;
+    }
+    mPlaybackScheduler = std::move(scheduler);
+}
+
+DataCallbackResult AudioStream::callDataCallback(void *audioData, int32_t numFrames) {
+    if (mPlaybackScheduler) {
+        return mPlaybackScheduler->onAudioReady(this, audioData, numFrames);
+    }
+    return mDataCallback->onAudioReady(this, audioData, numFrames);
+}
+
+void AudioStream::prepareMemoryForRealTime() {
+    auto regions = std::make_unique<MemoryRegions>();
+    collectMemoryRegions(*regions);
+    regions->prefault();
+    if (isMemoryLockEnabled()) {
+        regions->lock();
+        LOGD("AudioStream::%s() locked %lld of %lld bytes", __func__,
+             (long long) regions->getLockedBytes(), (long long) regions->getTotalBytes());
+        mLockedMemoryRegions = std::move(regions);
+    }
+}
+
+Result AudioStream::resetCallbackTimingStats() {
+    if (mCallbackTimingRecorder == nullptr) {
+        return Result::ErrorInvalidState;
+    }
+    mCallbackTimingRecorder->requestReset();
+    return Result::OK;
+}
+
+ResultWithValue<PercentileSummary> AudioStream::getCallbackLatenessWindow() {
+    if (mCallbackTimingRecorder == nullptr) {
+        return ResultWithValue<PercentileSummary>(Result::ErrorInvalidState);
+    }
+    if (mCallbackTimingRecorder->getLatenessWindowCount() == 0) {
+        return ResultWithValue<PercentileSummary>(Result::ErrorUnavailable);
+    }
+    return ResultWithValue<PercentileSummary>(mCallbackTimingRecorder->getLatenessWindow());
+}
+
+Result AudioStream::resetCallbackLatenessWindow() {
+    if (mCallbackTimingRecorder == nullptr) {
+        return Result::ErrorInvalidState;
+    }
+    mCallbackTimingRecorder->requestLatenessWindowReset();
+    return Result::OK;
+}
+
 Result AudioStream::waitForStateTransition(StreamState startingState,
                                            StreamState endingState,
                                            int64_t timeoutNanoseconds)
@@ -178,7 +405,11 @@ ResultWithValue<int32_t> AudioStream::waitForAvailableFrames(int32_t numFrames,
         if (!ready) {
             int64_t now = AudioClock::getNanoseconds();
             if (now > deadline) break;
-            AudioClock::sleepForNanos(burstInNanos);
+            // Only sleep long enough for the missing frames to arrive, up to one burst.
+            int64_t missingInNanos = (numFrames - framesAvailable) * kNanosPerSecond
+                    / getSampleRate();
+            AudioClock::sleepForNanos(std::min(std::min(missingInNanos, burstInNanos),
+                                               deadline - now));
         }
     } while (!ready);
     return (!ready)
@@ -186,6 +417,90 @@ ResultWithValue<int32_t> AudioStream::waitForAvailableFrames(int32_t numFrames,
             : ResultWithValue<int32_t>(framesAvailable);
 }
 
+Result AudioStream::writeAsync(const void *buffer,
+                               int32_t numFrames,
+                               int64_t timeoutNanoseconds,
+                               AsyncTransferCallback *callback) {
+    if (buffer == nullptr) return Result::ErrorNull;
+    return startAsyncTransfer(nullptr, buffer, numFrames, timeoutNanoseconds, callback);
+}
+
+Result AudioStream::readAsync(void *buffer,
+                              int32_t numFrames,
+                              int64_t timeoutNanoseconds,
+                              AsyncTransferCallback *callback) {
+    if (buffer == nullptr) return Result::ErrorNull;
+    return startAsyncTransfer(buffer, nullptr, numFrames, timeoutNanoseconds, callback);
+}
+
+Result AudioStream::startAsyncTransfer(void *readBuffer,
+                                       const void *writeBuffer,
+                                       int32_t numFrames,
+                                       int64_t timeoutNanoseconds,
+                                       AsyncTransferCallback *callback) {
+    if (callback == nullptr) return Result::ErrorNull;
+    if (numFrames < 0 || timeoutNanoseconds < 0) return Result::ErrorOutOfRange;
+    if (getState() == StreamState::Closed) return Result::ErrorClosed;
+    // Submit under the lock so that a transfer cannot start after cancelAsyncTransfer().
+    std::lock_guard<std::mutex> lock(mPendingTransferLock);
+    if (mAsyncTransferCancelled) return Result::ErrorClosed;
+    if (!mPendingTransfer) {
+        mPendingTransfer = std::make_unique<PendingTransfer>(*this);
+        mPendingTransferToSignal.store(mPendingTransfer.get(), std::memory_order_release);
+    }
+    return AsyncExecutor::getInstance().submit(*mPendingTransfer, readBuffer, writeBuffer,
+                                               numFrames, timeoutNanoseconds, callback);
+}
+
+void AudioStream::cancelAsyncTransfer() {
+    PendingTransfer *transfer = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mPendingTransferLock);
+        mAsyncTransferCancelled = true;
+        transfer = mPendingTransfer.get();
+    }
+    if (transfer != nullptr) {
+        AsyncExecutor::getInstance().cancel(*transfer);
+    }
+}
+
+void AudioStream::signalAsyncTransfer() {
+    AudioStream *owner = (mAsyncTransferOwner != nullptr) ? mAsyncTransferOwner : this;
+    PendingTransfer *transfer = owner->mPendingTransferToSignal.load(std::memory_order_acquire);
+    if (transfer != nullptr) {
+        AsyncExecutor::getInstance().signal(*transfer);
+    }
+}
+
+Result AudioStream::scheduleBuffer(int64_t framePosition, const void *buffer, int32_t numFrames) {
+    if (!mPlaybackScheduler) return Result::ErrorInvalidState;
+    if (getState() == StreamState::Closed) return Result::ErrorClosed;
+    return mPlaybackScheduler->scheduleBuffer(framePosition, buffer, numFrames);
+}
+
+Result AudioStream::scheduleEvent(int64_t framePosition, ScheduledEventCallback *callback) {
+    if (!mPlaybackScheduler) return Result::ErrorInvalidState;
+    if (getState() == StreamState::Closed) return Result::ErrorClosed;
+    return mPlaybackScheduler->scheduleEvent(framePosition, callback);
+}
+
+Result AudioStream::clearScheduledEvents() {
+    if (!mPlaybackScheduler) return Result::ErrorInvalidState;
+    mPlaybackScheduler->clear();
+    return Result::OK;
+}
+
+ResultWithValue<int64_t> AudioStream::getFramePositionAtTime(int64_t timeNanoseconds) {
+    auto result = getTimestamp(CLOCK_MONOTONIC);
+    if (!result) {
+        return ResultWithValue<int64_t>(result.error());
+    }
+    const FrameTimestamp &frame = result.value();
+    const int64_t framesAfter = (timeNanoseconds - frame.timestamp) * getSampleRate()
+            / kNanosPerSecond;
+    return ResultWithValue<int64_t>(frame.position + framesAfter);
+}
+
 ResultWithValue<FrameTimestamp> AudioStream::getTimestamp(clockid_t clockId) {
     FrameTimestamp frame;
     Result result = getTimestamp(clockId, &frame.position, &frame.timestamp);
@@ -19,10 +19,12 @@
 
 #include "aaudio/AAudioExtensions.h"
 #include "aaudio/AudioStreamAAudio.h"
+#include "CallbackBatcher.h"
 #include "FilterAudioStream.h"
 #include "OboeDebug.h"
 #include "oboe/Oboe.h"
 #include "oboe/AudioStreamBuilder.h"
+#include "null/AudioStreamNull.h"
 #include "opensles/AudioInputStreamOpenSLES.h"
 #include "opensles/AudioOutputStreamOpenSLES.h"
 #include "opensles/AudioStreamOpenSLES.h"
@@ -66,7 +68,9 @@ bool AudioStreamBuilder::isAAudioRecommended() {
 
 AudioStream *AudioStreamBuilder::build() {
     AudioStream *stream = nullptr;
-    if (isAAudioRecommended() && mAudioApi != AudioApi::OpenSLES) {
+    if (mAudioApi == AudioApi::Null || getOfflineSink() != nullptr) {
+        stream = new AudioStreamNull(*this);
+    } else if (isAAudioRecommended() && mAudioApi != AudioApi::OpenSLES) {
         stream = new AudioStreamAAudio(*this);
     } else if (isAAudioSupported() && mAudioApi == AudioApi::AAudio) {
         stream = new AudioStreamAAudio(*this);
@@ -85,7 +89,8 @@ bool AudioStreamBuilder::isCompatible(AudioStreamBase &other) {
     return (getSampleRate() == oboe::Unspecified || getSampleRate() == other.getSampleRate())
            && (getFormat() == (AudioFormat)oboe::Unspecified || getFormat() == other.getFormat())
            && (getFramesPerDataCallback() == oboe::Unspecified || getFramesPerDataCallback() == other.getFramesPerDataCallback())
-           && (getChannelCount() == oboe::Unspecified || getChannelCount() == other.getChannelCount());
+           && (getChannelCount() == oboe::Unspecified || getChannelCount() == other.getChannelCount())
+           && getBiquadFilterStageCount() == other.getBiquadFilterStageCount();
 }
 
 Result AudioStreamBuilder::openStream(AudioStream **streamPP) {
@@ -104,6 +109,7 @@ Result AudioStreamBuilder::openStream(AudioStream **streamPP) {
     *streamPP = nullptr;
 
     AudioStream *streamP = nullptr;
+    bool isFilterStream = false;
 
     // Maybe make a FilterInputStream.
     AudioStreamBuilder childBuilder(*this);
@@ -112,6 +118,8 @@ Result AudioStreamBuilder::openStream(AudioStream **streamPP) {
     // Do we need to make a child stream and convert.
     if (conversionNeeded) {
         AudioStream *tempStream;
+        // The scheduler belongs to the stream that calls the app.
+        childBuilder.setScheduledEventCapacity(0);
         result = childBuilder.openStream(&tempStream);
         if (result != Result::OK) {
             return result;
@@ -119,6 +127,7 @@ Result AudioStreamBuilder::openStream(AudioStream **streamPP) {
 
         if (isCompatible(*tempStream)) {
             // The child stream would work as the requested stream so we can just use it directly.
+            tempStream->configurePlaybackScheduler(getScheduledEventCapacity());
             *streamPP = tempStream;
             return result;
         } else {
@@ -135,6 +144,11 @@ Result AudioStreamBuilder::openStream(AudioStream **streamPP) {
             }
             if (getFramesPerDataCallback() == oboe::Unspecified) {
                 parentBuilder.setFramesPerCallback(tempStream->getFramesPerDataCallback());
+                // Keep the blocks from a batching child stream big after conversion.
+                if (tempStream->getFramesPerCallbackBatch() > 0) {
+                    parentBuilder.setFramesPerCallback(CallbackBatcher::calculateFramesPerBatch(
+                            getPowerSavingBatchMillis(), parentBuilder.getSampleRate(), 0));
+                }
             }
 
             // Use childStream in a FilterAudioStream.
@@ -147,6 +161,7 @@ Result AudioStreamBuilder::openStream(AudioStream **streamPP) {
                 // Just open streamP the old way.
             } else {
                 streamP = static_cast<AudioStream *>(filterStream);
+                isFilterStream = true;
             }
         }
     }
@@ -194,6 +209,18 @@ Result AudioStreamBuilder::openStream(AudioStream **streamPP) {
             }
         }
 
+        // The app did not ask for a callback size so the callbacks can be batched.
+        // A FilterAudioStream is given the batch size of its child stream instead.
+        if (!isFilterStream && getFramesPerDataCallback() == oboe::Unspecified) {
+            streamP->configureCallbackBatching();
+        }
+        streamP->configurePlaybackScheduler(getScheduledEventCapacity());
+
+        // A child stream of a FilterAudioStream prepared its own memory when it was opened.
+        if (streamP->isPrefaultEnabled() || streamP->isMemoryLockEnabled()) {
+            streamP->prepareMemoryForRealTime();
+        }
+
         *streamPP = streamP;
     } else {
         delete streamP;
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "AudioClock.h"
+#include "AutoSampleRateConverter.h"
+#include "OboeDebug.h"
+
+using namespace oboe;
+using namespace flowgraph;
+using namespace resampler;
+
+// Reading the clock costs about as much as resampling a few frames, so only some calls are timed.
+constexpr int32_t kMeasurementInterval = 4;
+constexpr int32_t kCalibrationMillis = 3000;
+constexpr int32_t kCalibrationWindowMillis = 250;
+constexpr int32_t kWindowMillis = 2000;
+constexpr int32_t kCrossfadeMillis = 10;
+
+static int32_t millisToFrames(int32_t millis, int32_t sampleRate) {
+    return std::max(1, static_cast<int32_t>(static_cast<int64_t>(millis) * sampleRate / 1000));
+}
+
+AutoSampleRateConverter::AutoSampleRateConverter(int32_t channelCount,
+                                                 int32_t inputRate,
+                                                 int32_t outputRate,
+                                                 double budgetFraction)
+        : FlowGraphFilter(channelCount)
+        , mBudgetNanosPerFrame(budgetFraction * kNanosPerSecond / outputRate)
+        , mCalibrationFrames(millisToFrames(kCalibrationMillis, outputRate))
+        , mCalibrationWindowFrames(millisToFrames(kCalibrationWindowMillis, outputRate))
+        , mWindowFrames(millisToFrames(kWindowMillis, outputRate))
+        , mCrossfadeFrames(millisToFrames(kCrossfadeMillis, outputRate))
+        , mFadingFrame(channelCount) {
+    setDataPulledAutomatically(false);
+    for (int32_t i = 0; i < kNumQualities; i++) {
+        mResamplers[i].reset(MultiChannelResampler::make(channelCount, inputRate, outputRate,
+                                                         static_cast<Quality>(i)));
+        mHistoryFrames = std::max(mHistoryFrames, mResamplers[i]->getNumTaps());
+    }
+    mHistory.resize(static_cast<size_t>(mHistoryFrames) * static_cast<size_t>(channelCount));
+
+    // Start in the middle so that calibration takes as few steps as possible.
+    mQualityIndex = static_cast<int32_t>(Quality::Medium);
+    mResampler = mResamplers[mQualityIndex].get();
+}
+
+void AutoSampleRateConverter::reset() {
+    FlowGraphNode::reset();
+    mInputCursor = 0;
+    mNumValidInputFrames = 0;
+}
+
+bool AutoSampleRateConverter::isInputAvailable() {
+    // If we have consumed all of the input data then go out and get some more.
+    if (mInputCursor >= mNumValidInputFrames) {
+        // Do not count the time spent upstream, eg. in the app callback.
+        const int64_t startNanos = mMeasuring ? AudioClock::getNanoseconds() : 0;
+        mInputCallCount++;
+        mNumValidInputFrames = input.pullData(mInputCallCount, input.getFramesPerBuffer());
+        mInputCursor = 0;
+        if (mMeasuring) {
+            mPullNanos += AudioClock::getNanoseconds() - startNanos;
+        }
+    }
+    return (mInputCursor < mNumValidInputFrames);
+}
+
+void AutoSampleRateConverter::writeHistory(const float *frame) {
+    const int32_t channelCount = input.getSamplesPerFrame();
+    std::copy(frame, frame + channelCount, &mHistory[mHistoryCursor * channelCount]);
+    if (++mHistoryCursor >= mHistoryFrames) {
+        mHistoryCursor = 0;
+    }
+}
+
+int32_t AutoSampleRateConverter::onProcess(int32_t numFrames) {
+    // Do not time the crossfade because two resamplers are running.
+    mMeasuring = (mCrossfadeFramesLeft == 0) && (++mProcessCount % kMeasurementInterval == 0);
+    mPullNanos = 0;
+    const int64_t startNanos = mMeasuring ? AudioClock::getNanoseconds() : 0;
+
+    float *outputBuffer = output.getBuffer();
+    const int32_t channelCount = output.getSamplesPerFrame();
+    int32_t framesLeft = numFrames;
+    while (framesLeft > 0) {
+        // Gather input samples as needed. The resamplers are in phase so they need the same input.
+        if (mResampler->isWriteNeeded()) {
+            if (isInputAvailable()) {
+                const float *frame = &input.getBuffer()[mInputCursor++ * channelCount];
+                writeHistory(frame);
+                mResampler->writeNextFrame(frame);
+                if (mFadingResampler != nullptr) {
+                    mFadingResampler->writeNextFrame(frame);
+                }
+            } else {
+                break;
+            }
+        } else {
+            // Output frame is interpolated from input samples.
+            mResampler->readNextFrame(outputBuffer);
+            if (mFadingResampler != nullptr) {
+                mFadingResampler->readNextFrame(mFadingFrame.data());
+                const float fadeIn = 1.0f - static_cast<float>(mCrossfadeFramesLeft)
+                        / static_cast<float>(mCrossfadeFrames);
+                for (int32_t channel = 0; channel < channelCount; channel++) {
+                    const float faded = mFadingFrame[channel];
+                    outputBuffer[channel] = faded + (fadeIn * (outputBuffer[channel] - faded));
+                }
+                if (--mCrossfadeFramesLeft == 0) {
+                    mFadingResampler = nullptr;
+                }
+            }
+            outputBuffer += channelCount;
+            framesLeft--;
+        }
+    }
+
+    const int32_t framesProcessed = numFrames - framesLeft;
+    if (mMeasuring) {
+        mMeasuredNanos += AudioClock::getNanoseconds() - startNanos - mPullNanos;
+        mMeasuredFrameCount += framesProcessed;
+        mMeasuring = false;
+    }
+    updateQuality(framesProcessed);
+    return framesProcessed;
+}
+
+void AutoSampleRateConverter::updateQuality(int32_t numFrames) {
+    mFramesProcessed += numFrames;
+    mWindowFrameCount += numFrames;
+    const bool isCalibrating = mFramesProcessed < mCalibrationFrames;
+    const int32_t windowFrames = isCalibrating ? mCalibrationWindowFrames : mWindowFrames;
+    if (mWindowFrameCount < windowFrames || mMeasuredFrameCount == 0) {
+        return;
+    }
+    const double nanosPerFrame = static_cast<double>(mMeasuredNanos) / mMeasuredFrameCount;
+    mWindowFrameCount = 0;
+    mMeasuredFrameCount = 0;
+    mMeasuredNanos = 0;
+
+    // Each quality has about twice the taps of the one below so it costs about twice as much.
+    // After calibration, only go up with more headroom so the quality does not flip back and forth.
+    const double headroom = isCalibrating ? 2.0 : 4.0;
+    const int32_t qualityIndex = mQualityIndex.load();
+    if (nanosPerFrame > mBudgetNanosPerFrame && qualityIndex > 0) {
+        startCrossfade(qualityIndex - 1);
+    } else if (nanosPerFrame * headroom <= mBudgetNanosPerFrame
+            && qualityIndex < kNumQualities - 1) {
+        startCrossfade(qualityIndex + 1);
+    }
+}
+
+void AutoSampleRateConverter::startCrossfade(int32_t qualityIndex) {
+    LOGD("AutoSampleRateConverter::%s() quality %d to %d", __func__,
+         mQualityIndex.load(), qualityIndex);
+    MultiChannelResampler *next = mResamplers[qualityIndex].get();
+    // Fill the filter of the next resampler with the most recent input, oldest first.
+    const int32_t channelCount = input.getSamplesPerFrame();
+    for (int32_t age = next->getNumTaps(); age > 0; age--) {
+        const int32_t historyIndex = (mHistoryCursor - age + mHistoryFrames) % mHistoryFrames;
+        next->writeNextFrame(&mHistory[historyIndex * channelCount]);
+    }
+    next->copyPhase(*mResampler);
+
+    mFadingResampler = mResampler;
+    mResampler = next;
+    mQualityIndex = qualityIndex;
+    mCrossfadeFramesLeft = mCrossfadeFrames;
+}
+
+void AutoSampleRateConverter::collectMemoryRegions(MemoryRegions &regions) {
+    auto addBuffer = [&regions](const void *address, size_t numBytes) {
+        regions.add(address, numBytes);
+    };
+    for (const auto &resampler : mResamplers) {
+        resampler->forEachBuffer(addBuffer);
+    }
+    addBuffer(mHistory.data(), mHistory.size() * sizeof(float));
+    addBuffer(mFadingFrame.data(), mFadingFrame.size() * sizeof(float));
+    addBuffer(output.getBuffer(), sizeof(float)
+            * static_cast<size_t>(output.getFramesPerBuffer())
+            * static_cast<size_t>(output.getSamplesPerFrame()));
+}
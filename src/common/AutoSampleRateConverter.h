@@ -0,0 +1,128 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_AUTO_SAMPLE_RATE_CONVERTER_H
+#define OBOE_AUTO_SAMPLE_RATE_CONVERTER_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "flowgraph/FlowGraphNode.h"
+#include "flowgraph/resampler/MultiChannelResampler.h"
+#include "MemoryRegions.h"
+
+namespace oboe {
+
+/**
+ * Sample rate converter for SampleRateConversionQuality::Auto.
+ *
+ * It measures how long the resampler takes for each output frame and picks the best
+ * quality whose cost fits in a fraction of the time that the frame lasts, which is the same
+ * fraction of any callback period. The quality is calibrated during the first seconds and
+ * lowered later if the cost grows, eg. because the CPU is throttled.
+ *
+ * A resampler for each quality is made up front so nothing is allocated when switching.
+ * The new resampler is given the recent input and the phase of the old one, then the two
+ * are crossfaded.
+ */
+class AutoSampleRateConverter : public flowgraph::FlowGraphFilter {
+public:
+    using Quality = resampler::MultiChannelResampler::Quality;
+
+    /**
+     * @param channelCount samples per frame
+     * @param inputRate sample rate of the input
+     * @param outputRate sample rate of the output
+     * @param budgetFraction fraction of real time that the resampler may use, eg. 0.25
+     */
+    AutoSampleRateConverter(int32_t channelCount,
+                            int32_t inputRate,
+                            int32_t outputRate,
+                            double budgetFraction);
+
+    virtual ~AutoSampleRateConverter() = default;
+
+    int32_t onProcess(int32_t numFrames) override;
+
+    const char *getName() override {
+        return "AutoSampleRateConverter";
+    }
+
+    void reset() override;
+
+    /**
+     * This may be called from any thread.
+     *
+     * @return quality of the resampler in use, or the one being faded in
+     */
+    Quality getQuality() const {
+        return static_cast<Quality>(mQualityIndex.load());
+    }
+
+    /**
+     * Add the resamplers and the output buffer.
+     */
+    void collectMemoryRegions(MemoryRegions &regions);
+
+private:
+    static constexpr int32_t kNumQualities = static_cast<int32_t>(Quality::Best) + 1;
+
+    // Return true if there is a sample available.
+    bool isInputAvailable();
+
+    // Record a frame so it can be written to the next resampler.
+    void writeHistory(const float *frame);
+
+    // Choose the quality at the end of each measurement window.
+    void updateQuality(int32_t numFrames);
+
+    void startCrossfade(int32_t qualityIndex);
+
+    std::unique_ptr<resampler::MultiChannelResampler> mResamplers[kNumQualities];
+    resampler::MultiChannelResampler *mResampler = nullptr;         // being used
+    resampler::MultiChannelResampler *mFadingResampler = nullptr;   // being faded out
+    std::atomic<int32_t> mQualityIndex{0};
+
+    const double  mBudgetNanosPerFrame;
+    const int32_t mCalibrationFrames;
+    const int32_t mCalibrationWindowFrames;
+    const int32_t mWindowFrames;
+    const int32_t mCrossfadeFrames;
+
+    int64_t mFramesProcessed = 0;
+    int32_t mWindowFrameCount = 0;  // frames in this window, measured or not
+    int32_t mMeasuredFrameCount = 0;
+    int64_t mMeasuredNanos = 0;
+    int32_t mProcessCount = 0;
+    int64_t mPullNanos = 0;         // time spent pulling input while measuring
+    bool    mMeasuring = false;
+    int32_t mCrossfadeFramesLeft = 0;
+
+    std::vector<float> mHistory;      // recent input frames, enough to fill any resampler
+    int32_t            mHistoryFrames = 0;
+    int32_t            mHistoryCursor = 0; // frame to write next
+    std::vector<float> mFadingFrame;  // output of the resampler being faded out
+
+    int32_t mInputCursor = 0;         // offset into the input port buffer
+    int32_t mNumValidInputFrames = 0; // number of valid frames currently in the input port buffer
+    // Input is pulled at a different rate than output so it has its own call count.
+    int64_t mInputCallCount = 0;
+};
+
+} // namespace oboe
+
+#endif //OBOE_AUTO_SAMPLE_RATE_CONVERTER_H
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "oboe/BiquadFilter.h"
+#include "flowgraph/BiquadCascade.h"
+
+using namespace oboe;
+using flowgraph::BiquadCoefficients;
+
+// The flowgraph has the math. This struct is the same without the flowgraph namespace.
+static BiquadFilterCoefficients convert(const BiquadCoefficients &coefficients) {
+    BiquadFilterCoefficients result;
+    result.b0 = coefficients.b0;
+    result.b1 = coefficients.b1;
+    result.b2 = coefficients.b2;
+    result.a1 = coefficients.a1;
+    result.a2 = coefficients.a2;
+    return result;
+}
+
+BiquadFilterCoefficients BiquadFilterCoefficients::makeDcBlocker(float pole) {
+    return convert(BiquadCoefficients::makeDcBlocker(pole));
+}
+
+BiquadFilterCoefficients BiquadFilterCoefficients::makeLowPass(float sampleRate,
+                                                               float frequency,
+                                                               float q) {
+    return convert(BiquadCoefficients::makeLowPass(sampleRate, frequency, q));
+}
+
+BiquadFilterCoefficients BiquadFilterCoefficients::makeHighPass(float sampleRate,
+                                                                float frequency,
+                                                                float q) {
+    return convert(BiquadCoefficients::makeHighPass(sampleRate, frequency, q));
+}
+
+BiquadFilterCoefficients BiquadFilterCoefficients::makePeaking(float sampleRate,
+                                                               float frequency,
+                                                               float q,
+                                                               float gainDecibels) {
+    return convert(BiquadCoefficients::makePeaking(sampleRate, frequency, q, gainDecibels));
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <climits>
+#include <string.h>
+
+#include "oboe/AudioStream.h"
+#include "oboe/ThreadPlacement.h"
+#include "AudioClock.h"
+#include "CallbackBatcher.h"
+#include "OboeDebug.h"
+#include "StreamArena.h"
+
+namespace oboe {
+
+// The worker wakes up this often anyway, in case a signal was missed.
+constexpr int64_t kWorkerTimeoutNanos = 100 * kNanosPerMillisecond;
+// The FIFO holds this many blocks so that the worker has a whole block of time to render.
+constexpr int32_t kBlocksPerFifo = 2;
+
+CallbackBatcher::~CallbackBatcher() {
+    close();
+}
+
+int32_t CallbackBatcher::calculateFramesPerBatch(int32_t batchMillis,
+                                                 int32_t sampleRate,
+                                                 int32_t framesPerBurst) {
+    const int64_t frames = static_cast<int64_t>(batchMillis) * sampleRate / kMillisPerSecond;
+    if (framesPerBurst <= 0) {
+        return static_cast<int32_t>(frames);
+    }
+    const int64_t numBursts = (frames + framesPerBurst - 1) / framesPerBurst;
+    return static_cast<int32_t>(numBursts * framesPerBurst);
+}
+
+Result CallbackBatcher::open(int32_t framesPerBatch, StreamArena &arena) {
+    if (!arena.claim(StreamArena::Owner::CallbackBatcher)) {
+        LOGE("CallbackBatcher::%s() batching was already set up for this stream", __func__);
+        return Result::ErrorInvalidState;
+    }
+    const int32_t bytesPerFrame = mStream.getBytesPerFrame();
+    const int32_t capacityInFrames = kBlocksPerFifo * framesPerBatch;
+    uint8_t *fifoStorage = arena.allocateArray<uint8_t>(
+            static_cast<size_t>(capacityInFrames) * bytesPerFrame);
+    mBlock = arena.allocateArray<uint8_t>(static_cast<size_t>(framesPerBatch) * bytesPerFrame);
+    if (fifoStorage == nullptr || mBlock == nullptr) {
+        return Result::ErrorNoMemory;
+    }
+    mFifo = std::make_unique<FifoBuffer>(bytesPerFrame, capacityInFrames, fifoStorage);
+    mFramesPerBatch = framesPerBatch;
+    mIsOutput = mStream.getDirection() == Direction::Output;
+    try {
+        mWorker = std::thread(&CallbackBatcher::runWorker, this);
+    } catch (const std::system_error &e) {
+        LOGE("CallbackBatcher::%s() could not start the worker, %s", __func__, e.what());
+        return Result::ErrorInternal;
+    }
+    return Result::OK;
+}
+
+void CallbackBatcher::close() {
+    {
+        std::lock_guard<std::mutex> lock(mWorkerLock);
+        mClosing = true;
+    }
+    mWorkerSignal.notify(INT32_MAX);
+    if (mWorker.joinable()) {
+        mWorker.join();
+    }
+}
+
+void CallbackBatcher::start() {
+    {
+        // Waits for the worker to finish a block that it started before the stream stopped.
+        std::lock_guard<std::mutex> lock(mWorkerLock);
+        mFifo->setWriteCounter(mFifo->getReadCounter());
+        mCallbackResult = DataCallbackResult::Continue;
+        mStarted = true;
+    }
+    mWorkerSignal.notify(INT32_MAX); // render the first output block now
+}
+
+int32_t CallbackBatcher::getWorkerFramesAvailable() {
+    const uint32_t fullFrames = mFifo->getFullFramesAvailable();
+    return static_cast<int32_t>(mIsOutput
+            ? mFifo->getBufferCapacityInFrames() - fullFrames
+            : fullFrames);
+}
+
+DataCallbackResult CallbackBatcher::process(void *audioData, int32_t numFrames) {
+    if (mIsOutput) {
+        const int32_t framesRead = mFifo->read(audioData, numFrames);
+        if (framesRead < numFrames) {
+            // The worker is late or the app stopped. Play silence rather than old frames.
+            const int32_t bytesPerFrame = mStream.getBytesPerFrame();
+            memset(static_cast<uint8_t *>(audioData) + (framesRead * bytesPerFrame), 0,
+                   static_cast<size_t>(numFrames - framesRead) * bytesPerFrame);
+        }
+    } else {
+        mFifo->write(audioData, numFrames); // frames that do not fit are dropped
+    }
+    mWorkerSignal.notify(getWorkerFramesAvailable());
+    return mCallbackResult.load();
+}
+
+void CallbackBatcher::runWorker() {
+    if (!mStream.getHelperThreadPlacement().isDefault()) {
+        applyThreadPlacement(mStream.getHelperThreadPlacement());
+    }
+    while (true) {
+        mWorkerSignal.waitForFrames(mFramesPerBatch,
+                                    AudioClock::getNanoseconds() + kWorkerTimeoutNanos,
+                                    [this] { return getWorkerFramesAvailable(); });
+        std::lock_guard<std::mutex> lock(mWorkerLock);
+        if (mClosing) {
+            break;
+        }
+        // Keep going until the FIFO is full for output or empty for input.
+        while (mStarted
+                && mCallbackResult.load() == DataCallbackResult::Continue
+                && getWorkerFramesAvailable() >= mFramesPerBatch) {
+            if (!mIsOutput) {
+                mFifo->read(mBlock, mFramesPerBatch);
+            }
+            DataCallbackResult result = mStream.callDataCallback(mBlock, mFramesPerBatch);
+            if (result != DataCallbackResult::Continue) {
+                mCallbackResult = result; // returned by the next device callback
+                break;
+            }
+            if (mIsOutput) {
+                mFifo->write(mBlock, mFramesPerBatch);
+            }
+        }
+    }
+}
+
+} // namespace oboe
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_CALLBACK_BATCHER_H
+#define OBOE_CALLBACK_BATCHER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+#include "oboe/Definitions.h"
+#include "oboe/FifoBuffer.h"
+#include "FrameSignal.h"
+
+namespace oboe {
+
+class AudioStream;
+class StreamArena;
+
+/**
+ * Call the app with large blocks of frames, eg. 100 msec, instead of once per burst.
+ * This is used by PerformanceMode::PowerSaving streams so the app does its work less often.
+ *
+ * The app is called from a worker thread with normal priority, not from the device callback.
+ * A FIFO of two blocks sits between them. For output, the worker renders a block whenever
+ * there is room for one and the device callbacks only copy bursts out of the FIFO.
+ * For input, the device callbacks copy bursts into the FIFO and the worker passes a block
+ * to the app whenever one is full. So the time the app takes for a block is not limited
+ * by the deadline of a burst, and the device callbacks stay short.
+ *
+ * If the worker falls behind then output bursts are filled with silence and input
+ * bursts are dropped.
+ */
+class CallbackBatcher {
+public:
+    explicit CallbackBatcher(AudioStream &stream)
+            : mStream(stream) {}
+
+    virtual ~CallbackBatcher();
+
+    /**
+     * @param batchMillis requested duration of a block
+     * @param sampleRate frames per second
+     * @param framesPerBurst size of a device callback
+     * @return batchMillis rounded up to a whole number of bursts
+     */
+    static int32_t calculateFramesPerBatch(int32_t batchMillis,
+                                           int32_t sampleRate,
+                                           int32_t framesPerBurst);
+
+    /**
+     * Allocate the FIFO and the block and start the worker thread.
+     * The worker does not call the app until start() is called.
+     *
+     * @param framesPerBatch frames passed to each app callback
+     * @param arena memory for the FIFO and the block
+     * @return OK, Result::ErrorNoMemory or Result::ErrorInternal,
+     *         or Result::ErrorInvalidState if batching was already set up with this arena
+     */
+    Result open(int32_t framesPerBatch, StreamArena &arena);
+
+    /**
+     * Stop the worker thread. The app is not called after this returns.
+     */
+    void close();
+
+    /**
+     * Forget the frames and the callback result from before and start calling the app.
+     * Call this when the stream is started, while the device callbacks are not running.
+     */
+    void start();
+
+    int32_t getFramesPerBatch() const {
+        return mFramesPerBatch;
+    }
+
+    /**
+     * Pass audio from a device callback to or from the FIFO. This does not lock.
+     *
+     * @param audioData frames for the device
+     * @param numFrames number of frames in audioData
+     * @return Continue, or the result of the app callback if it was not Continue
+     */
+    DataCallbackResult process(void *audioData, int32_t numFrames);
+
+private:
+    void runWorker();
+    // @return frames the worker can process now, room for output or data for input
+    int32_t getWorkerFramesAvailable();
+
+    AudioStream                    &mStream;
+    int32_t                         mFramesPerBatch = 0;
+    bool                            mIsOutput = true;
+    std::unique_ptr<FifoBuffer>     mFifo; // storage in the arena
+    uint8_t                        *mBlock = nullptr; // from the arena, used by the worker
+
+    std::thread                     mWorker;
+    FrameSignal                     mWorkerSignal; // the worker waits for a block
+    std::mutex                      mWorkerLock; // held while the worker calls the app
+    bool                            mStarted = false; // protected by mWorkerLock
+    bool                            mClosing = false; // protected by mWorkerLock
+    std::atomic<DataCallbackResult> mCallbackResult{DataCallbackResult::Continue};
+};
+
+} // namespace oboe
+
+#endif //OBOE_CALLBACK_BATCHER_H
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_CALLBACK_TIMING_RECORDER_H
+#define OBOE_CALLBACK_TIMING_RECORDER_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "oboe/CallbackTimingStats.h"
+#include "oboe/Definitions.h"
+#include "oboe/TimeHistogram.h"
+#include "common/FrameCountHistogram.h"
+
+namespace oboe {
+
+/**
+ * Measure the timing of data callbacks.
+ *
+ * record() is called by the callback thread. It does not allocate or lock.
+ * The other methods may be called from any thread.
+ *
+ * The lateness window is a separate histogram with its own reset, for the LatencyTuner,
+ * so that the stats read by the app are not cleared by Oboe.
+ */
+class CallbackTimingRecorder {
+public:
+    /**
+     * @param startNanos CLOCK_MONOTONIC time when the callback was entered
+     * @param endNanos CLOCK_MONOTONIC time when the callback returned
+     * @param numFrames frames passed to the callback
+     * @param sampleRate rate of the frames
+     */
+    void record(int64_t startNanos, int64_t endNanos, int32_t numFrames, int32_t sampleRate) {
+        if (mResetRequested.exchange(false)) {
+            // Only this thread adds to the histograms so it is safe to clear them here.
+            mDurations.reset();
+            mIntervalJitter.reset();
+            mFramesPerCallback.reset();
+            mDeadlineOverrunCount.store(0, std::memory_order_relaxed);
+            mMinFramesPerCallback.store(0, std::memory_order_relaxed);
+            mPreviousStartNanos = 0;
+        }
+        if (mLatenessWindowResetRequested.exchange(false)) {
+            mLatenessWindow.reset();
+        }
+
+        const int64_t deadlineNanos = (sampleRate > 0)
+                ? (numFrames * kNanosPerSecond / sampleRate)
+                : 0;
+        const int64_t durationNanos = endNanos - startNanos;
+        mDurations.add(durationNanos);
+        if (durationNanos > deadlineNanos) {
+            mDeadlineOverrunCount.store(mDeadlineOverrunCount.load(std::memory_order_relaxed) + 1,
+                                        std::memory_order_relaxed);
+        }
+        int64_t jitterNanos = 0;
+        if (mPreviousStartNanos > 0) {
+            int64_t intervalNanos = startNanos - mPreviousStartNanos;
+            jitterNanos = llabs(intervalNanos - mPreviousDeadlineNanos);
+            mIntervalJitter.add(jitterNanos);
+        }
+        mLatenessWindow.add(jitterNanos + durationNanos);
+        mPreviousStartNanos = startNanos;
+        mPreviousDeadlineNanos = deadlineNanos;
+
+        mFramesPerCallback.addFrames(numFrames);
+        int32_t minFrames = mMinFramesPerCallback.load(std::memory_order_relaxed);
+        if (minFrames == 0 || numFrames < minFrames) {
+            mMinFramesPerCallback.store(numFrames, std::memory_order_relaxed);
+        }
+    }
+
+    CallbackTimingStats getStats() const {
+        CallbackTimingStats stats;
+        stats.callbackCount = mDurations.getCount();
+        stats.deadlineOverrunCount = mDeadlineOverrunCount.load(std::memory_order_relaxed);
+        stats.durationNanos = summarize(mDurations);
+        stats.intervalJitterNanos = summarize(mIntervalJitter);
+        stats.framesPerCallback = summarize(mFramesPerCallback);
+        stats.minFramesPerCallback = mMinFramesPerCallback.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    /**
+     * Clear the stats before the next callback is recorded.
+     */
+    void requestReset() {
+        mResetRequested.store(true);
+    }
+
+    /**
+     * @return lateness of the callbacks in the window, in nanoseconds
+     */
+    PercentileSummary getLatenessWindow() const {
+        return summarize(mLatenessWindow);
+    }
+
+    int64_t getLatenessWindowCount() const {
+        return mLatenessWindow.getCount();
+    }
+
+    /**
+     * Clear the lateness window before the next callback is recorded.
+     */
+    void requestLatenessWindowReset() {
+        mLatenessWindowResetRequested.store(true);
+    }
+
+private:
+    static PercentileSummary summarize(const TimeHistogram &histogram) {
+        PercentileSummary summary;
+        summary.p50 = histogram.getPercentileNanos(50.0);
+        summary.p90 = histogram.getPercentileNanos(90.0);
+        summary.p99 = histogram.getPercentileNanos(99.0);
+        summary.max = histogram.getMaxNanos();
+        return summary;
+    }
+
+    static PercentileSummary summarize(const FrameCountHistogram &histogram) {
+        PercentileSummary summary;
+        summary.p50 = histogram.getPercentileFrames(50.0);
+        summary.p90 = histogram.getPercentileFrames(90.0);
+        summary.p99 = histogram.getPercentileFrames(99.0);
+        summary.max = histogram.getMaxFrames();
+        return summary;
+    }
+
+    TimeHistogram        mDurations;
+    TimeHistogram        mIntervalJitter;
+    FrameCountHistogram  mFramesPerCallback;
+    std::atomic<int64_t> mDeadlineOverrunCount{0};
+    std::atomic<int32_t> mMinFramesPerCallback{0};
+    std::atomic<bool>    mResetRequested{false};
+    TimeHistogram        mLatenessWindow;
+    std::atomic<bool>    mLatenessWindowResetRequested{false};
+    // Only used by the callback thread.
+    int64_t              mPreviousStartNanos = 0;
+    int64_t              mPreviousDeadlineNanos = 0;
+};
+
+} // namespace oboe
+
+#endif //OBOE_CALLBACK_TIMING_RECORDER_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ChannelConverterI16.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace oboe;
+
+static void convertMonoToStereo(const int16_t *input, int16_t *output, int32_t numFrames) {
+    int32_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 8 <= numFrames; i += 8) {
+        int16x8x2_t stereo;
+        stereo.val[0] = vld1q_s16(input + i);
+        stereo.val[1] = stereo.val[0];
+        vst2q_s16(output + (2 * i), stereo); // interleaves the two copies
+    }
+#endif
+    for (; i < numFrames; i++) {
+        int16_t sample = input[i];
+        output[2 * i] = sample;
+        output[(2 * i) + 1] = sample;
+    }
+}
+
+static void convertStereoToMono(const int16_t *input, int16_t *output, int32_t numFrames) {
+    int32_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 8 <= numFrames; i += 8) {
+        int16x8x2_t stereo = vld2q_s16(input + (2 * i)); // deinterleave
+        vst1q_s16(output + i, stereo.val[0]);
+    }
+#endif
+    for (; i < numFrames; i++) {
+        output[i] = input[2 * i];
+    }
+}
+
+void ChannelConverterI16::convert(const int16_t *input, int16_t *output, int32_t numFrames) const {
+    if (mInputChannelCount == 1 && mOutputChannelCount == 2) {
+        convertMonoToStereo(input, output, numFrames);
+    } else if (mInputChannelCount == 2 && mOutputChannelCount == 1) {
+        convertStereoToMono(input, output, numFrames);
+    } else {
+        for (int32_t i = 0; i < numFrames; i++) {
+            for (int32_t outputChannel = 0; outputChannel < mOutputChannelCount; outputChannel++) {
+                // Wrap if we run out of inputs. Discard if we run out of outputs.
+                output[outputChannel] = input[outputChannel % mInputChannelCount];
+            }
+            input += mInputChannelCount;
+            output += mOutputChannelCount;
+        }
+    }
+}
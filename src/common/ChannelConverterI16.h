@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_CHANNEL_CONVERTER_I16_H
+#define OBOE_CHANNEL_CONVERTER_I16_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace oboe {
+
+/**
+ * Change the number of channels of interleaved 16-bit PCM without converting to float.
+ *
+ * This is used by DataConversionFlowGraph when only the channel count differs between
+ * an I16 app stream and an I16 device stream, eg. a mono app on a stereo-only MMAP device.
+ * The results are bit-exact with the float flowgraph path:
+ * When increasing the channel count, duplicate input channels.
+ * When decreasing the channel count, drop input channels.
+ */
+class ChannelConverterI16 {
+public:
+    ChannelConverterI16(int32_t inputChannelCount, int32_t outputChannelCount)
+            : mInputChannelCount(inputChannelCount)
+            , mOutputChannelCount(outputChannelCount) {}
+
+    /**
+     * @param input interleaved data with getInputChannelCount() channels
+     * @param output interleaved data with getOutputChannelCount() channels
+     * @param numFrames number of frames to convert
+     */
+    void convert(const int16_t *input, int16_t *output, int32_t numFrames) const;
+
+    int32_t getInputChannelCount() const {
+        return mInputChannelCount;
+    }
+
+    int32_t getOutputChannelCount() const {
+        return mOutputChannelCount;
+    }
+
+private:
+    const int32_t mInputChannelCount;
+    const int32_t mOutputChannelCount;
+};
+
+} // namespace oboe
+
+#endif //OBOE_CHANNEL_CONVERTER_I16_H
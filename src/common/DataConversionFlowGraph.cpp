@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <memory>
 
 #include "OboeDebug.h"
@@ -23,6 +24,7 @@
 #include "SourceI24Caller.h"
 #include "SourceI32Caller.h"
 
+#include <flowgraph/BiquadCascade.h>
 #include <flowgraph/ClipToRange.h>
 #include <flowgraph/MonoToMultiConverter.h>
 #include <flowgraph/MultiToMonoConverter.h>
@@ -41,8 +43,25 @@ using namespace oboe;
 using namespace flowgraph;
 using namespace resampler;
 
+// Process I16 channel conversion in larger blocks than the float flowgraph
+// because there is no per-node overhead.
+constexpr int32_t kChannelConverterI16BlockSize = 256; // arbitrary
+
 void DataConversionFlowGraph::setSource(const void *buffer, int32_t numFrames) {
-    mSource->setData(buffer, numFrames);
+    if (mChannelConverterI16) {
+        mSourceDataI16 = static_cast<const int16_t *>(buffer);
+        mSourceSizeInFramesI16 = numFrames;
+        mSourceFrameIndexI16 = 0;
+    } else {
+        mSource->setData(buffer, numFrames);
+    }
+}
+
+int32_t DataConversionFlowGraph::getSourceFramesRead() const {
+    if (mChannelConverterI16) {
+        return mSourceFrameIndexI16;
+    }
+    return mSource ? mSource->getFramesRead() : 0;
 }
 
 static MultiChannelResampler::Quality convertOboeSRQualityToMCR(SampleRateConversionQuality quality) {
@@ -61,6 +80,22 @@ static MultiChannelResampler::Quality convertOboeSRQualityToMCR(SampleRateConver
     }
 }
 
+static SampleRateConversionQuality convertMCRQualityToOboe(MultiChannelResampler::Quality quality) {
+    switch (quality) {
+        case MultiChannelResampler::Quality::Fastest:
+            return SampleRateConversionQuality::Fastest;
+        case MultiChannelResampler::Quality::Low:
+            return SampleRateConversionQuality::Low;
+        default:
+        case MultiChannelResampler::Quality::Medium:
+            return SampleRateConversionQuality::Medium;
+        case MultiChannelResampler::Quality::High:
+            return SampleRateConversionQuality::High;
+        case MultiChannelResampler::Quality::Best:
+            return SampleRateConversionQuality::Best;
+    }
+}
+
 // Chain together multiple processors.
 // Callback Output
 //     Use SourceCaller that calls original app callback from the flowgraph.
@@ -76,6 +111,11 @@ static MultiChannelResampler::Quality convertOboeSRQualityToMCR(SampleRateConver
 //     A SourceCaller then does a blocking read from the child Stream.
 //
 Result DataConversionFlowGraph::configure(AudioStream *sourceStream, AudioStream *sinkStream) {
+    // The buffers of the flowgraph are never freed so it can only be configured once.
+    if (!mArena.claim(StreamArena::Owner::FlowGraph)) {
+        LOGE("%s() the flowgraph was already configured", __func__);
+        return Result::ErrorInvalidState;
+    }
 
     FlowGraphPortFloatOutput *lastOutput = nullptr;
 
@@ -102,6 +142,18 @@ Result DataConversionFlowGraph::configure(AudioStream *sourceStream, AudioStream
             sourceFramesPerCallback, sinkFramesPerCallback,
             sourceStream->getSampleRateConversionQuality());
 
+    // If only the channel count differs between I16 streams then skip the float flowgraph
+    // and duplicate or drop the 16-bit samples directly.
+    const int32_t biquadStageCount = mFilterStream->getBiquadFilterStageCount();
+    bool isChannelConversionOnlyI16 = sourceFormat == AudioFormat::I16
+            && sinkFormat == AudioFormat::I16
+            && sourceSampleRate == sinkSampleRate
+            && sourceChannelCount != sinkChannelCount
+            && biquadStageCount == 0;
+    mAppBufferSizeInFrames = isChannelConversionOnlyI16
+            ? kChannelConverterI16BlockSize
+            : flowgraph::kDefaultBufferSize;
+
     // Source
     // IF OUTPUT and using a callback then call back to the app using a SourceCaller.
     // OR IF INPUT and NOT using a callback then read from the child stream using a SourceCaller.
@@ -114,24 +166,31 @@ Result DataConversionFlowGraph::configure(AudioStream *sourceStream, AudioStream
         switch (sourceFormat) {
             case AudioFormat::Float:
                 mSourceCaller = std::make_unique<SourceFloatCaller>(sourceChannelCount,
-                                                                    actualSourceFramesPerCallback);
+                                                                    actualSourceFramesPerCallback,
+                                                                    mArena);
                 break;
             case AudioFormat::I16:
                 mSourceCaller = std::make_unique<SourceI16Caller>(sourceChannelCount,
-                                                                  actualSourceFramesPerCallback);
+                                                                  actualSourceFramesPerCallback,
+                                                                  mArena);
                 break;
             case AudioFormat::I24:
                 mSourceCaller = std::make_unique<SourceI24Caller>(sourceChannelCount,
-                                                                  actualSourceFramesPerCallback);
+                                                                  actualSourceFramesPerCallback,
+                                                                  mArena);
                 break;
             case AudioFormat::I32:
                 mSourceCaller = std::make_unique<SourceI32Caller>(sourceChannelCount,
-                                                                  actualSourceFramesPerCallback);
+                                                                  actualSourceFramesPerCallback,
+                                                                  mArena);
                 break;
             default:
                 LOGE("%s() Unsupported source caller format = %d", __func__, sourceFormat);
                 return Result::ErrorIllegalArgument;
         }
+        if (!mSourceCaller->isAllocated()) {
+            return Result::ErrorNoMemory;
+        }
         mSourceCaller->setStream(sourceStream);
         lastOutput = &mSourceCaller->output;
     } else {
@@ -159,13 +218,40 @@ Result DataConversionFlowGraph::configure(AudioStream *sourceStream, AudioStream
                     ? sinkStream->getFramesPerBurst()
                     : sinkFramesPerCallback;
             // The BlockWriter is after the Sink so use the SinkStream size.
-            mBlockWriter.open(actualSinkFramesPerCallback * sinkStream->getBytesPerFrame());
-            mAppBuffer = std::make_unique<uint8_t[]>(
-                    kDefaultBufferSize * sinkStream->getBytesPerFrame());
+            mBlockWriter.setArena(&mArena);
+            if (mBlockWriter.open(actualSinkFramesPerCallback
+                    * sinkStream->getBytesPerFrame()) < 0) {
+                return Result::ErrorNoMemory;
+            }
+            mAppBuffer = mArena.allocateArray<uint8_t>(
+                    mAppBufferSizeInFrames * sinkStream->getBytesPerFrame());
+            if (mAppBuffer == nullptr) {
+                return Result::ErrorNoMemory;
+            }
         }
         lastOutput = &mSource->output;
     }
 
+    if (isChannelConversionOnlyI16) {
+        LOGI("%s() convert I16 channels without float", __func__);
+        mChannelConverterI16 = std::make_unique<ChannelConverterI16>(sourceChannelCount,
+                                                                     sinkChannelCount);
+        if (mSourceCaller) {
+            mSourceBufferI16 = mArena.allocateArray<int16_t>(
+                    kChannelConverterI16BlockSize * sourceChannelCount);
+            if (mSourceBufferI16 == nullptr) {
+                return Result::ErrorNoMemory;
+            }
+        }
+        return Result::OK;
+    }
+
+    // The filter runs at the rate and channel count of the app, so that the app can calculate
+    // the coefficients for its own data. The app is the source for output.
+    if (biquadStageCount > 0 && isOutput) {
+        addBiquadCascade(lastOutput, sourceSampleRate);
+    }
+
     // If we are going to reduce the number of channels then do it before the
     // sample rate converter.
     if (sourceChannelCount > sinkChannelCount) {
@@ -183,7 +269,17 @@ Result DataConversionFlowGraph::configure(AudioStream *sourceStream, AudioStream
     }
 
     // Sample Rate conversion
-    if (sourceSampleRate != sinkSampleRate) {
+    if (sourceSampleRate != sinkSampleRate
+            && sourceStream->getSampleRateConversionQuality() == SampleRateConversionQuality::Auto) {
+        // Measure the cost and pick the quality while running.
+        mAutoRateConverter = std::make_unique<AutoSampleRateConverter>(
+                lastOutput->getSamplesPerFrame(),
+                sourceSampleRate,
+                sinkSampleRate,
+                sourceStream->getSampleRateConversionCpuBudget());
+        lastOutput->connect(&mAutoRateConverter->input);
+        lastOutput = &mAutoRateConverter->output;
+    } else if (sourceSampleRate != sinkSampleRate) {
         // Create a resampler to do the math.
         mResampler.reset(MultiChannelResampler::make(lastOutput->getSamplesPerFrame(),
                                                      sourceSampleRate,
@@ -212,6 +308,11 @@ Result DataConversionFlowGraph::configure(AudioStream *sourceStream, AudioStream
         }
     }
 
+    // The app is the sink for input.
+    if (biquadStageCount > 0 && isInput) {
+        addBiquadCascade(lastOutput, sinkSampleRate);
+    }
+
     // Sink
     switch (sinkFormat) {
         case AudioFormat::Float:
@@ -235,24 +336,133 @@ Result DataConversionFlowGraph::configure(AudioStream *sourceStream, AudioStream
     return Result::OK;
 }
 
+void DataConversionFlowGraph::addBiquadCascade(FlowGraphPortFloatOutput *&lastOutput,
+                                               int32_t sampleRate) {
+    mBiquadCascade = std::make_unique<BiquadCascade>(lastOutput->getSamplesPerFrame(),
+                                                     mFilterStream->getBiquadFilterStageCount(),
+                                                     sampleRate);
+    lastOutput->connect(&mBiquadCascade->input);
+    lastOutput = &mBiquadCascade->output;
+}
+
+Result DataConversionFlowGraph::setBiquadFilterCoefficients(
+        int32_t stage,
+        const BiquadFilterCoefficients &coefficients) {
+    if (!mBiquadCascade) {
+        return Result::ErrorInvalidState;
+    }
+    if (stage < 0 || stage >= mBiquadCascade->getNumStages()) {
+        return Result::ErrorOutOfRange;
+    }
+    BiquadCoefficients flowGraphCoefficients;
+    flowGraphCoefficients.b0 = coefficients.b0;
+    flowGraphCoefficients.b1 = coefficients.b1;
+    flowGraphCoefficients.b2 = coefficients.b2;
+    flowGraphCoefficients.a1 = coefficients.a1;
+    flowGraphCoefficients.a2 = coefficients.a2;
+    std::lock_guard<std::mutex> lock(mBiquadCoefficientsLock);
+    mBiquadCascade->setCoefficients(stage, flowGraphCoefficients);
+    return Result::OK;
+}
+
+void DataConversionFlowGraph::collectMemoryRegions(MemoryRegions &regions) {
+    auto addOutput = [&regions](FlowGraphPortFloatOutput &port) {
+        regions.add(port.getBuffer(), sizeof(float)
+                * static_cast<size_t>(port.getFramesPerBuffer())
+                * static_cast<size_t>(port.getSamplesPerFrame()));
+    };
+    if (mSourceCaller) {
+        mSourceCaller->collectMemoryRegions(regions);
+    }
+    if (mSource) {
+        addOutput(mSource->output);
+    }
+    if (mMonoToMultiConverter) {
+        addOutput(mMonoToMultiConverter->output);
+    }
+    if (mMultiToMonoConverter) {
+        addOutput(mMultiToMonoConverter->output);
+    }
+    if (mChannelCountConverter) {
+        addOutput(mChannelCountConverter->output);
+    }
+    if (mRateConverter) {
+        addOutput(mRateConverter->output);
+    }
+    if (mBiquadCascade) {
+        addOutput(mBiquadCascade->output);
+    }
+    if (mResampler) {
+        mResampler->forEachBuffer([&regions](const void *address, size_t numBytes) {
+            regions.add(address, numBytes);
+        });
+    }
+    if (mAutoRateConverter) {
+        mAutoRateConverter->collectMemoryRegions(regions);
+    }
+}
+
+SampleRateConversionQuality DataConversionFlowGraph::getActiveSampleRateConversionQuality() const {
+    if (mAutoRateConverter) {
+        return convertMCRQualityToOboe(mAutoRateConverter->getQuality());
+    } else if (mResampler) {
+        return mFilterStream->getSampleRateConversionQuality();
+    }
+    return SampleRateConversionQuality::None;
+}
+
 int32_t DataConversionFlowGraph::read(void *buffer, int32_t numFrames, int64_t timeoutNanos) {
     if (mSourceCaller) {
         mSourceCaller->setTimeoutNanos(timeoutNanos);
     }
+    if (mChannelConverterI16) {
+        return readChannelConvertedI16(static_cast<int16_t *>(buffer), numFrames);
+    }
     int32_t numRead = mSink->read(buffer, numFrames);
     return numRead;
 }
 
+int32_t DataConversionFlowGraph::readChannelConvertedI16(int16_t *buffer, int32_t numFrames) {
+    const int32_t sourceChannelCount = mChannelConverterI16->getInputChannelCount();
+    const int32_t sinkChannelCount = mChannelConverterI16->getOutputChannelCount();
+    int32_t framesLeft = numFrames;
+    while (framesLeft > 0) {
+        const int16_t *sourceData;
+        int32_t framesRead;
+        if (mSourceCaller) {
+            // Call the app or read from the child stream.
+            sourceData = mSourceBufferI16;
+            framesRead = mSourceCaller->readFrames(mSourceBufferI16,
+                    std::min(framesLeft, kChannelConverterI16BlockSize));
+        } else {
+            // Convert in place from the buffer passed to setSource().
+            sourceData = &mSourceDataI16[mSourceFrameIndexI16 * sourceChannelCount];
+            framesRead = std::min(framesLeft, mSourceSizeInFramesI16 - mSourceFrameIndexI16);
+            mSourceFrameIndexI16 += std::max(0, framesRead);
+        }
+        if (framesRead <= 0) {
+            break;
+        }
+        mChannelConverterI16->convert(sourceData, buffer, framesRead);
+        buffer += framesRead * sinkChannelCount;
+        framesLeft -= framesRead;
+    }
+    return numFrames - framesLeft;
+}
+
 // This is similar to pushing data through the flowgraph.
 int32_t DataConversionFlowGraph::write(void *inputBuffer, int32_t numFrames) {
     // Put the data from the input at the head of the flowgraph.
-    mSource->setData(inputBuffer, numFrames);
+    setSource(inputBuffer, numFrames);
     while (true) {
         // Pull and read some data in app format into a small buffer.
-        int32_t framesRead = mSink->read(mAppBuffer.get(), flowgraph::kDefaultBufferSize);
+        int32_t framesRead = mChannelConverterI16
+                ? readChannelConvertedI16(reinterpret_cast<int16_t *>(mAppBuffer),
+                                          mAppBufferSizeInFrames)
+                : mSink->read(mAppBuffer, mAppBufferSizeInFrames);
         if (framesRead <= 0) break;
         // Write to a block adapter, which will call the destination whenever it has enough data.
-        int32_t bytesRead = mBlockWriter.write(mAppBuffer.get(),
+        int32_t bytesRead = mBlockWriter.write(mAppBuffer,
                                                framesRead * mFilterStream->getBytesPerFrame());
         if (bytesRead < 0) return bytesRead; // TODO review
     }
@@ -261,7 +471,7 @@ int32_t DataConversionFlowGraph::write(void *inputBuffer, int32_t numFrames) {
 
 int32_t DataConversionFlowGraph::onProcessFixedBlock(uint8_t *buffer, int32_t numBytes) {
     int32_t numFrames = numBytes / mFilterStream->getBytesPerFrame();
-    mCallbackResult = mFilterStream->getDataCallback()->onAudioReady(mFilterStream, buffer, numFrames);
+    mCallbackResult = mFilterStream->callDataCallback(buffer, numFrames);
     // TODO handle STOP from callback, process data remaining in the block adapter
     return numBytes;
 }
@@ -18,16 +18,23 @@
 #define OBOE_OBOE_FLOW_GRAPH_H
 
 #include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <flowgraph/BiquadCascade.h>
 #include <flowgraph/ChannelCountConverter.h>
 #include <flowgraph/MonoToMultiConverter.h>
 #include <flowgraph/MultiToMonoConverter.h>
 #include <flowgraph/SampleRateConverter.h>
+#include <oboe/BiquadFilter.h>
 #include <oboe/Definitions.h>
 #include "AudioSourceCaller.h"
+#include "AutoSampleRateConverter.h"
+#include "ChannelConverterI16.h"
 #include "FixedBlockWriter.h"
+#include "MemoryRegions.h"
+#include "StreamArena.h"
 
 namespace oboe {
 
@@ -40,19 +47,29 @@ class AudioSourceCaller;
 class DataConversionFlowGraph : public FixedBlockProcessor {
 public:
 
-    DataConversionFlowGraph()
-    : mBlockWriter(*this) {}
+    /**
+     * @param arena memory for the conversion buffers, which must outlive the flowgraph
+     */
+    explicit DataConversionFlowGraph(StreamArena &arena)
+    : mArena(arena)
+    , mBlockWriter(*this) {}
 
     void setSource(const void *buffer, int32_t numFrames);
 
+    /**
+     * @return number of frames taken from the buffer passed to setSource()
+     */
+    int32_t getSourceFramesRead() const;
+
     /** Connect several modules together to convert from source to sink.
      * This should only be called once for each instance.
+     * Its buffers come from the arena, which never frees them, so a second call fails.
      *
      * @param sourceFormat
      * @param sourceChannelCount
      * @param sinkFormat
      * @param sinkChannelCount
-     * @return
+     * @return Result::ErrorInvalidState if it was already configured
      */
     oboe::Result configure(oboe::AudioStream *sourceStream, oboe::AudioStream *sinkStream);
 
@@ -66,7 +83,36 @@ public:
         return mCallbackResult;
     }
 
+    /**
+     * This may be called from any thread.
+     *
+     * @return quality of the resampler in use, or None if the rate is not converted
+     */
+    SampleRateConversionQuality getActiveSampleRateConversionQuality() const;
+
+    /**
+     * Change one stage of the filter that was added for
+     * AudioStreamBuilder::setBiquadFilterStageCount(). Called by the app.
+     *
+     * @return OK, ErrorInvalidState if there is no filter, or ErrorOutOfRange
+     */
+    Result setBiquadFilterCoefficients(int32_t stage, const BiquadFilterCoefficients &coefficients);
+
+    /**
+     * Add the buffers used while converting data that are not in the arena.
+     */
+    void collectMemoryRegions(MemoryRegions &regions);
+
 private:
+    /**
+     * Read from the source and convert the channel count directly in the I16 domain.
+     * Used instead of the float flowgraph when only the channel count differs.
+     */
+    int32_t readChannelConvertedI16(int16_t *buffer, int32_t numFrames);
+
+    void addBiquadCascade(flowgraph::FlowGraphPortFloatOutput *&lastOutput, int32_t sampleRate);
+
+    StreamArena                                       &mArena;
     std::unique_ptr<flowgraph::FlowGraphSourceBuffered>    mSource;
     std::unique_ptr<AudioSourceCaller>                 mSourceCaller;
     std::unique_ptr<flowgraph::MonoToMultiConverter>   mMonoToMultiConverter;
@@ -74,12 +120,23 @@ private:
     std::unique_ptr<flowgraph::ChannelCountConverter>  mChannelCountConverter;
     std::unique_ptr<resampler::MultiChannelResampler>  mResampler;
     std::unique_ptr<flowgraph::SampleRateConverter>    mRateConverter;
+    std::unique_ptr<AutoSampleRateConverter>           mAutoRateConverter; // instead of mRateConverter
+    std::unique_ptr<flowgraph::BiquadCascade>          mBiquadCascade;
+    std::mutex                                         mBiquadCoefficientsLock; // one writer at a time
     std::unique_ptr<flowgraph::FlowGraphSink>              mSink;
 
+    // Only used when converting I16 channel counts without a float flowgraph.
+    std::unique_ptr<ChannelConverterI16>               mChannelConverterI16;
+    int16_t                                           *mSourceBufferI16 = nullptr;
+    const int16_t                                     *mSourceDataI16 = nullptr;
+    int32_t                                            mSourceSizeInFramesI16 = 0;
+    int32_t                                            mSourceFrameIndexI16 = 0;
+
     FixedBlockWriter                                   mBlockWriter;
     DataCallbackResult                                 mCallbackResult = DataCallbackResult::Continue;
     AudioStream                                       *mFilterStream = nullptr;
-    std::unique_ptr<uint8_t[]>                         mAppBuffer;
+    uint8_t                                           *mAppBuffer = nullptr;
+    int32_t                                            mAppBufferSizeInFrames = 0;
 };
 
 }
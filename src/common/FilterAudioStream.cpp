@@ -14,10 +14,12 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <memory>
 
 #include "OboeDebug.h"
 #include "FilterAudioStream.h"
+#include "MemoryRegions.h"
 
 using namespace oboe;
 using namespace flowgraph;
@@ -42,7 +44,11 @@ using namespace flowgraph;
 //                <= app
 
 Result FilterAudioStream::configureFlowGraph() {
-    mFlowGraph = std::make_unique<DataConversionFlowGraph>();
+    // Keep the flowgraph that is running. Its buffers cannot be allocated again.
+    if (mFlowGraph) {
+        return Result::ErrorInvalidState;
+    }
+    mFlowGraph = std::make_unique<DataConversionFlowGraph>(getArena());
     bool isOutput = getDirection() == Direction::Output;
 
     AudioStream *sourceStream =  isOutput ? this : mChildStream.get();
@@ -50,19 +56,50 @@ Result FilterAudioStream::configureFlowGraph() {
 
     mRateScaler = ((double) getSampleRate()) / mChildStream->getSampleRate();
 
+    // The blocking buffer is allocated by the constructor, which cannot fail.
+    if (!isDataCallbackSpecified() && mBlockingBuffer == nullptr) {
+        return Result::ErrorNoMemory;
+    }
+
     return mFlowGraph->configure(sourceStream, sinkStream);
 }
 
+void FilterAudioStream::collectMemoryRegions(MemoryRegions &regions) {
+    if (mFlowGraph) {
+        mFlowGraph->collectMemoryRegions(regions);
+    }
+    AudioStream::collectMemoryRegions(regions);
+}
+
 // Put the data to be written at the source end of the flowgraph.
 // Then read (pull) the data from the flowgraph and write it to the
 // child stream.
 ResultWithValue<int32_t> FilterAudioStream::write(const void *buffer,
                                int32_t numFrames,
                                int64_t timeoutNanoseconds) {
-    int32_t framesWritten = 0;
+    // Finish writing the frames that were converted by an earlier call.
+    if (mBlockingBufferFrames > 0) {
+        auto writeResult = writeBlockingBuffer(timeoutNanoseconds);
+        if (!writeResult) {
+            return writeResult;
+        }
+        if (mBlockingBufferFrames > 0) {
+            return ResultWithValue<int32_t>(0); // no room for any of the new frames
+        }
+    }
+    if (timeoutNanoseconds == 0) {
+        // Only convert what the child can take now so that few frames are left over.
+        // Leave a frame of margin for the phase of the resampler.
+        auto childFrames = mChildStream->getAvailableFrames();
+        if (childFrames) {
+            const int32_t childEmpty = mChildStream->getBufferSizeInFrames() - childFrames.value();
+            const int32_t framesThatFit = static_cast<int32_t>((childEmpty - 1) * mRateScaler);
+            numFrames = std::max(0, std::min(numFrames, framesThatFit));
+        }
+    }
     mFlowGraph->setSource(buffer, numFrames);
     while (true) {
-        int32_t numRead = mFlowGraph->read(mBlockingBuffer.get(),
+        int32_t numRead = mFlowGraph->read(mBlockingBuffer,
                 getFramesPerBurst(),
                 timeoutNanoseconds);
         if (numRead < 0) {
@@ -71,15 +108,32 @@ ResultWithValue<int32_t> FilterAudioStream::write(const void *buffer,
         if (numRead == 0) {
             break; // finished processing the source buffer
         }
-        auto writeResult = mChildStream->write(mBlockingBuffer.get(),
-                                               numRead,
-                                               timeoutNanoseconds);
+        mBlockingBufferIndex = 0;
+        mBlockingBufferFrames = numRead;
+        auto writeResult = writeBlockingBuffer(timeoutNanoseconds);
         if (!writeResult) {
             return writeResult;
         }
-        framesWritten += writeResult.value();
+        if (mBlockingBufferFrames > 0) {
+            // Timed out. The source frames that were converted cannot be converted again,
+            // so keep the rest of the block for the next call and report them as written.
+            return ResultWithValue<int32_t>(mFlowGraph->getSourceFramesRead());
+        }
+    }
+    // All of the frames were converted and written.
+    return ResultWithValue<int32_t>(numFrames);
+}
+
+ResultWithValue<int32_t> FilterAudioStream::writeBlockingBuffer(int64_t timeoutNanoseconds) {
+    const int32_t bytesPerFrame = mChildStream->getBytesPerFrame();
+    auto writeResult = mChildStream->write(mBlockingBuffer + (mBlockingBufferIndex * bytesPerFrame),
+                                           mBlockingBufferFrames,
+                                           timeoutNanoseconds);
+    if (writeResult) {
+        mBlockingBufferIndex += writeResult.value();
+        mBlockingBufferFrames -= writeResult.value();
     }
-    return ResultWithValue<int32_t>::createBasedOnSign(framesWritten);
+    return writeResult;
 }
 
 // Read (pull) the data we want from the sink end of the flowgraph.
@@ -49,7 +49,9 @@ public:
             mDataCallback = mChildStream->swapDataCallback(this);
         } else {
             const int size = childStream->getFramesPerBurst() * childStream->getBytesPerFrame();
-            mBlockingBuffer = std::make_unique<uint8_t[]>(size);
+            mBlockingBuffer = getArena().allocateArray<uint8_t>(size);
+            // The FIFO of the child tells when an async read or write of this stream can go on.
+            mChildStream->setAsyncTransferOwner(this);
         }
 
         // Copy parameters that may not match builder.
@@ -70,6 +72,8 @@ public:
 
     // Close child and parent.
     Result close()  override {
+        // A pending write() or read() may still be using the child.
+        cancelAsyncTransfer();
         const Result result1 = mChildStream->close();
         const Result result2 = AudioStream::close();
         return (result1 != Result::OK ? result1 : result2);
@@ -161,6 +165,69 @@ public:
         return mChildStream->getXRunCount();
     }
 
+    ResultWithValue<int64_t> getDiscardedFrameCount() override {
+        return mChildStream->getDiscardedFrameCount();
+    }
+
+    const TimeHistogram *getFifoResidencyHistogram() const override {
+        return mChildStream->getFifoResidencyHistogram();
+    }
+
+    ResultWithValue<OfflineRenderStats> getOfflineRenderStats() override {
+        return mChildStream->getOfflineRenderStats();
+    }
+
+    ResultWithValue<CallbackTimingStats> getCallbackTimingStats() override {
+        return mChildStream->getCallbackTimingStats();
+    }
+
+    Result resetCallbackTimingStats() override {
+        return mChildStream->resetCallbackTimingStats();
+    }
+
+    ResultWithValue<PercentileSummary> getCallbackLatenessWindow() override {
+        return mChildStream->getCallbackLatenessWindow();
+    }
+
+    Result resetCallbackLatenessWindow() override {
+        return mChildStream->resetCallbackLatenessWindow();
+    }
+
+    ResultWithValue<EffectiveThreadPlacement> getEffectiveCallbackThreadPlacement() override {
+        return mChildStream->getEffectiveCallbackThreadPlacement();
+    }
+
+    // Include the memory locked by the child stream when it was opened.
+    ResultWithValue<int64_t> getLockedMemoryBytes() override {
+        ResultWithValue<int64_t> childBytes = mChildStream->getLockedMemoryBytes();
+        ResultWithValue<int64_t> parentBytes = AudioStream::getLockedMemoryBytes();
+        if (!childBytes || !parentBytes) {
+            return childBytes ? parentBytes : childBytes;
+        }
+        return ResultWithValue<int64_t>(childBytes.value() + parentBytes.value());
+    }
+
+    int64_t getArenaSizeInBytes() const override {
+        return mChildStream->getArenaSizeInBytes() + AudioStream::getArenaSizeInBytes();
+    }
+
+    // The child stream batches the device callbacks. Then the flowgraph calls the app
+    // with blocks of the same duration at the rate of this stream.
+    int32_t getFramesPerCallbackBatch() const override {
+        return (mChildStream->getFramesPerCallbackBatch() > 0) ? getFramesPerDataCallback() : 0;
+    }
+
+    SampleRateConversionQuality getActiveSampleRateConversionQuality() override {
+        return mFlowGraph ? mFlowGraph->getActiveSampleRateConversionQuality()
+                : SampleRateConversionQuality::None;
+    }
+
+    Result setBiquadFilterCoefficients(int32_t stage,
+                                       const BiquadFilterCoefficients &coefficients) override {
+        return mFlowGraph ? mFlowGraph->setBiquadFilterCoefficients(stage, coefficients)
+                : Result::ErrorInvalidState;
+    }
+
     ResultWithValue<double> calculateLatencyMillis() override {
         // This will automatically include the latency of the flowgraph?
         return mChildStream->calculateLatencyMillis();
@@ -190,6 +257,7 @@ public:
     }
 
     void onErrorBeforeClose(AudioStream * /*oboeStream*/, Result error) override {
+        cancelAsyncTransfer(); // before the child is closed
         if (mErrorCallback != nullptr) {
             mErrorCallback->onErrorBeforeClose(this, error);
         }
@@ -210,11 +278,22 @@ public:
         return mChildStream->getLastErrorCallbackResult();
     }
 
+protected:
+
+    // The child stream collected its own memory when it was opened.
+    void collectMemoryRegions(MemoryRegions &regions) override;
+
 private:
 
+    // Write the frames left in mBlockingBuffer to the child stream.
+    ResultWithValue<int32_t> writeBlockingBuffer(int64_t timeoutNanoseconds);
+
     std::unique_ptr<AudioStream>             mChildStream; // this stream wraps the child stream
     std::unique_ptr<DataConversionFlowGraph> mFlowGraph; // for converting data
-    std::unique_ptr<uint8_t[]>               mBlockingBuffer; // temp buffer for write()
+    uint8_t                                 *mBlockingBuffer = nullptr; // from the arena, for write()
+    // Converted frames in mBlockingBuffer that the child stream has not taken yet.
+    int32_t                                  mBlockingBufferIndex = 0;
+    int32_t                                  mBlockingBufferFrames = 0;
     double                                   mRateScaler = 1.0; // ratio parent/child sample rates
 };
 
@@ -17,6 +17,7 @@
 #include <stdint.h>
 
 #include "FixedBlockAdapter.h"
+#include "StreamArena.h"
 
 FixedBlockAdapter::~FixedBlockAdapter() {
 }
@@ -24,14 +25,20 @@ FixedBlockAdapter::~FixedBlockAdapter() {
 int32_t FixedBlockAdapter::open(int32_t bytesPerFixedBlock)
 {
     mSize = bytesPerFixedBlock;
-    mStorage = std::make_unique<uint8_t[]>(bytesPerFixedBlock);
+    if (mArena != nullptr) {
+        mStorage = mArena->allocateArray<uint8_t>(bytesPerFixedBlock);
+    } else {
+        mOwnedStorage = std::make_unique<uint8_t[]>(bytesPerFixedBlock);
+        mStorage = mOwnedStorage.get();
+    }
     mPosition = 0;
-    return 0;
+    return (mStorage != nullptr) ? 0 : -1;
 }
 
 int32_t FixedBlockAdapter::close()
 {
-    mStorage.reset(nullptr);
+    mOwnedStorage.reset(nullptr);
+    mStorage = nullptr;
     mSize = 0;
     mPosition = 0;
     return 0;
@@ -21,6 +21,10 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+namespace oboe {
+class StreamArena;
+}
+
 /**
  * Interface for a class that needs fixed-size blocks.
  */
@@ -57,9 +61,19 @@ public:
      */
     int32_t close();
 
+    /**
+     * Allocate the internal buffer from an arena instead of the heap.
+     * Call this before open(). The buffer is freed with the arena.
+     */
+    void setArena(oboe::StreamArena *arena) {
+        mArena = arena;
+    }
+
 protected:
     FixedBlockProcessor  &mFixedBlockProcessor;
-    std::unique_ptr<uint8_t[]> mStorage;       // Store data here while assembling buffers.
+    uint8_t              *mStorage = nullptr;  // Store data here while assembling buffers.
+    std::unique_ptr<uint8_t[]> mOwnedStorage;  // Only used if there is no arena.
+    oboe::StreamArena    *mArena = nullptr;
     int32_t               mSize = 0;           // Size in bytes of the fixed size buffer.
     int32_t               mPosition = 0;       // Offset of the last byte read or written.
 };
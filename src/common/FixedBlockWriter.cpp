@@ -30,7 +30,7 @@ int32_t FixedBlockWriter::writeToStorage(uint8_t *buffer, int32_t numBytes) {
     if (bytesToStore > roomAvailable) {
         bytesToStore = roomAvailable;
     }
-    memcpy(mStorage.get() + mPosition, buffer, bytesToStore);
+    memcpy(mStorage + mPosition, buffer, bytesToStore);
     mPosition += bytesToStore;
     return bytesToStore;
 }
@@ -45,7 +45,7 @@ int32_t FixedBlockWriter::write(uint8_t *buffer, int32_t numBytes) {
         bytesLeft -= bytesWritten;
         // If storage full then flush it out
         if (mPosition == mSize) {
-            bytesWritten = mFixedBlockProcessor.onProcessFixedBlock(mStorage.get(), mSize);
+            bytesWritten = mFixedBlockProcessor.onProcessFixedBlock(mStorage, mSize);
             if (bytesWritten < 0) return bytesWritten;
             mPosition = 0;
             if (bytesWritten < mSize) {
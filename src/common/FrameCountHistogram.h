@@ -0,0 +1,87 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_FRAME_COUNT_HISTOGRAM_H
+#define OBOE_FRAME_COUNT_HISTOGRAM_H
+
+#include <stdint.h>
+
+#include "oboe/Definitions.h"
+#include "oboe/TimeHistogram.h"
+
+namespace oboe {
+
+/**
+ * A histogram of frame counts, for example the frames passed to each callback.
+ *
+ * It has the same bins and threading rules as TimeHistogram, which holds the counts.
+ * The conversion between frames and the time units of TimeHistogram is kept in here,
+ * so callers only see frames. Counts up to about 100 million frames are binned.
+ */
+class FrameCountHistogram {
+public:
+    /**
+     * Count one frame count.
+     *
+     * @param frames negative values are counted as zero
+     */
+    void addFrames(int32_t frames) {
+        mHistogram.add(frames * kNanosPerFrame);
+    }
+
+    /**
+     * @return number of frame counts added
+     */
+    int64_t getCount() const {
+        return mHistogram.getCount();
+    }
+
+    /**
+     * @param percentile between 0.0 and 100.0
+     * @return upper edge of the bin holding the percentile in frames, or 0 if empty
+     */
+    int32_t getPercentileFrames(double percentile) const {
+        return toFrames(mHistogram.getPercentileNanos(percentile));
+    }
+
+    /**
+     * @return the largest frame count added
+     */
+    int32_t getMaxFrames() const {
+        return toFrames(mHistogram.getMaxNanos());
+    }
+
+    /**
+     * Clear the histogram. This must not be called while another thread is calling addFrames().
+     */
+    void reset() {
+        mHistogram.reset();
+    }
+
+private:
+    // One frame is stored as one microsecond, the resolution of TimeHistogram.
+    static constexpr int64_t kNanosPerFrame = kNanosPerMicrosecond;
+
+    static int32_t toFrames(int64_t nanoseconds) {
+        return static_cast<int32_t>(nanoseconds / kNanosPerFrame);
+    }
+
+    TimeHistogram mHistogram;
+};
+
+} // namespace oboe
+
+#endif //OBOE_FRAME_COUNT_HISTOGRAM_H
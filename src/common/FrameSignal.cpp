@@ -0,0 +1,48 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FrameSignal.h"
+
+namespace oboe {
+
+// The kernel operates on the address of a plain 32-bit integer.
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex word must be 32 bits");
+
+void FrameSignal::waitForSequenceChange(uint32_t sequence, int64_t deadlineNanos) {
+    struct timespec deadline;
+    deadline.tv_sec = deadlineNanos / kNanosPerSecond;
+    deadline.tv_nsec = deadlineNanos - (deadline.tv_sec * kNanosPerSecond);
+    // INT64_MAX does not fit in a 32-bit time_t, so it means no deadline.
+    struct timespec *deadlinePointer = (deadlineNanos == INT64_MAX) ? nullptr : &deadline;
+    // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline.
+    // Returns immediately if the sequence has already changed.
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&mSequence),
+            FUTEX_WAIT_BITSET_PRIVATE, sequence, deadlinePointer, nullptr,
+            FUTEX_BITSET_MATCH_ANY);
+}
+
+void FrameSignal::wakeWaiter() {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&mSequence),
+            FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+} // namespace oboe
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_FRAME_SIGNAL_H
+#define OBOE_FRAME_SIGNAL_H
+
+#include <atomic>
+#include <climits>
+#include <stdint.h>
+
+#include "common/AudioClock.h"
+
+namespace oboe {
+
+/**
+ * Lets one thread block until another thread reports that enough frames are available,
+ * for example in a FIFO between an app thread and an audio callback.
+ *
+ * notify() is lock-free and only makes a system call when a thread is waiting for
+ * no more than the number of frames reported. So it can be called from every audio callback.
+ * The waiting thread sleeps on a futex and wakes up within microseconds.
+ *
+ * Only one thread may wait at a time.
+ */
+class FrameSignal {
+public:
+
+    /**
+     * Block until getFramesAvailable() returns at least minFrames, or until the deadline passes.
+     * This may return early, eg. if the thread is interrupted, so the caller should check
+     * the result and call again if needed.
+     *
+     * @param minFrames number of frames wanted
+     * @param deadlineNanos CLOCK_MONOTONIC time at which to give up, or INT64_MAX to wait
+     *        without a deadline
+     * @param getFramesAvailable callable that returns the current number of frames available
+     * @return the last value returned by getFramesAvailable()
+     */
+    template <typename GetFramesAvailable>
+    int32_t waitForFrames(int32_t minFrames,
+                          int64_t deadlineNanos,
+                          GetFramesAvailable getFramesAvailable) {
+        int32_t framesAvailable = getFramesAvailable();
+        if (framesAvailable >= minFrames) {
+            return framesAvailable;
+        }
+        uint32_t sequence = mSequence.load(std::memory_order_acquire);
+        mThreshold.store(minFrames, std::memory_order_relaxed);
+        // Pairs with the fence in notify(). Either we see the new frames
+        // or notify() sees our threshold and changes the sequence.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        framesAvailable = getFramesAvailable();
+        if (framesAvailable < minFrames && AudioClock::getNanoseconds() < deadlineNanos) {
+            waitForSequenceChange(sequence, deadlineNanos);
+            framesAvailable = getFramesAvailable();
+        }
+        mThreshold.store(kNoWaiter, std::memory_order_relaxed);
+        return framesAvailable;
+    }
+
+    /**
+     * Report the number of frames now available to the waiting thread.
+     * Call this after the frames have been published, eg. by advancing a FIFO counter.
+     *
+     * @param framesAvailable frames available to the waiting thread
+     */
+    void notify(int32_t framesAvailable) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int32_t threshold = mThreshold.load(std::memory_order_relaxed);
+        // Only wake the waiter once per wait.
+        if (framesAvailable >= threshold
+                && mThreshold.compare_exchange_strong(threshold, kNoWaiter,
+                                                      std::memory_order_relaxed)) {
+            mSequence.fetch_add(1, std::memory_order_release);
+            wakeWaiter();
+        }
+    }
+
+private:
+    static constexpr int32_t kNoWaiter = INT32_MAX;
+
+    void waitForSequenceChange(uint32_t sequence, int64_t deadlineNanos);
+    void wakeWaiter();
+
+    std::atomic<int32_t>  mThreshold{kNoWaiter}; // frames wanted by the waiting thread
+    std::atomic<uint32_t> mSequence{0}; // futex word, changed by every wakeup
+};
+
+} // namespace oboe
+
+#endif //OBOE_FRAME_SIGNAL_H
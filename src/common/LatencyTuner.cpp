@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include "oboe/LatencyTuner.h"
 
 using namespace oboe;
@@ -48,32 +50,21 @@ Result LatencyTuner::tune() {
     // Set state to Active if the idle countdown has reached zero.
     if (mState == State::Idle && --mIdleCountDown <= 0) {
         mState = State::Active;
+        startGlitchFreePeriod(getFramesProcessed());
     }
 
     // When state is Active attempt to change the buffer size if the number of xRuns has increased.
-    if (mState == State::Active) {
+    // With Policy::Bidirectional the size can also come back down from AtMax.
+    if (mState == State::Active
+            || (mState == State::AtMax && mPolicy == Policy::Bidirectional)) {
 
         auto xRunCountResult = mStream.getXRunCount();
         if (xRunCountResult == Result::OK) {
             if ((xRunCountResult.value() - mPreviousXRuns) > 0) {
                 mPreviousXRuns = xRunCountResult.value();
-                int32_t oldBufferSize = mStream.getBufferSizeInFrames();
-                int32_t requestedBufferSize = oldBufferSize + getBufferSizeIncrement();
-
-                // Do not request more than the maximum buffer size (which was either user-specified
-                // or was from stream->getBufferCapacityInFrames())
-                if (requestedBufferSize > mMaxBufferSize) requestedBufferSize = mMaxBufferSize;
-
-                // Note that this will not allocate more memory. It simply determines
-                // how much of the existing buffer capacity will be used. The size will be
-                // clipped to the bufferCapacity by AAudio.
-                auto setBufferResult = mStream.setBufferSizeInFrames(requestedBufferSize);
-                if (setBufferResult != Result::OK) {
-                    result = setBufferResult;
-                    mState = State::Unsupported;
-                } else if (setBufferResult.value() == oldBufferSize) {
-                    mState = State::AtMax;
-                }
+                result = increaseBufferSize();
+            } else if (mPolicy == Policy::Bidirectional) {
+                result = maybeDecreaseBufferSize();
             }
         } else {
             mState = State::Unsupported;
@@ -90,6 +81,107 @@ Result LatencyTuner::tune() {
     return result;
 }
 
+Result LatencyTuner::increaseBufferSize() {
+    int32_t oldBufferSize = mStream.getBufferSizeInFrames();
+    int32_t requestedBufferSize = oldBufferSize + getBufferSizeIncrement();
+
+    // Do not request more than the maximum buffer size (which was either user-specified
+    // or was from stream->getBufferCapacityInFrames())
+    if (requestedBufferSize > mMaxBufferSize) requestedBufferSize = mMaxBufferSize;
+
+    // Note that this will not allocate more memory. It simply determines
+    // how much of the existing buffer capacity will be used. The size will be
+    // clipped to the bufferCapacity by AAudio.
+    auto setBufferResult = mStream.setBufferSizeInFrames(requestedBufferSize);
+    if (setBufferResult != Result::OK) {
+        mState = State::Unsupported;
+        return setBufferResult;
+    } else if (setBufferResult.value() == oldBufferSize) {
+        mState = State::AtMax;
+    }
+
+    // An XRun soon after lowering the size means it went too low, so wait longer next time.
+    int64_t framesProcessed = getFramesProcessed();
+    if (mLastDecreaseFrame >= 0
+            && (framesProcessed - mLastDecreaseFrame) < getGlitchFreeFrames()) {
+        mBackoffFactor = std::min(mBackoffFactor * 2, kMaxBackoffFactor);
+    }
+    mLastDecreaseFrame = -1;
+    startGlitchFreePeriod(framesProcessed);
+    return Result::OK;
+}
+
+Result LatencyTuner::maybeDecreaseBufferSize() {
+    int64_t framesProcessed = getFramesProcessed();
+    if ((framesProcessed - mGlitchFreeStartFrame) < getGlitchFreeFrames()) {
+        return Result::OK;
+    }
+
+    // The previous decrease lasted a whole period without an XRun.
+    if (mLastDecreaseFrame >= 0) {
+        mBackoffFactor = std::max(1, mBackoffFactor / 2);
+        mLastDecreaseFrame = -1;
+    }
+
+    int32_t oldBufferSize = mStream.getBufferSizeInFrames();
+    int32_t requestedBufferSize = std::max(oldBufferSize - getBufferSizeIncrement(),
+                                           getMinimumBufferSize());
+    // Check the timing of the period that just ended before starting the next one.
+    const bool hasMargin = hasTimingMarginFor(requestedBufferSize);
+    startGlitchFreePeriod(framesProcessed);
+    if (requestedBufferSize >= oldBufferSize || !hasMargin) {
+        return Result::OK;
+    }
+
+    auto setBufferResult = mStream.setBufferSizeInFrames(requestedBufferSize);
+    if (setBufferResult != Result::OK) {
+        mState = State::Unsupported;
+        return setBufferResult;
+    } else if (setBufferResult.value() < oldBufferSize) {
+        mState = State::Active;
+        mLastDecreaseFrame = framesProcessed;
+    }
+    return Result::OK;
+}
+
+bool LatencyTuner::hasTimingMarginFor(int32_t bufferSize) {
+    auto latenessResult = mStream.getCallbackLatenessWindow();
+    int32_t sampleRate = mStream.getSampleRate();
+    if (!latenessResult || sampleRate <= 0) {
+        return true; // Rely on the XRun count alone.
+    }
+    // The callback must finish before the frames left in the buffer run out.
+    int64_t latenessNanos = latenessResult.value().p99;
+    latenessNanos += static_cast<int64_t>(latenessNanos * mRobustness);
+    int64_t latenessFrames = latenessNanos * sampleRate / kNanosPerSecond;
+    return latenessFrames <= (bufferSize - mStream.getFramesPerBurst());
+}
+
+void LatencyTuner::startGlitchFreePeriod(int64_t framesProcessed) {
+    mGlitchFreeStartFrame = framesProcessed;
+    if (mPolicy == Policy::Bidirectional) {
+        // Only judge the next decrease by the callbacks in this period, so that one
+        // late callback long ago does not hold the size up forever.
+        mStream.resetCallbackLatenessWindow();
+    }
+}
+
+int64_t LatencyTuner::getGlitchFreeFrames() const {
+    int64_t millis = kMinGlitchFreeMillis
+            + static_cast<int64_t>(mRobustness * (kMaxGlitchFreeMillis - kMinGlitchFreeMillis));
+    return millis * mBackoffFactor * mStream.getSampleRate() / kMillisPerSecond;
+}
+
+int64_t LatencyTuner::getFramesProcessed() {
+    return (mStream.getDirection() == Direction::Output)
+            ? mStream.getFramesWritten()
+            : mStream.getFramesRead();
+}
+
+void LatencyTuner::setRobustness(float robustness) {
+    mRobustness = std::max(0.0f, std::min(1.0f, robustness));
+}
+
 void LatencyTuner::requestReset() {
     if (mState != State::Unsupported) {
         mLatencyTriggerRequests++;
@@ -99,6 +191,8 @@ void LatencyTuner::requestReset() {
 void LatencyTuner::reset() {
     mState = State::Idle;
     mIdleCountDown = kIdleCount;
+    mLastDecreaseFrame = -1;
+    mBackoffFactor = 1;
     // Set to minimal latency
     mStream.setBufferSizeInFrames(getMinimumBufferSize());
 }
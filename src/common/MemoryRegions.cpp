@@ -0,0 +1,144 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <alloca.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+
+#include "common/OboeDebug.h"
+#include "MemoryRegions.h"
+
+namespace oboe {
+
+// Enough for a typical callback. Thread stacks on Android are much larger than this.
+constexpr size_t kStackPrefaultBytes = 32 * 1024;
+constexpr size_t kMinPageSize = 4096;
+
+static uintptr_t getPageSize() {
+    static const uintptr_t sPageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    return sPageSize;
+}
+
+MemoryRegions::~MemoryRegions() {
+    unlock();
+}
+
+void MemoryRegions::add(const void *address, size_t numBytes) {
+    if (address == nullptr || numBytes == 0) {
+        return;
+    }
+    uintptr_t begin = reinterpret_cast<uintptr_t>(address);
+    mRegions.push_back({begin, begin + numBytes});
+}
+
+void MemoryRegions::prefault() {
+    const uintptr_t pageSize = getPageSize();
+    for (const Region &region : mRegions) {
+        // Touch the first byte, then the first byte of each following page.
+        uintptr_t address = region.begin;
+        while (address < region.end) {
+            volatile uint8_t *byte = reinterpret_cast<volatile uint8_t *>(address);
+            *byte = *byte;
+            address = (address & ~(pageSize - 1)) + pageSize;
+        }
+    }
+}
+
+int64_t MemoryRegions::lock() {
+    unlock();
+    const uintptr_t pageSize = getPageSize();
+    std::vector<Region> pages;
+    pages.reserve(mRegions.size());
+    for (const Region &region : mRegions) {
+        pages.push_back({region.begin & ~(pageSize - 1),
+                         (region.end + pageSize - 1) & ~(pageSize - 1)});
+    }
+    std::sort(pages.begin(), pages.end(), [](const Region &a, const Region &b) {
+        return a.begin < b.begin;
+    });
+    // Merge ranges that overlap or touch so each page is locked once.
+    std::vector<Region> merged;
+    for (const Region &range : pages) {
+        if (!merged.empty() && range.begin <= merged.back().end) {
+            merged.back().end = std::max(merged.back().end, range.end);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    for (const Region &range : merged) {
+        size_t numBytes = range.end - range.begin;
+        if (mlock(reinterpret_cast<void *>(range.begin), numBytes) != 0) {
+            LOGW("MemoryRegions::%s() mlock(%zu) failed, errno = %d", __func__, numBytes, errno);
+            continue;
+        }
+        mLockedRegions.push_back(range);
+        mLockedBytes += static_cast<int64_t>(numBytes);
+    }
+    return mLockedBytes;
+}
+
+void MemoryRegions::unlock() {
+    for (const Region &range : mLockedRegions) {
+        munlock(reinterpret_cast<void *>(range.begin), range.end - range.begin);
+    }
+    mLockedRegions.clear();
+    mLockedBytes = 0;
+}
+
+int64_t MemoryRegions::getTotalBytes() const {
+    int64_t total = 0;
+    for (const Region &region : mRegions) {
+        total += static_cast<int64_t>(region.end - region.begin);
+    }
+    return total;
+}
+
+__attribute__((noinline))
+void prefaultStack() {
+    volatile uint8_t *stack = static_cast<volatile uint8_t *>(alloca(kStackPrefaultBytes));
+    for (size_t i = 0; i < kStackPrefaultBytes; i += kMinPageSize) {
+        stack[i] = 0;
+    }
+}
+
+bool enableFlushToZero() {
+#if defined(__aarch64__)
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr |= 1 << 24; // FZ
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+    return true;
+#elif defined(__arm__) && defined(__ARM_FP)
+    uint32_t fpscr;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+    fpscr |= 1 << 24; // FZ
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+    return true;
+#elif defined(__i386__) || defined(__x86_64__)
+    _mm_setcsr(_mm_getcsr() | 0x8000 | 0x0040); // FTZ | DAZ
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace oboe
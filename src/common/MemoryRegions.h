@@ -0,0 +1,113 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_MEMORY_REGIONS_H
+#define OBOE_MEMORY_REGIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace oboe {
+
+/**
+ * A list of the memory used by a stream in its data callback, so that the pages can be
+ * touched and locked before the stream starts. Then the callback does not page fault.
+ *
+ * This is not thread safe. It is used when a stream is opened or closed.
+ */
+class MemoryRegions {
+public:
+    MemoryRegions() = default;
+
+    /**
+     * Calls unlock().
+     */
+    ~MemoryRegions();
+
+    MemoryRegions(const MemoryRegions &) = delete;
+    MemoryRegions &operator=(const MemoryRegions &) = delete;
+
+    /**
+     * Add a buffer. Null or empty buffers are ignored.
+     *
+     * @param address start of the buffer
+     * @param numBytes size of the buffer
+     */
+    void add(const void *address, size_t numBytes);
+
+    /**
+     * Read and write back one byte in each page so that the pages are mapped.
+     * The contents do not change. Only the bytes inside the buffers are touched.
+     */
+    void prefault();
+
+    /**
+     * Lock the pages of every buffer with mlock(). Pages that are shared by
+     * several buffers are only counted once.
+     * A range that cannot be locked, eg. because of RLIMIT_MEMLOCK, is skipped with a warning.
+     *
+     * @return number of bytes locked
+     */
+    int64_t lock();
+
+    /**
+     * Unlock the pages locked by lock().
+     * Note that locks do not nest, so this also unlocks pages shared with other locked memory.
+     */
+    void unlock();
+
+    /**
+     * @return number of bytes locked by lock(), or 0 if unlocked
+     */
+    int64_t getLockedBytes() const {
+        return mLockedBytes;
+    }
+
+    /**
+     * @return number of bytes in the buffers that were added
+     */
+    int64_t getTotalBytes() const;
+
+private:
+    struct Region {
+        uintptr_t begin;
+        uintptr_t end;
+    };
+
+    std::vector<Region> mRegions;
+    std::vector<Region> mLockedRegions; // page aligned
+    int64_t             mLockedBytes = 0;
+};
+
+/**
+ * Touch the next pages of the calling thread's stack so that a callback that uses them
+ * does not page fault.
+ */
+void prefaultStack();
+
+/**
+ * Make the FPU of the calling thread flush denormal floats to zero.
+ * Math on denormals can be very slow, eg. in a decaying filter or reverb tail.
+ * On x86 this sets FTZ and DAZ in the MXCSR. On ARM this sets FZ, which does both.
+ *
+ * @return true if the CPU is supported
+ */
+bool enableFlushToZero();
+
+} // namespace oboe
+
+#endif //OBOE_MEMORY_REGIONS_H
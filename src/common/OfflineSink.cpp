@@ -0,0 +1,124 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <string.h>
+
+#include "oboe/OfflineSink.h"
+#include "oboe/Utilities.h"
+#include "OboeDebug.h"
+
+namespace oboe {
+
+constexpr int32_t  kWavHeaderSize = 44;
+constexpr uint16_t kWavFormatPcm = 1;
+constexpr uint16_t kWavFormatIeeeFloat = 3;
+
+Result MemoryOfflineSink::onStart(AudioFormat format, int32_t channelCount,
+                                  int32_t /* sampleRate */) {
+    mBytesPerFrame = channelCount * convertFormatToSizeInBytes(format);
+    mData.clear();
+    return Result::OK;
+}
+
+Result MemoryOfflineSink::onData(const void *audioData, int32_t numFrames) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(audioData);
+    mData.insert(mData.end(), bytes, bytes + (numFrames * mBytesPerFrame));
+    return Result::OK;
+}
+
+WavFileOfflineSink::WavFileOfflineSink(const char *path)
+        : mPath(path) {
+}
+
+WavFileOfflineSink::~WavFileOfflineSink() {
+    onStop();
+}
+
+static void writeLittleEndian(uint8_t *destination, uint32_t value, int32_t numBytes) {
+    for (int32_t i = 0; i < numBytes; i++) {
+        destination[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+Result WavFileOfflineSink::writeHeader(uint32_t dataSizeInBytes) {
+    const int32_t bytesPerSample = convertFormatToSizeInBytes(mFormat);
+    const uint16_t formatTag = (mFormat == AudioFormat::Float)
+            ? kWavFormatIeeeFloat : kWavFormatPcm;
+    uint8_t header[kWavHeaderSize];
+    memcpy(&header[0], "RIFF", 4);
+    writeLittleEndian(&header[4], std::min<uint64_t>(UINT32_MAX,
+            static_cast<uint64_t>(dataSizeInBytes) + kWavHeaderSize - 8), 4);
+    memcpy(&header[8], "WAVE", 4);
+    memcpy(&header[12], "fmt ", 4);
+    writeLittleEndian(&header[16], 16, 4); // size of the fmt chunk
+    writeLittleEndian(&header[20], formatTag, 2);
+    writeLittleEndian(&header[22], mChannelCount, 2);
+    writeLittleEndian(&header[24], mSampleRate, 4);
+    writeLittleEndian(&header[28], mSampleRate * mBytesPerFrame, 4); // bytes per second
+    writeLittleEndian(&header[32], mBytesPerFrame, 2);
+    writeLittleEndian(&header[34], bytesPerSample * 8, 2); // bits per sample
+    memcpy(&header[36], "data", 4);
+    writeLittleEndian(&header[40], dataSizeInBytes, 4);
+    if (fseek(mFile, 0, SEEK_SET) != 0
+            || fwrite(header, sizeof(header), 1, mFile) != 1) {
+        return Result::ErrorInternal;
+    }
+    return Result::OK;
+}
+
+Result WavFileOfflineSink::onStart(AudioFormat format, int32_t channelCount, int32_t sampleRate) {
+    if (format != AudioFormat::I16 && format != AudioFormat::I24
+            && format != AudioFormat::I32 && format != AudioFormat::Float) {
+        return Result::ErrorInvalidFormat;
+    }
+    onStop(); // in case the stream is restarted
+    mFile = fopen(mPath.c_str(), "wb");
+    if (mFile == nullptr) {
+        LOGE("WavFileOfflineSink::%s() could not open %s", __func__, mPath.c_str());
+        return Result::ErrorIllegalArgument;
+    }
+    mFormat = format;
+    mChannelCount = channelCount;
+    mSampleRate = sampleRate;
+    mBytesPerFrame = channelCount * convertFormatToSizeInBytes(format);
+    mDataSizeInBytes = 0;
+    // Write a placeholder that is updated by onStop().
+    return writeHeader(0);
+}
+
+Result WavFileOfflineSink::onData(const void *audioData, int32_t numFrames) {
+    if (mFile == nullptr) {
+        return Result::ErrorInvalidState;
+    }
+    size_t numBytes = static_cast<size_t>(numFrames) * mBytesPerFrame;
+    if (fwrite(audioData, 1, numBytes, mFile) != numBytes) {
+        return Result::ErrorInternal;
+    }
+    mDataSizeInBytes += numBytes;
+    return Result::OK;
+}
+
+void WavFileOfflineSink::onStop() {
+    if (mFile == nullptr) {
+        return;
+    }
+    writeHeader(static_cast<uint32_t>(std::min<uint64_t>(UINT32_MAX, mDataSizeInBytes)));
+    fclose(mFile);
+    mFile = nullptr;
+}
+
+} // namespace oboe
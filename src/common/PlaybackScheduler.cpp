@@ -0,0 +1,247 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "oboe/AudioStream.h"
+#include "OboeDebug.h"
+#include "PlaybackScheduler.h"
+#include "StreamArena.h"
+
+namespace oboe {
+
+static void mixFloat(float *output, const float *input, int32_t numSamples) {
+    for (int32_t i = 0; i < numSamples; i++) {
+        output[i] += input[i];
+    }
+}
+
+static void mixI16(int16_t *output, const int16_t *input, int32_t numSamples) {
+    for (int32_t i = 0; i < numSamples; i++) {
+        const int32_t sum = output[i] + input[i];
+        output[i] = static_cast<int16_t>(std::min(INT16_MAX, std::max(INT16_MIN, sum)));
+    }
+}
+
+// Packed little endian 24-bit samples.
+static void mixI24(uint8_t *output, const uint8_t *input, int32_t numSamples) {
+    constexpr int32_t kMaxI24 = (1 << 23) - 1;
+    constexpr int32_t kMinI24 = -(1 << 23);
+    for (int32_t i = 0; i < numSamples; i++) {
+        // Shift up to sign extend then back down.
+        const int32_t a = static_cast<int32_t>((output[0] << 8) | (output[1] << 16)
+                | (static_cast<uint32_t>(output[2]) << 24)) >> 8;
+        const int32_t b = static_cast<int32_t>((input[0] << 8) | (input[1] << 16)
+                | (static_cast<uint32_t>(input[2]) << 24)) >> 8;
+        const int32_t sum = std::min(kMaxI24, std::max(kMinI24, a + b));
+        output[0] = static_cast<uint8_t>(sum);
+        output[1] = static_cast<uint8_t>(sum >> 8);
+        output[2] = static_cast<uint8_t>(sum >> 16);
+        output += 3;
+        input += 3;
+    }
+}
+
+static void mixI32(int32_t *output, const int32_t *input, int32_t numSamples) {
+    for (int32_t i = 0; i < numSamples; i++) {
+        const int64_t sum = static_cast<int64_t>(output[i]) + input[i];
+        output[i] = static_cast<int32_t>(std::min<int64_t>(INT32_MAX,
+                                                           std::max<int64_t>(INT32_MIN, sum)));
+    }
+}
+
+Result PlaybackScheduler::open(int32_t capacity, StreamArena &arena) {
+    if (!arena.claim(StreamArena::Owner::PlaybackScheduler)) {
+        LOGE("PlaybackScheduler::%s() a scheduler was already set up for this stream", __func__);
+        return Result::ErrorInvalidState;
+    }
+    mCapacity = capacity;
+    uint8_t *fifoStorage = arena.allocateArray<uint8_t>(capacity * sizeof(Item));
+    mPending = arena.allocateArray<Item>(capacity);
+    mActive = arena.allocateArray<Item>(capacity);
+    if (fifoStorage == nullptr || mPending == nullptr || mActive == nullptr) {
+        return Result::ErrorNoMemory;
+    }
+    mSubmitFifo = std::make_unique<FifoBuffer>(sizeof(Item), capacity, fifoStorage);
+    return Result::OK;
+}
+
+Result PlaybackScheduler::scheduleBuffer(int64_t framePosition,
+                                         const void *buffer,
+                                         int32_t numFrames) {
+    if (buffer == nullptr) {
+        return Result::ErrorNull;
+    }
+    if (numFrames <= 0 || framePosition < 0) {
+        return Result::ErrorIllegalArgument;
+    }
+    return submit({framePosition, static_cast<const uint8_t *>(buffer), numFrames,
+                   nullptr, 0});
+}
+
+Result PlaybackScheduler::scheduleEvent(int64_t framePosition, ScheduledEventCallback *callback) {
+    if (callback == nullptr) {
+        return Result::ErrorNull;
+    }
+    if (framePosition < 0) {
+        return Result::ErrorIllegalArgument;
+    }
+    return submit({framePosition, nullptr, 0, callback, 0});
+}
+
+Result PlaybackScheduler::submit(const Item &item) {
+    std::lock_guard<std::mutex> lock(mSubmitLock);
+    // The count includes the items in the FIFO so the FIFO cannot overflow.
+    if (mItemCount.load() >= mCapacity) {
+        return Result::ErrorNoFreeHandles;
+    }
+    Item stamped = item;
+    stamped.generation = mGeneration.load();
+    mItemCount++;
+    mSubmitFifo->write(&stamped, 1);
+    return Result::OK;
+}
+
+void PlaybackScheduler::clear() {
+    std::lock_guard<std::mutex> lock(mSubmitLock);
+    mGeneration++;
+}
+
+void PlaybackScheduler::takeSubmittedItems() {
+    Item item;
+    while (mSubmitFifo->read(&item, 1) == 1) {
+        if (item.generation != mCurrentGeneration) {
+            finishItem(); // cleared before it got here
+            continue;
+        }
+        // Insertion sort, latest first. Events scheduled for the same frame keep their order.
+        int32_t index = mPendingCount;
+        while (index > 0 && mPending[index - 1].framePosition <= item.framePosition) {
+            mPending[index] = mPending[index - 1];
+            index--;
+        }
+        mPending[index] = item;
+        mPendingCount++;
+    }
+}
+
+void PlaybackScheduler::dropClearedItems() {
+    const uint32_t generation = mGeneration.load();
+    if (generation == mCurrentGeneration) {
+        return;
+    }
+    // Everything that was taken so far was submitted before the clear.
+    mCurrentGeneration = generation;
+    for (int32_t i = 0; i < mPendingCount + mActiveCount; i++) {
+        finishItem();
+    }
+    mPendingCount = 0;
+    mActiveCount = 0;
+}
+
+void PlaybackScheduler::startDueItems(int64_t framePosition) {
+    while (mPendingCount > 0 && mPending[mPendingCount - 1].framePosition <= framePosition) {
+        Item &item = mPending[--mPendingCount];
+        if (item.callback != nullptr) {
+            item.callback->onScheduledEvent(&mStream, item.framePosition);
+            finishItem();
+            takeSubmittedItems(); // the event may have scheduled something for now
+            continue;
+        }
+        // Skip the part of a late buffer that should already have played.
+        const int64_t framesLate = framePosition - item.framePosition;
+        if (framesLate >= item.numFrames) {
+            finishItem();
+            continue;
+        }
+        item.buffer += framesLate * mStream.getBytesPerFrame();
+        item.numFrames -= static_cast<int32_t>(framesLate);
+        mActive[mActiveCount++] = item;
+    }
+}
+
+void PlaybackScheduler::mixActiveItems(uint8_t *output, int32_t numFrames) {
+    const int32_t samplesPerFrame = mStream.getChannelCount();
+    const int32_t bytesPerFrame = mStream.getBytesPerFrame();
+    int32_t index = 0;
+    while (index < mActiveCount) {
+        Item &item = mActive[index];
+        const int32_t framesToMix = std::min(numFrames, item.numFrames);
+        const int32_t numSamples = framesToMix * samplesPerFrame;
+        switch (mStream.getFormat()) {
+            case AudioFormat::Float:
+                mixFloat(reinterpret_cast<float *>(output),
+                         reinterpret_cast<const float *>(item.buffer), numSamples);
+                break;
+            case AudioFormat::I16:
+                mixI16(reinterpret_cast<int16_t *>(output),
+                       reinterpret_cast<const int16_t *>(item.buffer), numSamples);
+                break;
+            case AudioFormat::I24:
+                mixI24(output, item.buffer, numSamples);
+                break;
+            case AudioFormat::I32:
+                mixI32(reinterpret_cast<int32_t *>(output),
+                       reinterpret_cast<const int32_t *>(item.buffer), numSamples);
+                break;
+            default:
+                break;
+        }
+        item.buffer += framesToMix * bytesPerFrame;
+        item.numFrames -= framesToMix;
+        if (item.numFrames == 0) {
+            item = mActive[--mActiveCount]; // order does not matter for mixing
+            finishItem();
+        } else {
+            index++;
+        }
+    }
+}
+
+DataCallbackResult PlaybackScheduler::onAudioReady(AudioStream *audioStream,
+                                                   void *audioData,
+                                                   int32_t numFrames) {
+    uint8_t *output = static_cast<uint8_t *>(audioData);
+    const int32_t bytesPerFrame = mStream.getBytesPerFrame();
+    dropClearedItems();
+    takeSubmittedItems();
+
+    // Split the block at the events so that each event is handled once, not every frame.
+    int32_t framesDone = 0;
+    while (framesDone < numFrames) {
+        const int64_t position = mFramePosition + framesDone;
+        startDueItems(position);
+        int32_t framesToRender = numFrames - framesDone;
+        if (mPendingCount > 0) {
+            const int64_t framesToNextItem = mPending[mPendingCount - 1].framePosition - position;
+            framesToRender = static_cast<int32_t>(std::min<int64_t>(framesToRender,
+                                                                    framesToNextItem));
+        }
+        uint8_t *data = output + (framesDone * bytesPerFrame);
+        DataCallbackResult result = mAppCallback->onAudioReady(audioStream, data, framesToRender);
+        mixActiveItems(data, framesToRender);
+        framesDone += framesToRender;
+        if (result != DataCallbackResult::Continue) {
+            // Keep the position in step with the app if the stream is started again.
+            mFramePosition += framesDone;
+            return result;
+        }
+    }
+    mFramePosition += numFrames;
+    return DataCallbackResult::Continue;
+}
+
+} // namespace oboe
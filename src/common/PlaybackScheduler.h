@@ -0,0 +1,126 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_PLAYBACK_SCHEDULER_H
+#define OBOE_PLAYBACK_SCHEDULER_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
+#include "oboe/AudioStreamCallback.h"
+#include "oboe/Definitions.h"
+#include "oboe/FifoBuffer.h"
+
+namespace oboe {
+
+class AudioStream;
+class StreamArena;
+
+/**
+ * Start buffers and events at exact frame positions of an output stream.
+ *
+ * The stream calls the scheduler instead of the data callback of the app, see
+ * AudioStream::callDataCallback(), and the scheduler calls the app. Each block is split at the positions of the events so the app callback
+ * is called once per event instead of the scheduler looking at every frame.
+ * The buffers that are playing are added to the output of the app.
+ *
+ * The frame position is the number of frames rendered since the stream was opened, which is
+ * the same as AudioStream::getFramesWritten() for a callback stream.
+ *
+ * App threads submit items through a FIFO, serialized by a lock that the callback never takes.
+ * The callback moves them into arrays in the stream arena, so it does not allocate.
+ */
+class PlaybackScheduler : public AudioStreamDataCallback {
+public:
+    PlaybackScheduler(AudioStream &stream, AudioStreamDataCallback *appCallback)
+            : mStream(stream)
+            , mAppCallback(appCallback) {}
+
+    virtual ~PlaybackScheduler() = default;
+
+    /**
+     * @param capacity maximum number of items that are scheduled or playing
+     * @param arena memory for the items
+     * @return OK or Result::ErrorNoMemory,
+     *         or Result::ErrorInvalidState if a scheduler was already set up with this arena
+     */
+    Result open(int32_t capacity, StreamArena &arena);
+
+    /**
+     * Add a buffer in the format of the stream to the output, starting at framePosition.
+     * Called by the app.
+     */
+    Result scheduleBuffer(int64_t framePosition, const void *buffer, int32_t numFrames);
+
+    /**
+     * Call the callback when the stream reaches framePosition. Called by the app.
+     */
+    Result scheduleEvent(int64_t framePosition, ScheduledEventCallback *callback);
+
+    /**
+     * Drop everything that was scheduled before this call. Called by the app.
+     */
+    void clear();
+
+    DataCallbackResult onAudioReady(AudioStream *audioStream,
+                                    void *audioData,
+                                    int32_t numFrames) override;
+
+private:
+    struct Item {
+        int64_t                 framePosition;
+        const uint8_t          *buffer;      // nullptr for events
+        int32_t                 numFrames;   // left to play
+        ScheduledEventCallback *callback;
+        uint32_t                generation;  // from mGeneration when submitted
+    };
+
+    Result submit(const Item &item);
+
+    // Move new items from the FIFO into mPending, which is sorted with the earliest last.
+    void takeSubmittedItems();
+    // Drop the items that were scheduled before clear().
+    void dropClearedItems();
+    // Call the events and start the buffers that are due at framePosition.
+    void startDueItems(int64_t framePosition);
+    // Add the playing buffers to numFrames of output and remove the ones that end.
+    void mixActiveItems(uint8_t *output, int32_t numFrames);
+    void finishItem() {
+        mItemCount--;
+    }
+
+    AudioStream                 &mStream;
+    AudioStreamDataCallback     *mAppCallback;
+    int32_t                      mCapacity = 0;
+    std::unique_ptr<FifoBuffer>  mSubmitFifo; // of Item
+    std::mutex                   mSubmitLock; // only taken by app threads
+    std::atomic<int32_t>         mItemCount{0}; // submitted and not finished
+    std::atomic<uint32_t>        mGeneration{0}; // incremented by clear()
+
+    // Only used by the callback.
+    Item                        *mPending = nullptr;
+    int32_t                      mPendingCount = 0;
+    Item                        *mActive = nullptr; // buffers that are playing
+    int32_t                      mActiveCount = 0;
+    uint32_t                     mCurrentGeneration = 0;
+    int64_t                      mFramePosition = 0; // of the next frame rendered
+};
+
+} // namespace oboe
+
+#endif //OBOE_PLAYBACK_SCHEDULER_H
@@ -191,6 +191,12 @@ bool QuirksManager::isConversionNeeded(
     const bool isInput = builder.getDirection() == Direction::Input;
     const bool isFloat = builder.getFormat() == AudioFormat::Float;
 
+    // The biquad filter is part of the data conversion so it always needs a FilterAudioStream.
+    if (builder.getBiquadFilterStageCount() > 0) {
+        childBuilder.setBiquadFilterStageCount(0);
+        conversionNeeded = true;
+    }
+
     // There are multiple bugs involving using callback with a specified callback size.
     // Issue #778: O to Q had a problem with Legacy INPUT streams for FLOAT streams
     // and a specified callback size. It would assert because of a bad buffer size.
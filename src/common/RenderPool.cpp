@@ -0,0 +1,318 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <climits>
+#include <errno.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/AudioClock.h"
+#include "common/OboeDebug.h"
+#include "oboe/RenderPool.h"
+
+namespace oboe {
+
+// The kernel operates on the address of a plain 32-bit integer.
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex word must be 32 bits");
+
+constexpr int64_t kNoDeadline = INT64_MAX;
+
+static void futexWait(std::atomic<uint32_t> *word, uint32_t value, int64_t deadlineNanos) {
+    if (deadlineNanos == kNoDeadline) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(word),
+                FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+    } else {
+        struct timespec deadline;
+        deadline.tv_sec = deadlineNanos / kNanosPerSecond;
+        deadline.tv_nsec = deadlineNanos - (deadline.tv_sec * kNanosPerSecond);
+        // FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline.
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(word),
+                FUTEX_WAIT_BITSET_PRIVATE, value, &deadline, nullptr, FUTEX_BITSET_MATCH_ANY);
+    }
+}
+
+static void futexWake(std::atomic<uint32_t> *word, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(word),
+            FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+RenderPool::~RenderPool() {
+    close();
+}
+
+void *RenderPool::runWorkerThread(void *arg) {
+    Worker *worker = static_cast<Worker *>(arg);
+    worker->pool->runWorker(worker->index);
+    return nullptr;
+}
+
+Result RenderPool::open(int32_t numWorkers) {
+    if (mOpen) {
+        return Result::ErrorInvalidState;
+    }
+    if (numWorkers < 0 || numWorkers > kMaxWorkers) {
+        return Result::ErrorOutOfRange;
+    }
+    mWorkers = std::make_unique<Worker[]>(numWorkers);
+    mNumWorkers = numWorkers;
+    mOpenGeneration = mGeneration.load();
+    mEnabled.store(true);
+    mOpen = true;
+    resetStats();
+
+    bool useSchedFifo = mWorkerPriority > 0;
+    for (int32_t i = 0; i < numWorkers; i++) {
+        Worker &worker = mWorkers[i];
+        worker.pool = this;
+        worker.index = i;
+        int err = EPERM;
+        if (useSchedFifo) {
+            pthread_attr_t attributes;
+            pthread_attr_init(&attributes);
+            pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+            sched_param param{};
+            param.sched_priority = mWorkerPriority;
+            pthread_attr_setschedparam(&attributes, &param);
+            err = pthread_create(&worker.thread, &attributes, runWorkerThread, &worker);
+            pthread_attr_destroy(&attributes);
+            if (err == EPERM) {
+                LOGW("RenderPool::%s() SCHED_FIFO not allowed, using normal threads", __func__);
+                useSchedFifo = false;
+            }
+        }
+        if (err == EPERM) {
+            err = pthread_create(&worker.thread, nullptr, runWorkerThread, &worker);
+        }
+        if (err != 0) {
+            LOGE("RenderPool::%s() pthread_create() returned %d", __func__, err);
+            close();
+            return Result::ErrorInternal;
+        }
+        worker.threadCreated = true;
+    }
+    return Result::OK;
+}
+
+Result RenderPool::close() {
+    if (!mOpen) {
+        return Result::ErrorClosed;
+    }
+    if (mForked) {
+        join(0);
+    }
+    mEnabled.store(false);
+    mGeneration.fetch_add(1);
+    futexWake(&mGeneration, INT_MAX);
+    for (int32_t i = 0; i < mNumWorkers; i++) {
+        if (mWorkers[i].threadCreated) {
+            pthread_join(mWorkers[i].thread, nullptr);
+        }
+    }
+    mWorkers.reset();
+    mNumWorkers = 0;
+    mOpen = false;
+    return Result::OK;
+}
+
+Result RenderPool::fork(RenderTask * const *tasks, int32_t numTasks) {
+    if (!mOpen) {
+        return Result::ErrorClosed;
+    }
+    if (mForked) {
+        return Result::ErrorInvalidState;
+    }
+    if (numTasks < 0 || numTasks > kMaxTasks) {
+        return Result::ErrorOutOfRange;
+    }
+    if (tasks == nullptr && numTasks > 0) {
+        return Result::ErrorNull;
+    }
+    // No worker can be using these because the last fork has been joined.
+    mTasks = tasks;
+    mNumTasks = numTasks;
+    mCompletedCount.store(0, std::memory_order_relaxed);
+    uint32_t generation = mGeneration.load(std::memory_order_relaxed) + 1;
+    mClaim.store(makeClaim(generation, numTasks, 0), std::memory_order_release);
+    mGeneration.store(generation, std::memory_order_release);
+    mForked = true;
+
+    // Pairs with the fence in waitForFork(). Either the worker sees the new generation
+    // or we see that it is sleeping.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (numTasks > 0 && mSleepingWorkers.load(std::memory_order_relaxed) > 0) {
+        futexWake(&mGeneration, INT_MAX);
+    }
+    return Result::OK;
+}
+
+Result RenderPool::join(int64_t deadlineNanos) {
+    if (!mForked) {
+        return Result::ErrorInvalidState;
+    }
+    const uint32_t generation = mGeneration.load(std::memory_order_relaxed);
+    const uint32_t numTasks = static_cast<uint32_t>(mNumTasks);
+    bool ranInline = false;
+    while (true) {
+        uint32_t completedCount = mCompletedCount.load(std::memory_order_acquire);
+        if (completedCount >= numTasks) {
+            break;
+        }
+        if (!ranInline
+                && (mNumWorkers == 0 || AudioClock::getNanoseconds() >= deadlineNanos)) {
+            // Run whatever the workers have not claimed yet.
+            ranInline = true;
+            int32_t tasksRun = runTasks(generation, nullptr);
+            if (tasksRun > 0) {
+                mInlineTaskCount.fetch_add(tasksRun, std::memory_order_relaxed);
+                mDeadlineFallbackCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            continue;
+        }
+        // Once everything is claimed, wait for the running tasks however long they take.
+        waitForCompletion(completedCount, ranInline ? kNoDeadline : deadlineNanos);
+    }
+    mForked = false;
+    return Result::OK;
+}
+
+int32_t RenderPool::runTasks(uint32_t generation, std::atomic<int64_t> *busyNanos) {
+    int32_t tasksRun = 0;
+    uint64_t claim = mClaim.load(std::memory_order_acquire);
+    while (true) {
+        if ((claim >> 32) != generation) {
+            break; // a later fork
+        }
+        uint32_t numTasks = (claim >> 16) & 0xFFFF;
+        uint32_t taskIndex = claim & 0xFFFF;
+        if (taskIndex >= numTasks) {
+            break; // all claimed
+        }
+        if (!mClaim.compare_exchange_weak(claim, claim + 1,
+                                          std::memory_order_acquire,
+                                          std::memory_order_acquire)) {
+            continue;
+        }
+
+        if (busyNanos != nullptr) {
+            int64_t startNanos = AudioClock::getNanoseconds();
+            mTasks[taskIndex]->run();
+            busyNanos->fetch_add(AudioClock::getNanoseconds() - startNanos,
+                                 std::memory_order_relaxed);
+        } else {
+            mTasks[taskIndex]->run();
+        }
+        tasksRun++;
+
+        // Release the output of the task to join().
+        uint32_t completedCount = mCompletedCount.fetch_add(1, std::memory_order_acq_rel) + 1;
+        if (completedCount == numTasks) {
+            // Pairs with the fence in waitForCompletion().
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (mJoinWaiting.load(std::memory_order_relaxed)) {
+                futexWake(&mCompletedCount, 1);
+            }
+        }
+        claim = mClaim.load(std::memory_order_acquire);
+    }
+    return tasksRun;
+}
+
+void RenderPool::waitForCompletion(uint32_t completedCount, int64_t deadlineNanos) {
+    const int64_t spinEndNanos = AudioClock::getNanoseconds() + mSpinNanos;
+    while (mCompletedCount.load(std::memory_order_acquire) == completedCount) {
+        int64_t nowNanos = AudioClock::getNanoseconds();
+        if (nowNanos >= deadlineNanos) {
+            return;
+        }
+        if (nowNanos >= spinEndNanos) {
+            mJoinWaiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // Returns immediately if the count has already changed.
+            futexWait(&mCompletedCount, completedCount, deadlineNanos);
+            mJoinWaiting.store(false, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+void RenderPool::waitForFork(uint32_t generation) {
+    int64_t spinEndNanos = AudioClock::getNanoseconds() + mSpinNanos;
+    while (mGeneration.load(std::memory_order_acquire) == generation) {
+        if (AudioClock::getNanoseconds() >= spinEndNanos) {
+            mSleepingWorkers.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            // Returns immediately if the generation has already changed.
+            futexWait(&mGeneration, generation, kNoDeadline);
+            mSleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void RenderPool::runWorker(int32_t workerIndex) {
+    Worker &worker = mWorkers[workerIndex];
+    if (!mWorkerCpuIds.empty()) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(mWorkerCpuIds[workerIndex % mWorkerCpuIds.size()], &cpuSet);
+        // Zero means the calling thread.
+        if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+            LOGW("RenderPool::%s() sched_setaffinity() failed, errno = %d", __func__, errno);
+        }
+    }
+
+    uint32_t generation = mOpenGeneration;
+    while (true) {
+        waitForFork(generation);
+        if (!mEnabled.load(std::memory_order_acquire)) {
+            break;
+        }
+        generation = mGeneration.load(std::memory_order_acquire);
+        int32_t tasksRun = runTasks(generation, &worker.busyNanos);
+        worker.tasksRun.fetch_add(tasksRun, std::memory_order_relaxed);
+    }
+}
+
+ResultWithValue<RenderWorkerStats> RenderPool::getWorkerStats(int32_t workerIndex) const {
+    if (workerIndex < 0 || workerIndex >= mNumWorkers) {
+        return ResultWithValue<RenderWorkerStats>(Result::ErrorOutOfRange);
+    }
+    const Worker &worker = mWorkers[workerIndex];
+    RenderWorkerStats stats;
+    stats.tasksRun = worker.tasksRun.load(std::memory_order_relaxed);
+    stats.busyNanos = worker.busyNanos.load(std::memory_order_relaxed);
+    int64_t elapsedNanos = AudioClock::getNanoseconds() - mStatsStartNanos.load();
+    if (elapsedNanos > 0) {
+        stats.utilization = static_cast<double>(stats.busyNanos) / elapsedNanos;
+    }
+    return ResultWithValue<RenderWorkerStats>(stats);
+}
+
+void RenderPool::resetStats() {
+    for (int32_t i = 0; i < mNumWorkers; i++) {
+        mWorkers[i].tasksRun.store(0, std::memory_order_relaxed);
+        mWorkers[i].busyNanos.store(0, std::memory_order_relaxed);
+    }
+    mInlineTaskCount.store(0, std::memory_order_relaxed);
+    mDeadlineFallbackCount.store(0, std::memory_order_relaxed);
+    mStatsStartNanos.store(AudioClock::getNanoseconds());
+}
+
+} // namespace oboe
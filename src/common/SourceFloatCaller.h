@@ -30,8 +30,8 @@ namespace oboe {
  */
 class SourceFloatCaller : public AudioSourceCaller {
 public:
-    SourceFloatCaller(int32_t channelCount, int32_t framesPerCallback)
-    : AudioSourceCaller(channelCount, framesPerCallback, (int32_t)sizeof(float)) {}
+    SourceFloatCaller(int32_t channelCount, int32_t framesPerCallback, StreamArena &arena)
+    : AudioSourceCaller(channelCount, framesPerCallback, (int32_t)sizeof(float), arena) {}
 
     int32_t onProcess(int32_t numFrames) override;
 
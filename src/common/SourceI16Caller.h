@@ -30,19 +30,23 @@ namespace oboe {
  */
 class SourceI16Caller : public AudioSourceCaller {
 public:
-    SourceI16Caller(int32_t channelCount, int32_t framesPerCallback)
-    : AudioSourceCaller(channelCount, framesPerCallback, sizeof(int16_t)) {
-        mConversionBuffer = std::make_unique<int16_t[]>(static_cast<size_t>(channelCount)
+    SourceI16Caller(int32_t channelCount, int32_t framesPerCallback, StreamArena &arena)
+    : AudioSourceCaller(channelCount, framesPerCallback, sizeof(int16_t), arena) {
+        mConversionBuffer = arena.allocateArray<int16_t>(static_cast<size_t>(channelCount)
                 * static_cast<size_t>(output.getFramesPerBuffer()));
     }
 
+    bool isAllocated() const override {
+        return AudioSourceCaller::isAllocated() && mConversionBuffer != nullptr;
+    }
+
     int32_t onProcess(int32_t numFrames) override;
 
     const char *getName() override {
         return "SourceI16Caller";
     }
 private:
-    std::unique_ptr<int16_t[]>  mConversionBuffer;
+    int16_t                   *mConversionBuffer = nullptr; // from the arena
 };
 
 }
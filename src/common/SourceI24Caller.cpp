@@ -28,11 +28,11 @@ using namespace flowgraph;
 
 int32_t SourceI24Caller::onProcess(int32_t numFrames) {
     int32_t numBytes = mStream->getBytesPerFrame() * numFrames;
-    int32_t bytesRead = mBlockReader.read((uint8_t *) mConversionBuffer.get(), numBytes);
+    int32_t bytesRead = mBlockReader.read((uint8_t *) mConversionBuffer, numBytes);
     int32_t framesRead = bytesRead / mStream->getBytesPerFrame();
 
     float *floatData = output.getBuffer();
-    const uint8_t *byteData = mConversionBuffer.get();
+    const uint8_t *byteData = mConversionBuffer;
     int32_t numSamples = framesRead * output.getSamplesPerFrame();
 
 #if FLOWGRAPH_ANDROID_INTERNAL
@@ -31,13 +31,17 @@ namespace oboe {
  */
 class SourceI24Caller : public AudioSourceCaller {
 public:
-    SourceI24Caller(int32_t channelCount, int32_t framesPerCallback)
-    : AudioSourceCaller(channelCount, framesPerCallback, kBytesPerI24Packed) {
-        mConversionBuffer = std::make_unique<uint8_t[]>(static_cast<size_t>(kBytesPerI24Packed)
+    SourceI24Caller(int32_t channelCount, int32_t framesPerCallback, StreamArena &arena)
+    : AudioSourceCaller(channelCount, framesPerCallback, kBytesPerI24Packed, arena) {
+        mConversionBuffer = arena.allocateArray<uint8_t>(static_cast<size_t>(kBytesPerI24Packed)
                 * static_cast<size_t>(channelCount)
                 * static_cast<size_t>(output.getFramesPerBuffer()));
     }
 
+    bool isAllocated() const override {
+        return AudioSourceCaller::isAllocated() && mConversionBuffer != nullptr;
+    }
+
     int32_t onProcess(int32_t numFrames) override;
 
     const char *getName() override {
@@ -45,7 +49,7 @@ public:
     }
 
 private:
-    std::unique_ptr<uint8_t[]>  mConversionBuffer;
+    uint8_t                   *mConversionBuffer = nullptr; // from the arena
     static constexpr int kBytesPerI24Packed = 3;
 };
 
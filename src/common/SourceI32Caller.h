@@ -32,12 +32,16 @@ namespace oboe {
  */
 class SourceI32Caller : public AudioSourceCaller {
 public:
-    SourceI32Caller(int32_t channelCount, int32_t framesPerCallback)
-    : AudioSourceCaller(channelCount, framesPerCallback, sizeof(int32_t)) {
-        mConversionBuffer = std::make_unique<int32_t[]>(static_cast<size_t>(channelCount)
+    SourceI32Caller(int32_t channelCount, int32_t framesPerCallback, StreamArena &arena)
+    : AudioSourceCaller(channelCount, framesPerCallback, sizeof(int32_t), arena) {
+        mConversionBuffer = arena.allocateArray<int32_t>(static_cast<size_t>(channelCount)
                 * static_cast<size_t>(output.getFramesPerBuffer()));
     }
 
+    bool isAllocated() const override {
+        return AudioSourceCaller::isAllocated() && mConversionBuffer != nullptr;
+    }
+
     int32_t onProcess(int32_t numFrames) override;
 
     const char *getName() override {
@@ -45,7 +49,7 @@ public:
     }
 
 private:
-    std::unique_ptr<int32_t[]>  mConversionBuffer;
+    int32_t                   *mConversionBuffer = nullptr; // from the arena
     static constexpr float kScale = 1.0 / (1UL << 31);
 };
 
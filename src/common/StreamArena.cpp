@@ -0,0 +1,106 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "common/OboeDebug.h"
+#include "MemoryRegions.h"
+#include "StreamArena.h"
+
+namespace oboe {
+
+static size_t roundUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+StreamArena::~StreamArena() {
+    for (const Chunk &chunk : mChunks) {
+        munmap(chunk.address, chunk.size);
+    }
+}
+
+bool StreamArena::addChunk(size_t minBytes) {
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t alignment = pageSize;
+    size_t chunkBytes = std::max(minBytes, kMinChunkBytes);
+    if (mHugePagesEnabled) {
+        alignment = std::max(pageSize, kHugePageBytes);
+        chunkBytes = std::max(chunkBytes, kHugePageBytes);
+    }
+    chunkBytes = roundUp(chunkBytes, alignment);
+
+    // A huge page can only be used for an aligned range. So map extra then trim the ends.
+    const size_t mappedBytes = chunkBytes + ((alignment > pageSize) ? alignment : 0);
+    void *mapped = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        LOGE("StreamArena::%s() mmap(%zu) failed, errno = %d", __func__, mappedBytes, errno);
+        return false;
+    }
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(mapped);
+    const uintptr_t alignedBegin = roundUp(begin, alignment);
+    const uintptr_t alignedEnd = alignedBegin + chunkBytes;
+    if (alignedBegin > begin) {
+        munmap(mapped, alignedBegin - begin);
+    }
+    if (begin + mappedBytes > alignedEnd) {
+        munmap(reinterpret_cast<void *>(alignedEnd), begin + mappedBytes - alignedEnd);
+    }
+#ifdef MADV_HUGEPAGE
+    if (mHugePagesEnabled
+            && madvise(reinterpret_cast<void *>(alignedBegin), chunkBytes, MADV_HUGEPAGE) != 0) {
+        LOGW("StreamArena::%s() huge pages not available, errno = %d", __func__, errno);
+    }
+#endif
+
+    mChunks.push_back({reinterpret_cast<uint8_t *>(alignedBegin), chunkBytes, 0});
+    mCapacityInBytes += static_cast<int64_t>(chunkBytes);
+    return true;
+}
+
+bool StreamArena::reserve(size_t numBytes) {
+    if (!mChunks.empty() && mChunks.back().size - mChunks.back().used >= numBytes) {
+        return true;
+    }
+    return addChunk(numBytes);
+}
+
+void *StreamArena::allocate(size_t numBytes) {
+    if (numBytes == 0) {
+        return nullptr;
+    }
+    const size_t alignedBytes = getAllocationSize(numBytes);
+    if (!reserve(alignedBytes)) {
+        return nullptr;
+    }
+    // Anonymous mappings are zeroed, and nothing in a chunk is reused.
+    Chunk &chunk = mChunks.back();
+    uint8_t *address = chunk.address + chunk.used;
+    chunk.used += alignedBytes;
+    mUsedBytes += static_cast<int64_t>(alignedBytes);
+    return address;
+}
+
+void StreamArena::collectMemoryRegions(MemoryRegions &regions) const {
+    for (const Chunk &chunk : mChunks) {
+        regions.add(chunk.address, chunk.used);
+    }
+}
+
+} // namespace oboe
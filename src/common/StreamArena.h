@@ -0,0 +1,159 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_STREAM_ARENA_H
+#define OBOE_STREAM_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace oboe {
+
+class MemoryRegions;
+
+/**
+ * Memory for the buffers of one stream, so that they are next to each other
+ * and are mapped with one call instead of one allocation per buffer.
+ *
+ * Buffers are taken from the end of the current chunk. If a buffer does not fit then
+ * a new chunk is mapped. Nothing is freed until the arena is deleted.
+ *
+ * So every buffer lives as long as the stream. A part of the stream that takes buffers from
+ * the arena must call claim() first and may only be set up once. Setting it up again would
+ * grow the arena for the rest of the life of the stream, so claim() refuses it.
+ *
+ * This is not thread safe. Buffers are allocated when a stream is opened.
+ */
+class StreamArena {
+public:
+    StreamArena() = default;
+
+    /**
+     * Unmap every chunk.
+     */
+    ~StreamArena();
+
+    StreamArena(const StreamArena &) = delete;
+    StreamArena &operator=(const StreamArena &) = delete;
+
+    /**
+     * The parts of a stream that allocate from the arena.
+     */
+    enum class Owner : uint32_t {
+        Fifo = 0,
+        CallbackBuffers,
+        FlowGraph,
+        CallbackBatcher,
+        PlaybackScheduler,
+    };
+
+    /**
+     * Call this before an owner allocates its buffers.
+     *
+     * @return false if the owner already claimed this arena, so its buffers were already allocated
+     */
+    bool claim(Owner owner) {
+        const uint32_t bit = 1u << static_cast<uint32_t>(owner);
+        if ((mClaimedOwners & bit) != 0) {
+            return false;
+        }
+        mClaimedOwners |= bit;
+        return true;
+    }
+
+    /**
+     * Back new chunks with transparent huge pages if the kernel allows it.
+     * Each chunk is then at least kHugePageBytes. Call this before the first allocation.
+     */
+    void setHugePagesEnabled(bool enabled) {
+        mHugePagesEnabled = enabled;
+    }
+
+    /**
+     * @param numBytes size of the buffer
+     * @return zeroed memory aligned to kAlignment, or nullptr if numBytes is 0 or out of memory
+     */
+    void *allocate(size_t numBytes);
+
+    template <typename T>
+    T *allocateArray(size_t count) {
+        return static_cast<T *>(allocate(count * sizeof(T)));
+    }
+
+    /**
+     * Map a new chunk now if the current one does not have numBytes free.
+     * Use this to keep the buffers of a stream in one chunk.
+     *
+     * @param numBytes sum of getAllocationSize() of the buffers that will be allocated
+     * @return false if the chunk could not be mapped
+     */
+    bool reserve(size_t numBytes);
+
+    /**
+     * @return space used in a chunk by a buffer of numBytes
+     */
+    static size_t getAllocationSize(size_t numBytes) {
+        return (numBytes + kAlignment - 1) & ~(kAlignment - 1);
+    }
+
+    /**
+     * @return number of bytes mapped by all the chunks
+     */
+    int64_t getCapacityInBytes() const {
+        return mCapacityInBytes;
+    }
+
+    /**
+     * @return number of bytes given out, including alignment padding
+     */
+    int64_t getUsedBytes() const {
+        return mUsedBytes;
+    }
+
+    int32_t getChunkCount() const {
+        return static_cast<int32_t>(mChunks.size());
+    }
+
+    /**
+     * Add the used part of every chunk to the regions.
+     */
+    void collectMemoryRegions(MemoryRegions &regions) const;
+
+    static constexpr size_t kAlignment = 64; // a cache line, so buffers do not share one
+    static constexpr size_t kMinChunkBytes = 16 * 1024;
+    static constexpr size_t kHugePageBytes = 2 * 1024 * 1024;
+
+private:
+    struct Chunk {
+        uint8_t *address;
+        size_t   size;
+        size_t   used; // bytes given out from the start of the chunk
+    };
+
+    // @return false if the chunk could not be mapped
+    bool addChunk(size_t minBytes);
+
+    std::vector<Chunk> mChunks;
+    int64_t            mCapacityInBytes = 0;
+    int64_t            mUsedBytes = 0;
+    bool               mHugePagesEnabled = false;
+    uint32_t           mClaimedOwners = 0; // one bit per Owner
+};
+
+} // namespace oboe
+
+#endif //OBOE_STREAM_ARENA_H
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "oboe/StreamMixer.h"
+#include "AudioClock.h"
+#include "OboeDebug.h"
+#include "VirtualAudioStream.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace oboe;
+
+constexpr int32_t kDefaultMixFrames = 256; // if the device does not report a burst
+constexpr int64_t kMixingPollNanos = 100 * kNanosPerMicrosecond;
+
+// Set while a mixer is calling the virtual streams so that a stream that is stopped
+// from its own data callback does not wait for the callback to finish.
+static thread_local const StreamMixer *sMixingMixer = nullptr;
+
+static void mixInto(float *output, const float *input, int32_t numSamples) {
+    int32_t i = 0;
+#if defined(__ARM_NEON)
+    for (; i + 4 <= numSamples; i += 4) {
+        vst1q_f32(output + i, vaddq_f32(vld1q_f32(output + i), vld1q_f32(input + i)));
+    }
+#endif
+    for (; i < numSamples; i++) {
+        output[i] += input[i];
+    }
+}
+
+StreamMixer::~StreamMixer() {
+    close();
+}
+
+Result StreamMixer::open(const AudioStreamBuilder &builder) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mDeviceStream) {
+        return Result::ErrorInvalidState;
+    }
+    AudioStreamBuilder deviceBuilder(builder);
+    mDeviceErrorCallback = builder.getErrorCallback();
+    deviceBuilder.setDirection(Direction::Output)
+            ->setFormat(AudioFormat::Float)
+            ->setDataCallback(this)
+            ->setErrorCallback(this);
+    std::shared_ptr<AudioStream> deviceStream;
+    Result result = deviceBuilder.openStream(deviceStream);
+    if (result != Result::OK) {
+        return result;
+    }
+    mStreamBufferFrames = (deviceStream->getFramesPerBurst() > 0)
+            ? deviceStream->getFramesPerBurst()
+            : kDefaultMixFrames;
+    mStreamBuffer = std::make_unique<float[]>(
+            mStreamBufferFrames * deviceStream->getChannelCount());
+    mDeviceFramesMixed = 0;
+    mDeviceStream = deviceStream;
+    return Result::OK;
+}
+
+Result StreamMixer::start() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mDeviceStream) {
+        return Result::ErrorClosed;
+    }
+    return mDeviceStream->start();
+}
+
+Result StreamMixer::stop() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mDeviceStream) {
+        return Result::ErrorClosed;
+    }
+    return mDeviceStream->stop();
+}
+
+Result StreamMixer::close() {
+    std::vector<VirtualAudioStream *> streams;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (!mDeviceStream) {
+            return Result::ErrorClosed;
+        }
+        for (auto &slot : mStreams) {
+            VirtualAudioStream *stream = slot.exchange(nullptr);
+            if (stream != nullptr) {
+                stream->detachFromMixer();
+                streams.push_back(stream);
+            }
+        }
+        waitForMixingToFinish();
+        mDeviceStream->close();
+        mDeviceStream.reset();
+    }
+    // The app still owns the virtual streams.
+    for (VirtualAudioStream *stream : streams) {
+        stream->close();
+    }
+    return Result::OK;
+}
+
+Result StreamMixer::openStream(const AudioStreamBuilder &builder,
+                               std::shared_ptr<AudioStream> &stream) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mDeviceStream) {
+        return Result::ErrorInvalidState;
+    }
+    auto freeSlot = std::find_if(std::begin(mStreams), std::end(mStreams),
+            [](const std::atomic<VirtualAudioStream *> &slot) {
+                return slot.load() == nullptr;
+            });
+    if (freeSlot == std::end(mStreams)) {
+        LOGE("StreamMixer::%s() already mixing %d streams", __func__, kMaxStreams);
+        return Result::ErrorNoFreeHandles;
+    }
+    auto virtualStream = new VirtualAudioStream(builder, *this);
+    Result result = virtualStream->open();
+    if (result != Result::OK) {
+        delete virtualStream;
+        return result;
+    }
+    virtualStream->configurePlaybackScheduler(builder.getScheduledEventCapacity());
+    stream.reset(virtualStream);
+    virtualStream->setWeakThis(stream);
+    freeSlot->store(virtualStream);
+    return Result::OK;
+}
+
+int32_t StreamMixer::getStreamCount() const {
+    return static_cast<int32_t>(std::count_if(std::begin(mStreams), std::end(mStreams),
+            [](const std::atomic<VirtualAudioStream *> &slot) {
+                return slot.load() != nullptr;
+            }));
+}
+
+void StreamMixer::removeStream(VirtualAudioStream *stream) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto &slot : mStreams) {
+        VirtualAudioStream *expected = stream;
+        if (slot.compare_exchange_strong(expected, nullptr)) {
+            break;
+        }
+    }
+    waitForMixingToFinish();
+}
+
+void StreamMixer::waitForMixingToFinish() const {
+    if (sMixingMixer == this) {
+        return; // called from a data callback so the state is checked before the next one
+    }
+    const uint32_t sequence = mCallbackSequence.load();
+    if ((sequence & 1) == 0) {
+        return;
+    }
+    while (mCallbackSequence.load() == sequence) {
+        AudioClock::sleepForNanos(kMixingPollNanos);
+    }
+}
+
+DataCallbackResult StreamMixer::onAudioReady(AudioStream *audioStream,
+                                             void *audioData,
+                                             int32_t numFrames) {
+    float *output = static_cast<float *>(audioData);
+    const int32_t channelCount = audioStream->getChannelCount();
+    mCallbackSequence++; // now odd
+    sMixingMixer = this;
+
+    std::fill(output, output + (numFrames * channelCount), 0.0f);
+    for (auto &slot : mStreams) {
+        VirtualAudioStream *stream = slot.load();
+        if (stream == nullptr || stream->getState() != StreamState::Started) {
+            continue;
+        }
+        // Render in pieces that fit in the stream buffer.
+        int32_t framesMixed = 0;
+        while (framesMixed < numFrames) {
+            const int32_t framesToRender = std::min(numFrames - framesMixed, mStreamBufferFrames);
+            const int32_t framesRendered = stream->render(mStreamBuffer.get(), framesToRender,
+                                                          mDeviceFramesMixed + framesMixed);
+            mixInto(output + (framesMixed * channelCount), mStreamBuffer.get(),
+                    framesRendered * channelCount);
+            if (framesRendered < framesToRender) {
+                break; // the app stopped
+            }
+            framesMixed += framesRendered;
+        }
+    }
+    mDeviceFramesMixed += numFrames;
+
+    sMixingMixer = nullptr;
+    mCallbackSequence++; // now even
+    return DataCallbackResult::Continue;
+}
+
+bool StreamMixer::onError(AudioStream *audioStream, Result error) {
+    return mDeviceErrorCallback != nullptr && mDeviceErrorCallback->onError(audioStream, error);
+}
+
+// The virtual streams are not closed by Oboe. They are disconnected and the app closes them
+// from its error callbacks or later.
+void StreamMixer::onErrorBeforeClose(AudioStream *audioStream, Result error) {
+    if (mDeviceErrorCallback != nullptr) {
+        mDeviceErrorCallback->onErrorBeforeClose(audioStream, error);
+    }
+    for (const auto &stream : lockStreams()) {
+        static_cast<VirtualAudioStream *>(stream.get())->setState(StreamState::Disconnected);
+        if (stream->getErrorCallback() != nullptr) {
+            stream->getErrorCallback()->onErrorBeforeClose(stream.get(), error);
+        }
+    }
+}
+
+void StreamMixer::onErrorAfterClose(AudioStream *audioStream, Result error) {
+    if (mDeviceErrorCallback != nullptr) {
+        mDeviceErrorCallback->onErrorAfterClose(audioStream, error);
+    }
+    for (const auto &stream : lockStreams()) {
+        if (stream->getErrorCallback() != nullptr) {
+            stream->getErrorCallback()->onErrorAfterClose(stream.get(), error);
+        }
+    }
+}
+
+// The lock is not held while calling the app so that it can close the streams.
+std::vector<std::shared_ptr<AudioStream>> StreamMixer::lockStreams() {
+    std::vector<std::shared_ptr<AudioStream>> streams;
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto &slot : mStreams) {
+        VirtualAudioStream *stream = slot.load();
+        std::shared_ptr<AudioStream> sharedStream = stream ? stream->lockWeakThis() : nullptr;
+        if (sharedStream) {
+            streams.push_back(std::move(sharedStream));
+        }
+    }
+    return streams;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "common/OboeDebug.h"
+#include "oboe/ThreadPlacement.h"
+
+namespace oboe {
+
+constexpr int32_t kMaxCpus = 64; // bits in a cpuMask
+
+namespace {
+
+struct CoreTypeMasks {
+    uint64_t all = 0;
+    uint64_t efficiency = 0;
+    uint64_t performance = 0;
+};
+
+// @return value from the file or 0 if it cannot be read
+int64_t readSysfsValue(const char *format, int32_t cpu) {
+    char path[96];
+    snprintf(path, sizeof(path), format, cpu);
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+        return 0;
+    }
+    long long value = 0;
+    if (fscanf(file, "%lld", &value) != 1) {
+        value = 0;
+    }
+    fclose(file);
+    return value;
+}
+
+CoreTypeMasks findCoreTypes() {
+    CoreTypeMasks masks;
+    int64_t capacities[kMaxCpus] = {};
+    int64_t minCapacity = INT64_MAX;
+    for (int32_t cpu = 0; cpu < kMaxCpus; cpu++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+        if (access(path, F_OK) != 0) {
+            continue;
+        }
+        masks.all |= 1ULL << cpu;
+        // cpu_capacity is set on big.LITTLE devices. Otherwise use the maximum frequency.
+        int64_t capacity = readSysfsValue("/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+        if (capacity <= 0) {
+            capacity = readSysfsValue(
+                    "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+        }
+        capacities[cpu] = capacity;
+        if (capacity > 0 && capacity < minCapacity) {
+            minCapacity = capacity;
+        }
+    }
+    for (int32_t cpu = 0; cpu < kMaxCpus; cpu++) {
+        if (capacities[cpu] <= 0) continue;
+        if (capacities[cpu] == minCapacity) {
+            masks.efficiency |= 1ULL << cpu;
+        } else {
+            masks.performance |= 1ULL << cpu;
+        }
+    }
+    if (masks.efficiency == 0) {
+        masks.efficiency = masks.all; // types not known
+    }
+    if (masks.performance == 0) {
+        masks.performance = masks.efficiency; // all cores are the same
+    }
+    LOGD("%s() all = 0x%llX, efficiency = 0x%llX, performance = 0x%llX", __func__,
+         (unsigned long long) masks.all,
+         (unsigned long long) masks.efficiency,
+         (unsigned long long) masks.performance);
+    return masks;
+}
+
+} // namespace
+
+uint64_t getCpuMaskForCoreType(CoreType coreType) {
+    static const CoreTypeMasks sMasks = findCoreTypes();
+    switch (coreType) {
+        case CoreType::Efficiency:
+            return sMasks.efficiency;
+        case CoreType::Performance:
+            return sMasks.performance;
+        case CoreType::Any:
+        default:
+            return sMasks.all;
+    }
+}
+
+EffectiveThreadPlacement applyThreadPlacement(const ThreadPlacement &placement) {
+    EffectiveThreadPlacement effective;
+
+    uint64_t cpuMask = 0;
+    for (int32_t cpuId : placement.cpuIds) {
+        if (cpuId >= 0 && cpuId < kMaxCpus) {
+            cpuMask |= 1ULL << cpuId;
+        } else {
+            effective.affinityResult = Result::ErrorOutOfRange;
+        }
+    }
+    if (placement.coreType != CoreType::Any) {
+        uint64_t typeMask = getCpuMaskForCoreType(placement.coreType);
+        if (cpuMask == 0) {
+            cpuMask = typeMask;
+        } else if ((cpuMask & typeMask) != 0) {
+            cpuMask &= typeMask;
+        }
+    }
+    if (cpuMask != 0) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int32_t cpu = 0; cpu < kMaxCpus; cpu++) {
+            if (cpuMask & (1ULL << cpu)) {
+                CPU_SET(cpu, &cpuSet);
+            }
+        }
+        // Zero means the calling thread.
+        if (sched_setaffinity(0, sizeof(cpuSet), &cpuSet) != 0) {
+            LOGW("%s() sched_setaffinity() failed, errno = %d", __func__, errno);
+            effective.affinityResult = Result::ErrorInternal;
+        }
+    }
+
+    if (placement.priority > 0) {
+        sched_param param{};
+        param.sched_priority = placement.priority;
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0) {
+            LOGW("%s() SCHED_FIFO %d not allowed, errno = %d", __func__,
+                 placement.priority, errno);
+            effective.priorityResult = (errno == EINVAL)
+                    ? Result::ErrorOutOfRange
+                    : Result::ErrorInternal;
+        }
+    }
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+        for (int32_t cpu = 0; cpu < kMaxCpus; cpu++) {
+            if (CPU_ISSET(cpu, &cpuSet)) {
+                effective.cpuMask |= 1ULL << cpu;
+            }
+        }
+    }
+    effective.scheduler = sched_getscheduler(0) & ~SCHED_RESET_ON_FORK;
+    sched_param param{};
+    if (sched_getparam(0, &param) == 0) {
+        effective.priority = param.sched_priority;
+    }
+    return effective;
+}
+
+} // namespace oboe
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "oboe/Definitions.h"
+#include "oboe/TimeHistogram.h"
+
+namespace oboe {
+
+// The first kSubBins bins are one microsecond wide.
+// After that each octave is split into kSubBins bins.
+int32_t TimeHistogram::getBinIndex(uint64_t micros) {
+    if (micros < kSubBins) {
+        return static_cast<int32_t>(micros);
+    }
+    int32_t highestBit = 63 - __builtin_clzll(micros);
+    int32_t subBin = static_cast<int32_t>(micros >> (highestBit - kSubBinBits)) & (kSubBins - 1);
+    int32_t index = ((highestBit - kSubBinBits + 1) * kSubBins) + subBin;
+    return std::min(index, kNumBins - 1);
+}
+
+int64_t TimeHistogram::getBinUpperEdgeMicros(int32_t index) {
+    if (index < kSubBins) {
+        return index + 1;
+    }
+    int32_t shift = (index / kSubBins) - 1;
+    int64_t subBin = index % kSubBins;
+    return (kSubBins + subBin + 1) << shift;
+}
+
+void TimeHistogram::add(int64_t nanoseconds) {
+    nanoseconds = std::max(nanoseconds, static_cast<int64_t>(0));
+    std::atomic<uint32_t> &bin = mBins[getBinIndex(nanoseconds / kNanosPerMicrosecond)];
+    // Only one thread adds so there is no need for an atomic increment.
+    bin.store(bin.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    if (nanoseconds > mMaxNanos.load(std::memory_order_relaxed)) {
+        mMaxNanos.store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+int64_t TimeHistogram::getCount() const {
+    int64_t count = 0;
+    for (const std::atomic<uint32_t> &bin : mBins) {
+        count += bin.load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+int64_t TimeHistogram::getPercentileNanos(double percentile) const {
+    // Copy the bins so the total matches the bins even if add() is running.
+    uint32_t bins[kNumBins];
+    int64_t count = 0;
+    for (int32_t i = 0; i < kNumBins; i++) {
+        bins[i] = mBins[i].load(std::memory_order_relaxed);
+        count += bins[i];
+    }
+    if (count == 0) {
+        return 0;
+    }
+    percentile = std::max(0.0, std::min(100.0, percentile));
+    // Number of durations that must be at or below the result.
+    int64_t target = std::max(static_cast<int64_t>(1),
+            static_cast<int64_t>((percentile * count / 100.0) + 0.5));
+    int64_t sum = 0;
+    for (int32_t i = 0; i < kNumBins; i++) {
+        sum += bins[i];
+        if (sum >= target && i < kNumBins - 1) {
+            return std::min(getBinUpperEdgeMicros(i) * kNanosPerMicrosecond, getMaxNanos());
+        }
+    }
+    return getMaxNanos(); // the last bin has no upper edge
+}
+
+void TimeHistogram::reset() {
+    for (std::atomic<uint32_t> &bin : mBins) {
+        bin.store(0, std::memory_order_relaxed);
+    }
+    mMaxNanos.store(0, std::memory_order_relaxed);
+}
+
+} // namespace oboe
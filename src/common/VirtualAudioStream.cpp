@@ -0,0 +1,269 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "AudioClock.h"
+#include "OboeDebug.h"
+#include "VirtualAudioStream.h"
+
+using namespace oboe;
+
+VirtualAudioStream::VirtualAudioStream(const AudioStreamBuilder &builder, StreamMixer &mixer)
+        : AudioStream(builder)
+        , mMixer(&mixer)
+        , mDeviceStream(mixer.getDeviceStream()) {
+}
+
+VirtualAudioStream::~VirtualAudioStream() {
+    if (getState() != StreamState::Closed && getState() != StreamState::Uninitialized) {
+        close();
+    }
+}
+
+Result VirtualAudioStream::open() {
+    if (getState() != StreamState::Uninitialized) {
+        return Result::ErrorInvalidState;
+    }
+    if (mDeviceStream == nullptr) {
+        return Result::ErrorInvalidState;
+    }
+    if (getDirection() != Direction::Output || !isDataCallbackSpecified()) {
+        LOGE("VirtualAudioStream::%s() virtual streams need output and a data callback",
+             __func__);
+        return Result::ErrorIllegalArgument;
+    }
+    if (mChannelCount == kUnspecified) {
+        mChannelCount = mDeviceStream->getChannelCount();
+    }
+    if (mSampleRate == kUnspecified) {
+        mSampleRate = mDeviceStream->getSampleRate();
+    }
+    if (mFormat == AudioFormat::Unspecified) {
+        mFormat = AudioFormat::Float;
+    }
+    if (mSampleRate != mDeviceStream->getSampleRate()
+            && mSampleRateConversionQuality == SampleRateConversionQuality::None) {
+        mSampleRateConversionQuality = SampleRateConversionQuality::Medium;
+    }
+    mRateScaler = static_cast<double>(mSampleRate) / mDeviceStream->getSampleRate();
+
+    // The app sees the timing of the device stream at its own rate.
+    mFramesPerBurst = std::max(1, static_cast<int32_t>(
+            mDeviceStream->getFramesPerBurst() * mRateScaler));
+    mBufferCapacityInFrames = static_cast<int32_t>(
+            mDeviceStream->getBufferCapacityInFrames() * mRateScaler);
+    mBufferSizeInFrames = static_cast<int32_t>(
+            mDeviceStream->getBufferSizeInFrames() * mRateScaler);
+    mDeviceId = mDeviceStream->getDeviceId();
+    mSharingMode = mDeviceStream->getSharingMode();
+    mPerformanceMode = mDeviceStream->getPerformanceMode();
+
+    mFlowGraph = std::make_unique<DataConversionFlowGraph>(getArena());
+    Result result = mFlowGraph->configure(this, mDeviceStream);
+    if (result != Result::OK) {
+        mFlowGraph.reset();
+        return result;
+    }
+    result = AudioStream::open();
+    if (result == Result::OK) {
+        setState(StreamState::Open);
+    }
+    return result;
+}
+
+Result VirtualAudioStream::close() {
+    if (getState() == StreamState::Closed) {
+        return Result::ErrorClosed;
+    }
+    cancelAsyncTransfer();
+    if (mMixer != nullptr) {
+        mMixer->removeStream(this);
+        detachFromMixer();
+    }
+    setState(StreamState::Closed);
+    return AudioStream::close();
+}
+
+Result VirtualAudioStream::requestStart() {
+    switch (getState()) {
+        case StreamState::Open:
+        case StreamState::Paused:
+        case StreamState::Stopped:
+        case StreamState::Flushed:
+            setState(StreamState::Started);
+            return Result::OK;
+        case StreamState::Started:
+            return Result::OK;
+        case StreamState::Closed:
+            return Result::ErrorClosed;
+        default:
+            return Result::ErrorInvalidState;
+    }
+}
+
+Result VirtualAudioStream::requestPause() {
+    switch (getState()) {
+        case StreamState::Started:
+            setState(StreamState::Pausing);
+            if (mMixer != nullptr) {
+                mMixer->waitForMixingToFinish();
+            }
+            setState(StreamState::Paused);
+            return Result::OK;
+        case StreamState::Paused:
+            return Result::OK;
+        case StreamState::Closed:
+            return Result::ErrorClosed;
+        default:
+            return Result::ErrorInvalidState;
+    }
+}
+
+Result VirtualAudioStream::requestFlush() {
+    switch (getState()) {
+        case StreamState::Open:
+        case StreamState::Paused:
+        case StreamState::Stopped:
+        case StreamState::Flushed:
+            // Nothing is buffered. The app is called when the device needs data.
+            setState(StreamState::Flushed);
+            return Result::OK;
+        case StreamState::Closed:
+            return Result::ErrorClosed;
+        default:
+            return Result::ErrorInvalidState;
+    }
+}
+
+Result VirtualAudioStream::requestStop() {
+    switch (getState()) {
+        case StreamState::Started:
+        case StreamState::Pausing:
+        case StreamState::Paused:
+        case StreamState::Flushed:
+            setState(StreamState::Stopping);
+            if (mMixer != nullptr) {
+                mMixer->waitForMixingToFinish();
+            }
+            setState(StreamState::Stopped);
+            return Result::OK;
+        case StreamState::Open:
+        case StreamState::Stopped:
+            return Result::OK;
+        case StreamState::Closed:
+            return Result::ErrorClosed;
+        default:
+            return Result::ErrorInvalidState;
+    }
+}
+
+Result VirtualAudioStream::waitForStateChange(StreamState currentState,
+                                              StreamState *nextState,
+                                              int64_t timeoutNanoseconds) {
+    Result oboeResult = Result::ErrorTimeout;
+    int64_t sleepTimeNanos = 1 * kNanosPerMillisecond; // arbitrary
+    int64_t timeLeftNanos = timeoutNanoseconds;
+
+    while (true) {
+        const StreamState state = getState();
+        if (nextState != nullptr) {
+            *nextState = state;
+        }
+        if (currentState != state) { // state changed?
+            oboeResult = Result::OK;
+            break;
+        }
+
+        // Did we timeout or did user ask for non-blocking?
+        if (timeLeftNanos <= 0) {
+            break;
+        }
+
+        if (sleepTimeNanos > timeLeftNanos){
+            sleepTimeNanos = timeLeftNanos;
+        }
+        AudioClock::sleepForNanos(sleepTimeNanos);
+        timeLeftNanos -= sleepTimeNanos;
+    }
+
+    return oboeResult;
+}
+
+int32_t VirtualAudioStream::render(float *buffer, int32_t numFrames, int64_t deviceFramePosition) {
+    int32_t framesRead = std::max(0, mFlowGraph->read(buffer, numFrames, 0));
+    const int64_t framesRendered = mDeviceFramesRendered.load() + framesRead;
+    mDeviceFramesRendered.store(framesRendered);
+    mDeviceFrameOffset.store(deviceFramePosition + framesRead - framesRendered);
+    if (framesRead < numFrames) {
+        // The app returned DataCallbackResult::Stop.
+        StreamState expected = StreamState::Started;
+        mState.compare_exchange_strong(expected, StreamState::Stopped);
+    }
+    return framesRead;
+}
+
+ResultWithValue<int32_t> VirtualAudioStream::getXRunCount() {
+    if (mDeviceStream == nullptr) {
+        return ResultWithValue<int32_t>(Result::ErrorClosed);
+    }
+    return mDeviceStream->getXRunCount();
+}
+
+bool VirtualAudioStream::isXRunCountSupported() const {
+    return mDeviceStream != nullptr && mDeviceStream->isXRunCountSupported();
+}
+
+AudioApi VirtualAudioStream::getAudioApi() const {
+    return (mDeviceStream != nullptr) ? mDeviceStream->getAudioApi() : AudioApi::Unspecified;
+}
+
+ResultWithValue<double> VirtualAudioStream::calculateLatencyMillis() {
+    if (mDeviceStream == nullptr) {
+        return ResultWithValue<double>(Result::ErrorClosed);
+    }
+    return mDeviceStream->calculateLatencyMillis();
+}
+
+// Map the presentation position of the device to the frames of this stream.
+Result VirtualAudioStream::getTimestamp(clockid_t clockId,
+                                        int64_t *framePosition,
+                                        int64_t *timeNanoseconds) {
+    if (mDeviceStream == nullptr) {
+        return Result::ErrorClosed;
+    }
+    int64_t devicePosition = 0;
+    Result result = mDeviceStream->getTimestamp(clockId, &devicePosition, timeNanoseconds);
+    if (result != Result::OK) {
+        return result;
+    }
+    const int64_t framesRendered = mDeviceFramesRendered.load();
+    const int64_t renderedPosition = std::min(devicePosition - mDeviceFrameOffset.load(),
+                                              framesRendered);
+    if (framesRendered == 0 || renderedPosition < 0) {
+        return Result::ErrorUnavailable; // nothing from this stream was presented yet
+    }
+    *framePosition = static_cast<int64_t>(renderedPosition * mRateScaler);
+    return Result::OK;
+}
+
+void VirtualAudioStream::updateFramesRead() {
+    mFramesRead = static_cast<int64_t>(mDeviceFramesRendered.load() * mRateScaler);
+}
+
+void VirtualAudioStream::updateFramesWritten() {
+    mFramesWritten = static_cast<int64_t>(mDeviceFramesRendered.load() * mRateScaler);
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_VIRTUAL_AUDIO_STREAM_H
+#define OBOE_VIRTUAL_AUDIO_STREAM_H
+
+#include <atomic>
+#include <memory>
+
+#include "oboe/AudioStream.h"
+#include "oboe/StreamMixer.h"
+#include "DataConversionFlowGraph.h"
+
+namespace oboe {
+
+/**
+ * An output stream that is mixed into the device stream of a StreamMixer.
+ *
+ * The app callback is called from the callback of the device stream through a
+ * DataConversionFlowGraph that converts to the format, channel count and rate of the device.
+ * Starting and stopping only change the state. The device stream keeps running.
+ */
+class VirtualAudioStream : public AudioStream {
+public:
+    VirtualAudioStream(const AudioStreamBuilder &builder, StreamMixer &mixer);
+
+    // Closes the stream if the app did not.
+    virtual ~VirtualAudioStream();
+
+    /**
+     * Configure the conversion to the device stream.
+     * This should only be called by the StreamMixer.
+     */
+    Result open() override;
+
+    Result close() override;
+
+    Result requestStart() override;
+    Result requestPause() override;
+    Result requestFlush() override;
+    Result requestStop() override;
+
+    StreamState getState() override {
+        return mState.load();
+    }
+
+    Result waitForStateChange(StreamState currentState,
+                              StreamState *nextState,
+                              int64_t timeoutNanoseconds) override;
+
+    ResultWithValue<int32_t> getXRunCount() override;
+
+    bool isXRunCountSupported() const override;
+
+    AudioApi getAudioApi() const override;
+
+    ResultWithValue<double> calculateLatencyMillis() override;
+
+    Result getTimestamp(clockid_t clockId,
+                        int64_t *framePosition,
+                        int64_t *timeNanoseconds) override;
+
+    SampleRateConversionQuality getActiveSampleRateConversionQuality() override {
+        return mFlowGraph ? mFlowGraph->getActiveSampleRateConversionQuality()
+                : SampleRateConversionQuality::None;
+    }
+
+    Result setBiquadFilterCoefficients(int32_t stage,
+                                       const BiquadFilterCoefficients &coefficients) override {
+        return mFlowGraph ? mFlowGraph->setBiquadFilterCoefficients(stage, coefficients)
+                : Result::ErrorInvalidState;
+    }
+
+    /**
+     * Call the app and convert its data to the device format.
+     * This is called by the StreamMixer from the device callback.
+     *
+     * @param buffer float frames at the rate and channel count of the device
+     * @param numFrames number of device frames wanted
+     * @param deviceFramePosition number of frames the mixer had written to the device before
+     * @return number of frames rendered, less than numFrames if the app stopped
+     */
+    int32_t render(float *buffer, int32_t numFrames, int64_t deviceFramePosition);
+
+    /**
+     * The app callback returned Stop, or the device stream was disconnected.
+     * This is called by the StreamMixer.
+     */
+    void setState(StreamState state) {
+        mState.store(state);
+    }
+
+    /**
+     * The device stream is closing. This is called by the StreamMixer with its lock held.
+     */
+    void detachFromMixer() {
+        mMixer = nullptr;
+        mDeviceStream = nullptr;
+    }
+
+protected:
+    void updateFramesRead() override;
+    void updateFramesWritten() override;
+
+private:
+    StreamMixer                              *mMixer;
+    AudioStream                              *mDeviceStream;
+    std::unique_ptr<DataConversionFlowGraph>  mFlowGraph;
+    std::atomic<StreamState>                  mState{StreamState::Uninitialized};
+    std::atomic<int64_t>                      mDeviceFramesRendered{0};
+    // Device frame position minus mDeviceFramesRendered, which grows while not started.
+    std::atomic<int64_t>                      mDeviceFrameOffset{0};
+    double                                    mRateScaler = 1.0; // this rate over device rate
+};
+
+} // namespace oboe
+
+#endif //OBOE_VIRTUAL_AUDIO_STREAM_H
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <memory.h>
+#include <stdint.h>
+
+#include "oboe/ConvertingFifoBuffer.h"
+#include "oboe/Utilities.h"
+
+namespace oboe {
+
+// Small enough to stay in L1 cache when converting between two integer formats.
+constexpr int32_t kConversionBlockSize = 256;
+constexpr int32_t kBytesPerI24Packed = 3;
+
+// These loops are simple enough for the compiler to vectorize, except for packed I24.
+
+static void convertI16ToFloat(const int16_t *source, float *destination, int32_t numSamples) {
+    constexpr float kScale = 1.0f / 32768.0f;
+    for (int32_t i = 0; i < numSamples; i++) {
+        destination[i] = source[i] * kScale;
+    }
+}
+
+static void convertFloatToI16(const float *source, int16_t *destination, int32_t numSamples) {
+    for (int32_t i = 0; i < numSamples; i++) {
+        int32_t n = static_cast<int32_t>(source[i] * 32768.0f);
+        destination[i] = static_cast<int16_t>(
+                std::min<int32_t>(INT16_MAX, std::max<int32_t>(INT16_MIN, n))); // clip
+    }
+}
+
+static void convertI32ToFloat(const int32_t *source, float *destination, int32_t numSamples) {
+    constexpr float kScale = 1.0 / (1UL << 31);
+    for (int32_t i = 0; i < numSamples; i++) {
+        destination[i] = source[i] * kScale;
+    }
+}
+
+// Same rounding and clipping as FlowgraphUtilities::clamp32FromFloat().
+static void convertFloatToI32(const float *source, int32_t *destination, int32_t numSamples) {
+    constexpr float kScale = static_cast<float>(1UL << 31);
+    for (int32_t i = 0; i < numSamples; i++) {
+        float f = source[i];
+        int32_t n;
+        if (f <= -1.0f) {
+            n = INT32_MIN;
+        } else if (f >= 1.0f) {
+            n = INT32_MAX;
+        } else {
+            f *= kScale;
+            n = static_cast<int32_t>(f > 0 ? f + 0.5f : f - 0.5f);
+        }
+        destination[i] = n;
+    }
+}
+
+static void convertI24ToFloat(const uint8_t *source, float *destination, int32_t numSamples) {
+    constexpr float kScale = 1.0 / (1UL << 31);
+    for (int32_t i = 0; i < numSamples; i++) {
+        // Assemble the data assuming Little Endian format.
+        // Shift to 32 bit data so the sign is correct.
+        int32_t pad = static_cast<int32_t>((static_cast<uint32_t>(source[2]) << 24)
+                | (static_cast<uint32_t>(source[1]) << 16)
+                | (static_cast<uint32_t>(source[0]) << 8));
+        source += kBytesPerI24Packed;
+        destination[i] = pad * kScale;
+    }
+}
+
+static void convertFloatToI24(const float *source, uint8_t *destination, int32_t numSamples) {
+    const int32_t kI24PackedMax = 0x007FFFFF;
+    const int32_t kI24PackedMin = static_cast<int32_t>(0xFF800000);
+    for (int32_t i = 0; i < numSamples; i++) {
+        int32_t n = static_cast<int32_t>(source[i] * 0x00800000);
+        n = std::min(kI24PackedMax, std::max(kI24PackedMin, n)); // clip
+        // Write as a packed 24-bit integer in Little Endian format.
+        *destination++ = static_cast<uint8_t>(n);
+        *destination++ = static_cast<uint8_t>(n >> 8);
+        *destination++ = static_cast<uint8_t>(n >> 16);
+    }
+}
+
+static bool isSupported(AudioFormat format) {
+    return format == AudioFormat::I16 || format == AudioFormat::I24
+            || format == AudioFormat::I32 || format == AudioFormat::Float;
+}
+
+static void convertToFloat(const void *source, AudioFormat format,
+                           float *destination, int32_t numSamples) {
+    switch (format) {
+        case AudioFormat::I16:
+            convertI16ToFloat(static_cast<const int16_t *>(source), destination, numSamples);
+            break;
+        case AudioFormat::I24:
+            convertI24ToFloat(static_cast<const uint8_t *>(source), destination, numSamples);
+            break;
+        case AudioFormat::I32:
+            convertI32ToFloat(static_cast<const int32_t *>(source), destination, numSamples);
+            break;
+        default:
+            memcpy(destination, source, numSamples * sizeof(float));
+            break;
+    }
+}
+
+static void convertFromFloat(const float *source,
+                             void *destination, AudioFormat format, int32_t numSamples) {
+    switch (format) {
+        case AudioFormat::I16:
+            convertFloatToI16(source, static_cast<int16_t *>(destination), numSamples);
+            break;
+        case AudioFormat::I24:
+            convertFloatToI24(source, static_cast<uint8_t *>(destination), numSamples);
+            break;
+        case AudioFormat::I32:
+            convertFloatToI32(source, static_cast<int32_t *>(destination), numSamples);
+            break;
+        default:
+            memcpy(destination, source, numSamples * sizeof(float));
+            break;
+    }
+}
+
+Result ConvertingFifoBuffer::convert(const void *source,
+                                     AudioFormat sourceFormat,
+                                     void *destination,
+                                     AudioFormat destinationFormat,
+                                     int32_t numSamples) {
+    if (!isSupported(sourceFormat) || !isSupported(destinationFormat)) {
+        return Result::ErrorInvalidFormat;
+    }
+    if (numSamples <= 0) {
+        return Result::OK;
+    }
+    if (sourceFormat == destinationFormat) {
+        memcpy(destination, source, numSamples * convertFormatToSizeInBytes(sourceFormat));
+    } else if (sourceFormat == AudioFormat::Float) {
+        convertFromFloat(static_cast<const float *>(source),
+                         destination, destinationFormat, numSamples);
+    } else if (destinationFormat == AudioFormat::Float) {
+        convertToFloat(source, sourceFormat, static_cast<float *>(destination), numSamples);
+    } else {
+        // Go through float in small blocks that stay in the cache.
+        const uint8_t *sourceBytes = static_cast<const uint8_t *>(source);
+        uint8_t *destinationBytes = static_cast<uint8_t *>(destination);
+        const int32_t sourceSize = convertFormatToSizeInBytes(sourceFormat);
+        const int32_t destinationSize = convertFormatToSizeInBytes(destinationFormat);
+        float block[kConversionBlockSize];
+        while (numSamples > 0) {
+            int32_t samplesToConvert = std::min(numSamples, kConversionBlockSize);
+            convertToFloat(sourceBytes, sourceFormat, block, samplesToConvert);
+            convertFromFloat(block, destinationBytes, destinationFormat, samplesToConvert);
+            sourceBytes += samplesToConvert * sourceSize;
+            destinationBytes += samplesToConvert * destinationSize;
+            numSamples -= samplesToConvert;
+        }
+    }
+    return Result::OK;
+}
+
+ConvertingFifoBuffer::ConvertingFifoBuffer(AudioFormat writeFormat,
+                                           AudioFormat readFormat,
+                                           int32_t channelCount,
+                                           uint32_t capacityInFrames)
+        : mWriteFormat(writeFormat)
+        , mReadFormat(readFormat)
+        , mChannelCount(channelCount)
+        , mBytesPerReadFrame(channelCount * convertFormatToSizeInBytes(readFormat))
+        , mFifoBuffer(channelCount * convertFormatToSizeInBytes(writeFormat), capacityInFrames)
+{
+}
+
+int32_t ConvertingFifoBuffer::read(void *destination, int32_t framesToRead) {
+    FifoSpan span = mFifoBuffer.acquireRead(framesToRead);
+    if (span.getNumFrames() == 0) {
+        return 0;
+    }
+    // Convert straight out of the FIFO storage, in up to two parts.
+    uint8_t *destinationBytes = static_cast<uint8_t *>(destination);
+    Result result = convert(span.data1, mWriteFormat, destinationBytes, mReadFormat,
+                            span.numFrames1 * mChannelCount);
+    if (result != Result::OK) {
+        return static_cast<int32_t>(result);
+    }
+    if (span.numFrames2 > 0) {
+        destinationBytes += span.numFrames1 * mBytesPerReadFrame;
+        convert(span.data2, mWriteFormat, destinationBytes, mReadFormat,
+                span.numFrames2 * mChannelCount);
+    }
+    const int32_t framesRead = span.getNumFrames();
+    const int32_t framesValid = mFifoBuffer.commitRead(framesRead);
+    if (framesValid < framesRead) {
+        // Drop the oldest frames, which were overwritten while they were converted.
+        uint8_t *start = static_cast<uint8_t *>(destination);
+        memmove(start, start + ((framesRead - framesValid) * mBytesPerReadFrame),
+                static_cast<size_t>(framesValid * mBytesPerReadFrame));
+    }
+    return framesValid;
+}
+
+} // namespace oboe
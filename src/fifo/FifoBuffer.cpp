@@ -15,27 +15,40 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <memory.h>
 #include <stdint.h>
 
 #include "oboe/FifoControllerBase.h"
 #include "fifo/FifoController.h"
 #include "fifo/FifoControllerIndirect.h"
+#include "fifo/FifoControllerMasked.h"
+#include "fifo/FifoResidencyTracker.h"
+#include "common/AudioClock.h"
 #include "oboe/FifoBuffer.h"
 
 namespace oboe {
 
 FifoBuffer::FifoBuffer(uint32_t bytesPerFrame, uint32_t capacityInFrames)
+        : FifoBuffer(bytesPerFrame, capacityInFrames, new uint8_t[bytesPerFrame * capacityInFrames])
+{
+    mStorageOwned = true;
+}
+
+FifoBuffer::FifoBuffer(uint32_t bytesPerFrame, uint32_t capacityInFrames,
+                       uint8_t *dataStorageAddress)
         : mBytesPerFrame(bytesPerFrame)
-        , mStorage(nullptr)
+        , mStorage(dataStorageAddress)
+        , mStorageOwned(false)
         , mFramesReadCount(0)
         , mFramesUnderrunCount(0)
 {
-    mFifo = std::make_unique<FifoController>(capacityInFrames);
-    // allocate buffer
-    int32_t bytesPerBuffer = bytesPerFrame * capacityInFrames;
-    mStorage = new uint8_t[bytesPerBuffer];
-    mStorageOwned = true;
+    // Use a mask instead of a modulo for the indices if possible.
+    if (FifoControllerMasked::isPowerOfTwo(capacityInFrames)) {
+        mFifo = std::make_unique<FifoControllerMasked>(capacityInFrames);
+    } else {
+        mFifo = std::make_unique<FifoController>(capacityInFrames);
+    }
 }
 
 FifoBuffer::FifoBuffer( uint32_t  bytesPerFrame,
@@ -66,89 +79,163 @@ int32_t FifoBuffer::convertFramesToBytes(int32_t frames) {
     return frames * mBytesPerFrame;
 }
 
-int32_t FifoBuffer::read(void *buffer, int32_t numFrames) {
+FifoSpan FifoBuffer::getSpan(uint32_t index, uint32_t numFrames) const {
+    FifoSpan span;
+    span.data1 = &mStorage[index * mBytesPerFrame];
+    uint32_t framesToEnd = mFifo->getFrameCapacity() - index;
+    if (numFrames > framesToEnd) {
+        // wraps around, second part is at the beginning of mStorage
+        span.numFrames1 = static_cast<int32_t>(framesToEnd);
+        span.data2 = &mStorage[0];
+        span.numFrames2 = static_cast<int32_t>(numFrames - framesToEnd);
+    } else {
+        span.numFrames1 = static_cast<int32_t>(numFrames);
+    }
+    return span;
+}
+
+// Same clipping as FifoControllerBase::getFullFramesAvailable().
+uint32_t FifoBuffer::getFramesBetween(uint64_t readCounter, uint64_t writeCounter) const {
+    if (readCounter > writeCounter) {
+        return 0;
+    }
+    uint64_t delta = writeCounter - readCounter;
+    uint32_t capacity = mFifo->getFrameCapacity();
+    return (delta >= capacity) ? capacity : static_cast<uint32_t>(delta);
+}
+
+FifoSpan FifoBuffer::acquireRead(int32_t maxFrames) {
+    if (maxFrames <= 0) {
+        return FifoSpan();
+    }
+    // safe because maxFrames is guaranteed positive
+    uint32_t framesWanted = static_cast<uint32_t>(maxFrames);
+    uint64_t readCounter = mFifo->getReadCounter();
+    mAcquiredReadCounter = readCounter;
+    uint32_t framesAvailable = getFramesBetween(readCounter, mCachedWriteCounter);
+    if (framesAvailable < framesWanted) {
+        // The writer may have written more since we last looked.
+        mCachedWriteCounter = mFifo->getWriteCounter();
+        framesAvailable = getFramesBetween(readCounter, mCachedWriteCounter);
+    }
+    // Use the counter that was checked. writeOverwritingOldest() may have moved it since.
+    return getSpan(mFifo->getIndexForCounter(readCounter),
+                   std::min(framesWanted, framesAvailable));
+}
+
+int32_t FifoBuffer::commitRead(int32_t numFrames) {
     if (numFrames <= 0) {
         return 0;
     }
-    // safe because numFrames is guaranteed positive
-    uint32_t framesToRead = static_cast<uint32_t>(numFrames);
-    uint32_t framesAvailable = mFifo->getFullFramesAvailable();
-    framesToRead = std::min(framesToRead, framesAvailable);
+    // Like a seqlock. If writeOverwritingOldest() moved the read counter past some of
+    // these frames then they may have been overwritten while they were being read.
+    // The fence makes sure that the counter is loaded after the frames were read.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t readCounter = mFifo->getReadCounter();
+    const uint64_t framesOverwritten = (readCounter > mAcquiredReadCounter)
+            ? std::min<uint64_t>(readCounter - mAcquiredReadCounter, numFrames)
+            : 0;
+    // The writer may have already moved the read counter so do not simply add to it.
+    mFifo->advanceReadCounterTo(mAcquiredReadCounter + static_cast<uint32_t>(numFrames));
+    if (mResidencyTracker) {
+        mResidencyTracker->onRead(mFifo->getReadCounter(), AudioClock::getNanoseconds());
+    }
+    return numFrames - static_cast<int32_t>(framesOverwritten);
+}
 
-    uint32_t readIndex = mFifo->getReadIndex(); // ranges 0 to capacity
-    uint8_t *destination = reinterpret_cast<uint8_t *>(buffer);
-    uint8_t *source = &mStorage[convertFramesToBytes(readIndex)];
-    if ((readIndex + framesToRead) > mFifo->getFrameCapacity()) {
-        // read in two parts, first part here is at the end of the mStorage buffer
-        int32_t frames1 = static_cast<int32_t>(mFifo->getFrameCapacity() - readIndex);
-        int32_t numBytes = convertFramesToBytes(frames1);
-        if (numBytes < 0) {
-            return static_cast<int32_t>(Result::ErrorOutOfRange);
-        }
-        memcpy(destination, source, static_cast<size_t>(numBytes));
-        destination += numBytes;
-        // read second part, which is at the beginning of mStorage
-        source = &mStorage[0];
-        int32_t frames2 = static_cast<uint32_t>(framesToRead - frames1);
-        numBytes = convertFramesToBytes(frames2);
-        if (numBytes < 0) {
-            return static_cast<int32_t>(Result::ErrorOutOfRange);
-        }
-        memcpy(destination, source, static_cast<size_t>(numBytes));
-    } else {
-        // just read in one shot
-        int32_t numBytes = convertFramesToBytes(framesToRead);
-        if (numBytes < 0) {
-            return static_cast<int32_t>(Result::ErrorOutOfRange);
+FifoSpan FifoBuffer::acquireWrite(int32_t maxFrames) {
+    if (maxFrames <= 0) {
+        return FifoSpan();
+    }
+    // Guaranteed positive.
+    uint32_t framesWanted = static_cast<uint32_t>(maxFrames);
+    uint32_t capacity = mFifo->getFrameCapacity();
+    uint64_t writeCounter = mFifo->getWriteCounter();
+    uint32_t framesEmpty = capacity - getFramesBetween(mCachedReadCounter, writeCounter);
+    if (framesEmpty < framesWanted) {
+        // The reader may have read more since we last looked.
+        mCachedReadCounter = mFifo->getReadCounter();
+        framesEmpty = capacity - getFramesBetween(mCachedReadCounter, writeCounter);
+    }
+    return getSpan(mFifo->getIndexForCounter(writeCounter), std::min(framesWanted, framesEmpty));
+}
+
+void FifoBuffer::commitWrite(int32_t numFrames) {
+    if (numFrames > 0) {
+        if (mResidencyTracker) {
+            mResidencyTracker->onWrite(mFifo->getWriteCounter(), AudioClock::getNanoseconds());
         }
-        memcpy(destination, source, static_cast<size_t>(numBytes));
+        mFifo->advanceWriteIndex(static_cast<uint32_t>(numFrames));
     }
-    mFifo->advanceReadIndex(framesToRead);
+}
 
-    return framesToRead;
+int32_t FifoBuffer::read(void *buffer, int32_t numFrames) {
+    if (numFrames <= 0) {
+        return 0;
+    }
+    FifoSpan span = acquireRead(numFrames);
+    uint8_t *destination = reinterpret_cast<uint8_t *>(buffer);
+    int32_t numBytes1 = convertFramesToBytes(span.numFrames1);
+    memcpy(destination, span.data1, static_cast<size_t>(numBytes1));
+    if (span.numFrames2 > 0) {
+        memcpy(destination + numBytes1, span.data2,
+               static_cast<size_t>(convertFramesToBytes(span.numFrames2)));
+    }
+    int32_t framesRead = span.getNumFrames();
+    int32_t framesValid = commitRead(framesRead);
+    if (framesValid < framesRead) {
+        // Drop the oldest frames, which the writer overwrote while they were copied.
+        int32_t framesDropped = framesRead - framesValid;
+        memmove(destination, destination + convertFramesToBytes(framesDropped),
+                static_cast<size_t>(convertFramesToBytes(framesValid)));
+    }
+    return framesValid;
 }
 
 int32_t FifoBuffer::write(const void *buffer, int32_t numFrames) {
     if (numFrames <= 0) {
         return 0;
     }
-    // Guaranteed positive.
+    FifoSpan span = acquireWrite(numFrames);
+    const uint8_t *source = reinterpret_cast<const uint8_t *>(buffer);
+    int32_t numBytes1 = convertFramesToBytes(span.numFrames1);
+    memcpy(span.data1, source, static_cast<size_t>(numBytes1));
+    if (span.numFrames2 > 0) {
+        memcpy(span.data2, source + numBytes1,
+               static_cast<size_t>(convertFramesToBytes(span.numFrames2)));
+    }
+    int32_t framesWritten = span.getNumFrames();
+    commitWrite(framesWritten);
+    return framesWritten;
+}
+
+int32_t FifoBuffer::writeOverwritingOldest(const void *buffer,
+                                           int32_t numFrames,
+                                           int32_t framesToKeep) {
+    if (numFrames <= 0) {
+        return 0;
+    }
+    // Keep at least the new frames but no more than the capacity.
     uint32_t framesToWrite = static_cast<uint32_t>(numFrames);
-    uint32_t framesAvailable = mFifo->getEmptyFramesAvailable();
-    framesToWrite = std::min(framesToWrite, framesAvailable);
+    uint32_t capacity = mFifo->getFrameCapacity();
+    uint32_t maxFullFrames = std::min(capacity,
+            std::max(framesToWrite, static_cast<uint32_t>(std::max(framesToKeep, 0))));
+    framesToWrite = std::min(framesToWrite, maxFullFrames);
 
-    uint32_t writeIndex = mFifo->getWriteIndex();
-    int byteIndex = convertFramesToBytes(writeIndex);
-    const uint8_t *source = reinterpret_cast<const uint8_t *>(buffer);
-    uint8_t *destination = &mStorage[byteIndex];
-    if ((writeIndex + framesToWrite) > mFifo->getFrameCapacity()) {
-        // write in two parts, first part here
-        int32_t frames1 = static_cast<uint32_t>(mFifo->getFrameCapacity() - writeIndex);
-        int32_t numBytes = convertFramesToBytes(frames1);
-        if (numBytes < 0) {
-            return static_cast<int32_t>(Result::ErrorOutOfRange);
-        }
-        memcpy(destination, source, static_cast<size_t>(numBytes));
-        // read second part
-        source += convertFramesToBytes(frames1);
-        destination = &mStorage[0];
-        int frames2 = static_cast<uint32_t>(framesToWrite - frames1);
-        numBytes = convertFramesToBytes(frames2);
-        if (numBytes < 0) {
-            return static_cast<int32_t>(Result::ErrorOutOfRange);
-        }
-        memcpy(destination, source, static_cast<size_t>(numBytes));
-    } else {
-        // just write in one shot
-        int32_t numBytes = convertFramesToBytes(framesToWrite);
-        if (numBytes < 0) {
-            return static_cast<int32_t>(Result::ErrorOutOfRange);
+    uint64_t writeCounter = mFifo->getWriteCounter();
+    if (writeCounter + framesToWrite > maxFullFrames) {
+        uint64_t minReadCounter = writeCounter + framesToWrite - maxFullFrames;
+        uint64_t previous = mFifo->advanceReadCounterTo(minReadCounter);
+        if (minReadCounter > previous) {
+            mFramesDiscardedCount.fetch_add(minReadCounter - previous,
+                                            std::memory_order_relaxed);
         }
-        memcpy(destination, source, static_cast<size_t>(numBytes));
+        mCachedReadCounter = std::max(previous, minReadCounter);
+        // Make the new read counter visible before the frames are overwritten.
+        // This pairs with the fence in commitRead().
+        std::atomic_thread_fence(std::memory_order_release);
     }
-    mFifo->advanceWriteIndex(framesToWrite);
-
-    return framesToWrite;
+    return write(buffer, static_cast<int32_t>(framesToWrite));
 }
 
 int32_t FifoBuffer::readNow(void *buffer, int32_t numFrames) {
@@ -171,6 +258,18 @@ int32_t FifoBuffer::readNow(void *buffer, int32_t numFrames) {
 }
 
 
+void FifoBuffer::setResidencyTrackingEnabled(bool enabled) {
+    if (!enabled) {
+        mResidencyTracker.reset();
+    } else if (!mResidencyTracker) {
+        mResidencyTracker = std::make_unique<FifoResidencyTracker>();
+    }
+}
+
+const TimeHistogram *FifoBuffer::getResidencyHistogram() const {
+    return mResidencyTracker ? &mResidencyTracker->getHistogram() : nullptr;
+}
+
 uint32_t FifoBuffer::getBufferCapacityInFrames() const {
     return mFifo->getFrameCapacity();
 }
@@ -42,6 +42,13 @@ public:
     virtual void incrementReadCounter(uint64_t n) override {
         mReadCounter.fetch_add(n, std::memory_order_acq_rel);
     }
+    virtual uint64_t advanceReadCounterTo(uint64_t n) override {
+        uint64_t previous = mReadCounter.load(std::memory_order_acquire);
+        while (previous < n
+                && !mReadCounter.compare_exchange_weak(previous, n, std::memory_order_acq_rel)) {
+        }
+        return previous;
+    }
     virtual uint64_t getWriteCounter() const override {
         return mWriteCounter.load(std::memory_order_acquire);
     }
@@ -53,8 +60,9 @@ public:
     }
 
 private:
-    std::atomic<uint64_t> mReadCounter{};
-    std::atomic<uint64_t> mWriteCounter{};
+    // The counters are written by different threads so keep them on separate cache lines.
+    alignas(kCacheLineSize) std::atomic<uint64_t> mReadCounter{};
+    alignas(kCacheLineSize) std::atomic<uint64_t> mWriteCounter{};
 };
 
 } // namespace oboe
@@ -43,9 +43,9 @@ uint32_t FifoControllerBase::getFullFramesAvailable() const {
     return static_cast<uint32_t>(delta);
 }
 
-uint32_t FifoControllerBase::getReadIndex() const {
+uint32_t FifoControllerBase::getIndexForCounter(uint64_t counter) const {
     // % works with non-power of two sizes
-    return static_cast<uint32_t>(getReadCounter() % mTotalFrames);
+    return static_cast<uint32_t>(counter % mTotalFrames);
 }
 
 void FifoControllerBase::advanceReadIndex(uint32_t numFrames) {
@@ -56,11 +56,6 @@ uint32_t FifoControllerBase::getEmptyFramesAvailable() const {
     return static_cast<uint32_t>(mTotalFrames - getFullFramesAvailable());
 }
 
-uint32_t FifoControllerBase::getWriteIndex() const {
-    // % works with non-power of two sizes
-    return static_cast<uint32_t>(getWriteCounter() % mTotalFrames);
-}
-
 void FifoControllerBase::advanceWriteIndex(uint32_t numFrames) {
     incrementWriteCounter(numFrames);
 }
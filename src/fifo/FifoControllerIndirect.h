@@ -44,6 +44,13 @@ public:
     virtual void incrementReadCounter(uint64_t n) override {
         mReadCounterAddress->fetch_add(n, std::memory_order_acq_rel);
     }
+    virtual uint64_t advanceReadCounterTo(uint64_t n) override {
+        uint64_t previous = mReadCounterAddress->load(std::memory_order_acquire);
+        while (previous < n
+                && !mReadCounterAddress->compare_exchange_weak(previous, n, std::memory_order_acq_rel)) {
+        }
+        return previous;
+    }
     virtual uint64_t getWriteCounter() const override {
         return mWriteCounterAddress->load(std::memory_order_acquire);
     }
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVEOBOE_FIFOCONTROLLERMASKED_H
+#define NATIVEOBOE_FIFOCONTROLLERMASKED_H
+
+#include <stdint.h>
+
+#include "FifoController.h"
+
+namespace oboe {
+
+/**
+ * A FifoController whose capacity is a power of two.
+ *
+ * The indices are calculated with a mask instead of a 64-bit modulo,
+ * which is a library call on 32-bit ARM.
+ */
+class FifoControllerMasked : public FifoController
+{
+public:
+    explicit FifoControllerMasked(uint32_t bufferSize);
+    virtual ~FifoControllerMasked() = default;
+
+    static bool isPowerOfTwo(uint32_t n) {
+        return (n != 0) && ((n & (n - 1)) == 0);
+    }
+
+    uint32_t getIndexForCounter(uint64_t counter) const override {
+        return static_cast<uint32_t>(counter & mFrameMask);
+    }
+
+private:
+    const uint64_t mFrameMask;
+};
+
+} // namespace oboe
+
+#endif //NATIVEOBOE_FIFOCONTROLLERMASKED_H
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVEOBOE_FIFORESIDENCYTRACKER_H
+#define NATIVEOBOE_FIFORESIDENCYTRACKER_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "oboe/FifoControllerBase.h"
+#include "oboe/TimeHistogram.h"
+
+namespace oboe {
+
+/**
+ * Measure how long blocks of frames stay in a FIFO.
+ *
+ * The writer records the position and time of every block it writes in a small lock-free
+ * queue, beside the audio data. When the reader moves past the start of a block,
+ * the time since it was written is added to a histogram.
+ *
+ * If the queue is full then the writer skips the record, so a slow reader
+ * cannot block the writer.
+ */
+class FifoResidencyTracker {
+public:
+    /**
+     * Called by the writer before the frames are committed.
+     *
+     * @param position write counter at the start of the block
+     * @param timeNanos CLOCK_MONOTONIC time when the block was written
+     */
+    void onWrite(uint64_t position, int64_t timeNanos) {
+        uint32_t head = mHead.load(std::memory_order_relaxed);
+        uint32_t tail = mTail.load(std::memory_order_acquire);
+        if (head - tail >= kMaxRecords) {
+            return; // full
+        }
+        Record &record = mRecords[head & (kMaxRecords - 1)];
+        record.position = position;
+        record.timeNanos = timeNanos;
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+    /**
+     * Called by the reader after the read counter has been advanced.
+     *
+     * @param readCounter the new read counter
+     * @param timeNanos CLOCK_MONOTONIC time when the frames were read
+     */
+    void onRead(uint64_t readCounter, int64_t timeNanos) {
+        uint32_t tail = mTail.load(std::memory_order_relaxed);
+        uint32_t head = mHead.load(std::memory_order_acquire);
+        while (tail != head) {
+            const Record &record = mRecords[tail & (kMaxRecords - 1)];
+            if (record.position >= readCounter) {
+                break; // not read yet
+            }
+            mHistogram.add(timeNanos - record.timeNanos);
+            tail++;
+        }
+        mTail.store(tail, std::memory_order_release);
+    }
+
+    const TimeHistogram &getHistogram() const {
+        return mHistogram;
+    }
+
+private:
+    static constexpr uint32_t kMaxRecords = 64; // power of two
+
+    struct Record {
+        uint64_t position;
+        int64_t  timeNanos;
+    };
+
+    Record                mRecords[kMaxRecords];
+    alignas(FifoControllerBase::kCacheLineSize) std::atomic<uint32_t> mHead{0}; // writer
+    alignas(FifoControllerBase::kCacheLineSize) std::atomic<uint32_t> mTail{0}; // reader
+    TimeHistogram         mHistogram; // updated by the reader
+};
+
+} // namespace oboe
+
+#endif //NATIVEOBOE_FIFORESIDENCYTRACKER_H
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common/OboeDebug.h"
+#include "oboe/FifoControllerBase.h"
+#include "oboe/SharedFifoBuffer.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+namespace oboe {
+
+// The counters are accessed from both processes so they must not use a lock.
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "64-bit atomics must be lock-free to be shared between processes");
+
+constexpr uint32_t kSharedFifoMagic = 0x4F424646; // "OBFF"
+constexpr uint32_t kSharedFifoVersion = 1;
+
+/**
+ * Layout of the start of the shared memory region. The frames follow the header.
+ */
+struct SharedFifoHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t bytesPerFrame;
+    uint32_t capacityInFrames;
+    // Written by different processes so keep them on separate cache lines.
+    alignas(FifoControllerBase::kCacheLineSize) std::atomic<uint64_t> readCounter;
+    alignas(FifoControllerBase::kCacheLineSize) std::atomic<uint64_t> writeCounter;
+};
+
+constexpr size_t kStorageOffset = sizeof(SharedFifoHeader);
+
+// The peer must not be able to change the size of the region while it is mapped,
+// or an access past the end would raise SIGBUS.
+constexpr int kRequiredSeals = F_SEAL_SHRINK | F_SEAL_GROW;
+
+static uint8_t *getStorage(void *address) {
+    return reinterpret_cast<uint8_t *>(address) + kStorageOffset;
+}
+
+static int createSharedMemory(const char *name) {
+#if defined(__NR_memfd_create)
+    // Call the kernel directly because memfd_create() is only in libc since API 30.
+    return static_cast<int>(syscall(__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING));
+#else
+    (void) name;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// Read a header field that the peer process may be changing.
+static uint32_t readOnce(const uint32_t &value) {
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+
+SharedFifoBuffer::SharedFifoBuffer(int fileDescriptor,
+                                   void *address,
+                                   size_t sizeInBytes,
+                                   uint32_t bytesPerFrame,
+                                   uint32_t capacityInFrames)
+        : mFileDescriptor(fileDescriptor)
+        , mAddress(address)
+        , mSizeInBytes(sizeInBytes)
+{
+    // Use the sizes that were checked, not the header, which the peer can still write.
+    SharedFifoHeader *header = reinterpret_cast<SharedFifoHeader *>(address);
+    mFifoBuffer = std::make_unique<FifoBuffer>(bytesPerFrame,
+                                               capacityInFrames,
+                                               &header->readCounter,
+                                               &header->writeCounter,
+                                               getStorage(address));
+}
+
+SharedFifoBuffer::~SharedFifoBuffer() {
+    mFifoBuffer.reset();
+    munmap(mAddress, mSizeInBytes);
+    close(mFileDescriptor);
+}
+
+Result SharedFifoBuffer::map(int fileDescriptor, size_t sizeInBytes, void **address) {
+    void *mapped = mmap(nullptr, sizeInBytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fileDescriptor, 0);
+    if (mapped == MAP_FAILED) {
+        LOGE("SharedFifoBuffer::%s() mmap() failed, %s", __func__, strerror(errno));
+        return Result::ErrorNoMemory;
+    }
+    *address = mapped;
+    return Result::OK;
+}
+
+Result SharedFifoBuffer::create(uint32_t bytesPerFrame,
+                                uint32_t capacityInFrames,
+                                std::unique_ptr<SharedFifoBuffer> &sharedFifo) {
+    if (bytesPerFrame == 0 || capacityInFrames == 0
+            || capacityInFrames > (UINT32_MAX / 4) / bytesPerFrame) {
+        LOGE("SharedFifoBuffer::%s() invalid size", __func__);
+        return Result::ErrorIllegalArgument;
+    }
+    size_t sizeInBytes = kStorageOffset
+            + (static_cast<size_t>(bytesPerFrame) * capacityInFrames);
+
+    int fd = createSharedMemory("oboe_fifo");
+    if (fd < 0) {
+        LOGE("SharedFifoBuffer::%s() memfd_create() failed, %s", __func__, strerror(errno));
+        return Result::ErrorInternal;
+    }
+    if (ftruncate(fd, static_cast<off_t>(sizeInBytes)) < 0) {
+        LOGE("SharedFifoBuffer::%s() ftruncate() failed, %s", __func__, strerror(errno));
+        close(fd);
+        return Result::ErrorNoMemory;
+    }
+    if (fcntl(fd, F_ADD_SEALS, kRequiredSeals | F_SEAL_SEAL) < 0) {
+        LOGE("SharedFifoBuffer::%s() sealing failed, %s", __func__, strerror(errno));
+        close(fd);
+        return Result::ErrorInternal;
+    }
+    void *address = nullptr;
+    Result result = map(fd, sizeInBytes, &address);
+    if (result != Result::OK) {
+        close(fd);
+        return result;
+    }
+
+    // The region is zero filled by ftruncate() so the counters start at zero.
+    SharedFifoHeader *header = new (address) SharedFifoHeader();
+    header->bytesPerFrame = bytesPerFrame;
+    header->capacityInFrames = capacityInFrames;
+    header->version = kSharedFifoVersion;
+    header->magic = kSharedFifoMagic;
+
+    sharedFifo.reset(new SharedFifoBuffer(fd, address, sizeInBytes,
+                                          bytesPerFrame, capacityInFrames));
+    return Result::OK;
+}
+
+Result SharedFifoBuffer::attach(int fileDescriptor, std::unique_ptr<SharedFifoBuffer> &sharedFifo) {
+    // Check the seals first so that the size from fstat() cannot change.
+    const int seals = fcntl(fileDescriptor, F_GET_SEALS);
+    if (seals < 0 || (seals & kRequiredSeals) != kRequiredSeals) {
+        LOGE("SharedFifoBuffer::%s() not a sealed shared FIFO", __func__);
+        return Result::ErrorIllegalArgument;
+    }
+    struct stat status;
+    if (fstat(fileDescriptor, &status) < 0
+            || static_cast<size_t>(status.st_size) < kStorageOffset) {
+        LOGE("SharedFifoBuffer::%s() not a shared FIFO", __func__);
+        return Result::ErrorIllegalArgument;
+    }
+    int fd = fcntl(fileDescriptor, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) {
+        LOGE("SharedFifoBuffer::%s() dup failed, %s", __func__, strerror(errno));
+        return Result::ErrorInternal;
+    }
+    size_t sizeInBytes = static_cast<size_t>(status.st_size);
+    void *address = nullptr;
+    Result result = map(fd, sizeInBytes, &address);
+    if (result != Result::OK) {
+        close(fd);
+        return result;
+    }
+
+    // Check that the region was made by create() and is big enough for the frames.
+    // Read each field once because the peer process may change the header at any time.
+    const SharedFifoHeader *header = reinterpret_cast<const SharedFifoHeader *>(address);
+    const uint32_t magic = readOnce(header->magic);
+    const uint32_t version = readOnce(header->version);
+    const uint32_t bytesPerFrame = readOnce(header->bytesPerFrame);
+    const uint32_t capacityInFrames = readOnce(header->capacityInFrames);
+    size_t bytesNeeded = kStorageOffset
+            + (static_cast<size_t>(bytesPerFrame) * capacityInFrames);
+    if (magic != kSharedFifoMagic
+            || version != kSharedFifoVersion
+            || bytesPerFrame == 0
+            || capacityInFrames == 0
+            || capacityInFrames > (UINT32_MAX / 4) / bytesPerFrame
+            || bytesNeeded > sizeInBytes) {
+        LOGE("SharedFifoBuffer::%s() invalid header", __func__);
+        munmap(address, sizeInBytes);
+        close(fd);
+        return Result::ErrorInvalidFormat;
+    }
+
+    sharedFifo.reset(new SharedFifoBuffer(fd, address, sizeInBytes,
+                                          bytesPerFrame, capacityInFrames));
+    return Result::OK;
+}
+
+} // namespace oboe
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <math.h>
+#include <unistd.h>
+#include "FlowGraphNode.h"
+#include "BiquadCascade.h"
+
+using namespace FLOWGRAPH_OUTER_NAMESPACE::flowgraph;
+
+BiquadCoefficients BiquadCoefficients::makeDcBlocker(float pole) {
+    BiquadCoefficients coefficients;
+    coefficients.b0 = 1.0f;
+    coefficients.b1 = -1.0f;
+    coefficients.a1 = -pole;
+    return coefficients;
+}
+
+// Normalize cookbook coefficients so that a0 is 1.0.
+static BiquadCoefficients normalize(double b0, double b1, double b2,
+                                    double a0, double a1, double a2) {
+    BiquadCoefficients coefficients;
+    coefficients.b0 = static_cast<float>(b0 / a0);
+    coefficients.b1 = static_cast<float>(b1 / a0);
+    coefficients.b2 = static_cast<float>(b2 / a0);
+    coefficients.a1 = static_cast<float>(a1 / a0);
+    coefficients.a2 = static_cast<float>(a2 / a0);
+    return coefficients;
+}
+
+BiquadCoefficients BiquadCoefficients::makeLowPass(float sampleRate, float frequency, float q) {
+    double w0 = 2.0 * M_PI * frequency / sampleRate;
+    double cosW0 = cos(w0);
+    double alpha = sin(w0) / (2.0 * q);
+    return normalize((1.0 - cosW0) / 2.0, 1.0 - cosW0, (1.0 - cosW0) / 2.0,
+                     1.0 + alpha, -2.0 * cosW0, 1.0 - alpha);
+}
+
+BiquadCoefficients BiquadCoefficients::makeHighPass(float sampleRate, float frequency, float q) {
+    double w0 = 2.0 * M_PI * frequency / sampleRate;
+    double cosW0 = cos(w0);
+    double alpha = sin(w0) / (2.0 * q);
+    return normalize((1.0 + cosW0) / 2.0, -(1.0 + cosW0), (1.0 + cosW0) / 2.0,
+                     1.0 + alpha, -2.0 * cosW0, 1.0 - alpha);
+}
+
+BiquadCoefficients BiquadCoefficients::makePeaking(float sampleRate, float frequency, float q,
+                                                   float gainDecibels) {
+    double a = pow(10.0, gainDecibels / 40.0);
+    double w0 = 2.0 * M_PI * frequency / sampleRate;
+    double cosW0 = cos(w0);
+    double alpha = sin(w0) / (2.0 * q);
+    return normalize(1.0 + (alpha * a), -2.0 * cosW0, 1.0 - (alpha * a),
+                     1.0 + (alpha / a), -2.0 * cosW0, 1.0 - (alpha / a));
+}
+
+BiquadCascade::BiquadCascade(int32_t channelCount, int32_t numStages, int32_t sampleRate)
+        : FlowGraphFilter(channelCount)
+        , mNumStages(std::max(1, std::min(numStages, kMaxStages)))
+        , mSmoothingLengthInFrames(sampleRate * kDefaultSmoothingMillis / 1000) {
+    assert(numStages >= 1 && numStages <= kMaxStages);
+    mState = std::make_unique<float[]>(static_cast<size_t>(mNumStages) * channelCount * 2);
+}
+
+void BiquadCascade::reset() {
+    FlowGraphFilter::reset();
+    std::fill(mState.get(), mState.get() + (mNumStages * output.getSamplesPerFrame() * 2), 0.0f);
+}
+
+void BiquadCascade::setCoefficients(int32_t stage, const BiquadCoefficients &coefficients) {
+    if (stage < 0 || stage >= mNumStages) return;
+    mWriterCoefficients[stage] = coefficients;
+    mCoefficientSets[mWriterIndex] = mWriterCoefficients;
+    // Publish our set and take the old middle set for the next write.
+    mWriterIndex = mMiddleIndex.exchange(mWriterIndex | kNewDataFlag, std::memory_order_acq_rel)
+            & kIndexMask;
+}
+
+void BiquadCascade::checkForNewCoefficients() {
+    if ((mMiddleIndex.load(std::memory_order_relaxed) & kNewDataFlag) != 0) {
+        mReaderIndex = mMiddleIndex.exchange(mReaderIndex, std::memory_order_acq_rel)
+                & kIndexMask;
+        const CoefficientSet &target = mCoefficientSets[mReaderIndex];
+        int32_t length = mSmoothingLengthInFrames.load();
+        // If the filter has not run yet then start immediately with the new coefficients.
+        if (length <= 0 || !mHasRun) {
+            mCurrent = target;
+            mRemaining = 0;
+        } else {
+            // Start a new ramp from the current coefficients.
+            float scaler = 1.0f / length;
+            for (int32_t stage = 0; stage < mNumStages; stage++) {
+                mIncrement[stage].b0 = (target[stage].b0 - mCurrent[stage].b0) * scaler;
+                mIncrement[stage].b1 = (target[stage].b1 - mCurrent[stage].b1) * scaler;
+                mIncrement[stage].b2 = (target[stage].b2 - mCurrent[stage].b2) * scaler;
+                mIncrement[stage].a1 = (target[stage].a1 - mCurrent[stage].a1) * scaler;
+                mIncrement[stage].a2 = (target[stage].a2 - mCurrent[stage].a2) * scaler;
+            }
+            mRemaining = length;
+        }
+    }
+}
+
+/**
+ * Run every transposed direct form II section on one frame before moving to the next frame.
+ * Each section depends on its own previous output, so running the sections together lets
+ * the CPU overlap their dependency chains. The channels are independent so the channel
+ * loop can be vectorized.
+ *
+ * When kChannelCount is not zero the loop count is known at compile time
+ * and the state is kept in local arrays, which the compiler can hold in registers.
+ */
+template <int32_t kChannelCount>
+static void processFrames(const BiquadCoefficients *coefficients,
+                          int32_t numStages,
+                          float *state,
+                          const float *inputBuffer,
+                          float *outputBuffer,
+                          int32_t numFrames,
+                          int32_t runtimeChannelCount) {
+    constexpr int32_t kLocalChannelCount = std::max(kChannelCount, 1);
+    const int32_t channelCount = (kChannelCount > 0) ? kChannelCount : runtimeChannelCount;
+    float localZ1[BiquadCascade::kMaxStages][kLocalChannelCount];
+    float localZ2[BiquadCascade::kMaxStages][kLocalChannelCount];
+    if (kChannelCount > 0) {
+        for (int32_t stage = 0; stage < numStages; stage++) {
+            const float *stageState = &state[stage * channelCount * 2];
+            std::copy(stageState, stageState + channelCount, localZ1[stage]);
+            std::copy(stageState + channelCount, stageState + (2 * channelCount), localZ2[stage]);
+        }
+    }
+
+    float localFrame[kLocalChannelCount];
+    for (int32_t i = 0; i < numFrames; i++) {
+        // Filter the frame in place, in a local array if possible.
+        float *frame = (kChannelCount > 0) ? localFrame : outputBuffer;
+        std::copy(inputBuffer, inputBuffer + channelCount, frame);
+        for (int32_t stage = 0; stage < numStages; stage++) {
+            const BiquadCoefficients &c = coefficients[stage];
+            float *z1 = (kChannelCount > 0) ? localZ1[stage] : &state[stage * channelCount * 2];
+            float *z2 = (kChannelCount > 0) ? localZ2[stage] : z1 + channelCount;
+            for (int32_t ch = 0; ch < channelCount; ch++) {
+                float x = frame[ch];
+                float y = (c.b0 * x) + z1[ch];
+                z1[ch] = (c.b1 * x) - (c.a1 * y) + z2[ch];
+                z2[ch] = (c.b2 * x) - (c.a2 * y);
+                frame[ch] = y;
+            }
+        }
+        if (kChannelCount > 0) {
+            std::copy(localFrame, localFrame + channelCount, outputBuffer);
+        }
+        inputBuffer += channelCount;
+        outputBuffer += channelCount;
+    }
+
+    if (kChannelCount > 0) {
+        for (int32_t stage = 0; stage < numStages; stage++) {
+            float *stageState = &state[stage * channelCount * 2];
+            std::copy(localZ1[stage], localZ1[stage] + channelCount, stageState);
+            std::copy(localZ2[stage], localZ2[stage] + channelCount, stageState + channelCount);
+        }
+    }
+}
+
+void BiquadCascade::processStages(const float *inputBuffer,
+                                  float *outputBuffer,
+                                  int32_t numFrames) {
+    const int32_t channelCount = output.getSamplesPerFrame();
+    const BiquadCoefficients *coefficients = mCurrent.data();
+    float *state = mState.get();
+    switch (channelCount) {
+        case 1:
+            processFrames<1>(coefficients, mNumStages, state,
+                             inputBuffer, outputBuffer, numFrames, 1);
+            break;
+        case 2:
+            processFrames<2>(coefficients, mNumStages, state,
+                             inputBuffer, outputBuffer, numFrames, 2);
+            break;
+        case 4:
+            processFrames<4>(coefficients, mNumStages, state,
+                             inputBuffer, outputBuffer, numFrames, 4);
+            break;
+        case 8:
+            processFrames<8>(coefficients, mNumStages, state,
+                             inputBuffer, outputBuffer, numFrames, 8);
+            break;
+        default:
+            processFrames<0>(coefficients, mNumStages, state,
+                             inputBuffer, outputBuffer, numFrames, channelCount);
+            break;
+    }
+}
+
+int32_t BiquadCascade::onProcess(int32_t numFrames) {
+    process(input.getBuffer(), output.getBuffer(), numFrames);
+    return numFrames;
+}
+
+void BiquadCascade::process(const float *inputBuffer, float *outputBuffer, int32_t numFrames) {
+    checkForNewCoefficients();
+    mHasRun = true;
+
+    if (mRemaining > 0) { // Ramping? This doesn't happen very often.
+        // Step the coefficients once per block of kDefaultBufferSize frames or less.
+        int32_t framesLeft = numFrames;
+        while (framesLeft > 0 && mRemaining > 0) {
+            int32_t framesToRamp = std::min(std::min(framesLeft, mRemaining), kDefaultBufferSize);
+            stepCoefficients(framesToRamp);
+            processStages(inputBuffer, outputBuffer, framesToRamp);
+            inputBuffer += framesToRamp * output.getSamplesPerFrame();
+            outputBuffer += framesToRamp * output.getSamplesPerFrame();
+            framesLeft -= framesToRamp;
+        }
+        numFrames = framesLeft;
+    }
+
+    processStages(inputBuffer, outputBuffer, numFrames);
+}
+
+void BiquadCascade::stepCoefficients(int32_t numFrames) {
+    mRemaining -= numFrames;
+    if (mRemaining <= 0) {
+        mRemaining = 0;
+        mCurrent = mCoefficientSets[mReaderIndex]; // avoid accumulated rounding errors
+    } else {
+        for (int32_t stage = 0; stage < mNumStages; stage++) {
+            mCurrent[stage].b0 += mIncrement[stage].b0 * numFrames;
+            mCurrent[stage].b1 += mIncrement[stage].b1 * numFrames;
+            mCurrent[stage].b2 += mIncrement[stage].b2 * numFrames;
+            mCurrent[stage].a1 += mIncrement[stage].a1 * numFrames;
+            mCurrent[stage].a2 += mIncrement[stage].a2 * numFrames;
+        }
+    }
+}
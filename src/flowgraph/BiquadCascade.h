@@ -0,0 +1,168 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FLOWGRAPH_BIQUAD_CASCADE_H
+#define FLOWGRAPH_BIQUAD_CASCADE_H
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "FlowGraphNode.h"
+
+namespace FLOWGRAPH_OUTER_NAMESPACE::flowgraph {
+
+/**
+ * Coefficients for one second order IIR section, normalized so that a0 is 1.0.
+ *
+ *     y[n] = b0 * x[n] + b1 * x[n-1] + b2 * x[n-2] - a1 * y[n-1] - a2 * y[n-2]
+ *
+ * The default coefficients pass the signal through unchanged.
+ * The factory methods use the formulas from Robert Bristow-Johnson's "Audio EQ Cookbook".
+ */
+struct BiquadCoefficients {
+    float b0 = 1.0f;
+    float b1 = 0.0f;
+    float b2 = 0.0f;
+    float a1 = 0.0f;
+    float a2 = 0.0f;
+
+    /**
+     * First order DC blocking filter, H(z) = (1 - z^-1) / (1 - pole * z^-1).
+     * @param pole close to but less than 1.0, eg. 0.995
+     */
+    static BiquadCoefficients makeDcBlocker(float pole);
+
+    static BiquadCoefficients makeLowPass(float sampleRate, float frequency, float q);
+
+    static BiquadCoefficients makeHighPass(float sampleRate, float frequency, float q);
+
+    /**
+     * Boost or cut a band around the center frequency.
+     * @param gainDecibels positive to boost, negative to cut
+     */
+    static BiquadCoefficients makePeaking(float sampleRate, float frequency, float q,
+                                          float gainDecibels);
+};
+
+/**
+ * A cascade of biquad filters, eg. for EQ or DC blocking.
+ *
+ * Each section uses the transposed direct form II, which only needs two state
+ * variables per channel. All channels of a frame are independent so they are
+ * processed in the same inner loop, which the compiler can vectorize.
+ *
+ * The coefficients may be changed by another thread while the filter is running.
+ * They are passed to the audio thread through a lock-free triple buffer.
+ * The filter then ramps smoothly to the new coefficients to avoid clicks.
+ */
+class BiquadCascade : public FlowGraphFilter {
+public:
+    static constexpr int32_t kMaxStages = 8;
+    static constexpr int32_t kDefaultSmoothingMillis = 10;
+
+    /**
+     * @param channelCount number of interleaved channels
+     * @param numStages number of biquad sections, between 1 and kMaxStages
+     * @param sampleRate used to set the default smoothing length
+     */
+    BiquadCascade(int32_t channelCount, int32_t numStages, int32_t sampleRate);
+
+    virtual ~BiquadCascade() = default;
+
+    int32_t onProcess(int32_t numFrames) override;
+
+    /**
+     * Filter interleaved data directly, without connecting to a flowgraph.
+     * This can be used in an app callback. Do not mix with onProcess().
+     *
+     * @param inputBuffer numFrames of input, may be the same as outputBuffer
+     * @param outputBuffer numFrames of output
+     * @param numFrames number of frames to process
+     */
+    void process(const float *inputBuffer, float *outputBuffer, int32_t numFrames);
+
+    /**
+     * Clear the filter history.
+     */
+    void reset() override;
+
+    /**
+     * Set the coefficients of one stage. Other stages are unchanged.
+     *
+     * This may be safely called while the filter is running.
+     * It is lock-free but must not be called by more than one thread at a time.
+     *
+     * @param stage index between 0 and getNumStages() - 1
+     * @param coefficients normalized coefficients
+     */
+    void setCoefficients(int32_t stage, const BiquadCoefficients &coefficients);
+
+    int32_t getNumStages() const {
+        return mNumStages;
+    }
+
+    /**
+     * This is used for the next coefficient change.
+     * The default is kDefaultSmoothingMillis at the sample rate passed to the constructor.
+     * Set to zero to switch coefficients immediately.
+     */
+    void setSmoothingLengthInFrames(int32_t frames) {
+        mSmoothingLengthInFrames = frames;
+    }
+
+    int32_t getSmoothingLengthInFrames() const {
+        return mSmoothingLengthInFrames;
+    }
+
+    const char *getName() override {
+        return "BiquadCascade";
+    }
+
+private:
+    using CoefficientSet = std::array<BiquadCoefficients, kMaxStages>;
+
+    // Called by the audio thread.
+    void checkForNewCoefficients();
+    void stepCoefficients(int32_t numFrames);
+    void processStages(const float *inputBuffer, float *outputBuffer, int32_t numFrames);
+
+    const int32_t              mNumStages;
+    std::unique_ptr<float[]>   mState; // z1 and z2 for every stage and channel
+
+    // Triple buffer. The writer and the reader each own one set.
+    // They swap sets with the middle using an atomic exchange.
+    static constexpr uint32_t  kIndexMask = 0x3;
+    static constexpr uint32_t  kNewDataFlag = 0x4;
+    std::array<CoefficientSet, 3> mCoefficientSets;
+    std::atomic<uint32_t>      mMiddleIndex{1};
+    uint32_t                   mWriterIndex = 2;
+    uint32_t                   mReaderIndex = 0;
+    CoefficientSet             mWriterCoefficients; // accumulates changes to single stages
+
+    // Only used by the audio thread.
+    CoefficientSet             mCurrent;
+    CoefficientSet             mIncrement;
+    int32_t                    mRemaining = 0;
+    bool                       mHasRun = false;
+    std::atomic<int32_t>       mSmoothingLengthInFrames;
+};
+
+} /* namespace FLOWGRAPH_OUTER_NAMESPACE::flowgraph */
+
+#endif //FLOWGRAPH_BIQUAD_CASCADE_H
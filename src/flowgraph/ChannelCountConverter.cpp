@@ -41,7 +41,7 @@ int32_t ChannelCountConverter::onProcess(int32_t numFrames) {
             // Wrap if we run out of inputs.
             // Discard if we run out of outputs.
             outputBuffer[outputChannel] = inputBuffer[inputChannel];
-            inputChannel = (inputChannel == inputChannelCount)
+            inputChannel = (inputChannel + 1 == inputChannelCount)
                     ? 0 : inputChannel + 1;
         }
         inputBuffer += inputChannelCount;
@@ -382,6 +382,13 @@ public:
         mFrameIndex = 0;
     }
 
+    /**
+     * @return number of frames taken from the buffer passed to setData()
+     */
+    int32_t getFramesRead() const {
+        return mFrameIndex;
+    }
+
 protected:
     const void *mData = nullptr;
     int32_t     mSizeInFrames = 0; // number of frames in mData
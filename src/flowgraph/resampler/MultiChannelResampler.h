@@ -195,6 +195,28 @@ public:
         return mChannelCount;
     }
 
+    /**
+     * Continue from the same fractional position as another resampler with the same rates,
+     * so that the output of the two can be mixed, eg. when crossfading between qualities.
+     * Write the most recent input frames to this resampler before calling this.
+     *
+     * @param other resampler made for the same input and output rates
+     */
+    virtual void copyPhase(const MultiChannelResampler &other) {
+        mIntegerPhase = other.mIntegerPhase;
+    }
+
+    /**
+     * Call visit(address, numBytes) for each buffer used by process(),
+     * eg. to touch the memory before it is used in real time.
+     */
+    template <typename Visitor>
+    void forEachBuffer(Visitor visit) const {
+        visit(mCoefficients.data(), mCoefficients.size() * sizeof(float));
+        visit(mX.data(), mX.size() * sizeof(float));
+        visit(mSingleFrame.data(), mSingleFrame.size() * sizeof(float));
+    }
+
     static float hammingWindow(float radians, float spread);
 
     static float sinc(float radians);
@@ -58,3 +58,15 @@ void PolyphaseResampler::readFrame(float *frame) {
         frame[channel] = mSingleFrame[channel];
     }
 }
+
+void PolyphaseResampler::copyPhase(const MultiChannelResampler &other) {
+    MultiChannelResampler::copyPhase(other);
+    // Row N of the coefficients is used when (N * mNumerator) % mDenominator matches the phase.
+    const int32_t phase = getIntegerPhase() % mDenominator;
+    for (int32_t row = 0; row < mDenominator; row++) {
+        if ((static_cast<int64_t>(row) * mNumerator) % mDenominator == phase) {
+            mCoefficientCursor = row * mNumTaps;
+            break;
+        }
+    }
+}
@@ -42,6 +42,8 @@ public:
 
     void readFrame(float *frame) override;
 
+    void copyPhase(const MultiChannelResampler &other) override;
+
 protected:
 
     int32_t                mCoefficientCursor = 0;
@@ -0,0 +1,520 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <errno.h>
+#include <random>
+#include <sched.h>
+
+#include "common/AudioClock.h"
+#include "common/OboeDebug.h"
+#include "common/StreamArena.h"
+#include "null/AudioStreamNull.h"
+
+namespace oboe {
+
+constexpr int32_t kDefaultBurstsPerCapacity = 16; // same as AudioStreamBuffered
+constexpr int32_t kCyclesPerFifoDeviceBuffer = 2; // like the OpenSL ES buffer queue
+constexpr int     kDeviceThreadPriority = 2; // SCHED_FIFO priority used for audio on Android
+constexpr int     kJitterSeed = 1; // so runs can be repeated
+constexpr int32_t kOfflineStatsIntervalCycles = 256; // power of two
+
+static void *runDeviceThread(void *arg) {
+    static_cast<AudioStreamNull *>(arg)->runDevice();
+    return nullptr;
+}
+
+static void *renderOfflineThread(void *arg) {
+    static_cast<AudioStreamNull *>(arg)->renderOffline();
+    return nullptr;
+}
+
+AudioStreamNull::AudioStreamNull(const AudioStreamBuilder &builder)
+        : AudioStreamBuffered(builder) {
+}
+
+AudioStreamNull::~AudioStreamNull() {
+    std::unique_lock<std::mutex> lock(mLock);
+    stopThread(lock);
+}
+
+Result AudioStreamNull::open() {
+    if (getState() != StreamState::Uninitialized) {
+        return Result::ErrorInvalidState;
+    }
+    if (isOffline() && (getDirection() != Direction::Output || usingFIFO())) {
+        LOGE("AudioStreamNull::%s() offline streams need output and a data callback", __func__);
+        return Result::ErrorIllegalArgument;
+    }
+    // The simulated device accepts whatever the app asks for.
+    if (mSampleRate == kUnspecified) {
+        mSampleRate = DefaultStreamValues::SampleRate;
+    }
+    if (mChannelCount == kUnspecified) {
+        mChannelCount = DefaultStreamValues::ChannelCount;
+    }
+    if (mFormat == AudioFormat::Unspecified) {
+        mFormat = AudioFormat::Float;
+    }
+    mFramesPerBurst = (getSimulatedFramesPerBurst() > 0)
+            ? getSimulatedFramesPerBurst()
+            : DefaultStreamValues::FramesPerBurst;
+    // Call back with the requested size, like AAudio does.
+    mFramesPerCycle = (mFramesPerCallback > 0) ? mFramesPerCallback : mFramesPerBurst;
+    if (mBufferCapacityInFrames == kUnspecified) {
+        mBufferCapacityInFrames = mFramesPerBurst * kDefaultBurstsPerCapacity;
+    }
+    mBufferCapacityInFrames = std::max(mBufferCapacityInFrames, 2 * mFramesPerCycle);
+
+    // The device buffer can be resized when the app uses a callback.
+    // Otherwise the FIFO is resized and the device buffer stays small.
+    mDeviceCapacity = usingFIFO() ? kCyclesPerFifoDeviceBuffer * mFramesPerCycle
+                                  : mBufferCapacityInFrames;
+    mDeviceBufferSize = usingFIFO() ? mFramesPerCycle : mBufferCapacityInFrames;
+
+    // Map the FIFO and the cycle buffer together.
+    const size_t fifoBytes = static_cast<size_t>(calculateFifoCapacityInFrames())
+            * static_cast<size_t>(getBytesPerFrame());
+    const size_t cycleBytes = static_cast<size_t>(mFramesPerCycle)
+            * static_cast<size_t>(getBytesPerFrame());
+    getArena().reserve(StreamArena::getAllocationSize(fifoBytes)
+            + StreamArena::getAllocationSize(cycleBytes));
+    Result result = allocateFifo();
+    if (result != Result::OK) {
+        return result;
+    }
+    mBufferSizeInFrames = getBufferCapacityInFrames();
+
+    mCycleBuffer = getArena().allocateArray<uint8_t>(cycleBytes);
+    if (mCycleBuffer == nullptr) {
+        return Result::ErrorNoMemory;
+    }
+    setState(StreamState::Open);
+    return Result::OK;
+}
+
+Result AudioStreamNull::close() {
+    cancelAsyncTransfer();
+    std::unique_lock<std::mutex> lock(mLock);
+    if (getState() == StreamState::Closed) {
+        return Result::ErrorClosed;
+    }
+    stopThread(lock);
+    setState(StreamState::Closed);
+    lock.unlock();
+    return AudioStream::close();
+}
+
+Result AudioStreamNull::requestStart() {
+    std::unique_lock<std::mutex> lock(mLock);
+    StreamState initialState = getState();
+    switch (initialState) {
+        case StreamState::Starting:
+        case StreamState::Started:
+            return Result::OK;
+        case StreamState::Uninitialized:
+        case StreamState::Closed:
+            return Result::ErrorClosed;
+        default:
+            break;
+    }
+    // The thread may still be running if the callback returned Stop.
+    stopThread(lock);
+    if (isOffline()) {
+        Result result = getOfflineSink()->onStart(getFormat(), getChannelCount(),
+                                                  getSampleRate());
+        if (result != Result::OK) {
+            return result;
+        }
+    }
+
+    // Set the state first because the thread may stop itself right away.
+    setDataCallbackEnabled(true);
+    setState(StreamState::Started);
+    Result result = startThread_l();
+    if (result != Result::OK) {
+        setState(initialState);
+    }
+    return result;
+}
+
+Result AudioStreamNull::requestPause() {
+    if (getDirection() == Direction::Input) {
+        return Result::ErrorUnimplemented; // same as AAudio
+    }
+    std::unique_lock<std::mutex> lock(mLock);
+    switch (getState()) {
+        case StreamState::Pausing:
+        case StreamState::Paused:
+            return Result::OK;
+        case StreamState::Uninitialized:
+        case StreamState::Closed:
+            return Result::ErrorClosed;
+        default:
+            break;
+    }
+    setState(StreamState::Pausing);
+    stopThread(lock);
+    if (getState() == StreamState::Pausing) {
+        setState(StreamState::Paused);
+    }
+    return Result::OK;
+}
+
+Result AudioStreamNull::requestFlush() {
+    if (getDirection() == Direction::Input) {
+        return Result::ErrorUnimplemented;
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    switch (getState()) {
+        case StreamState::Open:
+        case StreamState::Paused:
+        case StreamState::Flushed:
+        case StreamState::Stopped:
+            break;
+        case StreamState::Uninitialized:
+        case StreamState::Closed:
+            return Result::ErrorClosed;
+        default:
+            return Result::ErrorInvalidState;
+    }
+    // Discard the data that the device has not played yet.
+    mAppPosition.store(mDevicePosition.load());
+    setState(StreamState::Flushed);
+    return Result::OK;
+}
+
+Result AudioStreamNull::requestStop() {
+    std::unique_lock<std::mutex> lock(mLock);
+    switch (getState()) {
+        case StreamState::Stopping:
+        case StreamState::Stopped:
+            return Result::OK;
+        case StreamState::Uninitialized:
+        case StreamState::Closed:
+            return Result::ErrorClosed;
+        default:
+            break;
+    }
+    setState(StreamState::Stopping);
+    stopThread(lock);
+    if (getState() == StreamState::Stopping) {
+        setState(StreamState::Stopped);
+    }
+    return Result::OK;
+}
+
+Result AudioStreamNull::waitForStateChange(StreamState currentState,
+                                           StreamState *nextState,
+                                           int64_t timeoutNanoseconds) {
+    Result oboeResult = Result::ErrorTimeout;
+    int64_t sleepTimeNanos = 1 * kNanosPerMillisecond; // arbitrary
+    int64_t timeLeftNanos = timeoutNanoseconds;
+
+    while (true) {
+        const StreamState state = getState();
+        if (nextState != nullptr) {
+            *nextState = state;
+        }
+        if (currentState != state) { // state changed?
+            oboeResult = Result::OK;
+            break;
+        }
+
+        // Did we timeout or did user ask for non-blocking?
+        if (timeLeftNanos <= 0) {
+            break;
+        }
+
+        if (sleepTimeNanos > timeLeftNanos){
+            sleepTimeNanos = timeLeftNanos;
+        }
+        AudioClock::sleepForNanos(sleepTimeNanos);
+        timeLeftNanos -= sleepTimeNanos;
+    }
+
+    return oboeResult;
+}
+
+ResultWithValue<int32_t> AudioStreamNull::setBufferSizeInFrames(int32_t requestedFrames) {
+    if (getState() == StreamState::Closed) {
+        return ResultWithValue<int32_t>(Result::ErrorClosed);
+    }
+    if (usingFIFO()) {
+        return AudioStreamBuffered::setBufferSizeInFrames(requestedFrames);
+    }
+    requestedFrames = std::max(mFramesPerCycle, std::min(requestedFrames, mDeviceCapacity));
+    mBufferSizeInFrames = requestedFrames;
+    mDeviceBufferSize.store(requestedFrames);
+    return ResultWithValue<int32_t>(requestedFrames);
+}
+
+ResultWithValue<OfflineRenderStats> AudioStreamNull::getOfflineRenderStats() {
+    if (!isOffline()) {
+        return ResultWithValue<OfflineRenderStats>(Result::ErrorUnimplemented);
+    }
+    OfflineRenderStats stats;
+    stats.framesRendered = mOfflineFramesRendered.load();
+    stats.cpuTimeNanos = mOfflineCpuTimeNanos.load();
+    stats.elapsedNanos = mOfflineElapsedNanos.load();
+    return ResultWithValue<OfflineRenderStats>(stats);
+}
+
+ResultWithValue<int32_t> AudioStreamNull::getXRunCount() {
+    int32_t xRunCount = mDeviceXRunCount.load();
+    if (usingFIFO()) {
+        // Also count when the app did not keep up with the FIFO.
+        ResultWithValue<int32_t> fifoXRunCount = AudioStreamBuffered::getXRunCount();
+        if (fifoXRunCount) {
+            xRunCount += fifoXRunCount.value();
+        }
+    }
+    return ResultWithValue<int32_t>(xRunCount);
+}
+
+Result AudioStreamNull::getTimestamp(clockid_t clockId,
+                                     int64_t *framePosition,
+                                     int64_t *timeNanoseconds) {
+    if (getState() != StreamState::Started) {
+        return Result::ErrorInvalidState;
+    }
+    // The position only changes at the start of a cycle so we know exactly when it did.
+    int64_t position = mDevicePosition.load();
+    int64_t nanos = mStartNanos.load() + convertFramesToNanos(position - mStartPosition.load());
+    if (clockId != CLOCK_MONOTONIC) {
+        nanos += AudioClock::getNanoseconds(clockId) - AudioClock::getNanoseconds();
+    }
+    *framePosition = position;
+    *timeNanoseconds = nanos;
+    return Result::OK;
+}
+
+void AudioStreamNull::updateFramesWritten() {
+    if (usingFIFO()) {
+        AudioStreamBuffered::updateFramesWritten();
+    } else {
+        mFramesWritten = (getDirection() == Direction::Output)
+                ? mAppPosition.load() : mDevicePosition.load();
+    }
+}
+
+void AudioStreamNull::updateFramesRead() {
+    if (usingFIFO()) {
+        AudioStreamBuffered::updateFramesRead();
+    } else {
+        mFramesRead = (getDirection() == Direction::Output)
+                ? mDevicePosition.load() : mAppPosition.load();
+    }
+}
+
+// Call under mLock.
+Result AudioStreamNull::startThread_l() {
+    mStartNanos.store(AudioClock::getNanoseconds());
+    mStartPosition.store(mDevicePosition.load());
+    mThreadEnabled.store(true);
+
+    if (isOffline()) {
+        // Do not use SCHED_FIFO because this thread never sleeps.
+        mOfflineFramesRendered.store(0);
+        mOfflineCpuTimeNanos.store(0);
+        mOfflineElapsedNanos.store(0);
+        int err = pthread_create(&mThread, nullptr, renderOfflineThread, this);
+        if (err != 0) {
+            LOGE("AudioStreamNull::%s() pthread_create() returned %d", __func__, err);
+            mThreadEnabled.store(false);
+            return Result::ErrorInternal;
+        }
+        mThreadCreated = true;
+        return Result::OK;
+    }
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+    sched_param param{};
+    param.sched_priority = kDeviceThreadPriority;
+    pthread_attr_setschedparam(&attributes, &param);
+    int err = pthread_create(&mThread, &attributes, runDeviceThread, this);
+    pthread_attr_destroy(&attributes);
+    if (err == EPERM) {
+        LOGW("AudioStreamNull::%s() SCHED_FIFO not allowed, using a normal thread", __func__);
+        err = pthread_create(&mThread, nullptr, runDeviceThread, this);
+    }
+    if (err != 0) {
+        LOGE("AudioStreamNull::%s() pthread_create() returned %d", __func__, err);
+        mThreadEnabled.store(false);
+        return Result::ErrorInternal;
+    }
+    mThreadCreated = true;
+    return Result::OK;
+}
+
+// Call with mLock held. The lock is released while waiting for the thread
+// so that the callback can call stream methods without a deadlock.
+void AudioStreamNull::stopThread(std::unique_lock<std::mutex> &lock) {
+    mThreadEnabled.store(false);
+    // If the callback stops the stream then the thread will exit by itself.
+    if (mThreadCreated && !pthread_equal(pthread_self(), mThread)) {
+        pthread_t thread = mThread;
+        mThreadCreated = false;
+        lock.unlock();
+        pthread_join(thread, nullptr);
+        lock.lock();
+    }
+}
+
+void AudioStreamNull::runDevice() {
+    const int64_t startNanos = mStartNanos.load();
+    const int64_t startPosition = mStartPosition.load();
+    const int32_t xRunIntervalCycles = getSimulatedXRunIntervalBursts();
+    // Oversleeping by this much causes an XRun at any buffer size.
+    const int64_t xRunDelayNanos = convertFramesToNanos(mDeviceCapacity + mFramesPerCycle);
+    std::minstd_rand random(kJitterSeed);
+    std::uniform_int_distribution<int64_t> jitter(0, std::max<int64_t>(0,
+            getSimulatedJitterNanos()));
+
+    int64_t cycles = 0;
+    bool running = serviceDevice(startPosition); // fill the output buffer before starting
+    while (running && mThreadEnabled.load()) {
+        cycles++;
+        int64_t wakeupNanos = startNanos + convertFramesToNanos(cycles * mFramesPerCycle);
+        wakeupNanos += jitter(random);
+        if (xRunIntervalCycles > 0 && (cycles % xRunIntervalCycles) == 0) {
+            wakeupNanos += xRunDelayNanos;
+        }
+        while (AudioClock::sleepUntilNanoTime(wakeupNanos) == -EINTR) {}
+
+        // The device clock keeps running even if we woke up late.
+        int64_t elapsedFrames = convertNanosToFrames(AudioClock::getNanoseconds() - startNanos);
+        cycles = std::max(cycles, elapsedFrames / mFramesPerCycle);
+        int64_t devicePosition = startPosition + (cycles * mFramesPerCycle);
+        mDevicePosition.store(devicePosition);
+        running = serviceDevice(devicePosition);
+    }
+
+    if (!running) {
+        // The callback returned Stop.
+        mThreadEnabled.store(false);
+        StreamState expected = StreamState::Started;
+        mState.compare_exchange_strong(expected, StreamState::Stopped);
+    }
+}
+
+void AudioStreamNull::renderOffline() {
+    OfflineSink *sink = getOfflineSink();
+    const int64_t framesToRender = getOfflineFramesToRender();
+    const int64_t startCpuNanos = AudioClock::getNanoseconds(CLOCK_THREAD_CPUTIME_ID);
+    const int64_t startNanos = AudioClock::getNanoseconds();
+    void *buffer = mCycleBuffer;
+    int64_t framesRendered = 0;
+    int64_t appPosition = mAppPosition.load();
+    int32_t cycles = 0;
+
+    while (mThreadEnabled.load()) {
+        int64_t framesLeft = (framesToRender > 0)
+                ? framesToRender - framesRendered
+                : mFramesPerCycle;
+        if (framesLeft <= 0) {
+            break;
+        }
+        // Always call back with whole cycles, like a real device.
+        if (fireDataCallback(buffer, mFramesPerCycle) != DataCallbackResult::Continue) {
+            break;
+        }
+        int32_t framesToSink = static_cast<int32_t>(
+                std::min(static_cast<int64_t>(mFramesPerCycle), framesLeft));
+        Result result = sink->onData(buffer, framesToSink);
+        if (result != Result::OK) {
+            LOGE("AudioStreamNull::%s() sink returned %s", __func__, convertToText(result));
+            break;
+        }
+        framesRendered += framesToSink;
+        appPosition += mFramesPerCycle;
+        mAppPosition.store(appPosition);
+        mDevicePosition.store(appPosition);
+        if ((++cycles & (kOfflineStatsIntervalCycles - 1)) == 0) {
+            updateOfflineRenderStats(framesRendered, startCpuNanos, startNanos);
+        }
+    }
+    updateOfflineRenderStats(framesRendered, startCpuNanos, startNanos);
+    sink->onStop();
+
+    mThreadEnabled.store(false);
+    StreamState expected = StreamState::Started;
+    mState.compare_exchange_strong(expected, StreamState::Stopped);
+}
+
+void AudioStreamNull::updateOfflineRenderStats(int64_t framesRendered,
+                                               int64_t startCpuNanos,
+                                               int64_t startNanos) {
+    mOfflineFramesRendered.store(framesRendered);
+    mOfflineCpuTimeNanos.store(AudioClock::getNanoseconds(CLOCK_THREAD_CPUTIME_ID)
+                               - startCpuNanos);
+    mOfflineElapsedNanos.store(AudioClock::getNanoseconds() - startNanos);
+}
+
+bool AudioStreamNull::serviceDevice(int64_t devicePosition) {
+    int64_t appPosition = mAppPosition.load();
+    void *buffer = mCycleBuffer;
+    if (getDirection() == Direction::Output) {
+        if (appPosition < devicePosition) {
+            // The device ran out of data and played silence.
+            mDeviceXRunCount++;
+            appPosition = devicePosition;
+            mAppPosition.store(appPosition);
+        }
+        int32_t bufferSize = std::max(mDeviceBufferSize.load(), mFramesPerCycle);
+        while (appPosition + mFramesPerCycle - devicePosition <= bufferSize
+                && mThreadEnabled.load()) {
+            if (fireDataCallback(buffer, mFramesPerCycle) != DataCallbackResult::Continue) {
+                return false;
+            }
+            appPosition += mFramesPerCycle;
+            mAppPosition.store(appPosition);
+        }
+    } else {
+        if (devicePosition - appPosition > mDeviceCapacity) {
+            // The app did not read in time so the oldest data was overwritten.
+            mDeviceXRunCount++;
+            appPosition = devicePosition - (mDeviceCapacity / mFramesPerCycle) * mFramesPerCycle;
+            mAppPosition.store(appPosition);
+        }
+        const int32_t bytesPerCycle = mFramesPerCycle * getBytesPerFrame();
+        while (devicePosition - appPosition >= mFramesPerCycle && mThreadEnabled.load()) {
+            memset(buffer, 0, bytesPerCycle);
+            if (fireDataCallback(buffer, mFramesPerCycle) != DataCallbackResult::Continue) {
+                return false;
+            }
+            appPosition += mFramesPerCycle;
+            mAppPosition.store(appPosition);
+        }
+    }
+    return true;
+}
+
+int64_t AudioStreamNull::convertFramesToNanos(int64_t frames) const {
+    // Split the calculation so it does not overflow during very long runs.
+    return ((frames / mSampleRate) * kNanosPerSecond)
+            + ((frames % mSampleRate) * kNanosPerSecond / mSampleRate);
+}
+
+int64_t AudioStreamNull::convertNanosToFrames(int64_t nanos) const {
+    return ((nanos / kNanosPerSecond) * mSampleRate)
+            + ((nanos % kNanosPerSecond) * mSampleRate / kNanosPerSecond);
+}
+
+} // namespace oboe
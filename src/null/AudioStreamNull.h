@@ -0,0 +1,166 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_AUDIO_STREAM_NULL_H_
+#define OBOE_AUDIO_STREAM_NULL_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+
+#include "oboe/Oboe.h"
+#include "opensles/AudioStreamBuffered.h"
+
+namespace oboe {
+
+/**
+ * INTERNAL USE ONLY
+ *
+ * A stream for a simulated device that does not need any audio hardware.
+ *
+ * A real-time thread wakes up once per burst, using clock_nanosleep() with absolute
+ * CLOCK_MONOTONIC deadlines. The device position advances by one burst per period,
+ * whether or not the app kept up, so XRuns happen just like on a real device.
+ * Output data is discarded. Input data is silence.
+ *
+ * The burst size, jitter and forced XRuns can be set with the AudioStreamBuilder.
+ * The rate, channel count, format and capacity are whatever the app asks for.
+ *
+ * If an OfflineSink is set then there is no clock. The callback is called back-to-back
+ * on a normal thread and the output goes to the sink.
+ *
+ * Do not instantiate this class directly.
+ * Use an AudioStreamBuilder with AudioApi::Null to create one.
+ */
+class AudioStreamNull : public AudioStreamBuffered {
+public:
+
+    explicit AudioStreamNull(const AudioStreamBuilder &builder);
+
+    virtual ~AudioStreamNull();
+
+    Result open() override;
+
+    Result close() override;
+
+    Result requestStart() override;
+    Result requestPause() override;
+    Result requestFlush() override;
+    Result requestStop() override;
+
+    StreamState getState() override { return mState.load(); }
+
+    Result waitForStateChange(StreamState currentState,
+                              StreamState *nextState,
+                              int64_t timeoutNanoseconds) override;
+
+    ResultWithValue<int32_t> setBufferSizeInFrames(int32_t requestedFrames) override;
+
+    ResultWithValue<int32_t> getXRunCount() override;
+
+    bool isXRunCountSupported() const override {
+        return true;
+    }
+
+    Result getTimestamp(clockid_t clockId,
+                        int64_t *framePosition,
+                        int64_t *timeNanoseconds) override;
+
+    AudioApi getAudioApi() const override {
+        return AudioApi::Null;
+    }
+
+    ResultWithValue<OfflineRenderStats> getOfflineRenderStats() override;
+
+    /**
+     * Body of the device thread.
+     *
+     * This is public, but don't call it directly.
+     */
+    void runDevice();
+
+    /**
+     * Body of the render thread of an offline stream.
+     *
+     * This is public, but don't call it directly.
+     */
+    void renderOffline();
+
+protected:
+
+    Result updateServiceFrameCounter() override {
+        return Result::OK;
+    }
+
+    void updateFramesRead() override;
+    void updateFramesWritten() override;
+
+private:
+
+    void setState(StreamState state) {
+        mState.store(state);
+    }
+
+    // Call under mLock.
+    Result startThread_l();
+    // Call with mLock held. It may be released while waiting for the thread.
+    void stopThread(std::unique_lock<std::mutex> &lock);
+
+    // Exchange data with the app until the device position has been served.
+    // @return false if the app asked to stop
+    bool serviceDevice(int64_t devicePosition);
+
+    bool isOffline() const {
+        return getOfflineSink() != nullptr;
+    }
+
+    void updateOfflineRenderStats(int64_t framesRendered, int64_t startCpuNanos,
+                                  int64_t startNanos);
+
+    int64_t convertFramesToNanos(int64_t frames) const;
+    int64_t convertNanosToFrames(int64_t nanos) const;
+
+    std::atomic<StreamState>      mState{StreamState::Uninitialized};
+
+    pthread_t                     mThread;
+    bool                          mThreadCreated = false; // protected by mLock
+    std::atomic<bool>             mThreadEnabled{false};
+
+    // Frames per wakeup of the device thread, and per callback.
+    int32_t                       mFramesPerCycle = 0;
+    uint8_t                      *mCycleBuffer = nullptr; // from the arena
+
+    // Position of the simulated hardware. It advances by one cycle per period.
+    std::atomic<int64_t>          mDevicePosition{0};
+    // Frames written to the device for output, or read from it for input.
+    std::atomic<int64_t>          mAppPosition{0};
+    // Device time and position when the thread was last started.
+    std::atomic<int64_t>          mStartNanos{0};
+    std::atomic<int64_t>          mStartPosition{0};
+
+    int32_t                       mDeviceCapacity = 0;
+    std::atomic<int32_t>          mDeviceBufferSize{0};
+    std::atomic<int32_t>          mDeviceXRunCount{0};
+
+    std::atomic<int64_t>          mOfflineFramesRendered{0};
+    std::atomic<int64_t>          mOfflineCpuTimeNanos{0};
+    std::atomic<int64_t>          mOfflineElapsedNanos{0};
+};
+
+} // namespace oboe
+
+#endif // OBOE_AUDIO_STREAM_NULL_H_
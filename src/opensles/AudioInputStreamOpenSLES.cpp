@@ -209,7 +209,11 @@ Result AudioInputStreamOpenSLES::open() {
         goto error;
     }
 
-    allocateFifo();
+    oboeResult = allocateFifo();
+    if (Result::OK != oboeResult) {
+        close();
+        return oboeResult;
+    }
 
     setState(StreamState::Open);
     return Result::OK;
@@ -221,6 +225,7 @@ error:
 
 Result AudioInputStreamOpenSLES::close() {
     LOGD("AudioInputStreamOpenSLES::%s()", __func__);
+    cancelAsyncTransfer();
     std::lock_guard<std::mutex> lock(mLock);
     Result result = Result::OK;
     if (getState() == StreamState::Closed){
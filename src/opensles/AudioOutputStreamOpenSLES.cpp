@@ -228,7 +228,11 @@ Result AudioOutputStreamOpenSLES::open() {
         goto error;
     }
 
-    allocateFifo();
+    oboeResult = allocateFifo();
+    if (Result::OK != oboeResult) {
+        close();
+        return oboeResult;
+    }
 
     setState(StreamState::Open);
     return Result::OK;
@@ -245,6 +249,7 @@ Result AudioOutputStreamOpenSLES::onAfterDestroy() {
 
 Result AudioOutputStreamOpenSLES::close() {
     LOGD("AudioOutputStreamOpenSLES::%s()", __func__);
+    cancelAsyncTransfer();
     std::lock_guard<std::mutex> lock(mLock);
     Result result = Result::OK;
     if (getState() == StreamState::Closed){
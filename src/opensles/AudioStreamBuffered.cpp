@@ -20,6 +20,7 @@
 
 #include "opensles/AudioStreamBuffered.h"
 #include "common/AudioClock.h"
+#include "common/StreamArena.h"
 
 namespace oboe {
 
@@ -27,6 +28,14 @@ constexpr int kDefaultBurstsPerBuffer = 16;  // arbitrary, allows dynamic latenc
 constexpr int kMinBurstsPerBuffer     = 4;  // arbitrary, allows dynamic latency tuning
 constexpr int kMinFramesPerBuffer     = 48 * 32; // arbitrary
 
+static int32_t roundUpToPowerOfTwo(int32_t n) {
+    int32_t powerOfTwo = 1;
+    while (powerOfTwo < n) {
+        powerOfTwo <<= 1;
+    }
+    return powerOfTwo;
+}
+
 /*
  * AudioStream with a FifoBuffer
  */
@@ -34,30 +43,53 @@ AudioStreamBuffered::AudioStreamBuffered(const AudioStreamBuilder &builder)
         : AudioStream(builder) {
 }
 
-void AudioStreamBuffered::allocateFifo() {
+int32_t AudioStreamBuffered::calculateFifoCapacityInFrames() const {
     // If the caller does not provide a callback use our own internal
     // callback that reads data from the FIFO.
-    if (usingFIFO()) {
-        // FIFO is configured with the same format and channels as the stream.
-        int32_t capacityFrames = getBufferCapacityInFrames();
-        if (capacityFrames == oboe::kUnspecified) {
-            capacityFrames = getFramesPerBurst() * kDefaultBurstsPerBuffer;
+    if (!usingFIFO()) {
+        return 0;
+    }
+    // FIFO is configured with the same format and channels as the stream.
+    int32_t capacityFrames = getBufferCapacityInFrames();
+    if (capacityFrames == oboe::kUnspecified) {
+        capacityFrames = getFramesPerBurst() * kDefaultBurstsPerBuffer;
+    } else {
+        int32_t minFramesPerBufferByBursts = getFramesPerBurst() * kMinBurstsPerBuffer;
+        if (capacityFrames <= minFramesPerBufferByBursts) {
+            capacityFrames = minFramesPerBufferByBursts;
         } else {
-            int32_t minFramesPerBufferByBursts = getFramesPerBurst() * kMinBurstsPerBuffer;
-            if (capacityFrames <= minFramesPerBufferByBursts) {
-                capacityFrames = minFramesPerBufferByBursts;
-            } else {
-                capacityFrames = std::max(kMinFramesPerBuffer, capacityFrames);
-                // round up to nearest burst
-                int32_t numBursts = (capacityFrames + getFramesPerBurst() - 1)
-                        / getFramesPerBurst();
-                capacityFrames = numBursts * getFramesPerBurst();
-            }
+            capacityFrames = std::max(kMinFramesPerBuffer, capacityFrames);
+            // round up to nearest burst
+            int32_t numBursts = (capacityFrames + getFramesPerBurst() - 1)
+                    / getFramesPerBurst();
+            capacityFrames = numBursts * getFramesPerBurst();
         }
+    }
+    if (isFifoCapacityRoundedToPowerOfTwo()) {
+        // So the FifoBuffer can use a mask instead of a modulo.
+        capacityFrames = roundUpToPowerOfTwo(capacityFrames);
+    }
+    return capacityFrames;
+}
 
-        mFifoBuffer = std::make_unique<FifoBuffer>(getBytesPerFrame(), capacityFrames);
+Result AudioStreamBuffered::allocateFifo() {
+    if (!getArena().claim(StreamArena::Owner::Fifo)) {
+        LOGE("AudioStreamBuffered::%s() the FIFO was already allocated", __func__);
+        return Result::ErrorInvalidState;
+    }
+    int32_t capacityFrames = calculateFifoCapacityInFrames();
+    if (capacityFrames > 0) {
+        // Like the other stream buffers, the FIFO must fit in the arena.
+        uint8_t *storage = getArena().allocateArray<uint8_t>(
+                static_cast<size_t>(getBytesPerFrame()) * static_cast<size_t>(capacityFrames));
+        if (storage == nullptr) {
+            return Result::ErrorNoMemory;
+        }
+        mFifoBuffer = std::make_unique<FifoBuffer>(getBytesPerFrame(), capacityFrames, storage);
+        mFifoBuffer->setResidencyTrackingEnabled(isFifoResidencyTrackingEnabled());
         mBufferCapacityInFrames = capacityFrames;
     }
+    return Result::OK;
 }
 
 void AudioStreamBuffered::updateFramesWritten() {
@@ -75,37 +107,74 @@ void AudioStreamBuffered::updateFramesRead() {
 // This is called by the OpenSL ES callback to read or write the back end of the FIFO.
 DataCallbackResult AudioStreamBuffered::onDefaultCallback(void *audioData, int numFrames) {
     int32_t framesTransferred  = 0;
+    bool framesDiscarded = false;
 
     if (getDirection() == oboe::Direction::Output) {
         // Read from the FIFO and write to audioData, clear part of buffer if not enough data.
         framesTransferred = mFifoBuffer->readNow(audioData, numFrames);
     } else {
         // Read from audioData and write to the FIFO
-        framesTransferred = mFifoBuffer->write(audioData, numFrames); // There is no writeNow()
+        int32_t framesToKeep = getLossyInputFifoFramesToKeep();
+        if (framesToKeep > 0) {
+            // Discard old frames instead of new frames so the latency stays bounded.
+            uint64_t previousDiscarded = mFifoBuffer->getDiscardedFrameCount();
+            framesTransferred = mFifoBuffer->writeOverwritingOldest(audioData, numFrames,
+                                                                    framesToKeep);
+            framesDiscarded = mFifoBuffer->getDiscardedFrameCount() != previousDiscarded;
+        } else {
+            framesTransferred = mFifoBuffer->write(audioData, numFrames); // There is no writeNow()
+        }
     }
 
-    if (framesTransferred < numFrames) {
+    // Count one xrun per callback, even if frames were both discarded and not transferred.
+    if (framesTransferred < numFrames || framesDiscarded) {
         LOGD("AudioStreamBuffered::%s(): xrun! framesTransferred = %d, numFrames = %d",
                 __func__, framesTransferred, numFrames);
         // TODO If we do not allow FIFO to wrap then our timestamps will drift when there is an XRun!
         incrementXRunCount();
     }
-    markCallbackTime(static_cast<int32_t>(numFrames)); // so foreground knows how long to wait.
+    // Wake up the app if it is blocked in read() or write(), or waiting in readAsync()
+    // or writeAsync().
+    mFramesAvailableSignal.notify(getFramesAvailableToApp());
+    signalAsyncTransfer();
     return DataCallbackResult::Continue;
 }
 
-void AudioStreamBuffered::markCallbackTime(int32_t numFrames) {
-    mLastBackgroundSize = numFrames;
-    mBackgroundRanAtNanoseconds = AudioClock::getNanoseconds();
+int32_t AudioStreamBuffered::getFramesAvailableToApp() {
+    int32_t fullFrames = static_cast<int32_t>(mFifoBuffer->getFullFramesAvailable());
+    if (getDirection() == Direction::Input) {
+        return fullFrames;
+    } else {
+        // Do not write above threshold size.
+        return std::max(0, getBufferSizeInFrames() - fullFrames);
+    }
 }
 
-int64_t AudioStreamBuffered::predictNextCallbackTime() {
-    if (mBackgroundRanAtNanoseconds == 0) {
-        return 0;
+ResultWithValue<int32_t> AudioStreamBuffered::waitForAvailableFrames(int32_t numFrames,
+        int64_t timeoutNanoseconds) {
+    // Only an input FIFO is filled by our callback.
+    if (!mFifoBuffer || getDirection() == Direction::Output) {
+        return AudioStream::waitForAvailableFrames(numFrames, timeoutNanoseconds);
+    }
+    if (numFrames == 0) return Result::OK;
+    if (numFrames < 0) return Result::ErrorOutOfRange;
+
+    int64_t deadline = AudioClock::getNanoseconds() + timeoutNanoseconds;
+    int32_t framesAvailable = 0;
+    do {
+        framesAvailable = mFramesAvailableSignal.waitForFrames(numFrames, deadline,
+                [this]() { return getFramesAvailableToApp(); });
+    } while (framesAvailable < numFrames && AudioClock::getNanoseconds() < deadline);
+    return (framesAvailable < numFrames)
+            ? ResultWithValue<int32_t>(Result::ErrorTimeout)
+            : ResultWithValue<int32_t>(framesAvailable);
+}
+
+ResultWithValue<int64_t> AudioStreamBuffered::getDiscardedFrameCount() {
+    if (!mFifoBuffer) {
+        return ResultWithValue<int64_t>(Result::ErrorUnimplemented);
     }
-    int64_t nanosPerBuffer = (kNanosPerSecond * mLastBackgroundSize) / getSampleRate();
-    const int64_t margin = 200 * kNanosPerMicrosecond; // arbitrary delay so we wake up just after
-    return mBackgroundRanAtNanoseconds + nanosPerBuffer + margin;
+    return ResultWithValue<int64_t>(static_cast<int64_t>(mFifoBuffer->getDiscardedFrameCount()));
 }
 
 // Common code for read/write.
@@ -161,11 +230,7 @@ ResultWithValue<int32_t> AudioStreamBuffered::transfer(
                 framesLeft -= result;
             }
         } else {
-            // between zero and capacity
-            uint32_t fullFrames = mFifoBuffer->getFullFramesAvailable();
-            // Do not write above threshold size.
-            int32_t emptyFrames = getBufferSizeInFrames() - static_cast<int32_t>(fullFrames);
-            int32_t framesToWrite = std::max(0, std::min(framesLeft, emptyFrames));
+            int32_t framesToWrite = std::min(framesLeft, getFramesAvailableToApp());
             result = mFifoBuffer->write(writeData, framesToWrite);
             if (result > 0) {
                 writeData += mFifoBuffer->convertFramesToBytes(result);
@@ -180,26 +245,11 @@ ResultWithValue<int32_t> AudioStreamBuffered::transfer(
                 LOGE("AudioStreamBuffered::%s(): TIMEOUT", __func__);
                 repeat = false; // TIMEOUT
             } else {
-                // Figure out how long to sleep.
-                int64_t sleepForNanos;
-                int64_t wakeTimeNanos = predictNextCallbackTime();
-                if (wakeTimeNanos <= 0) {
-                    // No estimate available. Sleep for one burst.
-                    sleepForNanos = (getFramesPerBurst() * kNanosPerSecond) / getSampleRate();
-                } else {
-                    // Don't sleep past timeout.
-                    if (wakeTimeNanos > timeToQuit) {
-                        wakeTimeNanos = timeToQuit;
-                    }
-                    sleepForNanos = wakeTimeNanos - timeNow;
-                    // Avoid rapid loop with no sleep.
-                    const int64_t minSleepTime = kNanosPerMillisecond; // arbitrary
-                    if (sleepForNanos < minSleepTime) {
-                        sleepForNanos = minSleepTime;
-                    }
-                }
-
-                AudioClock::sleepForNanos(sleepForNanos);
+                // Sleep until the callback has transferred enough data.
+                // Do not wait for more than a burst so that large transfers make progress.
+                int32_t framesWanted = std::min(framesLeft, getFramesPerBurst());
+                mFramesAvailableSignal.waitForFrames(framesWanted, timeToQuit,
+                        [this]() { return getFramesAvailableToApp(); });
             }
 
         } else {
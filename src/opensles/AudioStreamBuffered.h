@@ -19,6 +19,7 @@
 
 #include <cstring>
 #include <cassert>
+#include "common/FrameSignal.h"
 #include "common/OboeDebug.h"
 #include "oboe/AudioStream.h"
 #include "oboe/AudioStreamCallback.h"
@@ -34,7 +35,13 @@ public:
     AudioStreamBuffered();
     explicit AudioStreamBuffered(const AudioStreamBuilder &builder);
 
-    void allocateFifo();
+    // @return capacity of the FIFO that allocateFifo() would allocate, or 0 if there is no FIFO
+    int32_t calculateFifoCapacityInFrames() const;
+
+    // This can only be called once for each stream, because the arena never frees the FIFO.
+    // @return Result::ErrorNoMemory if the FIFO does not fit in the arena,
+    //         or Result::ErrorInvalidState if it was already allocated
+    Result allocateFifo();
 
 
     ResultWithValue<int32_t> write(const void *buffer,
@@ -55,6 +62,15 @@ public:
 
     bool isXRunCountSupported() const override;
 
+    ResultWithValue<int64_t> getDiscardedFrameCount() override;
+
+    const TimeHistogram *getFifoResidencyHistogram() const override {
+        return mFifoBuffer ? mFifoBuffer->getResidencyHistogram() : nullptr;
+    }
+
+    ResultWithValue<int32_t> waitForAvailableFrames(int32_t numFrames,
+                                                    int64_t timeoutNanoseconds) override;
+
 protected:
 
     DataCallbackResult onDefaultCallback(void *audioData, int numFrames) override;
@@ -69,9 +85,8 @@ protected:
 
 private:
 
-    int64_t predictNextCallbackTime();
-
-    void markCallbackTime(int32_t numFrames);
+    // Frames that the app can read or write without blocking.
+    int32_t getFramesAvailableToApp();
 
     // Read or write to the FIFO.
     // Only pass one pointer and set the other to nullptr.
@@ -86,8 +101,8 @@ private:
 
     std::unique_ptr<FifoBuffer>   mFifoBuffer{};
 
-    int64_t mBackgroundRanAtNanoseconds = 0;
-    int32_t mLastBackgroundSize = 0;
+    // Signalled by the callback so that a blocking read or write can resume.
+    FrameSignal mFramesAvailableSignal;
     int32_t mXRunCount = 0;
 };
 
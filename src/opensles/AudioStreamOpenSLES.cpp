@@ -22,6 +22,7 @@
 #include <oboe/AudioStream.h>
 #include <common/AudioClock.h>
 
+#include "common/StreamArena.h"
 #include "common/OboeDebug.h"
 #include "oboe/AudioStreamBuilder.h"
 #include "AudioStreamOpenSLES.h"
@@ -137,8 +138,15 @@ Result AudioStreamOpenSLES::configureBufferSizes(int32_t sampleRate) {
         return Result::ErrorInvalidFormat; // causing bytesPerFrame == 0
     }
 
+    if (!getArena().claim(StreamArena::Owner::CallbackBuffers)) {
+        LOGE("AudioStreamOpenSLES::open() callback buffers were already allocated");
+        return Result::ErrorInvalidState;
+    }
     for (int i = 0; i < kBufferQueueLength; ++i) {
-        mCallbackBuffer[i] = std::make_unique<uint8_t[]>(mBytesPerCallback);
+        mCallbackBuffer[i] = getArena().allocateArray<uint8_t>(mBytesPerCallback);
+        if (mCallbackBuffer[i] == nullptr) {
+            return Result::ErrorNoMemory;
+        }
     }
 
     if (!usingFIFO()) {
@@ -302,7 +310,7 @@ Result AudioStreamOpenSLES::close_l() {
 
 SLresult AudioStreamOpenSLES::enqueueCallbackBuffer(SLAndroidSimpleBufferQueueItf bq) {
     SLresult result = (*bq)->Enqueue(
-            bq, mCallbackBuffer[mCallbackBufferIndex].get(), mBytesPerCallback);
+            bq, mCallbackBuffer[mCallbackBufferIndex], mBytesPerCallback);
     mCallbackBufferIndex = (mCallbackBufferIndex + 1) % kBufferQueueLength;
     return result;
 }
@@ -317,7 +325,7 @@ void AudioStreamOpenSLES::processBufferCallback(SLAndroidSimpleBufferQueueItf bq
     bool stopStream = false;
     // Ask the app callback to process the buffer.
     DataCallbackResult result =
-            fireDataCallback(mCallbackBuffer[mCallbackBufferIndex].get(), mFramesPerCallback);
+            fireDataCallback(mCallbackBuffer[mCallbackBufferIndex], mFramesPerCallback);
     if (result == DataCallbackResult::Continue) {
         // Pass the buffer to OpenSLES.
         SLresult enqueueResult = enqueueCallbackBuffer(bq);
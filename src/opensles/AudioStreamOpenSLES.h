@@ -121,7 +121,7 @@ protected:
     MonotonicCounter              mPositionMillis; // for tracking OpenSL ES service position
 
 private:
-    std::unique_ptr<uint8_t[]>    mCallbackBuffer[kBufferQueueLength];
+    uint8_t                      *mCallbackBuffer[kBufferQueueLength] = {}; // from the arena
     int                           mCallbackBufferIndex = 0;
     std::atomic<StreamState>      mState{StreamState::Uninitialized};
 
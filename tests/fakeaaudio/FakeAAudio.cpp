@@ -0,0 +1,911 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A fake libaaudio.so for running AudioStreamAAudio on a Linux host.
+ *
+ * Each stream has a timer thread that plays the part of the audio device. It wakes up once per
+ * burst on an absolute deadline, advances the device position by the time that has really
+ * passed, counts XRuns and then calls the data callback, like the MMAP and Legacy data paths.
+ * Output data is discarded. Input data is silence.
+ *
+ * The values of the AAudio constants are taken from the Oboe enums, which are checked
+ * against AAudio.h by AAudioLoader.cpp.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "oboe/Definitions.h"
+#include "FakeAAudio.h"
+
+using namespace oboe;
+
+typedef struct AAudioStreamBuilderStruct AAudioStreamBuilder;
+
+typedef int32_t aaudio_result_t;
+typedef int32_t aaudio_stream_state_t;
+typedef int32_t aaudio_policy_t;
+
+typedef int32_t (*AAudioStream_dataCallback)(AAudioStream *stream,
+                                             void *userData,
+                                             void *audioData,
+                                             int32_t numFrames);
+
+typedef void (*AAudioStream_errorCallback)(AAudioStream *stream,
+                                           void *userData,
+                                           aaudio_result_t error);
+
+template <typename T>
+static constexpr int32_t toAAudio(T value) {
+    return static_cast<int32_t>(value);
+}
+
+// Same values as in AAudioExtensions.h.
+constexpr aaudio_policy_t kPolicyNever = 1;
+constexpr aaudio_policy_t kPolicyAuto = 2;
+constexpr aaudio_policy_t kPolicyAlways = 3;
+
+constexpr int32_t kDefaultDeviceSampleRate = 48000;
+constexpr int32_t kDefaultDeviceId = 1;
+constexpr int32_t kMaxChannelCount = 8;
+constexpr int32_t kMinSampleRate = 8000;
+constexpr int32_t kMaxSampleRate = 768000;
+constexpr int32_t kMMapBurstMillis = 2;
+constexpr int32_t kLegacyBurstMillis = 4;
+constexpr int32_t kPowerSavingBurstMillis = 20;
+constexpr int32_t kDefaultBurstsPerCapacity = 8;
+constexpr int32_t kTimerThreadPriority = 2; // SCHED_FIFO priority used for audio on Android
+constexpr int32_t kJitterSeed = 1; // so runs can be repeated
+constexpr int64_t kStatePollNanos = kNanosPerMillisecond;
+
+static std::atomic<int32_t> sDeviceSampleRate{kDefaultDeviceSampleRate};
+static std::atomic<int64_t> sWakeupJitterNanos{0};
+static std::atomic<aaudio_policy_t> sMMapPolicy{kPolicyAuto};
+static std::atomic<int32_t> sOpenStreamCount{0};
+static std::atomic<int32_t> sNextSessionId{1};
+
+static int64_t getNanoseconds(clockid_t clockId = CLOCK_MONOTONIC) {
+    struct timespec time;
+    clock_gettime(clockId, &time);
+    return (time.tv_sec * kNanosPerSecond) + time.tv_nsec;
+}
+
+static void sleepUntilNanoTime(int64_t nanoTime) {
+    struct timespec time;
+    time.tv_sec = nanoTime / kNanosPerSecond;
+    time.tv_nsec = nanoTime - (time.tv_sec * kNanosPerSecond);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, nullptr) == EINTR) {}
+}
+
+static int32_t getBytesPerSample(int32_t format) {
+    switch (static_cast<AudioFormat>(format)) {
+        case AudioFormat::I16:
+            return sizeof(int16_t);
+        case AudioFormat::I24:
+            return 3;
+        case AudioFormat::I32:
+        case AudioFormat::Float:
+            return sizeof(int32_t);
+        default:
+            return 0;
+    }
+}
+
+struct AAudioStreamBuilderStruct {
+    int32_t direction = toAAudio(Direction::Output);
+    int32_t format = toAAudio(AudioFormat::Unspecified);
+    int32_t channelCount = kUnspecified;
+    int32_t sampleRate = kUnspecified;
+    int32_t deviceId = kUnspecified;
+    int32_t bufferCapacityInFrames = kUnspecified;
+    int32_t framesPerDataCallback = kUnspecified;
+    int32_t sharingMode = toAAudio(SharingMode::Shared);
+    int32_t performanceMode = toAAudio(PerformanceMode::None);
+    int32_t usage = toAAudio(Usage::Media);
+    int32_t contentType = toAAudio(ContentType::Music);
+    int32_t inputPreset = toAAudio(InputPreset::VoiceRecognition);
+    int32_t sessionId = toAAudio(SessionId::None);
+    std::string packageName;
+    std::string attributionTag;
+    AAudioStream_dataCallback dataCallback = nullptr;
+    void *dataCallbackUserData = nullptr;
+    AAudioStream_errorCallback errorCallback = nullptr;
+    void *errorCallbackUserData = nullptr;
+};
+
+struct AAudioStreamStruct {
+    aaudio_result_t open(const AAudioStreamBuilderStruct &builder);
+    aaudio_result_t requestStart();
+    aaudio_result_t requestPause();
+    aaudio_result_t requestFlush();
+    aaudio_result_t requestStop();
+    aaudio_result_t close();
+    int32_t read(void *buffer, int32_t numFrames, int64_t timeoutNanoseconds);
+    int32_t write(const void *buffer, int32_t numFrames, int64_t timeoutNanoseconds);
+    aaudio_result_t waitForStateChange(aaudio_stream_state_t inputState,
+                                       aaudio_stream_state_t *nextState,
+                                       int64_t timeoutNanoseconds);
+    aaudio_result_t getTimestamp(clockid_t clockId, int64_t *framePosition, int64_t *timeNanos);
+    int32_t setBufferSizeInFrames(int32_t requestedFrames);
+    void disconnect();
+
+    bool isOutput() const {
+        return direction == toAAudio(Direction::Output);
+    }
+
+    int64_t getFramesRead() const {
+        return isOutput() ? mDevicePosition.load() : mAppPosition.load();
+    }
+
+    int64_t getFramesWritten() const {
+        return isOutput() ? mAppPosition.load() : mDevicePosition.load();
+    }
+
+    // Fixed when the stream is opened.
+    int32_t direction = 0;
+    int32_t format = 0;
+    int32_t channelCount = 0;
+    int32_t sampleRate = 0;
+    int32_t deviceId = 0;
+    int32_t framesPerBurst = 0;
+    int32_t framesPerDataCallback = 0;
+    int32_t bufferCapacityInFrames = 0;
+    int32_t sharingMode = 0;
+    int32_t performanceMode = 0;
+    int32_t usage = 0;
+    int32_t contentType = 0;
+    int32_t inputPreset = 0;
+    int32_t sessionId = 0;
+    bool    isMMap = false;
+
+    std::atomic<aaudio_stream_state_t> state{toAAudio(StreamState::Uninitialized)};
+    std::atomic<int32_t> bufferSizeInFrames{0};
+    std::atomic<int32_t> xRunCount{0};
+
+private:
+    void runTimer();
+    aaudio_result_t startThread_l();
+    void stopThread_l(aaudio_stream_state_t transientState, aaudio_stream_state_t finalState);
+    bool fireDataCallbacks();
+    bool isRunning() const;
+
+    static void *runTimerProc(void *arg) {
+        static_cast<AAudioStreamStruct *>(arg)->runTimer();
+        return nullptr;
+    }
+
+    AAudioStream_dataCallback mDataCallback = nullptr;
+    void *mDataCallbackUserData = nullptr;
+    AAudioStream_errorCallback mErrorCallback = nullptr;
+    void *mErrorCallbackUserData = nullptr;
+    int64_t mWakeupJitterNanos = 0;
+    std::vector<uint8_t> mCallbackBuffer;
+
+    std::mutex mControlLock; // start, pause, flush, stop and close
+    pthread_t mThread{};
+    bool mThreadCreated = false;
+    std::atomic<bool> mThreadEnabled{false};
+    std::atomic<bool> mDisconnectRequested{false};
+
+    // The timer thread holds mDataLock while it moves the positions so that it does not
+    // race with read() and write(). It does not hold it while calling the data callback.
+    std::mutex mDataLock;
+    std::condition_variable mDataCondition;
+    std::atomic<int64_t> mDevicePosition{0};
+    std::atomic<int64_t> mAppPosition{0};
+    std::atomic<int64_t> mTimestampPosition{0};
+    std::atomic<int64_t> mTimestampNanos{0};
+};
+
+aaudio_result_t AAudioStreamStruct::open(const AAudioStreamBuilderStruct &builder) {
+    if (builder.direction != toAAudio(Direction::Output)
+            && builder.direction != toAAudio(Direction::Input)) {
+        return toAAudio(Result::ErrorIllegalArgument);
+    }
+    if (builder.channelCount != kUnspecified
+            && (builder.channelCount < 1 || builder.channelCount > kMaxChannelCount)) {
+        return toAAudio(Result::ErrorOutOfRange);
+    }
+    if (builder.sampleRate != kUnspecified
+            && (builder.sampleRate < kMinSampleRate || builder.sampleRate > kMaxSampleRate)) {
+        return toAAudio(Result::ErrorInvalidRate);
+    }
+    if (builder.format != toAAudio(AudioFormat::Unspecified)
+            && getBytesPerSample(builder.format) == 0) {
+        return toAAudio(Result::ErrorInvalidFormat);
+    }
+
+    const int32_t deviceSampleRate = sDeviceSampleRate.load();
+    direction = builder.direction;
+    format = (builder.format == toAAudio(AudioFormat::Unspecified))
+            ? toAAudio(AudioFormat::Float) : builder.format;
+    channelCount = (builder.channelCount == kUnspecified) ? 2 : builder.channelCount;
+    sampleRate = (builder.sampleRate == kUnspecified) ? deviceSampleRate : builder.sampleRate;
+    deviceId = (builder.deviceId == kUnspecified) ? kDefaultDeviceId : builder.deviceId;
+    performanceMode = builder.performanceMode;
+    usage = builder.usage;
+    contentType = builder.contentType;
+    inputPreset = builder.inputPreset;
+    sessionId = (builder.sessionId == toAAudio(SessionId::Allocate))
+            ? sNextSessionId++ : builder.sessionId;
+
+    // MMAP needs a low latency stream at the native rate of the device.
+    const bool isLowLatency = performanceMode == toAAudio(PerformanceMode::LowLatency);
+    const aaudio_policy_t policy = sMMapPolicy.load();
+    isMMap = (policy == kPolicyAuto || policy == kPolicyAlways)
+            && isLowLatency
+            && sampleRate == deviceSampleRate;
+    sharingMode = isMMap ? builder.sharingMode : toAAudio(SharingMode::Shared);
+
+    int32_t burstMillis = isMMap ? kMMapBurstMillis
+            : (isLowLatency ? kLegacyBurstMillis : kPowerSavingBurstMillis);
+    framesPerBurst = sampleRate * burstMillis / 1000;
+    framesPerDataCallback = (builder.framesPerDataCallback > 0)
+            ? builder.framesPerDataCallback : kUnspecified;
+
+    int32_t capacity = (builder.bufferCapacityInFrames > 0)
+            ? builder.bufferCapacityInFrames
+            : framesPerBurst * kDefaultBurstsPerCapacity;
+    capacity = std::max(capacity, 2 * framesPerBurst);
+    capacity = std::max(capacity, 2 * framesPerDataCallback);
+    bufferCapacityInFrames = ((capacity + framesPerBurst - 1) / framesPerBurst) * framesPerBurst;
+    bufferSizeInFrames = (isOutput() && isLowLatency)
+            ? 2 * framesPerBurst
+            : bufferCapacityInFrames;
+
+    mDataCallback = builder.dataCallback;
+    mDataCallbackUserData = builder.dataCallbackUserData;
+    mErrorCallback = builder.errorCallback;
+    mErrorCallbackUserData = builder.errorCallbackUserData;
+    if (mDataCallback != nullptr) {
+        int32_t framesPerCallback = (framesPerDataCallback > 0)
+                ? framesPerDataCallback : framesPerBurst;
+        mCallbackBuffer.resize(framesPerCallback * channelCount * getBytesPerSample(format));
+    }
+    mWakeupJitterNanos = sWakeupJitterNanos.load();
+
+    state = toAAudio(StreamState::Open);
+    sOpenStreamCount++;
+    return toAAudio(Result::OK);
+}
+
+bool AAudioStreamStruct::isRunning() const {
+    aaudio_stream_state_t currentState = state.load();
+    return currentState == toAAudio(StreamState::Starting)
+            || currentState == toAAudio(StreamState::Started);
+}
+
+aaudio_result_t AAudioStreamStruct::startThread_l() {
+    if (mThreadCreated) {
+        // The thread may have stopped itself.
+        pthread_join(mThread, nullptr);
+        mThreadCreated = false;
+    }
+    mThreadEnabled = true;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+    sched_param param{};
+    param.sched_priority = kTimerThreadPriority;
+    pthread_attr_setschedparam(&attributes, &param);
+    int err = pthread_create(&mThread, &attributes, runTimerProc, this);
+    pthread_attr_destroy(&attributes);
+    if (err == EPERM) {
+        err = pthread_create(&mThread, nullptr, runTimerProc, this);
+    }
+    if (err != 0) {
+        mThreadEnabled = false;
+        return toAAudio(Result::ErrorNoMemory);
+    }
+    mThreadCreated = true;
+    return toAAudio(Result::OK);
+}
+
+// Call with mControlLock held.
+void AAudioStreamStruct::stopThread_l(aaudio_stream_state_t transientState,
+                                      aaudio_stream_state_t finalState) {
+    state = transientState;
+    mThreadEnabled = false;
+    mDataCondition.notify_all();
+    if (mThreadCreated) {
+        if (pthread_equal(pthread_self(), mThread)) {
+            // Stopped from a callback. The thread will exit when the callback returns.
+            // It is joined by the next start or by close.
+            state = finalState;
+            return;
+        }
+        pthread_join(mThread, nullptr);
+        mThreadCreated = false;
+    }
+    state = finalState;
+}
+
+aaudio_result_t AAudioStreamStruct::requestStart() {
+    std::lock_guard<std::mutex> lock(mControlLock);
+    switch (static_cast<StreamState>(state.load())) {
+        case StreamState::Open:
+        case StreamState::Paused:
+        case StreamState::Flushed:
+        case StreamState::Stopped:
+            break;
+        case StreamState::Starting:
+        case StreamState::Started:
+            return toAAudio(Result::OK);
+        case StreamState::Disconnected:
+            return toAAudio(Result::ErrorDisconnected);
+        default:
+            return toAAudio(Result::ErrorInvalidState);
+    }
+    if (!isOutput()) {
+        mAppPosition = mDevicePosition.load(); // discard old input
+    }
+    state = toAAudio(StreamState::Started);
+    aaudio_result_t result = startThread_l();
+    if (result != toAAudio(Result::OK)) {
+        state = toAAudio(StreamState::Stopped);
+    }
+    return result;
+}
+
+aaudio_result_t AAudioStreamStruct::requestPause() {
+    if (!isOutput()) {
+        return toAAudio(Result::ErrorUnimplemented);
+    }
+    std::lock_guard<std::mutex> lock(mControlLock);
+    switch (static_cast<StreamState>(state.load())) {
+        case StreamState::Starting:
+        case StreamState::Started:
+            break;
+        case StreamState::Open:
+        case StreamState::Stopped:
+        case StreamState::Flushed:
+            state = toAAudio(StreamState::Paused);
+            return toAAudio(Result::OK);
+        case StreamState::Paused:
+            return toAAudio(Result::OK);
+        default:
+            return toAAudio(Result::ErrorInvalidState);
+    }
+    stopThread_l(toAAudio(StreamState::Pausing), toAAudio(StreamState::Paused));
+    return toAAudio(Result::OK);
+}
+
+aaudio_result_t AAudioStreamStruct::requestFlush() {
+    if (!isOutput()) {
+        return toAAudio(Result::ErrorUnimplemented);
+    }
+    std::lock_guard<std::mutex> lock(mControlLock);
+    switch (static_cast<StreamState>(state.load())) {
+        case StreamState::Open:
+        case StreamState::Paused:
+        case StreamState::Stopped:
+        case StreamState::Flushed:
+            break;
+        default:
+            return toAAudio(Result::ErrorInvalidState);
+    }
+    {
+        std::lock_guard<std::mutex> dataLock(mDataLock);
+        mAppPosition = mDevicePosition.load();
+    }
+    state = toAAudio(StreamState::Flushed);
+    return toAAudio(Result::OK);
+}
+
+aaudio_result_t AAudioStreamStruct::requestStop() {
+    std::lock_guard<std::mutex> lock(mControlLock);
+    switch (static_cast<StreamState>(state.load())) {
+        case StreamState::Starting:
+        case StreamState::Started:
+            break;
+        case StreamState::Open:
+        case StreamState::Paused:
+        case StreamState::Flushed:
+            state = toAAudio(StreamState::Stopped);
+            return toAAudio(Result::OK);
+        case StreamState::Stopping:
+        case StreamState::Stopped:
+            return toAAudio(Result::OK);
+        case StreamState::Disconnected:
+            // Make sure the thread is gone but stay disconnected.
+            stopThread_l(state.load(), state.load());
+            return toAAudio(Result::OK);
+        default:
+            return toAAudio(Result::ErrorInvalidState);
+    }
+    stopThread_l(toAAudio(StreamState::Stopping), toAAudio(StreamState::Stopped));
+    return toAAudio(Result::OK);
+}
+
+aaudio_result_t AAudioStreamStruct::close() {
+    std::lock_guard<std::mutex> lock(mControlLock);
+    aaudio_stream_state_t currentState = state.load();
+    stopThread_l(toAAudio(StreamState::Closing), toAAudio(StreamState::Closed));
+    if (mThreadCreated) {
+        // Closed from a callback, which is not allowed by AAudio. Do not delete the stream.
+        state = currentState;
+        return toAAudio(Result::ErrorInvalidState);
+    }
+    sOpenStreamCount--;
+    return toAAudio(Result::OK);
+}
+
+void AAudioStreamStruct::disconnect() {
+    mDisconnectRequested = true;
+    std::lock_guard<std::mutex> lock(mControlLock);
+    if (!mThreadCreated || !mThreadEnabled) {
+        // No timer thread to report it so do it here.
+        aaudio_stream_state_t currentState = state.load();
+        if (currentState != toAAudio(StreamState::Closing)
+                && currentState != toAAudio(StreamState::Closed)) {
+            state = toAAudio(StreamState::Disconnected);
+        }
+    }
+}
+
+void AAudioStreamStruct::runTimer() {
+    std::minstd_rand jitterGenerator(kJitterSeed);
+    std::uniform_int_distribution<int64_t> jitterDistribution(0, mWakeupJitterNanos);
+
+    // Like real hardware, the device takes a little while to start.
+    const int64_t startNanos = getNanoseconds()
+            + (framesPerBurst * kNanosPerSecond / sampleRate);
+    const int64_t startPosition = mDevicePosition.load();
+    int64_t bursts = 0;
+    sleepUntilNanoTime(startNanos);
+
+    // Fill the buffer before the device starts to consume it.
+    bool running = (isOutput() && mThreadEnabled) ? fireDataCallbacks() : true;
+
+    while (running && mThreadEnabled) {
+        bursts++;
+        int64_t wakeupNanos = startNanos + (bursts * framesPerBurst * kNanosPerSecond
+                / sampleRate);
+        if (mWakeupJitterNanos > 0) {
+            wakeupNanos += jitterDistribution(jitterGenerator);
+        }
+        sleepUntilNanoTime(wakeupNanos);
+        if (!mThreadEnabled) break;
+
+        if (mDisconnectRequested) {
+            state = toAAudio(StreamState::Disconnected);
+            mDataCondition.notify_all();
+            if (mErrorCallback != nullptr) {
+                (*mErrorCallback)(this, mErrorCallbackUserData,
+                                  toAAudio(Result::ErrorDisconnected));
+            }
+            return; // The stream may be closed by now.
+        }
+
+        // The device clock keeps running even if we woke up late.
+        int64_t nowNanos = getNanoseconds();
+        int64_t elapsedBursts = (nowNanos - startNanos) * sampleRate
+                / (framesPerBurst * kNanosPerSecond);
+        bursts = std::max(bursts, elapsedBursts);
+        int64_t devicePosition = startPosition + (bursts * framesPerBurst);
+        {
+            std::lock_guard<std::mutex> lock(mDataLock);
+            mDevicePosition = devicePosition;
+            int64_t appPosition = mAppPosition.load();
+            if (isOutput() && appPosition < devicePosition) {
+                // Underflow. The device played silence so skip the app ahead.
+                xRunCount++;
+                mAppPosition = devicePosition;
+            } else if (!isOutput() && (devicePosition - appPosition) > bufferCapacityInFrames) {
+                // Overflow. The oldest data was overwritten.
+                xRunCount++;
+                mAppPosition = devicePosition - bufferCapacityInFrames;
+            }
+            mTimestampPosition = devicePosition;
+            mTimestampNanos = startNanos + (bursts * framesPerBurst * kNanosPerSecond
+                    / sampleRate);
+        }
+        mDataCondition.notify_all();
+
+        running = fireDataCallbacks();
+    }
+
+    if (!running) {
+        // The callback returned STOP.
+        aaudio_stream_state_t started = toAAudio(StreamState::Started);
+        state.compare_exchange_strong(started, toAAudio(StreamState::Stopped));
+    }
+}
+
+// @return false if the callback returned STOP
+bool AAudioStreamStruct::fireDataCallbacks() {
+    if (mDataCallback == nullptr) return true;
+    const int32_t framesPerCallback = (framesPerDataCallback > 0)
+            ? framesPerDataCallback : framesPerBurst;
+    while (mThreadEnabled) {
+        if (isOutput()) {
+            int64_t framesQueued = mAppPosition.load() - mDevicePosition.load();
+            if (framesQueued >= bufferSizeInFrames.load()
+                    || framesQueued + framesPerCallback > bufferCapacityInFrames) {
+                break;
+            }
+        } else {
+            int64_t framesAvailable = mDevicePosition.load() - mAppPosition.load();
+            if (framesAvailable < framesPerCallback) {
+                break;
+            }
+            memset(mCallbackBuffer.data(), 0, mCallbackBuffer.size());
+        }
+        int32_t result = (*mDataCallback)(this, mDataCallbackUserData,
+                                          mCallbackBuffer.data(), framesPerCallback);
+        mAppPosition += framesPerCallback;
+        if (result != toAAudio(DataCallbackResult::Continue)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int32_t AAudioStreamStruct::write(const void * /* buffer */,
+                                  int32_t numFrames,
+                                  int64_t timeoutNanoseconds) {
+    if (!isOutput()) return toAAudio(Result::ErrorUnimplemented);
+    if (mDataCallback != nullptr) return toAAudio(Result::ErrorInvalidState);
+    if (numFrames < 0) return toAAudio(Result::ErrorIllegalArgument);
+
+    const int64_t deadlineNanos = getNanoseconds() + timeoutNanoseconds;
+    int32_t framesWritten = 0;
+    std::unique_lock<std::mutex> lock(mDataLock);
+    while (framesWritten < numFrames) {
+        if (state.load() == toAAudio(StreamState::Disconnected)) {
+            return (framesWritten > 0) ? framesWritten : toAAudio(Result::ErrorDisconnected);
+        }
+        int64_t room = bufferSizeInFrames.load() - (mAppPosition.load() - mDevicePosition.load());
+        if (room > 0) {
+            int32_t framesToWrite = static_cast<int32_t>(
+                    std::min<int64_t>(room, numFrames - framesWritten));
+            mAppPosition += framesToWrite;
+            framesWritten += framesToWrite;
+            continue;
+        }
+        // The device only makes room while it is running.
+        if (timeoutNanoseconds <= 0 || !isRunning()) break;
+        int64_t timeLeftNanos = deadlineNanos - getNanoseconds();
+        if (timeLeftNanos <= 0) break;
+        mDataCondition.wait_for(lock, std::chrono::nanoseconds(timeLeftNanos));
+    }
+    return framesWritten;
+}
+
+int32_t AAudioStreamStruct::read(void *buffer, int32_t numFrames, int64_t timeoutNanoseconds) {
+    if (isOutput()) return toAAudio(Result::ErrorUnimplemented);
+    if (mDataCallback != nullptr) return toAAudio(Result::ErrorInvalidState);
+    if (numFrames < 0) return toAAudio(Result::ErrorIllegalArgument);
+
+    const int32_t bytesPerFrame = channelCount * getBytesPerSample(format);
+    uint8_t *destination = static_cast<uint8_t *>(buffer);
+    const int64_t deadlineNanos = getNanoseconds() + timeoutNanoseconds;
+    int32_t framesRead = 0;
+    std::unique_lock<std::mutex> lock(mDataLock);
+    while (framesRead < numFrames) {
+        if (state.load() == toAAudio(StreamState::Disconnected)) {
+            return (framesRead > 0) ? framesRead : toAAudio(Result::ErrorDisconnected);
+        }
+        int64_t available = mDevicePosition.load() - mAppPosition.load();
+        if (available > 0) {
+            int32_t framesToRead = static_cast<int32_t>(
+                    std::min<int64_t>(available, numFrames - framesRead));
+            memset(destination + (framesRead * bytesPerFrame), 0, framesToRead * bytesPerFrame);
+            mAppPosition += framesToRead;
+            framesRead += framesToRead;
+            continue;
+        }
+        if (timeoutNanoseconds <= 0 || !isRunning()) break;
+        int64_t timeLeftNanos = deadlineNanos - getNanoseconds();
+        if (timeLeftNanos <= 0) break;
+        mDataCondition.wait_for(lock, std::chrono::nanoseconds(timeLeftNanos));
+    }
+    return framesRead;
+}
+
+aaudio_result_t AAudioStreamStruct::waitForStateChange(aaudio_stream_state_t inputState,
+                                                       aaudio_stream_state_t *nextState,
+                                                       int64_t timeoutNanoseconds) {
+    const int64_t deadlineNanos = getNanoseconds() + timeoutNanoseconds;
+    aaudio_stream_state_t currentState = state.load();
+    while (currentState == inputState) {
+        int64_t timeLeftNanos = deadlineNanos - getNanoseconds();
+        if (timeLeftNanos <= 0) {
+            if (nextState != nullptr) *nextState = currentState;
+            return toAAudio(Result::ErrorTimeout);
+        }
+        sleepUntilNanoTime(getNanoseconds() + std::min(timeLeftNanos, kStatePollNanos));
+        currentState = state.load();
+    }
+    if (nextState != nullptr) *nextState = currentState;
+    return toAAudio(Result::OK);
+}
+
+aaudio_result_t AAudioStreamStruct::getTimestamp(clockid_t clockId,
+                                                 int64_t *framePosition,
+                                                 int64_t *timeNanos) {
+    if (clockId != CLOCK_MONOTONIC && clockId != CLOCK_BOOTTIME) {
+        return toAAudio(Result::ErrorIllegalArgument);
+    }
+    if (state.load() != toAAudio(StreamState::Started)) {
+        return toAAudio(Result::ErrorInvalidState);
+    }
+    std::lock_guard<std::mutex> lock(mDataLock);
+    int64_t timestampNanos = mTimestampNanos.load();
+    if (timestampNanos == 0) {
+        return toAAudio(Result::ErrorInvalidState); // no burst has been processed yet
+    }
+    if (clockId == CLOCK_BOOTTIME) {
+        timestampNanos += getNanoseconds(CLOCK_BOOTTIME) - getNanoseconds(CLOCK_MONOTONIC);
+    }
+    *framePosition = mTimestampPosition.load();
+    *timeNanos = timestampNanos;
+    return toAAudio(Result::OK);
+}
+
+int32_t AAudioStreamStruct::setBufferSizeInFrames(int32_t requestedFrames) {
+    if (requestedFrames < 0) return toAAudio(Result::ErrorOutOfRange);
+    int32_t frames = ((requestedFrames + framesPerBurst - 1) / framesPerBurst) * framesPerBurst;
+    frames = std::max(frames, framesPerBurst);
+    frames = std::min(frames, bufferCapacityInFrames);
+    bufferSizeInFrames = frames;
+    return frames;
+}
+
+// ===================== C API =====================
+extern "C" {
+
+aaudio_result_t AAudio_createStreamBuilder(AAudioStreamBuilder **builder) {
+    if (builder == nullptr) return toAAudio(Result::ErrorNull);
+    *builder = new AAudioStreamBuilderStruct();
+    return toAAudio(Result::OK);
+}
+
+aaudio_result_t AAudioStreamBuilder_openStream(AAudioStreamBuilder *builder,
+                                               AAudioStream **stream) {
+    if (builder == nullptr || stream == nullptr) return toAAudio(Result::ErrorNull);
+    *stream = nullptr;
+    AAudioStreamStruct *newStream = new AAudioStreamStruct();
+    aaudio_result_t result = newStream->open(*builder);
+    if (result != toAAudio(Result::OK)) {
+        delete newStream;
+        return result;
+    }
+    *stream = newStream;
+    return result;
+}
+
+aaudio_result_t AAudioStreamBuilder_delete(AAudioStreamBuilder *builder) {
+    delete builder;
+    return toAAudio(Result::OK);
+}
+
+#define FAKE_AAUDIO_BUILDER_SETTER(name, field) \
+void AAudioStreamBuilder_##name(AAudioStreamBuilder *builder, int32_t value) { \
+    builder->field = value; \
+}
+
+FAKE_AAUDIO_BUILDER_SETTER(setChannelCount, channelCount)
+FAKE_AAUDIO_BUILDER_SETTER(setSamplesPerFrame, channelCount)
+FAKE_AAUDIO_BUILDER_SETTER(setBufferCapacityInFrames, bufferCapacityInFrames)
+FAKE_AAUDIO_BUILDER_SETTER(setDeviceId, deviceId)
+FAKE_AAUDIO_BUILDER_SETTER(setDirection, direction)
+FAKE_AAUDIO_BUILDER_SETTER(setFormat, format)
+FAKE_AAUDIO_BUILDER_SETTER(setFramesPerDataCallback, framesPerDataCallback)
+FAKE_AAUDIO_BUILDER_SETTER(setSharingMode, sharingMode)
+FAKE_AAUDIO_BUILDER_SETTER(setPerformanceMode, performanceMode)
+FAKE_AAUDIO_BUILDER_SETTER(setSampleRate, sampleRate)
+FAKE_AAUDIO_BUILDER_SETTER(setUsage, usage)
+FAKE_AAUDIO_BUILDER_SETTER(setContentType, contentType)
+FAKE_AAUDIO_BUILDER_SETTER(setInputPreset, inputPreset)
+FAKE_AAUDIO_BUILDER_SETTER(setSessionId, sessionId)
+
+#undef FAKE_AAUDIO_BUILDER_SETTER
+
+void AAudioStreamBuilder_setPackageName(AAudioStreamBuilder *builder, const char *packageName) {
+    builder->packageName = (packageName != nullptr) ? packageName : "";
+}
+
+void AAudioStreamBuilder_setAttributionTag(AAudioStreamBuilder *builder,
+                                           const char *attributionTag) {
+    builder->attributionTag = (attributionTag != nullptr) ? attributionTag : "";
+}
+
+void AAudioStreamBuilder_setDataCallback(AAudioStreamBuilder *builder,
+                                         AAudioStream_dataCallback callback,
+                                         void *userData) {
+    builder->dataCallback = callback;
+    builder->dataCallbackUserData = userData;
+}
+
+void AAudioStreamBuilder_setErrorCallback(AAudioStreamBuilder *builder,
+                                          AAudioStream_errorCallback callback,
+                                          void *userData) {
+    builder->errorCallback = callback;
+    builder->errorCallbackUserData = userData;
+}
+
+aaudio_result_t AAudioStream_close(AAudioStream *stream) {
+    if (stream == nullptr) return toAAudio(Result::ErrorNull);
+    aaudio_result_t result = stream->close();
+    if (result == toAAudio(Result::OK)) {
+        delete stream;
+    }
+    return result;
+}
+
+aaudio_result_t AAudioStream_requestStart(AAudioStream *stream) {
+    return stream->requestStart();
+}
+
+aaudio_result_t AAudioStream_requestPause(AAudioStream *stream) {
+    return stream->requestPause();
+}
+
+aaudio_result_t AAudioStream_requestFlush(AAudioStream *stream) {
+    return stream->requestFlush();
+}
+
+aaudio_result_t AAudioStream_requestStop(AAudioStream *stream) {
+    return stream->requestStop();
+}
+
+aaudio_result_t AAudioStream_read(AAudioStream *stream,
+                                  void *buffer,
+                                  int32_t numFrames,
+                                  int64_t timeoutNanoseconds) {
+    return stream->read(buffer, numFrames, timeoutNanoseconds);
+}
+
+aaudio_result_t AAudioStream_write(AAudioStream *stream,
+                                   const void *buffer,
+                                   int32_t numFrames,
+                                   int64_t timeoutNanoseconds) {
+    return stream->write(buffer, numFrames, timeoutNanoseconds);
+}
+
+aaudio_result_t AAudioStream_waitForStateChange(AAudioStream *stream,
+                                                aaudio_stream_state_t inputState,
+                                                aaudio_stream_state_t *nextState,
+                                                int64_t timeoutNanoseconds) {
+    return stream->waitForStateChange(inputState, nextState, timeoutNanoseconds);
+}
+
+aaudio_result_t AAudioStream_getTimestamp(AAudioStream *stream,
+                                          clockid_t clockid,
+                                          int64_t *framePosition,
+                                          int64_t *timeNanoseconds) {
+    if (framePosition == nullptr || timeNanoseconds == nullptr) {
+        return toAAudio(Result::ErrorNull);
+    }
+    return stream->getTimestamp(clockid, framePosition, timeNanoseconds);
+}
+
+aaudio_result_t AAudioStream_setBufferSizeInFrames(AAudioStream *stream,
+                                                   int32_t numFrames) {
+    return stream->setBufferSizeInFrames(numFrames);
+}
+
+#define FAKE_AAUDIO_STREAM_GETTER(name, expression) \
+int32_t AAudioStream_##name(AAudioStream *stream) { \
+    return stream->expression; \
+}
+
+FAKE_AAUDIO_STREAM_GETTER(getChannelCount, channelCount)
+FAKE_AAUDIO_STREAM_GETTER(getSamplesPerFrame, channelCount)
+FAKE_AAUDIO_STREAM_GETTER(getBufferSizeInFrames, bufferSizeInFrames.load())
+FAKE_AAUDIO_STREAM_GETTER(getBufferCapacityInFrames, bufferCapacityInFrames)
+FAKE_AAUDIO_STREAM_GETTER(getDeviceId, deviceId)
+FAKE_AAUDIO_STREAM_GETTER(getFormat, format)
+FAKE_AAUDIO_STREAM_GETTER(getFramesPerBurst, framesPerBurst)
+FAKE_AAUDIO_STREAM_GETTER(getPerformanceMode, performanceMode)
+FAKE_AAUDIO_STREAM_GETTER(getSampleRate, sampleRate)
+FAKE_AAUDIO_STREAM_GETTER(getSharingMode, sharingMode)
+FAKE_AAUDIO_STREAM_GETTER(getState, state.load())
+FAKE_AAUDIO_STREAM_GETTER(getXRunCount, xRunCount.load())
+FAKE_AAUDIO_STREAM_GETTER(getUsage, usage)
+FAKE_AAUDIO_STREAM_GETTER(getContentType, contentType)
+FAKE_AAUDIO_STREAM_GETTER(getInputPreset, inputPreset)
+FAKE_AAUDIO_STREAM_GETTER(getSessionId, sessionId)
+
+#undef FAKE_AAUDIO_STREAM_GETTER
+
+int64_t AAudioStream_getFramesRead(AAudioStream *stream) {
+    return stream->getFramesRead();
+}
+
+int64_t AAudioStream_getFramesWritten(AAudioStream *stream) {
+    return stream->getFramesWritten();
+}
+
+bool AAudioStream_isMMapUsed(AAudioStream *stream) {
+    return stream->isMMap;
+}
+
+aaudio_result_t AAudio_setMMapPolicy(aaudio_policy_t policy) {
+    if (policy < kPolicyNever || policy > kPolicyAlways) {
+        return toAAudio(Result::ErrorIllegalArgument);
+    }
+    sMMapPolicy = policy;
+    return toAAudio(Result::OK);
+}
+
+aaudio_policy_t AAudio_getMMapPolicy() {
+    return sMMapPolicy.load();
+}
+
+const char *AAudio_convertResultToText(aaudio_result_t returnCode) {
+    switch (static_cast<Result>(returnCode)) {
+        case Result::OK: return "AAUDIO_OK";
+        case Result::ErrorDisconnected: return "AAUDIO_ERROR_DISCONNECTED";
+        case Result::ErrorIllegalArgument: return "AAUDIO_ERROR_ILLEGAL_ARGUMENT";
+        case Result::ErrorInternal: return "AAUDIO_ERROR_INTERNAL";
+        case Result::ErrorInvalidState: return "AAUDIO_ERROR_INVALID_STATE";
+        case Result::ErrorInvalidHandle: return "AAUDIO_ERROR_INVALID_HANDLE";
+        case Result::ErrorUnimplemented: return "AAUDIO_ERROR_UNIMPLEMENTED";
+        case Result::ErrorUnavailable: return "AAUDIO_ERROR_UNAVAILABLE";
+        case Result::ErrorNoFreeHandles: return "AAUDIO_ERROR_NO_FREE_HANDLES";
+        case Result::ErrorNoMemory: return "AAUDIO_ERROR_NO_MEMORY";
+        case Result::ErrorNull: return "AAUDIO_ERROR_NULL";
+        case Result::ErrorTimeout: return "AAUDIO_ERROR_TIMEOUT";
+        case Result::ErrorWouldBlock: return "AAUDIO_ERROR_WOULD_BLOCK";
+        case Result::ErrorInvalidFormat: return "AAUDIO_ERROR_INVALID_FORMAT";
+        case Result::ErrorOutOfRange: return "AAUDIO_ERROR_OUT_OF_RANGE";
+        case Result::ErrorNoService: return "AAUDIO_ERROR_NO_SERVICE";
+        case Result::ErrorInvalidRate: return "AAUDIO_ERROR_INVALID_RATE";
+        default: return "Unrecognized AAudio error.";
+    }
+}
+
+// ===================== Test controls =====================
+
+void FakeAAudio_setDeviceSampleRate(int32_t sampleRate) {
+    sDeviceSampleRate = sampleRate;
+}
+
+void FakeAAudio_setWakeupJitterNanos(int64_t jitterNanos) {
+    sWakeupJitterNanos = jitterNanos;
+}
+
+void FakeAAudio_disconnect(AAudioStream *stream) {
+    stream->disconnect();
+}
+
+int32_t FakeAAudio_getOpenStreamCount() {
+    return sOpenStreamCount.load();
+}
+
+void FakeAAudio_reset() {
+    sDeviceSampleRate = kDefaultDeviceSampleRate;
+    sWakeupJitterNanos = 0;
+    sMMapPolicy = kPolicyAuto;
+}
+
+} // extern "C"
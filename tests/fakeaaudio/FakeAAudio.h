@@ -0,0 +1,71 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OBOE_FAKE_AAUDIO_H
+#define OBOE_FAKE_AAUDIO_H
+
+#include <stdint.h>
+
+/*
+ * Test controls for the fake libaaudio.so that is built from FakeAAudio.cpp.
+ *
+ * The fake implements the part of the AAudio C API that AAudioLoader and AAudioExtensions
+ * look up, so AudioStreamAAudio can run on a Linux host. These extra functions let a test
+ * change the simulated device. They are not in the real libaaudio.so so tests should look
+ * them up with dlsym() and skip if they are missing.
+ */
+
+typedef struct AAudioStreamStruct AAudioStream;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Set the native rate of the simulated device. Streams that do not request a rate get this
+ * rate. MMAP is only used by streams that run at this rate. The default is 48000.
+ * Only affects streams opened afterwards.
+ */
+void FakeAAudio_setDeviceSampleRate(int32_t sampleRate);
+
+/**
+ * Make each timer thread wakeup late by a random amount between zero and jitterNanos.
+ * The device position follows the clock so a late wakeup may cause an XRun.
+ * The default is zero. Only affects streams opened afterwards.
+ */
+void FakeAAudio_setWakeupJitterNanos(int64_t jitterNanos);
+
+/**
+ * Simulate unplugging the device. The stream goes to the DISCONNECTED state and
+ * the error callback, if any, is called from the timer thread with AAUDIO_ERROR_DISCONNECTED.
+ */
+void FakeAAudio_disconnect(AAudioStream *stream);
+
+/**
+ * @return number of streams that have been opened but not closed
+ */
+int32_t FakeAAudio_getOpenStreamCount();
+
+/**
+ * Restore the default device settings and MMAP policy.
+ */
+void FakeAAudio_reset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //OBOE_FAKE_AAUDIO_H
@@ -0,0 +1,311 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test AudioStream::writeAsync() and readAsync(), and the coroutines when built with C++20.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+constexpr int32_t kSampleRate = 48000;
+constexpr int32_t kChannelCount = 2;
+constexpr int32_t kFramesPerChunk = 480; // 10 msec
+constexpr int64_t kTimeoutNanos = 2 * kNanosPerSecond;
+
+// Writes or reads a number of chunks, starting each one from the callback of the previous one.
+class ChunkTransferer : public AsyncTransferCallback {
+public:
+    ChunkTransferer(std::shared_ptr<AudioStream> stream, int32_t numChunks)
+            : mStream(stream)
+            , mChunksLeft(numChunks)
+            , mBuffer(kFramesPerChunk * kChannelCount, 0.0f) {}
+
+    Result start() {
+        return transferNextChunk();
+    }
+
+    void onTransferComplete(AudioStream *audioStream,
+                            ResultWithValue<int32_t> result) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        EXPECT_EQ(mStream.get(), audioStream);
+        threadIds.insert(std::this_thread::get_id());
+        lastResult = result.error();
+        if (result) {
+            framesTransferred += result.value();
+        }
+        if (!result || --mChunksLeft == 0 || transferNextChunk() != Result::OK) {
+            done = true;
+            mCondition.notify_all();
+        }
+    }
+
+    bool waitUntilDone(int64_t timeoutMillis) {
+        std::unique_lock<std::mutex> lock(mLock);
+        return mCondition.wait_for(lock, std::chrono::milliseconds(timeoutMillis),
+                                   [this] { return done; });
+    }
+
+    std::set<std::thread::id> threadIds;
+    int64_t framesTransferred = 0;
+    Result lastResult = Result::OK;
+    bool done = false;
+
+private:
+    Result transferNextChunk() {
+        return (mStream->getDirection() == Direction::Output)
+                ? mStream->writeAsync(mBuffer.data(), kFramesPerChunk, kTimeoutNanos, this)
+                : mStream->readAsync(mBuffer.data(), kFramesPerChunk, kTimeoutNanos, this);
+    }
+
+    std::shared_ptr<AudioStream> mStream;
+    int32_t                      mChunksLeft;
+    std::vector<float>           mBuffer;
+    std::mutex                   mLock;
+    std::condition_variable      mCondition;
+};
+
+class AsyncTransfer : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mBuilder.setAudioApi(AudioApi::Null)
+                ->setSampleRate(kSampleRate)
+                ->setChannelCount(kChannelCount)
+                ->setFormat(AudioFormat::Float);
+    }
+
+    std::shared_ptr<AudioStream> openStream() {
+        std::shared_ptr<AudioStream> stream;
+        EXPECT_EQ(Result::OK, mBuilder.openStream(stream));
+        return stream;
+    }
+
+    // Transfer 200 msec and check that it took about as long.
+    void checkTransfer(Direction direction) {
+        constexpr int32_t kNumChunks = 20;
+        mBuilder.setDirection(direction);
+        std::shared_ptr<AudioStream> stream = openStream();
+        ASSERT_TRUE(stream);
+        ASSERT_EQ(Result::OK, stream->requestStart());
+        ChunkTransferer transferer(stream, kNumChunks);
+        const auto start = std::chrono::steady_clock::now();
+        ASSERT_EQ(Result::OK, transferer.start());
+        ASSERT_TRUE(transferer.waitUntilDone(2000));
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        EXPECT_EQ(Result::OK, transferer.lastResult);
+        EXPECT_EQ(kNumChunks * kFramesPerChunk, transferer.framesTransferred);
+        // The output FIFO takes some frames right away.
+        EXPECT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(),
+                  (direction == Direction::Output) ? 100 : 180);
+        EXPECT_EQ(transferer.threadIds.count(std::this_thread::get_id()), 0u);
+        stream->close();
+    }
+
+    AudioStreamBuilder mBuilder;
+};
+
+TEST_F(AsyncTransfer, WriteChunks) {
+    checkTransfer(Direction::Output);
+}
+
+TEST_F(AsyncTransfer, ReadChunks) {
+    checkTransfer(Direction::Input);
+}
+
+// Many streams are serviced by a few shared threads.
+TEST_F(AsyncTransfer, ManyStreams) {
+    constexpr int32_t kNumStreams = 100;
+    constexpr int32_t kNumChunks = 10;
+    std::vector<std::shared_ptr<AudioStream>> streams;
+    std::vector<std::unique_ptr<ChunkTransferer>> transferers;
+    for (int32_t i = 0; i < kNumStreams; i++) {
+        std::shared_ptr<AudioStream> stream = openStream();
+        ASSERT_TRUE(stream);
+        ASSERT_EQ(Result::OK, stream->requestStart());
+        transferers.push_back(std::make_unique<ChunkTransferer>(stream, kNumChunks));
+        streams.push_back(stream);
+    }
+    for (auto &transferer : transferers) {
+        ASSERT_EQ(Result::OK, transferer->start());
+    }
+    std::set<std::thread::id> threadIds;
+    for (auto &transferer : transferers) {
+        ASSERT_TRUE(transferer->waitUntilDone(5000));
+        EXPECT_EQ(kNumChunks * kFramesPerChunk, transferer->framesTransferred);
+        threadIds.insert(transferer->threadIds.begin(), transferer->threadIds.end());
+    }
+    EXPECT_LE(threadIds.size(), 2u);
+    for (auto &stream : streams) {
+        stream->close();
+    }
+}
+
+TEST_F(AsyncTransfer, OnlyOnePending) {
+    std::shared_ptr<AudioStream> stream = openStream();
+    ASSERT_TRUE(stream);
+    // Not started so the write cannot finish.
+    ChunkTransferer first(stream, 1000);
+    ChunkTransferer second(stream, 1);
+    ASSERT_EQ(Result::OK, first.start());
+    EXPECT_EQ(Result::ErrorInvalidState, second.start());
+    stream->close();
+    EXPECT_TRUE(first.waitUntilDone(1000));
+}
+
+TEST_F(AsyncTransfer, CloseCancels) {
+    std::shared_ptr<AudioStream> stream = openStream();
+    ASSERT_TRUE(stream);
+    ChunkTransferer transferer(stream, 1000);
+    ASSERT_EQ(Result::OK, transferer.start());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(transferer.done);
+    stream->close();
+    ASSERT_TRUE(transferer.waitUntilDone(1000));
+    EXPECT_EQ(Result::ErrorClosed, transferer.lastResult);
+
+    ChunkTransferer afterClose(stream, 1);
+    EXPECT_EQ(Result::ErrorClosed, afterClose.start());
+}
+
+class PartialCallback : public AsyncTransferCallback {
+public:
+    void onTransferComplete(AudioStream * /* audioStream */,
+                            ResultWithValue<int32_t> result) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        mResult = result ? result.value() : static_cast<int32_t>(result.error());
+        mDone = true;
+        mCondition.notify_all();
+    }
+
+    ResultWithValue<int32_t> waitForResult() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mCondition.wait_for(lock, std::chrono::seconds(1), [this] { return mDone; });
+        return ResultWithValue<int32_t>::createBasedOnSign(mResult);
+    }
+
+private:
+    std::mutex               mLock;
+    std::condition_variable  mCondition;
+    int32_t                  mResult = static_cast<int32_t>(Result::ErrorTimeout);
+    bool                     mDone = false;
+};
+
+TEST_F(AsyncTransfer, TimeoutWritesWhatFits) {
+    std::shared_ptr<AudioStream> stream = openStream();
+    ASSERT_TRUE(stream);
+    // The stream is not started so only the buffer can be filled.
+    const int32_t numFrames = stream->getBufferCapacityInFrames() * 2;
+    std::vector<float> buffer(numFrames * kChannelCount);
+    PartialCallback callback;
+    ASSERT_EQ(Result::OK, stream->writeAsync(buffer.data(), numFrames,
+                                             20 * kNanosPerMillisecond, &callback));
+    auto result = callback.waitForResult();
+    ASSERT_TRUE(result);
+    EXPECT_GT(result.value(), 0);
+    EXPECT_LT(result.value(), numFrames);
+    stream->close();
+}
+
+TEST_F(AsyncTransfer, InvalidArguments) {
+    std::shared_ptr<AudioStream> stream = openStream();
+    ASSERT_TRUE(stream);
+    float buffer[kChannelCount];
+    PartialCallback callback;
+    EXPECT_EQ(Result::ErrorNull, stream->writeAsync(nullptr, 1, 0, &callback));
+    EXPECT_EQ(Result::ErrorNull, stream->writeAsync(buffer, 1, 0, nullptr));
+    EXPECT_EQ(Result::ErrorOutOfRange, stream->writeAsync(buffer, -1, 0, &callback));
+    EXPECT_EQ(Result::ErrorOutOfRange, stream->writeAsync(buffer, 1, -1, &callback));
+    stream->close();
+}
+
+// A FilterAudioStream converts the frames and waits for the FIFO of its child.
+TEST_F(AsyncTransfer, WriteWithConversion) {
+    mBuilder.setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(44100)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium);
+    std::shared_ptr<AudioStream> stream = openStream();
+    ASSERT_TRUE(stream);
+    ASSERT_EQ(44100, stream->getSampleRate());
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    constexpr int32_t kNumChunks = 20;
+    ChunkTransferer transferer(stream, kNumChunks);
+    ASSERT_EQ(Result::OK, transferer.start());
+    ASSERT_TRUE(transferer.waitUntilDone(2000));
+    EXPECT_EQ(Result::OK, transferer.lastResult);
+    EXPECT_EQ(kNumChunks * kFramesPerChunk, transferer.framesTransferred);
+    stream->close();
+}
+
+#ifdef OBOE_COROUTINES_SUPPORTED
+
+// Just enough of a coroutine type to run a test.
+struct TestTask {
+    struct promise_type {
+        TestTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+struct CoroutineState {
+    std::mutex              lock;
+    std::condition_variable condition;
+    int64_t                 framesWritten = 0;
+    bool                    done = false;
+};
+
+static TestTask writeChunks(AudioStream &stream, int32_t numChunks, CoroutineState &state) {
+    std::vector<float> buffer(kFramesPerChunk * kChannelCount, 0.0f);
+    int64_t framesWritten = 0;
+    for (int32_t i = 0; i < numChunks; i++) {
+        auto result = co_await asyncWrite(stream, buffer.data(), kFramesPerChunk, kTimeoutNanos);
+        if (!result) break;
+        framesWritten += result.value();
+    }
+    std::lock_guard<std::mutex> lock(state.lock);
+    state.framesWritten = framesWritten;
+    state.done = true;
+    state.condition.notify_all();
+}
+
+TEST_F(AsyncTransfer, CoroutineWrite) {
+    constexpr int32_t kNumChunks = 20;
+    std::shared_ptr<AudioStream> stream = openStream();
+    ASSERT_TRUE(stream);
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    CoroutineState state;
+    writeChunks(*stream, kNumChunks, state);
+    std::unique_lock<std::mutex> lock(state.lock);
+    ASSERT_TRUE(state.condition.wait_for(lock, std::chrono::seconds(2),
+                                         [&state] { return state.done; }));
+    EXPECT_EQ(kNumChunks * kFramesPerChunk, state.framesWritten);
+    lock.unlock();
+    stream->close();
+}
+
+#endif // OBOE_COROUTINES_SUPPORTED
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+#include "common/AutoSampleRateConverter.h"
+#include "flowgraph/SinkFloat.h"
+#include "flowgraph/SourceFloat.h"
+
+using namespace oboe;
+using namespace oboe::flowgraph;
+using namespace oboe::resampler;
+
+constexpr int32_t kChannelCount = 2;
+constexpr float kFrequency = 1000.0f;
+
+static std::vector<float> makeSine(int32_t numFrames, int32_t sampleRate) {
+    std::vector<float> sine(static_cast<size_t>(numFrames) * kChannelCount);
+    for (int32_t i = 0; i < numFrames; i++) {
+        const float sample = 0.5f * sinf(2.0f * static_cast<float>(M_PI) * kFrequency * i
+                / sampleRate);
+        sine[i * kChannelCount] = sample;
+        sine[i * kChannelCount + 1] = -sample;
+    }
+    return sine;
+}
+
+// A resampler that is given the recent input and the phase of another one
+// should continue with exactly the same output.
+static void checkCopyPhase(int32_t inputRate, int32_t outputRate,
+                           MultiChannelResampler::Quality quality) {
+    constexpr int32_t kNumOutputFrames = 1000;
+    constexpr int32_t kSwitchFrame = 333;
+    std::vector<float> input = makeSine(2 * kNumOutputFrames, inputRate);
+    std::unique_ptr<MultiChannelResampler> reference(
+            MultiChannelResampler::make(kChannelCount, inputRate, outputRate, quality));
+    std::unique_ptr<MultiChannelResampler> copy(
+            MultiChannelResampler::make(kChannelCount, inputRate, outputRate, quality));
+    float referenceFrame[kChannelCount];
+    float copyFrame[kChannelCount];
+    int32_t inputIndex = 0;
+    bool copying = false;
+    for (int32_t outputIndex = 0; outputIndex < kNumOutputFrames;) {
+        if (reference->isWriteNeeded()) {
+            const float *frame = &input[inputIndex++ * kChannelCount];
+            reference->writeNextFrame(frame);
+            if (copying) {
+                copy->writeNextFrame(frame);
+            }
+        } else {
+            if (outputIndex == kSwitchFrame) {
+                for (int32_t i = inputIndex - copy->getNumTaps(); i < inputIndex; i++) {
+                    copy->writeNextFrame(&input[i * kChannelCount]);
+                }
+                copy->copyPhase(*reference);
+                copying = true;
+            }
+            reference->readNextFrame(referenceFrame);
+            if (copying) {
+                ASSERT_FALSE(copy->isWriteNeeded());
+                copy->readNextFrame(copyFrame);
+                for (int32_t channel = 0; channel < kChannelCount; channel++) {
+                    ASSERT_NEAR(referenceFrame[channel], copyFrame[channel], 1.0e-6f)
+                            << "quality = " << static_cast<int32_t>(quality)
+                            << ", frame = " << outputIndex;
+                }
+            }
+            outputIndex++;
+        }
+    }
+}
+
+TEST(AutoSampleRateConverter, CopyPhasePolyphase) {
+    for (int32_t quality = 0; quality <= static_cast<int32_t>(MultiChannelResampler::Quality::Best);
+            quality++) {
+        checkCopyPhase(44100, 48000, static_cast<MultiChannelResampler::Quality>(quality));
+        checkCopyPhase(48000, 44100, static_cast<MultiChannelResampler::Quality>(quality));
+    }
+}
+
+TEST(AutoSampleRateConverter, CopyPhaseSinc) {
+    // The reduced ratio is too big for a polyphase table.
+    checkCopyPhase(44100, 47999, MultiChannelResampler::Quality::High);
+    checkCopyPhase(44100, 47999, MultiChannelResampler::Quality::Best);
+}
+
+// Convert a sine wave for a few seconds and check that it stays smooth.
+static AutoSampleRateConverter::Quality convertSine(double budgetFraction) {
+    constexpr int32_t kInputRate = 44100;
+    constexpr int32_t kOutputRate = 48000;
+    constexpr int32_t kSeconds = 5;
+    constexpr int32_t kFramesPerRead = 192;
+    std::vector<float> input = makeSine(kSeconds * kInputRate, kInputRate);
+    SourceFloat source(kChannelCount);
+    AutoSampleRateConverter converter(kChannelCount, kInputRate, kOutputRate, budgetFraction);
+    SinkFloat sink(kChannelCount);
+    source.output.connect(&converter.input);
+    converter.output.connect(&sink.input);
+    source.setData(input.data(), kSeconds * kInputRate);
+
+    // The biggest step of the sine between frames, with some margin for the filters.
+    const float maxStep = 1.2f * 0.5f * 2.0f * static_cast<float>(M_PI) * kFrequency / kOutputRate;
+    std::vector<float> output(kFramesPerRead * kChannelCount);
+    float previous = 0.0f;
+    int64_t framesRead = 0;
+    const int64_t framesToRead = (kSeconds - 1) * kOutputRate;
+    while (framesRead < framesToRead) {
+        int32_t numRead = sink.read(output.data(), kFramesPerRead);
+        EXPECT_EQ(kFramesPerRead, numRead);
+        for (int32_t i = 0; i < numRead; i++) {
+            const float sample = output[i * kChannelCount];
+            // Allow the filter to settle at the start.
+            if (framesRead + i > 100) {
+                EXPECT_LT(fabsf(sample - previous), maxStep) << "frame = " << framesRead + i;
+                EXPECT_NEAR(sample, -output[i * kChannelCount + 1], 1.0e-6f);
+            }
+            previous = sample;
+        }
+        framesRead += numRead;
+    }
+    return converter.getQuality();
+}
+
+TEST(AutoSampleRateConverter, RaisesQualityWhenCheap) {
+    EXPECT_EQ(MultiChannelResampler::Quality::Best, convertSine(1.0));
+}
+
+TEST(AutoSampleRateConverter, LowersQualityWhenExpensive) {
+    EXPECT_EQ(MultiChannelResampler::Quality::Fastest, convertSine(1.0e-6));
+}
+
+TEST(AutoSampleRateConverter, StreamReportsActiveQuality) {
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)
+            ->setFormat(AudioFormat::Float)
+            ->setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(44100)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Auto)
+            ->setSampleRateConversionCpuBudget(0.5);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    ASSERT_EQ(44100, stream->getSampleRate());
+    EXPECT_EQ(SampleRateConversionQuality::Auto, stream->getSampleRateConversionQuality());
+    EXPECT_EQ(SampleRateConversionQuality::Medium, stream->getActiveSampleRateConversionQuality());
+    stream->close();
+
+    // No conversion at the native rate.
+    builder.setSampleRate(kUnspecified);
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    EXPECT_EQ(SampleRateConversionQuality::None, stream->getActiveSampleRateConversionQuality());
+    stream->close();
+}
+
+TEST(AutoSampleRateConverter, InvalidBudget) {
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Auto)
+            ->setSampleRateConversionCpuBudget(0.0);
+    std::shared_ptr<AudioStream> stream;
+    EXPECT_EQ(Result::ErrorIllegalArgument, builder.openStream(stream));
+}
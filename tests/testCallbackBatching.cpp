@@ -0,0 +1,236 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test batching of the data callbacks of PerformanceMode::PowerSaving streams.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <time.h>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+constexpr int32_t kSampleRate = 48000;
+constexpr int32_t kFramesPerBurst = 96;
+constexpr int32_t kBatchMillis = 100;
+constexpr int kRunMillis = 500;
+
+static int64_t getThreadCpuNanos() {
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (static_cast<int64_t>(time.tv_sec) * kNanosPerSecond) + time.tv_nsec;
+}
+
+class BatchCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream *oboeStream,
+                                    void *audioData,
+                                    int32_t numFrames) override {
+        if (numFrames != expectedFrames) {
+            wrongSizeCount++;
+        }
+        // Touch the data like a real app would.
+        float *samples = static_cast<float *>(audioData);
+        const int32_t numSamples = numFrames * oboeStream->getChannelCount();
+        for (int32_t i = 0; i < numSamples; i++) {
+            samples[i] *= 0.5f;
+        }
+        callbackCount++;
+        frameCount += numFrames;
+        threadCpuNanos = getThreadCpuNanos();
+        return DataCallbackResult::Continue;
+    }
+
+    std::atomic<int32_t> callbackCount{0};
+    std::atomic<int64_t> frameCount{0};
+    std::atomic<int32_t> wrongSizeCount{0};
+    std::atomic<int64_t> threadCpuNanos{0};
+    int32_t expectedFrames = 0;
+};
+
+class CallbackBatching : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mBuilder.setAudioApi(AudioApi::Null)
+                ->setDataCallback(&mCallback)
+                ->setPerformanceMode(PerformanceMode::PowerSaving)
+                ->setSampleRate(kSampleRate)
+                ->setChannelCount(2)
+                ->setFormat(AudioFormat::Float)
+                ->setSimulatedFramesPerBurst(kFramesPerBurst);
+    }
+
+    void TearDown() override {
+        if (mStream) {
+            mStream->close();
+        }
+    }
+
+    void runFor(int millis) {
+        ASSERT_EQ(Result::OK, mStream->requestStart());
+        std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+        ASSERT_EQ(Result::OK, mStream->requestStop());
+    }
+
+    // Run a stream with and without batching and compare the app callbacks.
+    void compareWithUnbatched(Direction direction) {
+        mBuilder.setDirection(direction);
+        ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+        ASSERT_EQ(0, mStream->getFramesPerCallbackBatch());
+        mCallback.expectedFrames = kFramesPerBurst;
+        runFor(kRunMillis);
+        mStream->close();
+        const int32_t unbatchedCount = mCallback.callbackCount;
+        const int64_t unbatchedCpuNanos = mCallback.threadCpuNanos;
+        EXPECT_EQ(0, mCallback.wrongSizeCount);
+
+        BatchCallback batchCallback;
+        mBuilder.setDataCallback(&batchCallback)
+                ->setPowerSavingBatchMillis(kBatchMillis);
+        ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+        // 100 msec rounded up to whole bursts.
+        const int32_t framesPerBatch = mStream->getFramesPerCallbackBatch();
+        EXPECT_EQ(4800, framesPerBatch);
+        batchCallback.expectedFrames = framesPerBatch;
+        runFor(kRunMillis);
+        mStream->close();
+        const int32_t batchedCount = batchCallback.callbackCount;
+        EXPECT_GT(batchedCount, 0);
+        EXPECT_EQ(0, batchCallback.wrongSizeCount);
+        EXPECT_LT(batchedCount * 4, unbatchedCount);
+
+        printf("%s: %d app callbacks, %.2f msec app thread CPU unbatched;"
+               " %d app callbacks, %.2f msec batched\n",
+               (direction == Direction::Output) ? "Output" : "Input",
+               unbatchedCount, unbatchedCpuNanos * 1.0e-6,
+               batchedCount, batchCallback.threadCpuNanos * 1.0e-6);
+    }
+
+    AudioStreamBuilder mBuilder;
+    std::shared_ptr<AudioStream> mStream;
+    BatchCallback mCallback;
+};
+
+TEST_F(CallbackBatching, OutputFewerCallbacks) {
+    compareWithUnbatched(Direction::Output);
+}
+
+TEST_F(CallbackBatching, InputFewerCallbacks) {
+    compareWithUnbatched(Direction::Input);
+}
+
+TEST_F(CallbackBatching, DefaultIsNotBatched) {
+    EXPECT_EQ(0, mBuilder.getPowerSavingBatchMillis());
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    EXPECT_EQ(0, mStream->getFramesPerCallbackBatch());
+}
+
+TEST_F(CallbackBatching, OnlyForPowerSaving) {
+    mBuilder.setPowerSavingBatchMillis(kBatchMillis)
+            ->setPerformanceMode(PerformanceMode::LowLatency);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    EXPECT_EQ(0, mStream->getFramesPerCallbackBatch());
+}
+
+TEST_F(CallbackBatching, FramesPerCallbackWins) {
+    mBuilder.setPowerSavingBatchMillis(kBatchMillis)
+            ->setFramesPerDataCallback(kFramesPerBurst * 2);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    EXPECT_EQ(0, mStream->getFramesPerCallbackBatch());
+    EXPECT_EQ(kFramesPerBurst * 2, mStream->getFramesPerDataCallback());
+}
+
+TEST_F(CallbackBatching, NegativeMillis) {
+    mBuilder.setPowerSavingBatchMillis(-1);
+    EXPECT_EQ(Result::ErrorOutOfRange, mBuilder.openStream(mStream));
+}
+
+TEST_F(CallbackBatching, RoundedToBursts) {
+    mBuilder.setPowerSavingBatchMillis(kBatchMillis)
+            ->setSampleRate(44100);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    ASSERT_EQ(44100, mStream->getSampleRate());
+    // 4410 frames rounded up to 46 bursts.
+    EXPECT_EQ(46 * kFramesPerBurst, mStream->getFramesPerCallbackBatch());
+    mCallback.expectedFrames = mStream->getFramesPerCallbackBatch();
+    runFor(kRunMillis);
+    EXPECT_GT(mCallback.callbackCount, 0);
+    EXPECT_LT(mCallback.callbackCount, 10);
+    EXPECT_EQ(0, mCallback.wrongSizeCount);
+}
+
+class StopAfterOneCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream * /* oboeStream */,
+                                    void * /* audioData */,
+                                    int32_t /* numFrames */) override {
+        callbackCount++;
+        return DataCallbackResult::Stop;
+    }
+
+    std::atomic<int32_t> callbackCount{0};
+};
+
+// A Stop returned by the app must not stop the stream again after it is restarted.
+TEST_F(CallbackBatching, RestartAfterStop) {
+    StopAfterOneCallback callback;
+    mBuilder.setDataCallback(&callback)
+            ->setPowerSavingBatchMillis(kBatchMillis);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    ASSERT_GT(mStream->getFramesPerCallbackBatch(), 0);
+    for (int32_t i = 1; i <= 3; i++) {
+        ASSERT_EQ(Result::OK, mStream->requestStart());
+        StreamState nextState = StreamState::Unknown;
+        mStream->waitForStateChange(StreamState::Started, &nextState, kNanosPerSecond);
+        EXPECT_EQ(i, callback.callbackCount);
+        mStream->stop();
+    }
+}
+
+class SlowCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream * /* oboeStream */,
+                                    void * /* audioData */,
+                                    int32_t /* numFrames */) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kSleepMillis));
+        callbackCount++;
+        return DataCallbackResult::Continue;
+    }
+
+    static constexpr int kSleepMillis = 20;
+    std::atomic<int32_t> callbackCount{0};
+};
+
+// The app renders on a worker thread so a slow block does not hold up the device callback.
+TEST_F(CallbackBatching, SlowAppDoesNotDelayBursts) {
+    SlowCallback callback;
+    mBuilder.setDataCallback(&callback)
+            ->setPowerSavingBatchMillis(kBatchMillis)
+            ->setCallbackTimingEnabled(true);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    runFor(kRunMillis);
+    EXPECT_GT(callback.callbackCount, 2);
+    auto stats = mStream->getCallbackTimingStats();
+    ASSERT_TRUE(stats);
+    EXPECT_GT(stats.value().callbackCount, callback.callbackCount * 10);
+    EXPECT_LT(stats.value().durationNanos.max,
+              SlowCallback::kSleepMillis * kNanosPerMillisecond / 2);
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test the callback timing measured by AudioStream::fireDataCallback().
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+#include "common/CallbackTimingRecorder.h"
+
+using namespace oboe;
+
+constexpr int kRunMillis = 300;
+
+// Feed the recorder with made up times so the results are exact.
+TEST(CallbackTimingRecorder, SyntheticTimes) {
+    constexpr int32_t kSampleRate = 48000;
+    constexpr int32_t kFrames = 480; // 10 msec
+    constexpr int64_t kPeriodNanos = 10 * kNanosPerMillisecond;
+    CallbackTimingRecorder recorder;
+    int64_t startNanos = kNanosPerSecond;
+    for (int i = 0; i < 100; i++) {
+        // Every tenth callback is 2 msec late and takes too long.
+        bool isLate = (i % 10) == 9;
+        int64_t callbackStart = startNanos + (isLate ? 2 * kNanosPerMillisecond : 0);
+        int64_t durationNanos = isLate ? 12 * kNanosPerMillisecond : kNanosPerMillisecond;
+        recorder.record(callbackStart, callbackStart + durationNanos, kFrames, kSampleRate);
+        startNanos += kPeriodNanos;
+    }
+    CallbackTimingStats stats = recorder.getStats();
+    EXPECT_EQ(100, stats.callbackCount);
+    EXPECT_EQ(10, stats.deadlineOverrunCount);
+    EXPECT_EQ(12 * kNanosPerMillisecond, stats.durationNanos.max);
+    EXPECT_NEAR(kNanosPerMillisecond, stats.durationNanos.p50, kNanosPerMillisecond / 8);
+    EXPECT_EQ(2 * kNanosPerMillisecond, stats.intervalJitterNanos.max);
+    EXPECT_LE(stats.intervalJitterNanos.p50, kNanosPerMicrosecond); // histogram resolution
+    EXPECT_EQ(kFrames, stats.framesPerCallback.p50);
+    EXPECT_EQ(kFrames, stats.framesPerCallback.max);
+    EXPECT_EQ(kFrames, stats.minFramesPerCallback);
+
+    // Each callback is 1 msec late or less, except the late ones: 12 + 2 msec.
+    EXPECT_EQ(100, recorder.getLatenessWindowCount());
+    EXPECT_EQ(14 * kNanosPerMillisecond, recorder.getLatenessWindow().max);
+    recorder.requestLatenessWindowReset();
+    recorder.record(startNanos, startNanos + 1000, kFrames, kSampleRate);
+    EXPECT_EQ(1, recorder.getLatenessWindowCount());
+    EXPECT_EQ(101, recorder.getStats().callbackCount); // not reset by the window
+    startNanos += kPeriodNanos;
+
+    // The reset happens on the next record().
+    recorder.requestReset();
+    recorder.record(startNanos, startNanos + 1000, 96, kSampleRate);
+    stats = recorder.getStats();
+    EXPECT_EQ(1, stats.callbackCount);
+    EXPECT_EQ(0, stats.deadlineOverrunCount);
+    EXPECT_EQ(96, stats.minFramesPerCallback);
+}
+
+TEST(CallbackTimingRecorder, FrameCountHistogram) {
+    FrameCountHistogram histogram;
+    EXPECT_EQ(0, histogram.getPercentileFrames(50.0));
+    for (int32_t frames = 1; frames <= 1000; frames++) {
+        histogram.addFrames(frames);
+    }
+    EXPECT_EQ(1000, histogram.getCount());
+    EXPECT_EQ(1000, histogram.getMaxFrames());
+    // Bins are 1/8 of an octave wide so the result may be up to 12.5% high.
+    int32_t median = histogram.getPercentileFrames(50.0);
+    EXPECT_GE(median, 500);
+    EXPECT_LE(median, 563);
+    histogram.reset();
+    EXPECT_EQ(0, histogram.getMaxFrames());
+}
+
+class SleepyCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream * /* oboeStream */,
+                                    void * /* audioData */,
+                                    int32_t /* numFrames */) override {
+        if ((++callbackCount % 50) == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return DataCallbackResult::Continue;
+    }
+
+    std::atomic<int32_t> callbackCount{0};
+};
+
+class CallbackTiming : public ::testing::Test {
+protected:
+    void TearDown() override {
+        if (mStream) {
+            mStream->close();
+        }
+    }
+
+    AudioStreamBuilder mBuilder;
+    std::shared_ptr<AudioStream> mStream;
+    SleepyCallback mCallback;
+};
+
+TEST_F(CallbackTiming, DisabledByDefault) {
+    mBuilder.setAudioApi(AudioApi::Null)->setDataCallback(&mCallback);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    EXPECT_EQ(Result::ErrorInvalidState, mStream->getCallbackTimingStats().error());
+    EXPECT_EQ(Result::ErrorInvalidState, mStream->resetCallbackTimingStats());
+}
+
+TEST_F(CallbackTiming, NullStream) {
+    constexpr int32_t kFramesPerBurst = 96; // 2 msec
+    mBuilder.setAudioApi(AudioApi::Null)
+            ->setCallbackTimingEnabled(true)
+            ->setDataCallback(&mCallback)
+            ->setSampleRate(48000)
+            ->setSimulatedFramesPerBurst(kFramesPerBurst);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+    std::this_thread::sleep_for(std::chrono::milliseconds(kRunMillis));
+    ASSERT_EQ(Result::OK, mStream->stop());
+
+    auto result = mStream->getCallbackTimingStats();
+    ASSERT_TRUE(result);
+    CallbackTimingStats stats = result.value();
+    EXPECT_EQ(mCallback.callbackCount.load(), stats.callbackCount);
+    EXPECT_EQ(kFramesPerBurst, stats.framesPerCallback.p50);
+    EXPECT_EQ(kFramesPerBurst, stats.minFramesPerCallback);
+    // Every 50th callback sleeps for more than a burst.
+    EXPECT_GE(stats.deadlineOverrunCount, stats.callbackCount / 50);
+    EXPECT_GE(stats.durationNanos.max, 5 * kNanosPerMillisecond);
+    EXPECT_LT(stats.durationNanos.p50, kNanosPerMillisecond);
+    EXPECT_GE(stats.intervalJitterNanos.max, 2 * kNanosPerMillisecond);
+    EXPECT_LE(stats.durationNanos.p50, stats.durationNanos.p90);
+    EXPECT_LE(stats.durationNanos.p90, stats.durationNanos.p99);
+    EXPECT_LE(stats.durationNanos.p99, stats.durationNanos.max);
+}
+
+// A FilterAudioStream reports the timing of the callbacks from the device.
+TEST_F(CallbackTiming, ThroughFilterStream) {
+    mBuilder.setAudioApi(AudioApi::Null)
+            ->setCallbackTimingEnabled(true)
+            ->setDataCallback(&mCallback)
+            ->setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(44100)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium)
+            ->setSimulatedFramesPerBurst(192);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    ASSERT_EQ(44100, mStream->getSampleRate());
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(Result::OK, mStream->resetCallbackTimingStats());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(Result::OK, mStream->stop());
+
+    auto result = mStream->getCallbackTimingStats();
+    ASSERT_TRUE(result);
+    EXPECT_GT(result.value().callbackCount, 0);
+    EXPECT_LT(result.value().callbackCount, mCallback.callbackCount.load());
+    EXPECT_EQ(192, result.value().framesPerCallback.max);
+}
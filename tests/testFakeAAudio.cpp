@@ -0,0 +1,218 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test AudioStreamAAudio against the fake libaaudio.so in tests/fakeaaudio.
+ * These tests do nothing when running with the real AAudio.
+ */
+
+#include <dlfcn.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+#include "../src/aaudio/AAudioExtensions.h"
+#include "../src/aaudio/AAudioLoader.h"
+#include "fakeaaudio/FakeAAudio.h"
+
+using namespace oboe;
+
+constexpr int kRunMillis = 300;
+
+class FakeAAudioCallback : public AudioStreamDataCallback, public AudioStreamErrorCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream * /* oboeStream */,
+                                    void * /* audioData */,
+                                    int32_t numFrames) override {
+        callbackCount++;
+        frameCount += numFrames;
+        if (slowCallbackInterval > 0 && (callbackCount % slowCallbackInterval) == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return DataCallbackResult::Continue;
+    }
+
+    void onErrorAfterClose(AudioStream * /* oboeStream */, Result error) override {
+        lastError = error;
+        errorAfterCloseCount++;
+    }
+
+    std::atomic<int32_t> callbackCount{0};
+    std::atomic<int64_t> frameCount{0};
+    std::atomic<int32_t> errorAfterCloseCount{0};
+    std::atomic<Result> lastError{Result::OK};
+    int32_t slowCallbackInterval = 0;
+};
+
+class FakeAAudio : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mBuilder.setAudioApi(AudioApi::AAudio)
+                ->setDataCallback(&mCallback)
+                ->setErrorCallback(&mCallback);
+        AAudioLoader *loader = AAudioLoader::getInstance();
+        if (loader->open() != 0) return;
+        mReset = reinterpret_cast<decltype(&FakeAAudio_reset)>(
+                dlsym(loader->getLibHandle(), "FakeAAudio_reset"));
+        mDisconnect = reinterpret_cast<decltype(&FakeAAudio_disconnect)>(
+                dlsym(loader->getLibHandle(), "FakeAAudio_disconnect"));
+        mGetOpenStreamCount = reinterpret_cast<decltype(&FakeAAudio_getOpenStreamCount)>(
+                dlsym(loader->getLibHandle(), "FakeAAudio_getOpenStreamCount"));
+        if (mReset != nullptr) {
+            mReset();
+        }
+    }
+
+    void TearDown() override {
+        if (mStream) {
+            mStream->close();
+        }
+        if (mReset != nullptr) {
+            mReset();
+        }
+    }
+
+    /**
+     * @return true if the fake libaaudio.so was loaded
+     */
+    bool isFake() const {
+        return mReset != nullptr;
+    }
+
+    void openAndRun(int millis) {
+        ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+        ASSERT_EQ(Result::OK, mStream->requestStart());
+        std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+    }
+
+    AudioStreamBuilder mBuilder;
+    std::shared_ptr<AudioStream> mStream;
+    FakeAAudioCallback mCallback;
+    decltype(&FakeAAudio_reset) mReset = nullptr;
+    decltype(&FakeAAudio_disconnect) mDisconnect = nullptr;
+    decltype(&FakeAAudio_getOpenStreamCount) mGetOpenStreamCount = nullptr;
+};
+
+TEST_F(FakeAAudio, LowLatencyOutputUsesMMap) {
+    if (!isFake()) return;
+    mBuilder.setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSharingMode(SharingMode::Exclusive)
+            ->setFormat(AudioFormat::Float);
+    openAndRun(kRunMillis);
+    EXPECT_EQ(AudioApi::AAudio, mStream->getAudioApi());
+    EXPECT_TRUE(AAudioExtensions::getInstance().isMMapUsed(mStream.get()));
+    EXPECT_EQ(SharingMode::Exclusive, mStream->getSharingMode());
+    EXPECT_EQ(48000, mStream->getSampleRate());
+    EXPECT_EQ(96, mStream->getFramesPerBurst());
+
+    int64_t framePosition = 0;
+    int64_t timeNanos = 0;
+    ASSERT_EQ(Result::OK, mStream->getTimestamp(CLOCK_MONOTONIC, &framePosition, &timeNanos));
+    EXPECT_GT(framePosition, 0);
+    EXPECT_EQ(0, framePosition % 96);
+    ASSERT_EQ(Result::OK, mStream->stop());
+
+    // The device consumes frames at the sample rate.
+    EXPECT_NEAR(48000 * kRunMillis / 1000, mStream->getFramesRead(), 48000 / 20);
+    // An underflow skips the write position ahead.
+    EXPECT_GE(mStream->getFramesWritten(), mCallback.frameCount.load());
+}
+
+TEST_F(FakeAAudio, MMapPolicyNever) {
+    if (!isFake()) return;
+    AAudioExtensions &extensions = AAudioExtensions::getInstance();
+    ASSERT_EQ(0, extensions.setMMapEnabled(false));
+    EXPECT_FALSE(extensions.isMMapEnabled());
+    mBuilder.setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSharingMode(SharingMode::Exclusive);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    EXPECT_FALSE(AAudioExtensions::getInstance().isMMapUsed(mStream.get()));
+    EXPECT_EQ(SharingMode::Shared, mStream->getSharingMode());
+    EXPECT_EQ(192, mStream->getFramesPerBurst());
+}
+
+// The QuirksManager should open the device at its native rate and add a FilterAudioStream.
+TEST_F(FakeAAudio, ConversionThroughFilterStream) {
+    if (!isFake()) return;
+    mBuilder.setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(44100)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium)
+            ->setChannelCount(1)
+            ->setChannelConversionAllowed(true)
+            ->setFormat(AudioFormat::I16)
+            ->setFormatConversionAllowed(true);
+    openAndRun(kRunMillis);
+    EXPECT_EQ(44100, mStream->getSampleRate());
+    EXPECT_EQ(1, mStream->getChannelCount());
+    EXPECT_EQ(AudioFormat::I16, mStream->getFormat());
+    EXPECT_TRUE(AAudioExtensions::getInstance().isMMapUsed(mStream.get()));
+    ASSERT_EQ(Result::OK, mStream->stop());
+    EXPECT_NEAR(44100 * kRunMillis / 1000, mCallback.frameCount.load(), 44100 / 10);
+}
+
+TEST_F(FakeAAudio, SlowCallbackCausesXRuns) {
+    if (!isFake()) return;
+    mCallback.slowCallbackInterval = 20;
+    mBuilder.setPerformanceMode(PerformanceMode::LowLatency);
+    openAndRun(kRunMillis);
+    ASSERT_EQ(Result::OK, mStream->stop());
+    auto xRunCount = mStream->getXRunCount();
+    ASSERT_TRUE(xRunCount);
+    EXPECT_GT(xRunCount.value(), 0);
+}
+
+TEST_F(FakeAAudio, InputBlockingRead) {
+    if (!isFake()) return;
+    mBuilder.setDirection(Direction::Input)
+            ->setDataCallback(nullptr)
+            ->setErrorCallback(nullptr)
+            ->setSampleRate(48000)
+            ->setChannelCount(1)
+            ->setFormat(AudioFormat::Float);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+
+    constexpr int32_t kFramesToRead = 4800; // 100 msec
+    float buffer[kFramesToRead];
+    buffer[0] = 1.0f;
+    auto start = std::chrono::steady_clock::now();
+    auto result = mStream->read(buffer, kFramesToRead, kNanosPerSecond);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_TRUE(result);
+    EXPECT_EQ(kFramesToRead, result.value());
+    EXPECT_EQ(0.0f, buffer[0]); // silence
+    // The data arrives in real time.
+    EXPECT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 80);
+}
+
+// Oboe should stop and close the stream after a disconnect.
+TEST_F(FakeAAudio, DisconnectClosesStream) {
+    if (!isFake()) return;
+    int32_t openStreamCount = mGetOpenStreamCount();
+    openAndRun(50);
+    EXPECT_EQ(openStreamCount + 1, mGetOpenStreamCount());
+    mDisconnect(static_cast<AAudioStream *>(mStream->getUnderlyingStream()));
+    for (int i = 0; i < 100 && mCallback.errorAfterCloseCount == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(1, mCallback.errorAfterCloseCount.load());
+    EXPECT_EQ(Result::ErrorDisconnected, mCallback.lastError.load());
+    EXPECT_EQ(StreamState::Closed, mStream->getState());
+    EXPECT_EQ(openStreamCount, mGetOpenStreamCount());
+}
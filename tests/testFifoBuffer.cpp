@@ -0,0 +1,369 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test FifoBuffer
+ */
+
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+#include "fifo/FifoControllerMasked.h"
+
+using namespace oboe;
+
+constexpr int kBytesPerFrame = 4; // eg. stereo I16
+
+// Write and read a frame counter so we can check the order of the data.
+static void checkWrapAround(uint32_t capacityInFrames, uint64_t startCounter) {
+    FifoBuffer fifo(sizeof(int32_t), capacityInFrames);
+    fifo.setReadCounter(startCounter);
+    fifo.setWriteCounter(startCounter);
+
+    constexpr int kFramesPerTransfer = 7; // odd size so we wrap at different places
+    int32_t writeData[kFramesPerTransfer];
+    int32_t readData[kFramesPerTransfer];
+    int32_t nextWrite = 0;
+    int32_t nextRead = 0;
+    for (uint32_t i = 0; i < capacityInFrames; i++) {
+        for (int j = 0; j < kFramesPerTransfer; j++) {
+            writeData[j] = nextWrite++;
+        }
+        ASSERT_EQ(kFramesPerTransfer, fifo.write(writeData, kFramesPerTransfer));
+        ASSERT_EQ(kFramesPerTransfer, fifo.read(readData, kFramesPerTransfer));
+        for (int j = 0; j < kFramesPerTransfer; j++) {
+            ASSERT_EQ(nextRead++, readData[j]);
+        }
+    }
+    EXPECT_EQ(startCounter + (capacityInFrames * kFramesPerTransfer), fifo.getReadCounter());
+}
+
+TEST(test_fifo_buffer, power_of_two_detection) {
+    EXPECT_FALSE(FifoControllerMasked::isPowerOfTwo(0));
+    EXPECT_TRUE(FifoControllerMasked::isPowerOfTwo(1));
+    EXPECT_TRUE(FifoControllerMasked::isPowerOfTwo(1024));
+    EXPECT_FALSE(FifoControllerMasked::isPowerOfTwo(1000));
+    EXPECT_FALSE(FifoControllerMasked::isPowerOfTwo(3 * 256));
+}
+
+TEST(test_fifo_buffer, masked_indices) {
+    FifoControllerMasked controller(64);
+    controller.setReadCounter(64 * 1000 + 5);
+    controller.setWriteCounter(64 * 1000 + 9);
+    EXPECT_EQ(5u, controller.getReadIndex());
+    EXPECT_EQ(9u, controller.getWriteIndex());
+    EXPECT_EQ(7u, controller.getIndexForCounter(64 * 2000 + 7));
+    EXPECT_EQ(4u, controller.getFullFramesAvailable());
+    EXPECT_EQ(60u, controller.getEmptyFramesAvailable());
+}
+
+TEST(test_fifo_buffer, wrap_around_power_of_two) {
+    checkWrapAround(64, 0);
+    checkWrapAround(64, (1ULL << 40) - 3); // large counters
+}
+
+TEST(test_fifo_buffer, wrap_around_not_power_of_two) {
+    checkWrapAround(60, 0);
+    checkWrapAround(60, (1ULL << 40) - 3);
+}
+
+TEST(test_fifo_buffer, acquire_wraps_around) {
+    constexpr int kCapacity = 8;
+    FifoBuffer fifo(sizeof(int16_t), kCapacity);
+    fifo.setReadCounter(5);
+    fifo.setWriteCounter(5);
+
+    // Write 6 frames directly into the storage. They wrap after 3 frames.
+    FifoSpan writeSpan = fifo.acquireWrite(6);
+    ASSERT_EQ(3, writeSpan.numFrames1);
+    ASSERT_EQ(3, writeSpan.numFrames2);
+    int16_t value = 100;
+    int16_t *data1 = static_cast<int16_t *>(writeSpan.data1);
+    int16_t *data2 = static_cast<int16_t *>(writeSpan.data2);
+    for (int i = 0; i < writeSpan.numFrames1; i++) data1[i] = value++;
+    for (int i = 0; i < writeSpan.numFrames2; i++) data2[i] = value++;
+    EXPECT_EQ(0u, fifo.getFullFramesAvailable()); // not visible until committed
+    fifo.commitWrite(writeSpan.getNumFrames());
+    EXPECT_EQ(6u, fifo.getFullFramesAvailable());
+
+    // Only 2 empty frames are left.
+    EXPECT_EQ(2, fifo.acquireWrite(kCapacity).getNumFrames());
+
+    // Read some frames in place then read the rest with a copy.
+    FifoSpan readSpan = fifo.acquireRead(4);
+    ASSERT_EQ(3, readSpan.numFrames1);
+    ASSERT_EQ(1, readSpan.numFrames2);
+    EXPECT_EQ(100, static_cast<int16_t *>(readSpan.data1)[0]);
+    EXPECT_EQ(103, static_cast<int16_t *>(readSpan.data2)[0]);
+    fifo.commitRead(readSpan.getNumFrames());
+
+    int16_t buffer[kCapacity] = {};
+    ASSERT_EQ(2, fifo.read(buffer, kCapacity));
+    EXPECT_EQ(104, buffer[0]);
+    EXPECT_EQ(105, buffer[1]);
+    EXPECT_EQ(0, fifo.acquireRead(kCapacity).getNumFrames());
+}
+
+TEST(test_fifo_buffer, acquire_partial_commit) {
+    FifoBuffer fifo(sizeof(int16_t), 16);
+    int16_t data[4] = {1, 2, 3, 4};
+    fifo.write(data, 4);
+    // Consume less than was acquired.
+    FifoSpan readSpan = fifo.acquireRead(4);
+    ASSERT_EQ(4, readSpan.getNumFrames());
+    fifo.commitRead(1);
+    EXPECT_EQ(3u, fifo.getFullFramesAvailable());
+    EXPECT_EQ(2, static_cast<int16_t *>(fifo.acquireRead(4).data1)[0]);
+    EXPECT_EQ(0, fifo.acquireRead(0).getNumFrames());
+    EXPECT_EQ(0, fifo.acquireWrite(-1).getNumFrames());
+}
+
+// Measure the cost of many small transfers, which is dominated by the index calculations.
+static double measureSmallTransfers(uint32_t capacityInFrames, int framesPerTransfer) {
+    constexpr int kNumTransfers = 1000000;
+    FifoBuffer fifo(kBytesPerFrame, capacityInFrames);
+    uint8_t buffer[kBytesPerFrame * 16] = {};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kNumTransfers; i++) {
+        fifo.write(buffer, framesPerTransfer);
+        fifo.read(buffer, framesPerTransfer);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double nanos = std::chrono::duration<double, std::nano>(elapsed).count();
+    return nanos / kNumTransfers;
+}
+
+TEST(test_fifo_buffer, benchmark_small_transfers) {
+    for (int framesPerTransfer : {1, 4, 16}) {
+        double moduloNanos = measureSmallTransfers(1000, framesPerTransfer);
+        double maskedNanos = measureSmallTransfers(1024, framesPerTransfer);
+        printf("FifoBuffer write+read of %2d frames: modulo = %.1f nsec, mask = %.1f nsec\n",
+               framesPerTransfer, moduloNanos, maskedNanos);
+    }
+}
+
+// Stream frames from a writer thread to a reader thread and check that none are lost.
+// @return frames per second
+static double measureCrossThreadThroughput(uint32_t capacityInFrames, int32_t framesPerTransfer) {
+    constexpr int64_t kNumFrames = 4 * 1000 * 1000;
+    FifoBuffer fifo(sizeof(int32_t), capacityInFrames);
+    std::thread writer([&fifo, framesPerTransfer]() {
+        int32_t data[256];
+        int32_t value = 0;
+        int64_t framesLeft = kNumFrames;
+        while (framesLeft > 0) {
+            int32_t framesToWrite = static_cast<int32_t>(
+                    std::min(static_cast<int64_t>(framesPerTransfer), framesLeft));
+            for (int i = 0; i < framesToWrite; i++) {
+                data[i] = value + i;
+            }
+            int32_t framesWritten = fifo.write(data, framesToWrite);
+            if (framesWritten == 0) {
+                std::this_thread::yield(); // in case the reader is on the same CPU
+            }
+            value += framesWritten;
+            framesLeft -= framesWritten;
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    int32_t data[256];
+    int32_t expected = 0;
+    int32_t errors = 0;
+    int64_t framesLeft = kNumFrames;
+    while (framesLeft > 0) {
+        int32_t framesRead = fifo.read(data, framesPerTransfer);
+        if (framesRead == 0) {
+            std::this_thread::yield();
+        }
+        for (int i = 0; i < framesRead; i++) {
+            errors += (data[i] != expected++) ? 1 : 0;
+        }
+        framesLeft -= framesRead;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    writer.join();
+    EXPECT_EQ(0, errors);
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    return kNumFrames / seconds;
+}
+
+TEST(test_fifo_buffer, benchmark_cross_thread) {
+    for (int framesPerTransfer : {4, 32, 256}) {
+        double framesPerSecond = measureCrossThreadThroughput(1024, framesPerTransfer);
+        printf("FifoBuffer cross-thread, %3d frames per transfer: %.1f Mframes/sec\n",
+               framesPerTransfer, framesPerSecond * 1.0e-6);
+    }
+}
+
+TEST(test_fifo_buffer, overwrite_oldest) {
+    FifoBuffer fifo(sizeof(int32_t), 16);
+    int32_t data[8];
+    int32_t value = 0;
+    // Write 40 frames with nobody reading. Only the newest 6 should be kept.
+    for (int i = 0; i < 10; i++) {
+        for (int j = 0; j < 4; j++) data[j] = value++;
+        ASSERT_EQ(4, fifo.writeOverwritingOldest(data, 4, 6));
+    }
+    EXPECT_EQ(6u, fifo.getFullFramesAvailable());
+    EXPECT_EQ(34u, fifo.getDiscardedFrameCount());
+    ASSERT_EQ(6, fifo.read(data, 8));
+    EXPECT_EQ(34, data[0]);
+    EXPECT_EQ(39, data[5]);
+
+    // Nothing is discarded when the reader keeps up.
+    ASSERT_EQ(4, fifo.writeOverwritingOldest(data, 4, 6));
+    EXPECT_EQ(34u, fifo.getDiscardedFrameCount());
+    // framesToKeep is limited by the capacity.
+    ASSERT_EQ(8, fifo.writeOverwritingOldest(data, 8, 1000));
+    ASSERT_EQ(8, fifo.writeOverwritingOldest(data, 8, 1000));
+    EXPECT_EQ(16u, fifo.getFullFramesAvailable());
+    EXPECT_EQ(38u, fifo.getDiscardedFrameCount());
+}
+
+// A late commitRead() must not move the read counter backwards or skip frames.
+TEST(test_fifo_buffer, overwrite_during_read) {
+    FifoBuffer fifo(sizeof(int32_t), 16);
+    int32_t data[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+    fifo.write(data, 8);
+    FifoSpan span = fifo.acquireRead(4); // reading frames 0-3
+    ASSERT_EQ(4, span.getNumFrames());
+    fifo.writeOverwritingOldest(data, 8, 8); // discards frames 0-7
+    EXPECT_EQ(8u, fifo.getReadCounter());
+    // All of the acquired frames may have been overwritten while they were read.
+    EXPECT_EQ(0, fifo.commitRead(span.getNumFrames()));
+    EXPECT_EQ(8u, fifo.getReadCounter());
+    EXPECT_EQ(8u, fifo.getFullFramesAvailable());
+
+    // Only the oldest part of the span was overwritten.
+    span = fifo.acquireRead(6); // reading frames 8-13
+    ASSERT_EQ(6, span.getNumFrames());
+    fifo.writeOverwritingOldest(data, 4, 8); // discards frames 8-11
+    EXPECT_EQ(2, fifo.commitRead(span.getNumFrames()));
+    EXPECT_EQ(14u, fifo.getReadCounter());
+}
+
+TEST(test_fifo_buffer, converting_i16_to_float) {
+    constexpr int kChannelCount = 2;
+    ConvertingFifoBuffer fifo(AudioFormat::I16, AudioFormat::Float, kChannelCount, 8);
+    fifo.getFifoBuffer().setReadCounter(6); // so that the read wraps around
+    fifo.getFifoBuffer().setWriteCounter(6);
+    int16_t data[5 * kChannelCount] = {0, 16384, -16384, 32767, -32768,
+                                       1, 2, 3, 4, 5};
+    ASSERT_EQ(5, fifo.write(data, 5));
+    float result[5 * kChannelCount] = {};
+    ASSERT_EQ(5, fifo.read(result, 5));
+    for (int i = 0; i < 5 * kChannelCount; i++) {
+        EXPECT_EQ(data[i] / 32768.0f, result[i]);
+    }
+}
+
+TEST(test_fifo_buffer, converting_all_formats) {
+    const AudioFormat formats[] = {AudioFormat::I16, AudioFormat::I24,
+                                   AudioFormat::I32, AudioFormat::Float};
+    constexpr int kNumSamples = 300; // more than one conversion block
+    float original[kNumSamples];
+    for (int i = 0; i < kNumSamples; i++) {
+        original[i] = (i - (kNumSamples / 2)) / 256.0f; // exact in 16 bits, some clipped
+    }
+    for (AudioFormat writeFormat : formats) {
+        for (AudioFormat readFormat : formats) {
+            uint8_t written[kNumSamples * sizeof(float)];
+            ASSERT_EQ(Result::OK, ConvertingFifoBuffer::convert(original, AudioFormat::Float,
+                    written, writeFormat, kNumSamples));
+            ConvertingFifoBuffer fifo(writeFormat, readFormat, 1, 512);
+            fifo.getFifoBuffer().setReadCounter(400);
+            fifo.getFifoBuffer().setWriteCounter(400);
+            ASSERT_EQ(kNumSamples, fifo.write(written, kNumSamples));
+            uint8_t read[kNumSamples * sizeof(float)];
+            ASSERT_EQ(kNumSamples, fifo.read(read, kNumSamples));
+            float result[kNumSamples];
+            ConvertingFifoBuffer::convert(read, readFormat, result, AudioFormat::Float,
+                                          kNumSamples);
+            for (int i = 0; i < kNumSamples; i++) {
+                float expected = std::max(-1.0f, std::min(original[i], 32767.0f / 32768.0f));
+                ASSERT_NEAR(expected, result[i], 1.0 / 32768.0)
+                        << "write format " << convertToText(writeFormat)
+                        << ", read format " << convertToText(readFormat) << ", i = " << i;
+            }
+        }
+    }
+}
+
+// Compare reading I16 as float directly with reading into a temporary buffer then converting.
+static void measureConvertingRead(int32_t framesPerTransfer) {
+    constexpr int kChannelCount = 2;
+    const int numTransfers = (20 * 1000 * 1000) / framesPerTransfer;
+    const uint32_t capacity = 2 * framesPerTransfer;
+    const int32_t numSamples = framesPerTransfer * kChannelCount;
+    std::vector<int16_t> source(numSamples);
+    std::vector<int16_t> temporary(numSamples);
+    std::vector<float> destination(numSamples);
+
+    FifoBuffer fifo(kChannelCount * sizeof(int16_t), capacity);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numTransfers; i++) {
+        fifo.write(source.data(), framesPerTransfer);
+        int32_t framesRead = fifo.read(temporary.data(), framesPerTransfer);
+        convertPcm16ToFloat(temporary.data(), destination.data(), framesRead * kChannelCount);
+    }
+    double copyThenConvertNanos = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+
+    ConvertingFifoBuffer converting(AudioFormat::I16, AudioFormat::Float,
+                                    kChannelCount, capacity);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < numTransfers; i++) {
+        converting.write(source.data(), framesPerTransfer);
+        converting.read(destination.data(), framesPerTransfer);
+    }
+    double convertingNanos = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count();
+
+    double numFrames = static_cast<double>(numTransfers) * framesPerTransfer;
+    printf("I16 FIFO read as float, %5d frames: copy then convert = %.3f nsec/frame, "
+           "converting FIFO = %.3f nsec/frame\n", framesPerTransfer,
+           copyThenConvertNanos / numFrames, convertingNanos / numFrames);
+}
+
+TEST(test_fifo_buffer, benchmark_converting_read) {
+    measureConvertingRead(192); // a typical burst, everything stays in the L1 cache
+    measureConvertingRead(64 * 1024); // too big for the L1 cache
+}
+
+TEST(test_fifo_buffer, residency_tracking) {
+    FifoBuffer fifo(sizeof(int16_t), 64);
+    EXPECT_EQ(nullptr, fifo.getResidencyHistogram());
+    fifo.setResidencyTrackingEnabled(true);
+    int16_t data[16] = {};
+    fifo.write(data, 8);
+    fifo.write(data, 8);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    // Reading the start of the first block counts it. The second block is still waiting.
+    fifo.read(data, 4);
+    const TimeHistogram *histogram = fifo.getResidencyHistogram();
+    ASSERT_NE(nullptr, histogram);
+    EXPECT_EQ(1, histogram->getCount());
+    fifo.read(data, 12);
+    EXPECT_EQ(2, histogram->getCount());
+    EXPECT_GE(histogram->getPercentileNanos(50.0), 5 * kNanosPerMillisecond);
+    EXPECT_LT(histogram->getPercentileNanos(50.0), kNanosPerSecond);
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Multi-threaded stress tests and throughput benchmarks for FifoBuffer.
+//
+// These only depend on the FIFO code so they can also be built and run on a host,
+// which is the easiest way to run them under ThreadSanitizer, eg.
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=thread -Iinclude -Isrc
+//       tests/testFifoBufferStress.cpp src/fifo/*.cpp src/common/Utilities.cpp
+//       src/common/TimeHistogram.cpp -lgtest -lgtest_main -lpthread
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+#if defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define OBOE_TEST_TSAN 1
+#endif
+#endif
+#if defined(__SANITIZE_THREAD__)
+#define OBOE_TEST_TSAN 1
+#endif
+
+// ThreadSanitizer is about 10x slower so do less work.
+#ifdef OBOE_TEST_TSAN
+constexpr int64_t kStressFrames = 200 * 1000;
+#else
+constexpr int64_t kStressFrames = 4 * 1000 * 1000;
+#endif
+
+constexpr int32_t kMaxTransferFrames = 512;
+
+// Start close to where a 32-bit counter would wrap so any truncation of the
+// 64-bit counters shows up as bad data.
+constexpr uint64_t kStartCounter = UINT32_MAX - 1000;
+
+// Each frame holds a sequence number so the reader can check that nothing was lost,
+// repeated or reordered. The second word catches frames that were only partly copied.
+struct SequencedFrame {
+    uint32_t sequence;
+    uint32_t check;
+};
+
+static uint32_t getCheck(uint32_t sequence) {
+    return ~sequence * 2654435761u;
+}
+
+static void fillFrames(SequencedFrame *frames, int32_t numFrames, uint32_t &sequence) {
+    for (int32_t i = 0; i < numFrames; i++) {
+        frames[i] = {sequence, getCheck(sequence)};
+        sequence++;
+    }
+}
+
+static int64_t checkFrames(const SequencedFrame *frames, int32_t numFrames, uint32_t &sequence) {
+    int64_t errors = 0;
+    for (int32_t i = 0; i < numFrames; i++) {
+        errors += (frames[i].sequence != sequence || frames[i].check != getCheck(sequence))
+                ? 1 : 0;
+        sequence++;
+    }
+    return errors;
+}
+
+// Write with random sizes, using either write() or acquireWrite()/commitWrite().
+static void runWriter(FifoBuffer &fifo, int64_t numFrames, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int32_t> sizes(1, kMaxTransferFrames);
+    std::vector<SequencedFrame> data(kMaxTransferFrames);
+    uint32_t sequence = 0;
+    int64_t framesLeft = numFrames;
+    while (framesLeft > 0) {
+        int32_t framesToWrite = static_cast<int32_t>(
+                std::min(static_cast<int64_t>(sizes(random)), framesLeft));
+        int32_t framesWritten;
+        if (random() & 1) {
+            uint32_t nextSequence = sequence;
+            fillFrames(data.data(), framesToWrite, nextSequence);
+            framesWritten = fifo.write(data.data(), framesToWrite);
+        } else {
+            FifoSpan span = fifo.acquireWrite(framesToWrite);
+            uint32_t nextSequence = sequence;
+            fillFrames(static_cast<SequencedFrame *>(span.data1), span.numFrames1, nextSequence);
+            fillFrames(static_cast<SequencedFrame *>(span.data2), span.numFrames2, nextSequence);
+            framesWritten = span.getNumFrames();
+            fifo.commitWrite(framesWritten);
+        }
+        if (framesWritten == 0) {
+            std::this_thread::yield(); // in case the reader is on the same CPU
+        }
+        sequence += framesWritten;
+        framesLeft -= framesWritten;
+    }
+}
+
+// Read with random sizes and return the number of bad frames.
+static int64_t runReader(FifoBuffer &fifo, int64_t numFrames, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int32_t> sizes(1, kMaxTransferFrames);
+    std::vector<SequencedFrame> data(kMaxTransferFrames);
+    uint32_t sequence = 0;
+    int64_t errors = 0;
+    int64_t framesLeft = numFrames;
+    while (framesLeft > 0) {
+        int32_t framesToRead = static_cast<int32_t>(
+                std::min(static_cast<int64_t>(sizes(random)), framesLeft));
+        int32_t framesRead;
+        if (random() & 1) {
+            framesRead = fifo.read(data.data(), framesToRead);
+            errors += checkFrames(data.data(), framesRead, sequence);
+        } else {
+            FifoSpan span = fifo.acquireRead(framesToRead);
+            errors += checkFrames(static_cast<const SequencedFrame *>(span.data1),
+                                  span.numFrames1, sequence);
+            errors += checkFrames(static_cast<const SequencedFrame *>(span.data2),
+                                  span.numFrames2, sequence);
+            framesRead = span.getNumFrames();
+            fifo.commitRead(framesRead);
+        }
+        if (framesRead == 0) {
+            std::this_thread::yield();
+        }
+        framesLeft -= framesRead;
+    }
+    return errors;
+}
+
+static void stressFifo(FifoBuffer &fifo, uint32_t seed) {
+    fifo.setReadCounter(kStartCounter);
+    fifo.setWriteCounter(kStartCounter);
+    std::thread writer(runWriter, std::ref(fifo), kStressFrames, seed);
+    int64_t errors = runReader(fifo, kStressFrames, seed + 1);
+    writer.join();
+    EXPECT_EQ(0, errors);
+    EXPECT_EQ(kStartCounter + kStressFrames, fifo.getReadCounter());
+    EXPECT_EQ(kStartCounter + kStressFrames, fifo.getWriteCounter());
+}
+
+// FifoController with the modulo index.
+TEST(test_fifo_buffer_stress, random_sizes_not_power_of_two) {
+    FifoBuffer fifo(sizeof(SequencedFrame), 1000);
+    stressFifo(fifo, 1);
+}
+
+// FifoControllerMasked.
+TEST(test_fifo_buffer_stress, random_sizes_power_of_two) {
+    FifoBuffer fifo(sizeof(SequencedFrame), 1024);
+    stressFifo(fifo, 2);
+}
+
+// Capacity smaller than a transfer so the FIFO is full or empty most of the time.
+TEST(test_fifo_buffer_stress, random_sizes_small_capacity) {
+    FifoBuffer fifo(sizeof(SequencedFrame), 37);
+    stressFifo(fifo, 3);
+}
+
+// FifoControllerIndirect, with counters and storage owned by the caller.
+TEST(test_fifo_buffer_stress, random_sizes_indirect) {
+    constexpr uint32_t kCapacity = 777;
+    std::atomic<uint64_t> readCounter{0};
+    std::atomic<uint64_t> writeCounter{0};
+    std::vector<uint8_t> storage(kCapacity * sizeof(SequencedFrame));
+    FifoBuffer fifo(sizeof(SequencedFrame), kCapacity, &readCounter, &writeCounter,
+                    storage.data());
+    stressFifo(fifo, 4);
+    EXPECT_EQ(kStartCounter + kStressFrames, readCounter.load());
+}
+
+// The writer overwrites frames that the reader has not taken yet. Frames can be dropped
+// but every frame that read() returns must be whole and newer than the one before.
+TEST(test_fifo_buffer_stress, overwrite_oldest_while_reading) {
+    constexpr uint32_t kCapacity = 64;
+    FifoBuffer fifo(sizeof(SequencedFrame), kCapacity);
+    std::atomic<bool> writing{true};
+    std::thread writer([&fifo, &writing]() {
+        std::vector<SequencedFrame> data(kCapacity);
+        uint32_t sequence = 0;
+        for (int64_t framesLeft = kStressFrames; framesLeft > 0; framesLeft -= kCapacity / 4) {
+            fillFrames(data.data(), kCapacity / 4, sequence);
+            fifo.writeOverwritingOldest(data.data(), kCapacity / 4, kCapacity / 2);
+        }
+        writing = false;
+    });
+
+    std::vector<SequencedFrame> data(kCapacity);
+    int64_t errors = 0;
+    int64_t framesRead = 0;
+    int64_t lastSequence = -1;
+    while (writing.load()) {
+        int32_t numFrames = fifo.read(data.data(), kCapacity / 2);
+        for (int32_t i = 0; i < numFrames; i++) {
+            const SequencedFrame &frame = data[i];
+            errors += (frame.check != getCheck(frame.sequence)
+                    || frame.sequence <= lastSequence) ? 1 : 0;
+            lastSequence = frame.sequence;
+        }
+        framesRead += numFrames;
+    }
+    writer.join();
+    EXPECT_EQ(0, errors);
+    EXPECT_EQ(kStressFrames, framesRead + static_cast<int64_t>(fifo.getDiscardedFrameCount())
+            + fifo.getFullFramesAvailable());
+}
+
+// Stream frames between two threads in fixed bursts.
+// Reports the throughput and the mean time for each read() call.
+static void measureThroughput(int32_t framesPerBurst) {
+    constexpr uint32_t kBytesPerFrame = 8; // stereo float
+    constexpr uint32_t kCapacity = 8192;
+#ifdef OBOE_TEST_TSAN
+    constexpr int64_t kMaxBursts = 20 * 1000;
+#else
+    constexpr int64_t kMaxBursts = 1000 * 1000;
+#endif
+    // Move at least 64 MB unless that takes too many calls.
+    const int64_t numBursts = std::min(kMaxBursts,
+            std::max<int64_t>(1000, (64 << 20) / (framesPerBurst * kBytesPerFrame)));
+    const int64_t numFrames = numBursts * framesPerBurst;
+    FifoBuffer fifo(kBytesPerFrame, kCapacity);
+
+    std::thread writer([&fifo, framesPerBurst, numFrames]() {
+        std::vector<uint8_t> data(framesPerBurst * kBytesPerFrame, 1);
+        int64_t framesLeft = numFrames;
+        while (framesLeft > 0) {
+            int32_t framesWritten = fifo.write(data.data(), framesPerBurst);
+            if (framesWritten == 0) {
+                std::this_thread::yield();
+            }
+            framesLeft -= framesWritten;
+        }
+    });
+
+    std::vector<uint8_t> data(framesPerBurst * kBytesPerFrame);
+    int64_t reads = 0;
+    int64_t framesLeft = numFrames;
+    auto start = std::chrono::steady_clock::now();
+    while (framesLeft > 0) {
+        int32_t framesRead = fifo.read(data.data(), framesPerBurst);
+        if (framesRead == 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        reads++;
+        framesLeft -= framesRead;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    writer.join();
+
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    printf("FifoBuffer burst %4d frames: %6.2f GB/s, %8.1f nsec per read\n",
+           framesPerBurst,
+           numFrames * kBytesPerFrame / seconds * 1.0e-9,
+           seconds * 1.0e9 / reads);
+}
+
+TEST(test_fifo_buffer_stress, benchmark_burst_sizes) {
+    for (int32_t framesPerBurst = 1; framesPerBurst <= 4096; framesPerBurst *= 4) {
+        measureThroughput(framesPerBurst);
+    }
+}
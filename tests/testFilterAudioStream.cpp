@@ -0,0 +1,182 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test FilterAudioStream::write() and close() with a child stream that only takes
+ * part of each write.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+#include "common/DataConversionFlowGraph.h"
+#include "common/FilterAudioStream.h"
+#include "common/StreamArena.h"
+
+using namespace oboe;
+
+constexpr int32_t kAppSampleRate = 44100;
+constexpr int32_t kChildSampleRate = 48000;
+constexpr int32_t kFramesPerBurst = 96;
+
+// A mono float output stream that takes at most framesPerWrite frames from each write()
+// and keeps them.
+class RecordingStream : public AudioStream {
+public:
+    explicit RecordingStream(const AudioStreamBuilder &builder)
+            : AudioStream(builder) {
+        mSampleRate = kChildSampleRate;
+        mChannelCount = 1;
+        mFormat = AudioFormat::Float;
+        mFramesPerBurst = kFramesPerBurst;
+        mBufferCapacityInFrames = 4 * kFramesPerBurst;
+        mBufferSizeInFrames = mBufferCapacityInFrames;
+    }
+
+    Result close() override {
+        closed = true;
+        // Give a transfer that is still pending a chance to call write().
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        return AudioStream::close();
+    }
+
+    Result requestStart() override { return Result::OK; }
+    Result requestPause() override { return Result::OK; }
+    Result requestFlush() override { return Result::OK; }
+    Result requestStop() override { return Result::OK; }
+    StreamState getState() override { return StreamState::Started; }
+    Result waitForStateChange(StreamState /* currentState */,
+                              StreamState *nextState,
+                              int64_t /* timeoutNanoseconds */) override {
+        if (nextState != nullptr) *nextState = StreamState::Started;
+        return Result::OK;
+    }
+    bool isXRunCountSupported() const override { return false; }
+    AudioApi getAudioApi() const override { return AudioApi::Unspecified; }
+
+    ResultWithValue<int32_t> write(const void *buffer,
+                                   int32_t numFrames,
+                                   int64_t /* timeoutNanoseconds */) override {
+        if (closed) {
+            writesAfterClose++;
+        }
+        const int32_t framesWritten = std::min(numFrames, framesPerWrite);
+        const float *data = static_cast<const float *>(buffer);
+        samples.insert(samples.end(), data, data + framesWritten);
+        return ResultWithValue<int32_t>(framesWritten);
+    }
+
+    int32_t framesPerWrite = 50;
+    std::vector<float> samples;
+    std::atomic<bool> closed{false};
+    std::atomic<int32_t> writesAfterClose{0};
+
+protected:
+    void updateFramesWritten() override {}
+    void updateFramesRead() override {}
+};
+
+class FilterAudioStreamTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mBuilder.setDirection(Direction::Output)
+                ->setSampleRate(kAppSampleRate)
+                ->setChannelCount(1)
+                ->setFormat(AudioFormat::Float)
+                ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium);
+        mChild = new RecordingStream(mBuilder);
+        mStream = std::make_unique<FilterAudioStream>(mBuilder, mChild);
+        ASSERT_EQ(Result::OK, mStream->configureFlowGraph());
+    }
+
+    AudioStreamBuilder                 mBuilder;
+    RecordingStream                   *mChild = nullptr; // owned by mStream
+    std::unique_ptr<FilterAudioStream> mStream;
+};
+
+// Frames that were converted but not taken by the child must be written by the next call.
+// Otherwise the resampled ramp would jump where they were dropped.
+TEST_F(FilterAudioStreamTest, PartialWritesKeepConvertedFrames) {
+    constexpr int32_t kNumFrames = 4000;
+    constexpr float kStep = 0.0002f;
+    std::vector<float> ramp(kNumFrames);
+    for (int32_t i = 0; i < kNumFrames; i++) {
+        ramp[i] = i * kStep;
+    }
+    int32_t framesWritten = 0;
+    int32_t calls = 0;
+    while (framesWritten < kNumFrames && calls++ < 1000) {
+        auto result = mStream->write(&ramp[framesWritten], kNumFrames - framesWritten,
+                                     kNanosPerMillisecond);
+        ASSERT_TRUE(result);
+        framesWritten += result.value();
+    }
+    ASSERT_EQ(kNumFrames, framesWritten);
+
+    // Skip the start, where the resampler is filling up.
+    const std::vector<float> &samples = mChild->samples;
+    const float expectedStep = kStep * kAppSampleRate / kChildSampleRate;
+    ASSERT_GT(samples.size(), 4000u);
+    for (size_t i = 100; i < 4000; i++) {
+        ASSERT_NEAR(expectedStep, samples[i] - samples[i - 1], 0.2f * expectedStep)
+                << "at frame " << i;
+    }
+}
+
+class CancelledTransferCallback : public AsyncTransferCallback {
+public:
+    void onTransferComplete(AudioStream * /* audioStream */,
+                            ResultWithValue<int32_t> result) override {
+        lastResult = result.error();
+        done = true;
+    }
+
+    std::atomic<Result> lastResult{Result::OK};
+    std::atomic<bool> done{false};
+};
+
+// close() must stop a pending writeAsync() before it closes the child.
+TEST_F(FilterAudioStreamTest, CloseCancelsTransferFirst) {
+    mChild->framesPerWrite = 0; // the transfer can never finish
+    std::vector<float> buffer(kFramesPerBurst);
+    CancelledTransferCallback callback;
+    ASSERT_EQ(Result::OK, mStream->writeAsync(buffer.data(), kFramesPerBurst,
+                                              kNanosPerSecond, &callback));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(callback.done);
+    mStream->close();
+    EXPECT_TRUE(callback.done);
+    EXPECT_EQ(Result::ErrorClosed, callback.lastResult.load());
+    EXPECT_EQ(0, mChild->writesAfterClose.load());
+}
+
+// The arena never frees, so configuring again would leak a second set of buffers.
+TEST_F(FilterAudioStreamTest, FlowGraphIsConfiguredOnce) {
+    EXPECT_EQ(Result::ErrorInvalidState, mStream->configureFlowGraph());
+
+    StreamArena arena;
+    DataConversionFlowGraph flowGraph(arena);
+    ASSERT_EQ(Result::OK, flowGraph.configure(mStream.get(), mChild));
+    const int64_t usedBytes = arena.getUsedBytes();
+    EXPECT_EQ(Result::ErrorInvalidState, flowGraph.configure(mStream.get(), mChild));
+    EXPECT_EQ(usedBytes, arena.getUsedBytes());
+}
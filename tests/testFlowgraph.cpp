@@ -20,13 +20,19 @@
 
 #include "stdio.h"
 
+#include <chrono>
 #include <iostream>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include <oboe/Oboe.h>
 
+#include "common/ChannelConverterI16.h"
+#include "flowgraph/BiquadCascade.h"
+#include "flowgraph/ChannelCountConverter.h"
 #include "flowgraph/ClipToRange.h"
 #include "flowgraph/MonoToMultiConverter.h"
+#include "flowgraph/MultiToMonoConverter.h"
 #include "flowgraph/SourceFloat.h"
 #include "flowgraph/RampLinear.h"
 #include "flowgraph/SampleRateConverter.h"
@@ -40,6 +46,7 @@
 using namespace oboe::flowgraph;
 
 constexpr int kBytesPerI24Packed = 3;
+constexpr int kBiquadSampleRate = 48000;
 
 TEST(test_flowgraph, module_sinki16) {
     static const float input[] = {1.0f, 0.5f, -0.25f, -1.0f, 0.0f, 53.9f, -87.2f};
@@ -193,3 +200,262 @@ TEST(test_flowgraph, module_sinki32) {
         EXPECT_EQ(expected[i], output[i]) << ", i = " << i;
     }
 }
+
+TEST(test_flowgraph, module_channel_converter_i16_mono_to_stereo) {
+    static constexpr int kNumFrames = 19; // not a multiple of the SIMD width
+    int16_t input[kNumFrames];
+    for (int i = 0; i < kNumFrames; i++) {
+        input[i] = static_cast<int16_t>((i * 3617) - 32768);
+    }
+    int16_t expected[kNumFrames * 2];
+    int16_t output[kNumFrames * 2];
+
+    // The float flowgraph is the reference.
+    SourceI16 sourceI16{1};
+    MonoToMultiConverter monoToStereo{2};
+    SinkI16 sinkI16{2};
+    sourceI16.setData(input, kNumFrames);
+    sourceI16.output.connect(&monoToStereo.input);
+    monoToStereo.output.connect(&sinkI16.input);
+    ASSERT_EQ(kNumFrames, sinkI16.read(expected, kNumFrames));
+
+    oboe::ChannelConverterI16 converter{1, 2};
+    converter.convert(input, output, kNumFrames);
+    for (int i = 0; i < kNumFrames * 2; i++) {
+        EXPECT_EQ(expected[i], output[i]) << ", i = " << i;
+    }
+}
+
+TEST(test_flowgraph, module_channel_converter_i16_stereo_to_mono) {
+    static constexpr int kNumFrames = 19; // not a multiple of the SIMD width
+    int16_t input[kNumFrames * 2];
+    for (int i = 0; i < kNumFrames * 2; i++) {
+        input[i] = static_cast<int16_t>((i * 1811) - 32768);
+    }
+    int16_t expected[kNumFrames];
+    int16_t output[kNumFrames];
+
+    SourceI16 sourceI16{2};
+    MultiToMonoConverter stereoToMono{2};
+    SinkI16 sinkI16{1};
+    sourceI16.setData(input, kNumFrames);
+    sourceI16.output.connect(&stereoToMono.input);
+    stereoToMono.output.connect(&sinkI16.input);
+    ASSERT_EQ(kNumFrames, sinkI16.read(expected, kNumFrames));
+
+    oboe::ChannelConverterI16 converter{2, 1};
+    converter.convert(input, output, kNumFrames);
+    for (int i = 0; i < kNumFrames; i++) {
+        EXPECT_EQ(expected[i], output[i]) << ", i = " << i;
+    }
+}
+
+TEST(test_flowgraph, module_channel_converter_i16_wraps_channels) {
+    static const int16_t input[] = {1, 2, 3, 4, 5, 6};
+    static const int16_t expected[] = {1, 2, 1, 2, 3, 4, 3, 4, 5, 6, 5, 6};
+    int16_t output[12];
+    oboe::ChannelConverterI16 converter{2, 4};
+    converter.convert(input, output, 3);
+    for (int i = 0; i < 12; i++) {
+        EXPECT_EQ(expected[i], output[i]) << ", i = " << i;
+    }
+}
+
+TEST(test_flowgraph, module_channel_converter_i16_matches_float) {
+    static constexpr int kNumFrames = 19;
+    static constexpr int kMaxChannels = 5;
+    static const int channelCounts[][2] = {{2, 4}, {2, 5}, {3, 2}, {4, 3}, {3, 5}};
+    for (const auto &counts : channelCounts) {
+        const int inputChannelCount = counts[0];
+        const int outputChannelCount = counts[1];
+        int16_t input[kNumFrames * kMaxChannels];
+        for (int i = 0; i < kNumFrames * inputChannelCount; i++) {
+            input[i] = static_cast<int16_t>((i * 977) - 32768);
+        }
+        int16_t expected[kNumFrames * kMaxChannels];
+        int16_t output[kNumFrames * kMaxChannels];
+
+        SourceI16 sourceI16{inputChannelCount};
+        ChannelCountConverter channelCountConverter{inputChannelCount, outputChannelCount};
+        SinkI16 sinkI16{outputChannelCount};
+        sourceI16.setData(input, kNumFrames);
+        sourceI16.output.connect(&channelCountConverter.input);
+        channelCountConverter.output.connect(&sinkI16.input);
+        ASSERT_EQ(kNumFrames, sinkI16.read(expected, kNumFrames));
+
+        oboe::ChannelConverterI16 converter{inputChannelCount, outputChannelCount};
+        converter.convert(input, output, kNumFrames);
+        for (int i = 0; i < kNumFrames * outputChannelCount; i++) {
+            EXPECT_EQ(expected[i], output[i]) << inputChannelCount << " to "
+                    << outputChannelCount << ", i = " << i;
+        }
+    }
+}
+
+// Direct form I, one sample at a time. This is the reference for BiquadCascade.
+class NaiveBiquad {
+public:
+    explicit NaiveBiquad(const BiquadCoefficients &coefficients)
+            : mCoefficients(coefficients) {}
+
+    float process(float x) {
+        const BiquadCoefficients &c = mCoefficients;
+        float y = (c.b0 * x) + (c.b1 * mX1) + (c.b2 * mX2) - (c.a1 * mY1) - (c.a2 * mY2);
+        mX2 = mX1;
+        mX1 = x;
+        mY2 = mY1;
+        mY1 = y;
+        return y;
+    }
+
+private:
+    BiquadCoefficients mCoefficients;
+    float mX1 = 0.0f;
+    float mX2 = 0.0f;
+    float mY1 = 0.0f;
+    float mY2 = 0.0f;
+};
+
+static void makeBiquadTestSignal(std::vector<float> &signal, int channelCount) {
+    for (size_t i = 0; i < signal.size(); i++) {
+        int frame = i / channelCount;
+        int channel = i % channelCount;
+        // A DC offset plus a different tone on each channel.
+        signal[i] = 0.25f + (0.5f * sinf(frame * 0.01f * (channel + 1)));
+    }
+}
+
+TEST(test_flowgraph, module_biquad_cascade_matches_naive) {
+    static constexpr int kChannelCount = 2;
+    static constexpr int kNumFrames = 1000;
+    static constexpr int kNumStages = 3;
+    const BiquadCoefficients coefficients[kNumStages] = {
+            BiquadCoefficients::makeDcBlocker(0.995f),
+            BiquadCoefficients::makePeaking(48000.0f, 1000.0f, 0.7f, 6.0f),
+            BiquadCoefficients::makeLowPass(48000.0f, 8000.0f, 0.707f),
+    };
+    std::vector<float> input(kNumFrames * kChannelCount);
+    std::vector<float> output(kNumFrames * kChannelCount);
+    makeBiquadTestSignal(input, kChannelCount);
+
+    SourceFloat sourceFloat{kChannelCount};
+    BiquadCascade biquads{kChannelCount, kNumStages, kBiquadSampleRate};
+    SinkFloat sinkFloat{kChannelCount};
+    for (int stage = 0; stage < kNumStages; stage++) {
+        biquads.setCoefficients(stage, coefficients[stage]);
+    }
+    sourceFloat.setData(input.data(), kNumFrames);
+    sourceFloat.output.connect(&biquads.input);
+    biquads.output.connect(&sinkFloat.input);
+    ASSERT_EQ(kNumFrames, sinkFloat.read(output.data(), kNumFrames));
+
+    for (int channel = 0; channel < kChannelCount; channel++) {
+        std::vector<NaiveBiquad> naive(coefficients, coefficients + kNumStages);
+        for (int i = 0; i < kNumFrames; i++) {
+            float sample = input[(i * kChannelCount) + channel];
+            for (auto &biquad : naive) {
+                sample = biquad.process(sample);
+            }
+            ASSERT_NEAR(sample, output[(i * kChannelCount) + channel], 0.0001f)
+                    << ", frame = " << i << ", channel = " << channel;
+        }
+    }
+}
+
+TEST(test_flowgraph, module_biquad_cascade_smooths_changes) {
+    static constexpr int kNumFrames = 2000;
+    static constexpr int kSmoothingFrames = 480;
+    std::vector<float> input(kNumFrames, 1.0f);
+    std::vector<float> output(kNumFrames);
+
+    SourceFloat sourceFloat{1};
+    BiquadCascade biquads{1, 1, kBiquadSampleRate};
+    SinkFloat sinkFloat{1};
+    // The default is 10 msec at the sample rate.
+    EXPECT_EQ(kBiquadSampleRate / 100, biquads.getSmoothingLengthInFrames());
+    EXPECT_EQ(441, (BiquadCascade{1, 1, 44100}.getSmoothingLengthInFrames()));
+    biquads.setSmoothingLengthInFrames(kSmoothingFrames);
+    sourceFloat.setData(input.data(), kNumFrames);
+    sourceFloat.output.connect(&biquads.input);
+    biquads.output.connect(&sinkFloat.input);
+
+    // Pass through at first.
+    ASSERT_EQ(100, sinkFloat.read(output.data(), 100));
+    EXPECT_NEAR(1.0f, output[99], 0.0001f);
+
+    // Change to a gain of 0.5. The output should ramp down, not jump.
+    BiquadCoefficients half;
+    half.b0 = 0.5f;
+    biquads.setCoefficients(0, half);
+    ASSERT_EQ(kNumFrames - 100, sinkFloat.read(&output[100], kNumFrames - 100));
+    for (int i = 101; i < 100 + kSmoothingFrames; i++) {
+        EXPECT_LE(output[i], output[i - 1]);
+        EXPECT_LT(output[i - 1] - output[i], 0.05f) << ", i = " << i;
+    }
+    EXPECT_NEAR(0.5f, output[kNumFrames - 1], 0.0001f);
+}
+
+TEST(test_flowgraph, module_biquad_cascade_benchmark) {
+    static constexpr int kChannelCount = 2;
+    static constexpr int kNumFrames = 48000 * 4;
+    static constexpr int kNumStages = 4;
+    BiquadCoefficients coefficients = BiquadCoefficients::makePeaking(48000.0f, 500.0f, 1.0f, 3.0f);
+    std::vector<float> input(kNumFrames * kChannelCount);
+    std::vector<float> output(kNumFrames * kChannelCount);
+    std::vector<float> naiveOutput(kNumFrames * kChannelCount);
+    makeBiquadTestSignal(input, kChannelCount);
+
+    // Naive: one sample at a time through every stage, one channel after another.
+    auto start = std::chrono::steady_clock::now();
+    for (int channel = 0; channel < kChannelCount; channel++) {
+        std::vector<NaiveBiquad> naive(kNumStages, NaiveBiquad(coefficients));
+        for (int i = 0; i < kNumFrames; i++) {
+            int index = (i * kChannelCount) + channel;
+            float sample = input[index];
+            for (auto &biquad : naive) {
+                sample = biquad.process(sample);
+            }
+            naiveOutput[index] = sample;
+        }
+    }
+    auto naiveNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    SourceFloat sourceFloat{kChannelCount};
+    BiquadCascade biquads{kChannelCount, kNumStages, kBiquadSampleRate};
+    SinkFloat sinkFloat{kChannelCount};
+    for (int stage = 0; stage < kNumStages; stage++) {
+        biquads.setCoefficients(stage, coefficients);
+    }
+    sourceFloat.setData(input.data(), kNumFrames);
+    sourceFloat.output.connect(&biquads.input);
+    biquads.output.connect(&sinkFloat.input);
+    start = std::chrono::steady_clock::now();
+    ASSERT_EQ(kNumFrames, sinkFloat.read(output.data(), kNumFrames));
+    auto cascadeNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    for (int i = 0; i < kNumFrames * kChannelCount; i += 997) {
+        ASSERT_NEAR(naiveOutput[i], output[i], 0.001f) << ", i = " << i;
+    }
+
+    // Without the flowgraph, as an app callback would use it.
+    BiquadCascade directBiquads{kChannelCount, kNumStages, kBiquadSampleRate};
+    for (int stage = 0; stage < kNumStages; stage++) {
+        directBiquads.setCoefficients(stage, coefficients);
+    }
+    start = std::chrono::steady_clock::now();
+    directBiquads.process(input.data(), output.data(), kNumFrames);
+    auto directNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    printf("biquad %d stages x %d channels, nsec/frame: naive = %.2f"
+           ", flowgraph = %.2f, direct = %.2f\n",
+           kNumStages, kChannelCount,
+           (double) naiveNanos / kNumFrames,
+           (double) cascadeNanos / kNumFrames,
+           (double) directNanos / kNumFrames);
+    for (int i = 0; i < kNumFrames * kChannelCount; i += 997) {
+        ASSERT_NEAR(naiveOutput[i], output[i], 0.001f) << ", i = " << i;
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test FrameSignal, which wakes blocking reads and writes.
+ */
+
+#include <atomic>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+#include "common/AudioClock.h"
+#include "common/FrameSignal.h"
+
+using namespace oboe;
+
+TEST(test_frame_signal, already_available) {
+    FrameSignal signal;
+    int64_t deadline = AudioClock::getNanoseconds() + kNanosPerSecond;
+    int32_t frames = signal.waitForFrames(10, deadline, []() { return 20; });
+    EXPECT_EQ(20, frames);
+}
+
+TEST(test_frame_signal, timeout) {
+    FrameSignal signal;
+    int64_t start = AudioClock::getNanoseconds();
+    int64_t deadline = start + (20 * kNanosPerMillisecond);
+    int32_t frames = 0;
+    do {
+        frames = signal.waitForFrames(10, deadline, []() { return 5; });
+    } while (frames < 10 && AudioClock::getNanoseconds() < deadline);
+    EXPECT_EQ(5, frames);
+    EXPECT_GE(AudioClock::getNanoseconds(), deadline);
+}
+
+// A notify() below the threshold should not wake the waiter but one above it should.
+TEST(test_frame_signal, wakes_at_threshold) {
+    FrameSignal signal;
+    std::atomic<int32_t> framesAvailable{0};
+    std::atomic<int64_t> notifyTime{0};
+
+    std::thread notifier([&]() {
+        for (int i = 1; i <= 10; i++) {
+            AudioClock::sleepForNanos(2 * kNanosPerMillisecond);
+            if (i == 10) {
+                notifyTime = AudioClock::getNanoseconds();
+            }
+            framesAvailable = i * 10;
+            signal.notify(framesAvailable);
+        }
+    });
+
+    int64_t deadline = AudioClock::getNanoseconds() + kNanosPerSecond;
+    int32_t frames = 0;
+    do {
+        frames = signal.waitForFrames(100, deadline, [&]() { return framesAvailable.load(); });
+    } while (frames < 100 && AudioClock::getNanoseconds() < deadline);
+    int64_t wakeTime = AudioClock::getNanoseconds();
+    notifier.join();
+
+    EXPECT_EQ(100, frames);
+    // Much less than the old polling interval of a millisecond or more.
+    printf("FrameSignal woke up %d usec after notify()\n",
+           static_cast<int>((wakeTime - notifyTime) / kNanosPerMicrosecond));
+    EXPECT_LT(wakeTime, deadline);
+}
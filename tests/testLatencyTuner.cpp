@@ -0,0 +1,238 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test the LatencyTuner against a stream that glitches on a simulated schedule.
+ * The stream does not run in real time, so minutes of tuning take milliseconds.
+ */
+
+#include <algorithm>
+#include <functional>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+constexpr int32_t kSampleRate = 48000;
+constexpr int32_t kFramesPerBurst = 96; // 2 msec
+constexpr int32_t kCapacity = 16 * kFramesPerBurst;
+
+/**
+ * An output stream that is driven by the test, one burst at a time.
+ * Each burst is an XRun if the buffer size is smaller than the size needed at that time.
+ */
+class ScheduledXRunStream : public AudioStream {
+public:
+    explicit ScheduledXRunStream(const AudioStreamBuilder &builder)
+            : AudioStream(builder) {
+        mSampleRate = kSampleRate;
+        mFramesPerBurst = kFramesPerBurst;
+        mBufferCapacityInFrames = kCapacity;
+        mBufferSizeInFrames = kCapacity;
+    }
+
+    Result requestStart() override { return Result::OK; }
+    Result requestPause() override { return Result::OK; }
+    Result requestFlush() override { return Result::OK; }
+    Result requestStop() override { return Result::OK; }
+    StreamState getState() override { return StreamState::Started; }
+    Result waitForStateChange(StreamState /* currentState */,
+                              StreamState *nextState,
+                              int64_t /* timeoutNanoseconds */) override {
+        if (nextState != nullptr) *nextState = StreamState::Started;
+        return Result::OK;
+    }
+    bool isXRunCountSupported() const override { return true; }
+    AudioApi getAudioApi() const override { return AudioApi::Unspecified; }
+
+    ResultWithValue<int32_t> setBufferSizeInFrames(int32_t requestedFrames) override {
+        mBufferSizeInFrames = std::max(kFramesPerBurst, std::min(kCapacity, requestedFrames));
+        return ResultWithValue<int32_t>(mBufferSizeInFrames);
+    }
+
+    ResultWithValue<int32_t> getXRunCount() override {
+        return ResultWithValue<int32_t>(mXRunCount);
+    }
+
+    ResultWithValue<PercentileSummary> getCallbackLatenessWindow() override {
+        if (!latenessNanos) {
+            return AudioStream::getCallbackLatenessWindow();
+        }
+        if (mCallbackCount == 0) {
+            return ResultWithValue<PercentileSummary>(Result::ErrorUnavailable);
+        }
+        PercentileSummary lateness;
+        lateness.p99 = mWorstLatenessNanos;
+        return ResultWithValue<PercentileSummary>(lateness);
+    }
+
+    Result resetCallbackLatenessWindow() override {
+        mCallbackCount = 0;
+        mWorstLatenessNanos = 0;
+        return Result::OK;
+    }
+
+    Result resetCallbackTimingStats() override {
+        statsResetCount++;
+        return AudioStream::resetCallbackTimingStats();
+    }
+
+    /**
+     * Simulate one burst then call the tuner, like a data callback would.
+     */
+    void runBurst(LatencyTuner &tuner) {
+        int64_t timeMillis = mFramesWritten * kMillisPerSecond / kSampleRate;
+        if (mBufferSizeInFrames < neededFrames(timeMillis)) {
+            mXRunCount++;
+        }
+        if (latenessNanos) {
+            mCallbackCount++;
+            mWorstLatenessNanos = std::max(mWorstLatenessNanos, latenessNanos(timeMillis));
+        }
+        mFramesWritten += kFramesPerBurst;
+        tuner.tune();
+    }
+
+    void runSeconds(LatencyTuner &tuner, int seconds) {
+        int64_t bursts = static_cast<int64_t>(seconds) * kSampleRate / kFramesPerBurst;
+        for (int64_t i = 0; i < bursts; i++) {
+            runBurst(tuner);
+        }
+    }
+
+    int32_t getXRunCountValue() const {
+        return mXRunCount;
+    }
+
+    // Buffer size needed to avoid an XRun, as a function of time in msec.
+    std::function<int32_t(int64_t)> neededFrames = [](int64_t) { return 0; };
+    // If set then report the worst callback lateness since the stats were reset,
+    // as a function of time in msec.
+    std::function<int64_t(int64_t)> latenessNanos;
+    // Number of times the stats that the app reads were reset.
+    int32_t statsResetCount = 0;
+
+protected:
+    void updateFramesWritten() override {}
+    void updateFramesRead() override {}
+
+private:
+    int32_t mXRunCount = 0;
+    int64_t mCallbackCount = 0;
+    int64_t mWorstLatenessNanos = 0;
+};
+
+class LatencyTunerSchedule : public ::testing::Test {
+protected:
+    AudioStreamBuilder mBuilder;
+    ScheduledXRunStream mStream{mBuilder};
+};
+
+// A transient problem should not leave the latency high.
+TEST_F(LatencyTunerSchedule, RecoversAfterTransient) {
+    // Need 6 bursts for the first 10 seconds, then 3 bursts.
+    mStream.neededFrames = [](int64_t timeMillis) {
+        return ((timeMillis < 10000) ? 6 : 3) * kFramesPerBurst;
+    };
+    LatencyTuner tuner(mStream);
+    tuner.setPolicy(LatencyTuner::Policy::Bidirectional);
+    tuner.setRobustness(0.0f); // lower the size after one second without an XRun
+    EXPECT_EQ(2 * kFramesPerBurst, mStream.getBufferSizeInFrames());
+
+    mStream.runSeconds(tuner, 9);
+    EXPECT_EQ(6 * kFramesPerBurst, mStream.getBufferSizeInFrames());
+
+    mStream.runSeconds(tuner, 60);
+    // It should settle at the needed size or one increment above it,
+    // after probing the size below.
+    EXPECT_GE(mStream.getBufferSizeInFrames(), 3 * kFramesPerBurst);
+    EXPECT_LE(mStream.getBufferSizeInFrames(), 4 * kFramesPerBurst);
+}
+
+TEST_F(LatencyTunerSchedule, IncreaseOnlyStaysHigh) {
+    mStream.neededFrames = [](int64_t timeMillis) {
+        return ((timeMillis < 10000) ? 6 : 3) * kFramesPerBurst;
+    };
+    LatencyTuner tuner(mStream);
+    EXPECT_EQ(LatencyTuner::Policy::IncreaseOnly, tuner.getPolicy());
+    mStream.runSeconds(tuner, 70);
+    EXPECT_EQ(6 * kFramesPerBurst, mStream.getBufferSizeInFrames());
+}
+
+// Probing below the needed size causes XRuns, so the tuner should probe less and less often.
+TEST_F(LatencyTunerSchedule, HysteresisLimitsProbing) {
+    mStream.neededFrames = [](int64_t) { return 4 * kFramesPerBurst; };
+    LatencyTuner tuner(mStream);
+    tuner.setPolicy(LatencyTuner::Policy::Bidirectional);
+    tuner.setRobustness(0.0f);
+    mStream.runSeconds(tuner, 5);
+    int32_t xRunsAfterConverging = mStream.getXRunCountValue();
+
+    mStream.runSeconds(tuner, 600);
+    // Each probe waits twice as long as the last, up to 16 seconds.
+    // Probing every second would cause 600 XRuns.
+    int32_t probeXRuns = mStream.getXRunCountValue() - xRunsAfterConverging;
+    EXPECT_GT(probeXRuns, 0);
+    EXPECT_LE(probeXRuns, 45);
+    EXPECT_GE(mStream.getBufferSizeInFrames(), 4 * kFramesPerBurst);
+}
+
+// A more robust tuner waits longer before lowering the size.
+TEST_F(LatencyTunerSchedule, RobustnessDelaysDecrease) {
+    mStream.neededFrames = [](int64_t timeMillis) {
+        return ((timeMillis < 1000) ? 6 : 2) * kFramesPerBurst;
+    };
+    LatencyTuner tuner(mStream);
+    tuner.setPolicy(LatencyTuner::Policy::Bidirectional);
+    tuner.setRobustness(1.0f);
+    mStream.runSeconds(tuner, 29);
+    EXPECT_EQ(6 * kFramesPerBurst, mStream.getBufferSizeInFrames());
+    mStream.runSeconds(tuner, 3);
+    EXPECT_EQ(5 * kFramesPerBurst, mStream.getBufferSizeInFrames());
+}
+
+// The size is not lowered if the callback is too late for the smaller buffer.
+TEST_F(LatencyTunerSchedule, TimingMarginBlocksDecrease) {
+    mStream.neededFrames = [](int64_t timeMillis) {
+        return ((timeMillis < 1000) ? 6 : 2) * kFramesPerBurst;
+    };
+    mStream.latenessNanos = [](int64_t) {
+        return 7 * kNanosPerMillisecond; // 3.5 bursts
+    };
+    LatencyTuner tuner(mStream);
+    tuner.setPolicy(LatencyTuner::Policy::Bidirectional);
+    tuner.setRobustness(0.0f);
+    mStream.runSeconds(tuner, 30);
+    // 3.5 bursts of lateness need 4.5 bursts plus the burst being written.
+    EXPECT_EQ(5 * kFramesPerBurst, mStream.getBufferSizeInFrames());
+}
+
+// Late callbacks in an earlier period do not stop the size from coming back down.
+TEST_F(LatencyTunerSchedule, OldLatenessIsForgotten) {
+    mStream.neededFrames = [](int64_t timeMillis) {
+        return ((timeMillis < 1000) ? 6 : 2) * kFramesPerBurst;
+    };
+    mStream.latenessNanos = [](int64_t timeMillis) {
+        return (timeMillis < 1000) ? 7 * kNanosPerMillisecond : 0;
+    };
+    LatencyTuner tuner(mStream);
+    tuner.setPolicy(LatencyTuner::Policy::Bidirectional);
+    tuner.setRobustness(0.0f);
+    mStream.runSeconds(tuner, 30);
+    EXPECT_EQ(2 * kFramesPerBurst, mStream.getBufferSizeInFrames());
+    EXPECT_EQ(0, mStream.statsResetCount);
+}
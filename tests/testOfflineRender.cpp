@@ -0,0 +1,205 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test offline streams, which render faster than real time into an OfflineSink.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+constexpr int32_t kAppSampleRate = 44100;
+
+// Generate a sine wave that only depends on the frame index.
+class SineCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream *oboeStream,
+                                    void *audioData,
+                                    int32_t numFrames) override {
+        float *floatData = static_cast<float *>(audioData);
+        const int32_t channelCount = oboeStream->getChannelCount();
+        for (int32_t i = 0; i < numFrames; i++) {
+            float sample = 0.5f * sinf(mFrameIndex++ * kPhaseIncrement);
+            for (int32_t channel = 0; channel < channelCount; channel++) {
+                *floatData++ = sample;
+            }
+        }
+        return DataCallbackResult::Continue;
+    }
+
+private:
+    static constexpr float kPhaseIncrement = 2.0f * M_PI * 440.0f / kAppSampleRate;
+    int64_t mFrameIndex = 0;
+};
+
+// Render with a sample rate conversion, the same way as a real low latency stream.
+static void renderToSink(OfflineSink *sink, int64_t framesToRender,
+                         OfflineRenderStats *stats = nullptr) {
+    SineCallback callback;
+    AudioStreamBuilder builder;
+    builder.setOfflineSink(sink)
+            ->setOfflineFramesToRender(framesToRender)
+            ->setDataCallback(&callback)
+            ->setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(kAppSampleRate)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium)
+            ->setFormat(AudioFormat::Float)
+            ->setChannelCount(2);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    EXPECT_EQ(kAppSampleRate, stream->getSampleRate());
+
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    StreamState nextState = StreamState::Unknown;
+    stream->waitForStateChange(StreamState::Started, &nextState, 60 * kNanosPerSecond);
+    EXPECT_EQ(StreamState::Stopped, nextState);
+    auto result = stream->getOfflineRenderStats();
+    ASSERT_TRUE(result);
+    EXPECT_EQ(framesToRender, result.value().framesRendered);
+    if (stats != nullptr) {
+        *stats = result.value();
+    }
+    stream->close();
+}
+
+TEST(OfflineRender, FasterThanRealTime) {
+    constexpr int64_t kSeconds = 60;
+    const int64_t framesToRender = kSeconds * DefaultStreamValues::SampleRate;
+    MemoryOfflineSink sink;
+    OfflineRenderStats stats;
+    renderToSink(&sink, framesToRender, &stats);
+    EXPECT_EQ(framesToRender * sink.getBytesPerFrame(),
+              static_cast<int64_t>(sink.getData().size()));
+    EXPECT_LT(stats.elapsedNanos, kSeconds * kNanosPerSecond / 10);
+    printf("Offline render of %d seconds: %.1f msec, %.1f msec CPU, %.0fx real time\n",
+           static_cast<int>(kSeconds),
+           stats.elapsedNanos * 1.0e-6,
+           stats.cpuTimeNanos * 1.0e-6,
+           (kSeconds * kNanosPerSecond) / static_cast<double>(stats.elapsedNanos));
+}
+
+TEST(OfflineRender, Deterministic) {
+    MemoryOfflineSink sink1;
+    MemoryOfflineSink sink2;
+    renderToSink(&sink1, 48000, nullptr);
+    renderToSink(&sink2, 48000, nullptr);
+    ASSERT_EQ(sink1.getData().size(), sink2.getData().size());
+    EXPECT_TRUE(sink1.getData() == sink2.getData());
+}
+
+TEST(OfflineRender, WavFile) {
+    char path[] = "/tmp/oboe_offline_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    constexpr int64_t kFramesToRender = 1000;
+    {
+        WavFileOfflineSink sink(path);
+        renderToSink(&sink, kFramesToRender, nullptr);
+    }
+
+    FILE *file = fopen(path, "rb");
+    ASSERT_NE(nullptr, file);
+    uint8_t header[44];
+    ASSERT_EQ(1u, fread(header, sizeof(header), 1, file));
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fclose(file);
+    unlink(path);
+
+    const uint32_t dataSize = kFramesToRender * 2 * sizeof(float);
+    EXPECT_EQ(0, memcmp(&header[0], "RIFF", 4));
+    EXPECT_EQ(0, memcmp(&header[8], "WAVE", 4));
+    EXPECT_EQ(3, header[20]); // IEEE float
+    EXPECT_EQ(2, header[22]); // channels
+    EXPECT_EQ(0, memcmp(&header[36], "data", 4));
+    uint32_t headerDataSize = header[40] | (header[41] << 8) | (header[42] << 16)
+            | (header[43] << 24);
+    EXPECT_EQ(dataSize, headerDataSize);
+    EXPECT_EQ(static_cast<long>(sizeof(header) + dataSize), fileSize);
+}
+
+TEST(OfflineRender, NeedsOutputCallback) {
+    MemoryOfflineSink sink;
+    SineCallback callback;
+    AudioStreamBuilder builder;
+    std::shared_ptr<AudioStream> stream;
+    builder.setOfflineSink(&sink)->setDirection(Direction::Input)->setDataCallback(&callback);
+    EXPECT_EQ(Result::ErrorIllegalArgument, builder.openStream(stream));
+    builder.setDirection(Direction::Output)->setDataCallback(nullptr);
+    EXPECT_EQ(Result::ErrorIllegalArgument, builder.openStream(stream));
+}
+
+TEST(OfflineRender, BiquadFilterInConversion) {
+    constexpr int64_t kFramesToRender = 4800;
+    constexpr int32_t kChannelCount = 2;
+    SineCallback callback;
+    MemoryOfflineSink sink;
+    AudioStreamBuilder builder;
+    builder.setOfflineSink(&sink)
+            ->setOfflineFramesToRender(kFramesToRender)
+            ->setDataCallback(&callback)
+            ->setFormat(AudioFormat::Float)
+            ->setChannelCount(kChannelCount)
+            ->setBiquadFilterStageCount(kMaxBiquadFilterStages + 1);
+    std::shared_ptr<AudioStream> stream;
+    EXPECT_EQ(Result::ErrorOutOfRange, builder.openStream(stream));
+
+    builder.setBiquadFilterStageCount(2);
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    EXPECT_EQ(2, stream->getBiquadFilterStageCount());
+    BiquadFilterCoefficients half;
+    half.b0 = 0.5f;
+    EXPECT_EQ(Result::ErrorOutOfRange, stream->setBiquadFilterCoefficients(2, half));
+    ASSERT_EQ(Result::OK, stream->setBiquadFilterCoefficients(1, half));
+
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    StreamState nextState = StreamState::Unknown;
+    stream->waitForStateChange(StreamState::Started, &nextState, 10 * kNanosPerSecond);
+    EXPECT_EQ(StreamState::Stopped, nextState);
+    stream->close();
+
+    // The first stage passes through and the second one halves the sine.
+    ASSERT_EQ(kFramesToRender * kChannelCount * sizeof(float), sink.getData().size());
+    const float *samples = reinterpret_cast<const float *>(sink.getData().data());
+    const float phaseIncrement = 2.0f * M_PI * 440.0f / kAppSampleRate;
+    for (int32_t i = 0; i < kFramesToRender; i++) {
+        ASSERT_FLOAT_EQ(0.25f * sinf(i * phaseIncrement), samples[i * kChannelCount])
+                << "frame " << i;
+    }
+}
+
+TEST(OfflineRender, NoBiquadFilterByDefault) {
+    SineCallback callback;
+    MemoryOfflineSink sink;
+    AudioStreamBuilder builder;
+    builder.setOfflineSink(&sink)
+            ->setOfflineFramesToRender(100)
+            ->setDataCallback(&callback)
+            ->setFormat(AudioFormat::Float);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    EXPECT_EQ(Result::ErrorInvalidState,
+              stream->setBiquadFilterCoefficients(0, BiquadFilterCoefficients()));
+    stream->close();
+}
@@ -0,0 +1,405 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test buffers and events that are scheduled at exact frame positions.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+#include "common/AudioClock.h"
+
+using namespace oboe;
+
+constexpr int32_t kChannelCount = 2;
+constexpr int32_t kCapacity = 8;
+constexpr int64_t kFramesToRender = 9600;
+
+// Output silence and remember where each callback started.
+class SilenceCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream *oboeStream,
+                                    void *audioData,
+                                    int32_t numFrames) override {
+        const int32_t numSamples = numFrames * oboeStream->getChannelCount();
+        float *floatData = static_cast<float *>(audioData);
+        std::fill(floatData, floatData + numSamples, 0.0f);
+        if (callbackStarts.size() < callbackStarts.capacity()) {
+            callbackStarts.push_back(framesRendered);
+        }
+        framesRendered += numFrames;
+        return DataCallbackResult::Continue;
+    }
+
+    SilenceCallback() {
+        callbackStarts.reserve(1000); // so the callback does not allocate
+    }
+
+    std::vector<int64_t> callbackStarts;
+    int64_t framesRendered = 0;
+};
+
+// Record the position of the app callback when the event happens.
+class RecordingEvent : public ScheduledEventCallback {
+public:
+    explicit RecordingEvent(const SilenceCallback &callback) : mCallback(callback) {}
+
+    void onScheduledEvent(AudioStream * /* audioStream */, int64_t framePosition) override {
+        scheduledPosition = framePosition;
+        renderedPosition = mCallback.framesRendered;
+        count++;
+    }
+
+    int64_t scheduledPosition = -1;
+    int64_t renderedPosition = -1;
+    int32_t count = 0;
+
+private:
+    const SilenceCallback &mCallback;
+};
+
+// Schedule a buffer at a position that has already passed.
+class LateBufferEvent : public ScheduledEventCallback {
+public:
+    LateBufferEvent(const float *buffer, int32_t numFrames, int64_t framesLate)
+            : mBuffer(buffer)
+            , mNumFrames(numFrames)
+            , mFramesLate(framesLate) {}
+
+    void onScheduledEvent(AudioStream *audioStream, int64_t framePosition) override {
+        result = audioStream->scheduleBuffer(framePosition - mFramesLate, mBuffer, mNumFrames);
+    }
+
+    Result result = Result::ErrorInternal;
+
+private:
+    const float   *mBuffer;
+    const int32_t  mNumFrames;
+    const int64_t  mFramesLate;
+};
+
+class PlaybackSchedulerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mBuilder.setAudioApi(AudioApi::Null)
+                ->setPerformanceMode(PerformanceMode::LowLatency)
+                ->setFormat(AudioFormat::Float)
+                ->setChannelCount(kChannelCount)
+                ->setDataCallback(&mCallback)
+                ->setScheduledEventCapacity(kCapacity)
+                ->setOfflineSink(&mSink)
+                ->setOfflineFramesToRender(kFramesToRender);
+    }
+
+    void TearDown() override {
+        if (mStream) {
+            mStream->close();
+        }
+    }
+
+    void openStream() {
+        ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    }
+
+    void render() {
+        ASSERT_EQ(Result::OK, mStream->requestStart());
+        StreamState nextState = StreamState::Unknown;
+        mStream->waitForStateChange(StreamState::Started, &nextState, 10 * kNanosPerSecond);
+        ASSERT_EQ(StreamState::Stopped, nextState);
+        ASSERT_EQ(kFramesToRender * kChannelCount * sizeof(float), mSink.getData().size());
+    }
+
+    float getSample(int64_t frame) const {
+        const float *samples = reinterpret_cast<const float *>(mSink.getData().data());
+        return samples[frame * kChannelCount];
+    }
+
+    // Return the first frame at or after startFrame that is not silent, or -1.
+    int64_t findSound(int64_t startFrame) const {
+        for (int64_t frame = startFrame; frame < kFramesToRender; frame++) {
+            if (getSample(frame) != 0.0f) {
+                return frame;
+            }
+        }
+        return -1;
+    }
+
+    AudioStreamBuilder           mBuilder;
+    SilenceCallback              mCallback;
+    MemoryOfflineSink            mSink;
+    std::shared_ptr<AudioStream> mStream;
+};
+
+TEST_F(PlaybackSchedulerTest, BuffersStartAtExactFrames) {
+    openStream();
+    const int32_t burst = mStream->getFramesPerBurst();
+    std::vector<float> click(100 * kChannelCount, 0.5f);
+    std::vector<float> longTone(3 * burst * kChannelCount, 0.25f);
+    // Start inside a burst and play across the next ones.
+    const int64_t clickPosition = 1000 + (burst / 3);
+    const int64_t tonePosition = clickPosition + 100 + (5 * burst) - 7;
+    ASSERT_EQ(Result::OK, mStream->scheduleBuffer(clickPosition, click.data(), 100));
+    ASSERT_EQ(Result::OK, mStream->scheduleBuffer(tonePosition, longTone.data(), 3 * burst));
+
+    render();
+    EXPECT_EQ(clickPosition, findSound(0));
+    EXPECT_EQ(0.5f, getSample(clickPosition + 99));
+    EXPECT_EQ(0.0f, getSample(clickPosition + 100));
+    EXPECT_EQ(tonePosition, findSound(clickPosition + 100));
+    EXPECT_EQ(0.25f, getSample(tonePosition + (3 * burst) - 1));
+    EXPECT_EQ(-1, findSound(tonePosition + (3 * burst)));
+}
+
+TEST_F(PlaybackSchedulerTest, EventsSplitTheCallback) {
+    openStream();
+    const int32_t burst = mStream->getFramesPerBurst();
+    const int64_t eventPosition = 2 * burst + 13;
+    RecordingEvent event1(mCallback);
+    RecordingEvent event2(mCallback);
+    ASSERT_EQ(Result::OK, mStream->scheduleEvent(eventPosition, &event1));
+    ASSERT_EQ(Result::OK, mStream->scheduleEvent(eventPosition, &event2));
+
+    render();
+    EXPECT_EQ(1, event1.count);
+    EXPECT_EQ(eventPosition, event1.scheduledPosition);
+    EXPECT_EQ(eventPosition, event1.renderedPosition);
+    EXPECT_EQ(eventPosition, event2.renderedPosition);
+    // One extra callback for the split, not one per frame.
+    const int64_t numBursts = kFramesToRender / burst;
+    EXPECT_EQ(numBursts + 1, static_cast<int64_t>(mCallback.callbackStarts.size()));
+    EXPECT_NE(mCallback.callbackStarts.end(),
+              std::find(mCallback.callbackStarts.begin(), mCallback.callbackStarts.end(),
+                        eventPosition));
+}
+
+TEST_F(PlaybackSchedulerTest, LateBufferStaysAligned) {
+    openStream();
+    constexpr int32_t kNumFrames = 64;
+    constexpr int64_t kFramesLate = 10;
+    std::vector<float> ramp(kNumFrames * kChannelCount);
+    for (int32_t i = 0; i < kNumFrames * kChannelCount; i++) {
+        ramp[i] = (i / kChannelCount + 1) * 0.01f;
+    }
+    LateBufferEvent event(ramp.data(), kNumFrames, kFramesLate);
+    const int64_t eventPosition = 3000;
+    ASSERT_EQ(Result::OK, mStream->scheduleEvent(eventPosition, &event));
+
+    render();
+    EXPECT_EQ(Result::OK, event.result);
+    EXPECT_EQ(eventPosition, findSound(0));
+    // The frames that were due before the event are skipped.
+    EXPECT_FLOAT_EQ(ramp[kFramesLate * kChannelCount], getSample(eventPosition));
+    EXPECT_EQ(-1, findSound(eventPosition + kNumFrames - kFramesLate));
+}
+
+TEST_F(PlaybackSchedulerTest, ClearDropsScheduledBuffers) {
+    openStream();
+    std::vector<float> click(10 * kChannelCount, 0.5f);
+    ASSERT_EQ(Result::OK, mStream->scheduleBuffer(100, click.data(), 10));
+    ASSERT_EQ(Result::OK, mStream->clearScheduledEvents());
+    ASSERT_EQ(Result::OK, mStream->scheduleBuffer(200, click.data(), 10));
+
+    render();
+    EXPECT_EQ(200, findSound(0));
+}
+
+TEST_F(PlaybackSchedulerTest, LimitsScheduledEvents) {
+    openStream();
+    std::vector<float> click(10 * kChannelCount, 0.5f);
+    for (int i = 0; i < kCapacity; i++) {
+        ASSERT_EQ(Result::OK, mStream->scheduleBuffer(100 * i, click.data(), 10));
+    }
+    EXPECT_EQ(Result::ErrorNoFreeHandles, mStream->scheduleBuffer(5000, click.data(), 10));
+    EXPECT_EQ(Result::ErrorNull, mStream->scheduleBuffer(5000, nullptr, 10));
+    EXPECT_EQ(Result::ErrorNull, mStream->scheduleEvent(5000, nullptr));
+
+    // Played buffers free their slots.
+    render();
+    EXPECT_EQ(Result::OK, mStream->scheduleBuffer(kFramesToRender + 100, click.data(), 10));
+    mStream->close();
+    EXPECT_EQ(Result::ErrorClosed, mStream->scheduleBuffer(5000, click.data(), 10));
+}
+
+// The app still sees its own callback after the scheduler is set up.
+TEST_F(PlaybackSchedulerTest, KeepsAppCallback) {
+    openStream();
+    EXPECT_EQ(&mCallback, mStream->getDataCallback());
+}
+
+// Scheduled buffers are mixed in when Oboe batches the callbacks.
+TEST_F(PlaybackSchedulerTest, WithCallbackBatching) {
+    mBuilder.setOfflineSink(nullptr)
+            ->setOfflineFramesToRender(0)
+            ->setPerformanceMode(PerformanceMode::PowerSaving)
+            ->setPowerSavingBatchMillis(20);
+    openStream();
+    RecordingEvent event(mCallback);
+    const int64_t eventPosition = mStream->getFramesPerBurst() + 7;
+    ASSERT_EQ(Result::OK, mStream->scheduleEvent(eventPosition, &event));
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+    usleep(200 * 1000);
+    mStream->requestStop();
+    EXPECT_EQ(1, event.count);
+    EXPECT_EQ(eventPosition, event.renderedPosition);
+}
+
+TEST_F(PlaybackSchedulerTest, NeedsCapacityAndOutputCallback) {
+    mBuilder.setScheduledEventCapacity(0);
+    openStream();
+    std::vector<float> click(10 * kChannelCount, 0.5f);
+    EXPECT_EQ(Result::ErrorInvalidState, mStream->scheduleBuffer(100, click.data(), 10));
+    EXPECT_EQ(Result::ErrorInvalidState, mStream->clearScheduledEvents());
+    mStream->close();
+    mStream.reset();
+
+    std::shared_ptr<AudioStream> stream;
+    mBuilder.setScheduledEventCapacity(-1);
+    EXPECT_EQ(Result::ErrorOutOfRange, mBuilder.openStream(stream));
+    mBuilder.setScheduledEventCapacity(kCapacity)->setDataCallback(nullptr);
+    EXPECT_EQ(Result::ErrorIllegalArgument, mBuilder.openStream(stream));
+    mBuilder.setDataCallback(&mCallback)->setDirection(Direction::Input);
+    EXPECT_EQ(Result::ErrorIllegalArgument, mBuilder.openStream(stream));
+}
+
+// The scheduler counts the frames of the app when Oboe converts the sample rate.
+TEST_F(PlaybackSchedulerTest, WithSampleRateConversion) {
+    mBuilder.setSampleRate(44100)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium);
+    openStream();
+    ASSERT_EQ(44100, mStream->getSampleRate());
+    RecordingEvent event(mCallback);
+    const int64_t eventPosition = 4410;
+    ASSERT_EQ(Result::OK, mStream->scheduleEvent(eventPosition, &event));
+
+    render();
+    EXPECT_EQ(1, event.count);
+    EXPECT_EQ(eventPosition, event.renderedPosition);
+}
+
+TEST_F(PlaybackSchedulerTest, FramePositionAtTime) {
+    mBuilder.setOfflineSink(nullptr)->setOfflineFramesToRender(0);
+    openStream();
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+    usleep(50 * 1000);
+    const int64_t now = AudioClock::getNanoseconds();
+    auto result = mStream->getFramePositionAtTime(now + 100 * kNanosPerMillisecond);
+    if (result) {
+        // About 100 msec after what is playing now, which is before what was written.
+        const int64_t framesWritten = mStream->getFramesWritten();
+        const int64_t framesIn100Millis = mStream->getSampleRate() / 10;
+        EXPECT_GT(result.value(), framesWritten - mStream->getBufferCapacityInFrames());
+        EXPECT_LT(result.value(), framesWritten + framesIn100Millis);
+    } else {
+        EXPECT_EQ(Result::ErrorUnimplemented, result.error());
+    }
+    mStream->requestStop();
+}
+
+// Count the events that did not happen at their frame.
+class MetronomeEvent : public ScheduledEventCallback {
+public:
+    explicit MetronomeEvent(const SilenceCallback &callback) : mCallback(callback) {}
+
+    void onScheduledEvent(AudioStream * /* audioStream */, int64_t framePosition) override {
+        if (mCallback.framesRendered != framePosition) {
+            misplacedCount++;
+        }
+        count++;
+    }
+
+    std::atomic<int32_t> count{0};
+    std::atomic<int32_t> misplacedCount{0};
+
+private:
+    const SilenceCallback &mCallback;
+};
+
+// Schedule from another thread while the stream is running.
+TEST_F(PlaybackSchedulerTest, ScheduleWhileRunning) {
+    mBuilder.setOfflineSink(nullptr)->setOfflineFramesToRender(0);
+    openStream();
+    MetronomeEvent metronome(mCallback);
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+    const int32_t beatFrames = mStream->getSampleRate() / 100;
+    int64_t nextBeat = 0;
+    int32_t numScheduled = 0;
+    for (int i = 0; i < 30; i++) {
+        // Stay ahead of the callback.
+        const int64_t horizon = mStream->getFramesWritten() + (8 * mStream->getFramesPerBurst());
+        while (nextBeat < horizon) {
+            nextBeat += beatFrames;
+            if (mStream->scheduleEvent(nextBeat, &metronome) == Result::OK) {
+                numScheduled++;
+            }
+        }
+        usleep(5 * 1000);
+    }
+    mStream->requestStop();
+    EXPECT_GT(metronome.count.load(), 0);
+    EXPECT_LE(metronome.count.load(), numScheduled);
+    EXPECT_EQ(0, metronome.misplacedCount.load());
+}
+
+// Return Stop from the part of a block after an event.
+class StopAtPositionCallback : public SilenceCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream *oboeStream,
+                                    void *audioData,
+                                    int32_t numFrames) override {
+        const int64_t startPosition = framesRendered;
+        SilenceCallback::onAudioReady(oboeStream, audioData, numFrames);
+        return (startPosition == stopPosition)
+                ? DataCallbackResult::Stop
+                : DataCallbackResult::Continue;
+    }
+
+    int64_t stopPosition = -1;
+};
+
+// The frames rendered before a Stop are counted, so events after a restart stay aligned.
+TEST_F(PlaybackSchedulerTest, StopInsideBlockKeepsPosition) {
+    StopAtPositionCallback callback;
+    mBuilder.setOfflineSink(nullptr)
+            ->setOfflineFramesToRender(0)
+            ->setDataCallback(&callback);
+    openStream();
+    const int32_t burst = mStream->getFramesPerBurst();
+    callback.stopPosition = (2 * burst) + 13;
+    RecordingEvent splitEvent(callback);
+    RecordingEvent laterEvent(callback);
+    const int64_t laterPosition = (6 * burst) + 5;
+    ASSERT_EQ(Result::OK, mStream->scheduleEvent(callback.stopPosition, &splitEvent));
+    ASSERT_EQ(Result::OK, mStream->scheduleEvent(laterPosition, &laterEvent));
+
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+    StreamState nextState = StreamState::Unknown;
+    mStream->waitForStateChange(StreamState::Started, &nextState, kNanosPerSecond);
+    ASSERT_EQ(StreamState::Stopped, mStream->getState());
+    EXPECT_EQ(1, splitEvent.count);
+    EXPECT_EQ(0, laterEvent.count);
+
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+    usleep(100 * 1000);
+    mStream->requestStop();
+    EXPECT_EQ(1, laterEvent.count);
+    EXPECT_EQ(laterPosition, laterEvent.renderedPosition);
+}
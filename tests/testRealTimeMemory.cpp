@@ -0,0 +1,151 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#endif
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+#include "common/MemoryRegions.h"
+
+using namespace oboe;
+
+TEST(MemoryRegions, MergesSharedPages) {
+    constexpr size_t kNumBytes = 3 * 4096;
+    std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(kNumBytes);
+    MemoryRegions regions;
+    regions.add(buffer.get(), kNumBytes);
+    regions.add(buffer.get() + 100, 200); // inside the first region
+    regions.add(nullptr, 100); // ignored
+    EXPECT_EQ(static_cast<int64_t>(kNumBytes + 200), regions.getTotalBytes());
+
+    buffer[0] = 7;
+    regions.prefault();
+    EXPECT_EQ(7, buffer[0]);
+
+    int64_t lockedBytes = regions.lock();
+    // The lock may be refused by RLIMIT_MEMLOCK.
+    if (lockedBytes > 0) {
+        const int64_t pageSize = sysconf(_SC_PAGESIZE);
+        EXPECT_EQ(0, lockedBytes % pageSize);
+        EXPECT_GE(lockedBytes, static_cast<int64_t>(kNumBytes));
+        EXPECT_LE(lockedBytes, static_cast<int64_t>(kNumBytes) + pageSize);
+    }
+    EXPECT_EQ(lockedBytes, regions.getLockedBytes());
+    regions.unlock();
+    EXPECT_EQ(0, regions.getLockedBytes());
+}
+
+class FpuStateCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream * /* oboeStream */,
+                                    void * /* audioData */,
+                                    int32_t /* numFrames */) override {
+#if defined(__i386__) || defined(__x86_64__)
+        mxcsr = _mm_getcsr();
+#endif
+        callbackCount++;
+        return DataCallbackResult::Continue;
+    }
+
+    std::atomic<uint32_t> mxcsr{0};
+    std::atomic<int32_t> callbackCount{0};
+};
+
+static void runStream(AudioStream *stream) {
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(Result::OK, stream->stop());
+}
+
+TEST(RealTimeMemory, DisabledByDefault) {
+    FpuStateCallback callback;
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)->setDataCallback(&callback);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    EXPECT_FALSE(stream->isPrefaultEnabled());
+    EXPECT_FALSE(stream->isMemoryLockEnabled());
+    EXPECT_FALSE(stream->isFlushToZeroEnabled());
+    EXPECT_EQ(Result::ErrorInvalidState, stream->getLockedMemoryBytes().error());
+    stream->close();
+}
+
+TEST(RealTimeMemory, LockStreamBuffers) {
+    FpuStateCallback callback;
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)
+            ->setDataCallback(&callback)
+            ->setMemoryLockEnabled(true);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    auto lockedBytes = stream->getLockedMemoryBytes();
+    ASSERT_TRUE(lockedBytes);
+    EXPECT_GE(lockedBytes.value(), 0);
+
+    runStream(stream.get());
+    EXPECT_GT(callback.callbackCount.load(), 0);
+    stream->close();
+    auto lockedBytesAfterClose = stream->getLockedMemoryBytes();
+    ASSERT_TRUE(lockedBytesAfterClose);
+    EXPECT_EQ(0, lockedBytesAfterClose.value());
+}
+
+TEST(RealTimeMemory, LockThroughFilterStream) {
+    FpuStateCallback callback;
+    AudioStreamBuilder builder;
+    // Conversion from 44100 to 48000 Hz needs a FilterAudioStream with a resampler.
+    builder.setAudioApi(AudioApi::Null)
+            ->setDataCallback(&callback)
+            ->setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(44100)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium)
+            ->setPrefaultEnabled(true)
+            ->setMemoryLockEnabled(true);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    ASSERT_EQ(44100, stream->getSampleRate());
+    EXPECT_TRUE(stream->getLockedMemoryBytes());
+    runStream(stream.get());
+    EXPECT_GT(callback.callbackCount.load(), 0);
+    stream->close();
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+TEST(RealTimeMemory, FlushToZeroInCallback) {
+    constexpr uint32_t kFlushToZeroBits = 0x8000 | 0x0040; // FTZ | DAZ
+    FpuStateCallback callback;
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)
+            ->setDataCallback(&callback)
+            ->setFlushToZeroEnabled(true);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    runStream(stream.get());
+    ASSERT_GT(callback.callbackCount.load(), 0);
+    EXPECT_EQ(kFlushToZeroBits, callback.mxcsr.load() & kFlushToZeroBits);
+    stream->close();
+    // The test thread is not changed.
+    EXPECT_EQ(0u, _mm_getcsr() & kFlushToZeroBits);
+}
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+#include "common/AudioClock.h"
+
+using namespace oboe;
+
+constexpr int32_t kNumTasks = 8;
+
+class CountingTask : public RenderTask {
+public:
+    void run() override {
+        if (sleepMillis > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(sleepMillis));
+        }
+        // Not atomic. join() must make the result visible.
+        runCount++;
+    }
+
+    int32_t runCount = 0;
+    int32_t sleepMillis = 0;
+};
+
+class RenderPoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (int i = 0; i < kNumTasks; i++) {
+            mTaskPointers[i] = &mTasks[i];
+        }
+    }
+
+    // @param timeoutNanos time the workers have to claim the tasks before join() runs them
+    void forkAndJoin(int32_t iterations, int64_t timeoutNanos) {
+        for (int i = 0; i < iterations; i++) {
+            int64_t deadlineNanos = AudioClock::getNanoseconds() + timeoutNanos;
+            ASSERT_EQ(Result::OK, mPool.fork(mTaskPointers, kNumTasks));
+            ASSERT_EQ(Result::OK, mPool.join(deadlineNanos));
+        }
+    }
+
+    int64_t getTasksRunByWorkers() {
+        int64_t tasksRun = 0;
+        for (int i = 0; i < mPool.getNumWorkers(); i++) {
+            auto stats = mPool.getWorkerStats(i);
+            EXPECT_TRUE(stats);
+            tasksRun += stats.value().tasksRun;
+        }
+        return tasksRun;
+    }
+
+    RenderPool   mPool;
+    CountingTask mTasks[kNumTasks];
+    RenderTask  *mTaskPointers[kNumTasks];
+};
+
+TEST_F(RenderPoolTest, RunsEveryTaskOnce) {
+    constexpr int32_t kIterations = 2000;
+    constexpr int32_t kTotalIterations = kIterations + kIterations / 10;
+    ASSERT_EQ(Result::OK, mPool.open(3));
+    EXPECT_EQ(3, mPool.getNumWorkers());
+    // Help the workers right away, then leave them time to claim the tasks.
+    forkAndJoin(kIterations, 0);
+    forkAndJoin(kIterations / 10, kNanosPerMillisecond);
+    for (const CountingTask &task : mTasks) {
+        EXPECT_EQ(kTotalIterations, task.runCount);
+    }
+    EXPECT_GT(getTasksRunByWorkers(), 0);
+    EXPECT_EQ(kTotalIterations * kNumTasks,
+              getTasksRunByWorkers() + mPool.getInlineTaskCount());
+    ASSERT_EQ(Result::OK, mPool.close());
+    EXPECT_EQ(0, mPool.getNumWorkers());
+}
+
+// With no spinning the workers sleep on a futex between forks.
+TEST_F(RenderPoolTest, WorkersSleepBetweenForks) {
+    constexpr int32_t kIterations = 50;
+    mPool.setSpinNanos(0);
+    ASSERT_EQ(Result::OK, mPool.open(2));
+    for (int i = 0; i < kIterations; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        forkAndJoin(1, 10 * kNanosPerMillisecond);
+    }
+    for (const CountingTask &task : mTasks) {
+        EXPECT_EQ(kIterations, task.runCount);
+    }
+    EXPECT_GT(getTasksRunByWorkers(), 0);
+}
+
+TEST_F(RenderPoolTest, NoWorkers) {
+    ASSERT_EQ(Result::OK, mPool.open(0));
+    // Runs the tasks right away without waiting for the deadline.
+    forkAndJoin(10, kNanosPerSecond);
+    for (const CountingTask &task : mTasks) {
+        EXPECT_EQ(10, task.runCount);
+    }
+    EXPECT_EQ(10 * kNumTasks, mPool.getInlineTaskCount());
+    EXPECT_EQ(10, mPool.getDeadlineFallbackCount());
+}
+
+// A worker that is stuck in a slow task cannot run the others, so join() runs them.
+TEST_F(RenderPoolTest, DeadlineFallback) {
+    mPool.setSpinNanos(kNanosPerSecond);
+    ASSERT_EQ(Result::OK, mPool.open(1));
+    mTasks[0].sleepMillis = 50;
+    ASSERT_EQ(Result::OK, mPool.fork(mTaskPointers, kNumTasks));
+    ASSERT_EQ(Result::OK, mPool.join(AudioClock::getNanoseconds() + 5 * kNanosPerMillisecond));
+    for (const CountingTask &task : mTasks) {
+        EXPECT_EQ(1, task.runCount);
+    }
+    EXPECT_EQ(1, mPool.getDeadlineFallbackCount());
+    EXPECT_GE(mPool.getInlineTaskCount(), 1);
+    EXPECT_EQ(kNumTasks, getTasksRunByWorkers() + mPool.getInlineTaskCount());
+}
+
+TEST_F(RenderPoolTest, WorkerStats) {
+    mPool.setWorkerPriority(2); // falls back to normal threads if not allowed
+    mPool.setWorkerCpuIds({0});
+    ASSERT_EQ(Result::OK, mPool.open(2));
+    for (CountingTask &task : mTasks) {
+        task.sleepMillis = 1;
+    }
+    forkAndJoin(5, kNanosPerSecond);
+    int64_t busyNanos = 0;
+    for (int i = 0; i < mPool.getNumWorkers(); i++) {
+        auto stats = mPool.getWorkerStats(i);
+        ASSERT_TRUE(stats);
+        busyNanos += stats.value().busyNanos;
+        EXPECT_GE(stats.value().utilization, 0.0);
+        EXPECT_LE(stats.value().utilization, 1.0);
+    }
+    EXPECT_GE(busyNanos, getTasksRunByWorkers() * kNanosPerMillisecond);
+    EXPECT_EQ(Result::ErrorOutOfRange, mPool.getWorkerStats(2).error());
+
+    mPool.resetStats();
+    EXPECT_EQ(0, getTasksRunByWorkers());
+    EXPECT_EQ(0, mPool.getInlineTaskCount());
+}
+
+TEST_F(RenderPoolTest, Errors) {
+    EXPECT_EQ(Result::ErrorClosed, mPool.fork(mTaskPointers, kNumTasks));
+    EXPECT_EQ(Result::ErrorClosed, mPool.close());
+    EXPECT_EQ(Result::ErrorOutOfRange, mPool.open(-1));
+    EXPECT_EQ(Result::ErrorOutOfRange, mPool.open(RenderPool::kMaxWorkers + 1));
+    ASSERT_EQ(Result::OK, mPool.open(1));
+    EXPECT_EQ(Result::ErrorInvalidState, mPool.open(1));
+    EXPECT_EQ(Result::ErrorInvalidState, mPool.join(0));
+    EXPECT_EQ(Result::ErrorNull, mPool.fork(nullptr, 1));
+    EXPECT_EQ(Result::ErrorOutOfRange, mPool.fork(mTaskPointers, -1));
+    ASSERT_EQ(Result::OK, mPool.fork(mTaskPointers, kNumTasks));
+    EXPECT_EQ(Result::ErrorInvalidState, mPool.fork(mTaskPointers, kNumTasks));
+    // Closing runs the tasks that were forked.
+    ASSERT_EQ(Result::OK, mPool.close());
+    for (const CountingTask &task : mTasks) {
+        EXPECT_EQ(1, task.runCount);
+    }
+}
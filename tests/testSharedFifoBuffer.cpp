@@ -0,0 +1,155 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test SharedFifoBuffer, a FifoBuffer in shared memory.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+#include "common/AudioClock.h"
+
+using namespace oboe;
+
+TEST(test_shared_fifo_buffer, create_and_attach) {
+    std::unique_ptr<SharedFifoBuffer> writer;
+    ASSERT_EQ(Result::OK, SharedFifoBuffer::create(sizeof(int16_t), 64, writer));
+    std::unique_ptr<SharedFifoBuffer> reader;
+    ASSERT_EQ(Result::OK, SharedFifoBuffer::attach(writer->getFileDescriptor(), reader));
+    EXPECT_EQ(64u, reader->getFifoBuffer().getBufferCapacityInFrames());
+    EXPECT_EQ(sizeof(int16_t), reader->getFifoBuffer().getBytesPerFrame());
+
+    // The two mappings see the same counters and data.
+    int16_t data[3] = {7, 8, 9};
+    ASSERT_EQ(3, writer->getFifoBuffer().write(data, 3));
+    EXPECT_EQ(3u, reader->getFifoBuffer().getFullFramesAvailable());
+    int16_t result[3] = {};
+    ASSERT_EQ(3, reader->getFifoBuffer().read(result, 3));
+    EXPECT_EQ(8, result[1]);
+    EXPECT_EQ(3u, writer->getFifoBuffer().getReadCounter());
+}
+
+TEST(test_shared_fifo_buffer, attach_rejects_invalid) {
+    std::unique_ptr<SharedFifoBuffer> fifo;
+    EXPECT_EQ(Result::ErrorIllegalArgument, SharedFifoBuffer::attach(-1, fifo));
+    int pipeFds[2];
+    ASSERT_EQ(0, pipe(pipeFds));
+    EXPECT_EQ(Result::ErrorIllegalArgument, SharedFifoBuffer::attach(pipeFds[0], fifo));
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    EXPECT_EQ(Result::ErrorIllegalArgument, SharedFifoBuffer::create(0, 64, fifo));
+    EXPECT_EQ(nullptr, fifo.get());
+}
+
+TEST(test_shared_fifo_buffer, size_is_sealed) {
+    std::unique_ptr<SharedFifoBuffer> writer;
+    ASSERT_EQ(Result::OK, SharedFifoBuffer::create(sizeof(int16_t), 64, writer));
+    // A peer cannot shrink the region under a mapping.
+    EXPECT_NE(0, ftruncate(writer->getFileDescriptor(), 0));
+    EXPECT_NE(0, ftruncate(writer->getFileDescriptor(), 1 << 20));
+
+    // Copy the region into memory that is not sealed. attach() must refuse it.
+    int unsealedFd = static_cast<int>(syscall(__NR_memfd_create, "unsealed", 0));
+    ASSERT_GE(unsealedFd, 0);
+    struct stat status;
+    ASSERT_EQ(0, fstat(writer->getFileDescriptor(), &status));
+    ASSERT_EQ(0, ftruncate(unsealedFd, status.st_size));
+    std::vector<uint8_t> contents(status.st_size);
+    ASSERT_EQ(status.st_size, pread(writer->getFileDescriptor(), contents.data(),
+                                    contents.size(), 0));
+    ASSERT_EQ(status.st_size, pwrite(unsealedFd, contents.data(), contents.size(), 0));
+    std::unique_ptr<SharedFifoBuffer> reader;
+    EXPECT_EQ(Result::ErrorIllegalArgument, SharedFifoBuffer::attach(unsealedFd, reader));
+    EXPECT_EQ(nullptr, reader.get());
+    close(unsealedFd);
+}
+
+struct TimedFrame {
+    int64_t index;
+    int64_t timeNanos; // when the frame was written
+};
+
+// Write frames from a child process and read them in this process.
+TEST(test_shared_fifo_buffer, two_process_transfer) {
+    constexpr int64_t kNumFrames = 1000 * 1000;
+    constexpr int32_t kFramesPerTransfer = 32;
+    std::unique_ptr<SharedFifoBuffer> reader;
+    ASSERT_EQ(Result::OK, SharedFifoBuffer::create(sizeof(TimedFrame), 1024, reader));
+
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // Child process. Attach as if the file descriptor had been passed over a socket.
+        std::unique_ptr<SharedFifoBuffer> writer;
+        if (SharedFifoBuffer::attach(reader->getFileDescriptor(), writer) != Result::OK) {
+            _exit(1);
+        }
+        FifoBuffer &fifo = writer->getFifoBuffer();
+        int64_t index = 0;
+        while (index < kNumFrames) {
+            FifoSpan span = fifo.acquireWrite(kFramesPerTransfer);
+            if (span.getNumFrames() == 0) {
+                sched_yield(); // in case the reader is on the same CPU
+                continue;
+            }
+            int64_t now = AudioClock::getNanoseconds();
+            TimedFrame *frames1 = static_cast<TimedFrame *>(span.data1);
+            for (int i = 0; i < span.numFrames1; i++) frames1[i] = {index++, now};
+            TimedFrame *frames2 = static_cast<TimedFrame *>(span.data2);
+            for (int i = 0; i < span.numFrames2; i++) frames2[i] = {index++, now};
+            fifo.commitWrite(span.getNumFrames());
+        }
+        _exit(0);
+    }
+
+    FifoBuffer &fifo = reader->getFifoBuffer();
+    TimedFrame frames[kFramesPerTransfer];
+    int64_t expectedIndex = 0;
+    int64_t errors = 0;
+    int64_t totalLatencyNanos = 0;
+    int64_t startNanos = AudioClock::getNanoseconds();
+    while (expectedIndex < kNumFrames) {
+        int32_t framesRead = fifo.read(frames, kFramesPerTransfer);
+        if (framesRead == 0) {
+            sched_yield();
+            continue;
+        }
+        int64_t now = AudioClock::getNanoseconds();
+        for (int i = 0; i < framesRead; i++) {
+            errors += (frames[i].index != expectedIndex++) ? 1 : 0;
+            totalLatencyNanos += now - frames[i].timeNanos;
+        }
+    }
+    double seconds = (AudioClock::getNanoseconds() - startNanos) * 1.0e-9;
+
+    int status = 0;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    EXPECT_EQ(0, errors);
+    printf("SharedFifoBuffer: %.1f Mframes/sec, mean latency = %.1f usec\n",
+           kNumFrames / seconds * 1.0e-6,
+           totalLatencyNanos / static_cast<double>(kNumFrames) * 1.0e-3);
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+#include "common/StreamArena.h"
+
+using namespace oboe;
+
+TEST(StreamArena, AlignedAndZeroed) {
+    StreamArena arena;
+    EXPECT_EQ(0, arena.getCapacityInBytes());
+    EXPECT_EQ(nullptr, arena.allocate(0));
+
+    uint8_t *first = arena.allocateArray<uint8_t>(10);
+    float *second = arena.allocateArray<float>(100);
+    ASSERT_NE(nullptr, first);
+    ASSERT_NE(nullptr, second);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(first) % StreamArena::kAlignment);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(second) % StreamArena::kAlignment);
+    // Buffers do not share a cache line.
+    EXPECT_EQ(first + StreamArena::kAlignment, reinterpret_cast<uint8_t *>(second));
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(0.0f, second[i]);
+    }
+    EXPECT_EQ(1, arena.getChunkCount());
+    EXPECT_EQ(static_cast<int64_t>(StreamArena::kMinChunkBytes), arena.getCapacityInBytes());
+    EXPECT_EQ(static_cast<int64_t>(StreamArena::kAlignment * 8), arena.getUsedBytes());
+}
+
+TEST(StreamArena, OwnersClaimOnce) {
+    StreamArena arena;
+    EXPECT_TRUE(arena.claim(StreamArena::Owner::FlowGraph));
+    EXPECT_TRUE(arena.claim(StreamArena::Owner::Fifo));
+    EXPECT_FALSE(arena.claim(StreamArena::Owner::FlowGraph));
+    EXPECT_FALSE(arena.claim(StreamArena::Owner::Fifo));
+    EXPECT_TRUE(arena.claim(StreamArena::Owner::PlaybackScheduler));
+}
+
+TEST(StreamArena, AddsChunkWhenFull) {
+    StreamArena arena;
+    ASSERT_NE(nullptr, arena.allocate(StreamArena::kMinChunkBytes - 64));
+    EXPECT_EQ(1, arena.getChunkCount());
+    // Too big for what is left, and bigger than a default chunk.
+    uint8_t *big = arena.allocateArray<uint8_t>(3 * StreamArena::kMinChunkBytes);
+    ASSERT_NE(nullptr, big);
+    big[3 * StreamArena::kMinChunkBytes - 1] = 1;
+    EXPECT_EQ(2, arena.getChunkCount());
+    EXPECT_EQ(static_cast<int64_t>(4 * StreamArena::kMinChunkBytes), arena.getCapacityInBytes());
+}
+
+TEST(StreamArena, HugePageChunks) {
+    StreamArena arena;
+    arena.setHugePagesEnabled(true);
+    uint8_t *buffer = arena.allocateArray<uint8_t>(1000);
+    ASSERT_NE(nullptr, buffer);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(buffer) % StreamArena::kHugePageBytes);
+    EXPECT_EQ(static_cast<int64_t>(StreamArena::kHugePageBytes), arena.getCapacityInBytes());
+}
+
+static void writeSilence(AudioStream *stream) {
+    std::vector<float> silence(stream->getFramesPerBurst() * stream->getChannelCount());
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    for (int i = 0; i < 10; i++) {
+        auto result = stream->write(silence.data(), stream->getFramesPerBurst(),
+                                    100 * kNanosPerMillisecond);
+        ASSERT_TRUE(result);
+    }
+    ASSERT_EQ(Result::OK, stream->stop());
+}
+
+TEST(StreamArena, BlockingStreamUsesOneChunk) {
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)->setFormat(AudioFormat::Float);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    // The FIFO and the simulated device buffer are mapped in one chunk.
+    const int64_t fifoBytes = stream->getBufferCapacityInFrames() * stream->getBytesPerFrame();
+    EXPECT_GE(stream->getArenaSizeInBytes(), fifoBytes);
+    EXPECT_LT(stream->getArenaSizeInBytes(),
+              fifoBytes + static_cast<int64_t>(StreamArena::kMinChunkBytes));
+    writeSilence(stream.get());
+    stream->close();
+}
+
+TEST(StreamArena, FilterStreamIncludesChild) {
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)
+            ->setFormat(AudioFormat::Float)
+            ->setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(44100)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    ASSERT_EQ(44100, stream->getSampleRate());
+    // The child stream maps its FIFO. The FilterAudioStream maps a chunk for the conversion.
+    const int64_t childFifoBytes = stream->getBufferCapacityInFrames()
+            * stream->getBytesPerFrame();
+    EXPECT_GE(stream->getArenaSizeInBytes(),
+              childFifoBytes + static_cast<int64_t>(StreamArena::kMinChunkBytes));
+    writeSilence(stream.get());
+    stream->close();
+}
+
+TEST(StreamArena, HugePageStream) {
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)->setHugePageArenaEnabled(true);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    EXPECT_TRUE(stream->isHugePageArenaEnabled());
+    EXPECT_EQ(static_cast<int64_t>(StreamArena::kHugePageBytes), stream->getArenaSizeInBytes());
+    stream->close();
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test virtual streams that are mixed into one device stream by a StreamMixer.
+ */
+
+#include <atomic>
+#include <math.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+constexpr int32_t kDeviceChannelCount = 2;
+constexpr int64_t kFramesToRender = 48000;
+
+// Output a constant value in the format of the stream.
+class ConstantCallback : public AudioStreamDataCallback {
+public:
+    explicit ConstantCallback(float value, int64_t framesBeforeStop = -1)
+            : mValue(value)
+            , mFramesBeforeStop(framesBeforeStop) {}
+
+    DataCallbackResult onAudioReady(AudioStream *oboeStream,
+                                    void *audioData,
+                                    int32_t numFrames) override {
+        const int32_t numSamples = numFrames * oboeStream->getChannelCount();
+        if (oboeStream->getFormat() == AudioFormat::I16) {
+            int16_t *shortData = static_cast<int16_t *>(audioData);
+            std::fill(shortData, shortData + numSamples, static_cast<int16_t>(mValue * 32768));
+        } else {
+            float *floatData = static_cast<float *>(audioData);
+            std::fill(floatData, floatData + numSamples, mValue);
+        }
+        framesRendered += numFrames;
+        if (mFramesBeforeStop >= 0 && framesRendered >= mFramesBeforeStop) {
+            return DataCallbackResult::Stop;
+        }
+        return DataCallbackResult::Continue;
+    }
+
+    std::atomic<int64_t> framesRendered{0};
+
+private:
+    const float   mValue;
+    const int64_t mFramesBeforeStop;
+};
+
+class StreamMixerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mDeviceBuilder.setAudioApi(AudioApi::Null)
+                ->setPerformanceMode(PerformanceMode::LowLatency)
+                ->setChannelCount(kDeviceChannelCount)
+                ->setOfflineSink(&mSink)
+                ->setOfflineFramesToRender(kFramesToRender);
+    }
+
+    void TearDown() override {
+        mMixer.close();
+    }
+
+    void openMixer() {
+        ASSERT_EQ(Result::OK, mMixer.open(mDeviceBuilder));
+        ASSERT_NE(nullptr, mMixer.getDeviceStream());
+        EXPECT_EQ(AudioFormat::Float, mMixer.getDeviceStream()->getFormat());
+    }
+
+    void openStream(AudioStreamDataCallback *callback,
+                    AudioFormat format,
+                    int32_t channelCount,
+                    int32_t sampleRate,
+                    std::shared_ptr<AudioStream> &stream) {
+        AudioStreamBuilder builder;
+        builder.setDataCallback(callback)
+                ->setFormat(format)
+                ->setChannelCount(channelCount)
+                ->setSampleRate(sampleRate);
+        ASSERT_EQ(Result::OK, mMixer.openStream(builder, stream));
+        ASSERT_NE(nullptr, stream);
+    }
+
+    // Render the device stream offline.
+    void render() {
+        ASSERT_EQ(Result::OK, mMixer.start());
+        StreamState nextState = StreamState::Unknown;
+        mMixer.getDeviceStream()->waitForStateChange(StreamState::Started, &nextState,
+                                                     10 * kNanosPerSecond);
+        ASSERT_EQ(StreamState::Stopped, nextState);
+        ASSERT_EQ(kFramesToRender * kDeviceChannelCount * sizeof(float), mSink.getData().size());
+    }
+
+    float getSample(int64_t frame) const {
+        const float *samples = reinterpret_cast<const float *>(mSink.getData().data());
+        return samples[frame * kDeviceChannelCount];
+    }
+
+    AudioStreamBuilder mDeviceBuilder;
+    MemoryOfflineSink  mSink;
+    StreamMixer        mMixer;
+};
+
+TEST_F(StreamMixerTest, SumsStreams) {
+    openMixer();
+    const int32_t deviceRate = mMixer.getDeviceStream()->getSampleRate();
+    ConstantCallback quarter(0.25f);
+    ConstantCallback eighth(0.125f);
+    std::shared_ptr<AudioStream> monoStream;
+    std::shared_ptr<AudioStream> stereoStream;
+    openStream(&quarter, AudioFormat::I16, 1, deviceRate, monoStream);
+    openStream(&eighth, AudioFormat::Float, 2, deviceRate, stereoStream);
+    EXPECT_EQ(2, mMixer.getStreamCount());
+    ASSERT_EQ(Result::OK, monoStream->requestStart());
+    ASSERT_EQ(Result::OK, stereoStream->requestStart());
+
+    render();
+    const float *samples = reinterpret_cast<const float *>(mSink.getData().data());
+    for (int64_t i = 0; i < kFramesToRender * kDeviceChannelCount; i++) {
+        ASSERT_EQ(0.375f, samples[i]) << "sample " << i;
+    }
+    EXPECT_EQ(kFramesToRender, quarter.framesRendered.load());
+    EXPECT_EQ(kFramesToRender, eighth.framesRendered.load());
+    EXPECT_EQ(kFramesToRender, monoStream->getFramesWritten());
+}
+
+TEST_F(StreamMixerTest, ConvertsSampleRate) {
+    openMixer();
+    const int32_t deviceRate = mMixer.getDeviceStream()->getSampleRate();
+    const int32_t streamRate = (deviceRate == 44100) ? 48000 : 44100;
+    ConstantCallback callback(0.5f);
+    std::shared_ptr<AudioStream> stream;
+    openStream(&callback, AudioFormat::Float, 1, streamRate, stream);
+    EXPECT_EQ(streamRate, stream->getSampleRate());
+    EXPECT_EQ(SampleRateConversionQuality::Medium, stream->getSampleRateConversionQuality());
+    ASSERT_EQ(Result::OK, stream->requestStart());
+
+    render();
+    const int64_t expectedFrames = kFramesToRender * streamRate / deviceRate;
+    EXPECT_NEAR(expectedFrames, callback.framesRendered.load(), 2 * stream->getFramesPerBurst());
+    EXPECT_NEAR(expectedFrames, stream->getFramesWritten(), 2);
+    // Skip the start of the resampler filter.
+    EXPECT_NEAR(0.5f, getSample(kFramesToRender / 2), 0.001f);
+}
+
+TEST_F(StreamMixerTest, StoppedStreamsAreSilent) {
+    openMixer();
+    const int32_t deviceRate = mMixer.getDeviceStream()->getSampleRate();
+    ConstantCallback playing(0.25f);
+    ConstantCallback stopsItself(0.5f, kFramesToRender / 4);
+    ConstantCallback neverStarted(1.0f);
+    std::shared_ptr<AudioStream> playingStream;
+    std::shared_ptr<AudioStream> stoppingStream;
+    std::shared_ptr<AudioStream> idleStream;
+    openStream(&playing, AudioFormat::Float, 2, deviceRate, playingStream);
+    openStream(&stopsItself, AudioFormat::Float, 2, deviceRate, stoppingStream);
+    openStream(&neverStarted, AudioFormat::Float, 2, deviceRate, idleStream);
+    ASSERT_EQ(Result::OK, playingStream->requestStart());
+    ASSERT_EQ(Result::OK, stoppingStream->requestStart());
+
+    render();
+    EXPECT_EQ(StreamState::Stopped, stoppingStream->getState());
+    EXPECT_EQ(StreamState::Open, idleStream->getState());
+    EXPECT_EQ(0, neverStarted.framesRendered.load());
+    EXPECT_FLOAT_EQ(0.75f, getSample(0));
+    EXPECT_FLOAT_EQ(0.25f, getSample(kFramesToRender - 1));
+}
+
+TEST_F(StreamMixerTest, StateChanges) {
+    openMixer();
+    ConstantCallback callback(0.5f);
+    std::shared_ptr<AudioStream> stream;
+    openStream(&callback, AudioFormat::Float, 2, kUnspecified, stream);
+    EXPECT_EQ(mMixer.getDeviceStream()->getSampleRate(), stream->getSampleRate());
+    EXPECT_EQ(StreamState::Open, stream->getState());
+    EXPECT_EQ(Result::OK, stream->start());
+    EXPECT_EQ(StreamState::Started, stream->getState());
+    EXPECT_EQ(Result::OK, stream->pause());
+    EXPECT_EQ(StreamState::Paused, stream->getState());
+    EXPECT_EQ(Result::OK, stream->flush());
+    EXPECT_EQ(StreamState::Flushed, stream->getState());
+    EXPECT_EQ(Result::OK, stream->start());
+    EXPECT_EQ(Result::OK, stream->stop());
+    EXPECT_EQ(StreamState::Stopped, stream->getState());
+    EXPECT_EQ(AudioApi::Null, stream->getAudioApi());
+    EXPECT_EQ(Result::OK, stream->close());
+    EXPECT_EQ(StreamState::Closed, stream->getState());
+    EXPECT_EQ(Result::ErrorClosed, stream->requestStart());
+    EXPECT_EQ(0, mMixer.getStreamCount());
+}
+
+TEST_F(StreamMixerTest, RejectsBadBuilders) {
+    std::shared_ptr<AudioStream> stream;
+    ConstantCallback callback(0.5f);
+    AudioStreamBuilder builder;
+    builder.setDataCallback(&callback);
+    EXPECT_EQ(Result::ErrorInvalidState, mMixer.openStream(builder, stream));
+
+    openMixer();
+    EXPECT_EQ(Result::ErrorInvalidState, mMixer.open(mDeviceBuilder));
+    builder.setDirection(Direction::Input);
+    EXPECT_EQ(Result::ErrorIllegalArgument, mMixer.openStream(builder, stream));
+    AudioStreamBuilder noCallbackBuilder;
+    EXPECT_EQ(Result::ErrorIllegalArgument, mMixer.openStream(noCallbackBuilder, stream));
+    EXPECT_EQ(nullptr, stream);
+    EXPECT_EQ(0, mMixer.getStreamCount());
+}
+
+TEST_F(StreamMixerTest, LimitsStreamCount) {
+    openMixer();
+    ConstantCallback callback(0.0f);
+    AudioStreamBuilder builder;
+    builder.setDataCallback(&callback);
+    std::shared_ptr<AudioStream> streams[StreamMixer::kMaxStreams];
+    for (auto &stream : streams) {
+        ASSERT_EQ(Result::OK, mMixer.openStream(builder, stream));
+    }
+    std::shared_ptr<AudioStream> extraStream;
+    EXPECT_EQ(Result::ErrorNoFreeHandles, mMixer.openStream(builder, extraStream));
+
+    // Deleting a stream closes it and frees the slot.
+    streams[3].reset();
+    EXPECT_EQ(StreamMixer::kMaxStreams - 1, mMixer.getStreamCount());
+    EXPECT_EQ(Result::OK, mMixer.openStream(builder, extraStream));
+}
+
+TEST_F(StreamMixerTest, CloseClosesStreams) {
+    openMixer();
+    ConstantCallback callback(0.5f);
+    std::shared_ptr<AudioStream> stream;
+    openStream(&callback, AudioFormat::Float, 2, kUnspecified, stream);
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    EXPECT_EQ(Result::OK, mMixer.close());
+    EXPECT_EQ(nullptr, mMixer.getDeviceStream());
+    EXPECT_EQ(StreamState::Closed, stream->getState());
+    EXPECT_EQ(Result::ErrorClosed, stream->close());
+    EXPECT_EQ(Result::ErrorClosed, mMixer.close());
+}
+
+// Start and stop virtual streams while the device stream is running in real time.
+TEST_F(StreamMixerTest, RealTime) {
+    mDeviceBuilder.setOfflineSink(nullptr)->setOfflineFramesToRender(0);
+    openMixer();
+    ConstantCallback callback(0.5f);
+    std::shared_ptr<AudioStream> stream;
+    openStream(&callback, AudioFormat::I16, 1, 44100, stream);
+    ASSERT_EQ(Result::OK, mMixer.start());
+    for (int i = 0; i < 20; i++) {
+        ASSERT_EQ(Result::OK, stream->requestStart());
+        usleep(10 * 1000);
+        ASSERT_EQ(Result::OK, stream->requestStop());
+        const int64_t framesAfterStop = callback.framesRendered.load();
+        usleep(2 * 1000);
+        ASSERT_EQ(framesAfterStop, callback.framesRendered.load());
+    }
+    EXPECT_GT(callback.framesRendered.load(), 0);
+    int64_t framePosition = 0;
+    int64_t timeNanos = 0;
+    Result result = stream->getTimestamp(CLOCK_MONOTONIC, &framePosition, &timeNanos);
+    if (result == Result::OK) {
+        EXPECT_LE(framePosition, stream->getFramesWritten());
+    }
+    EXPECT_EQ(Result::OK, mMixer.stop());
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Test the AudioApi::Null stream, which runs without any audio hardware.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+constexpr int kRunMillis = 300;
+
+class CountingCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream *oboeStream,
+                                    void *audioData,
+                                    int32_t numFrames) override {
+        if (latencyTuner) {
+            latencyTuner->tune();
+        }
+        callbackCount++;
+        frameCount += numFrames;
+        return (callbackCount == stopAfterCallbacks)
+                ? DataCallbackResult::Stop
+                : DataCallbackResult::Continue;
+    }
+
+    std::atomic<int32_t> callbackCount{0};
+    std::atomic<int64_t> frameCount{0};
+    int32_t stopAfterCallbacks = -1;
+    LatencyTuner *latencyTuner = nullptr;
+};
+
+class StreamNull : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mBuilder.setAudioApi(AudioApi::Null);
+    }
+
+    void TearDown() override {
+        if (mStream) {
+            mStream->close();
+        }
+    }
+
+    void runFor(int millis) {
+        ASSERT_EQ(Result::OK, mStream->requestStart());
+        std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+    }
+
+    AudioStreamBuilder mBuilder;
+    std::shared_ptr<AudioStream> mStream;
+    CountingCallback mCallback;
+};
+
+TEST_F(StreamNull, OutputCallback) {
+    mBuilder.setDataCallback(&mCallback)
+            ->setSampleRate(48000)
+            ->setChannelCount(2)
+            ->setFormat(AudioFormat::I16)
+            ->setSimulatedFramesPerBurst(96);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    EXPECT_EQ(AudioApi::Null, mStream->getAudioApi());
+    EXPECT_EQ(96, mStream->getFramesPerBurst());
+    EXPECT_EQ(AudioFormat::I16, mStream->getFormat());
+
+    runFor(kRunMillis);
+    int64_t framePosition = 0;
+    int64_t timeNanos = 0;
+    ASSERT_EQ(Result::OK, mStream->getTimestamp(CLOCK_MONOTONIC, &framePosition, &timeNanos));
+    ASSERT_EQ(Result::OK, mStream->stop());
+
+    // The device consumes frames at the sample rate.
+    const int64_t expectedFrames = 48000 * kRunMillis / 1000;
+    EXPECT_NEAR(expectedFrames, mStream->getFramesRead(), 48000 / 20);
+    EXPECT_GE(mStream->getFramesWritten(), mStream->getFramesRead());
+    EXPECT_EQ(mCallback.frameCount.load(), mStream->getFramesWritten());
+    EXPECT_GT(framePosition, 0);
+    EXPECT_EQ(0, framePosition % 96);
+    EXPECT_TRUE(mStream->isXRunCountSupported());
+}
+
+TEST_F(StreamNull, InputBlockingRead) {
+    mBuilder.setDirection(Direction::Input)
+            ->setSampleRate(16000)
+            ->setChannelCount(1)
+            ->setFormat(AudioFormat::Float);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+
+    constexpr int32_t kFramesToRead = 1600; // 100 msec
+    float buffer[kFramesToRead];
+    buffer[0] = 1.0f;
+    auto start = std::chrono::steady_clock::now();
+    auto result = mStream->read(buffer, kFramesToRead, kNanosPerSecond);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_TRUE(result);
+    EXPECT_EQ(kFramesToRead, result.value());
+    EXPECT_EQ(0.0f, buffer[0]); // silence
+    // The data arrives in real time.
+    EXPECT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 80);
+}
+
+// Ask for a rate that the QuirksManager will convert with a FilterAudioStream.
+TEST_F(StreamNull, SampleRateConversion) {
+    mBuilder.setDataCallback(&mCallback)
+            ->setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(44100)
+            ->setSampleRateConversionQuality(SampleRateConversionQuality::Medium)
+            ->setFormat(AudioFormat::I16)
+            ->setFormatConversionAllowed(true);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    EXPECT_EQ(44100, mStream->getSampleRate());
+    EXPECT_EQ(AudioApi::Null, mStream->getAudioApi());
+
+    runFor(kRunMillis);
+    ASSERT_EQ(Result::OK, mStream->stop());
+    EXPECT_NEAR(44100 * kRunMillis / 1000, mCallback.frameCount.load(), 44100 / 10);
+}
+
+TEST_F(StreamNull, ForcedXRuns) {
+    mBuilder.setDataCallback(&mCallback)
+            ->setSimulatedXRunIntervalBursts(10);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    runFor(kRunMillis);
+    ASSERT_EQ(Result::OK, mStream->stop());
+    auto xRunCount = mStream->getXRunCount();
+    ASSERT_TRUE(xRunCount);
+    EXPECT_GT(xRunCount.value(), 0);
+}
+
+// Late wakeups cause XRuns at a small buffer size so the tuner should raise it.
+TEST_F(StreamNull, LatencyTunerRaisesBufferSize) {
+    constexpr int32_t kFramesPerBurst = 48;
+    mBuilder.setDataCallback(&mCallback)
+            ->setPerformanceMode(PerformanceMode::LowLatency)
+            ->setSampleRate(48000)
+            ->setSimulatedFramesPerBurst(kFramesPerBurst)
+            ->setSimulatedJitterNanos(4 * kNanosPerMillisecond); // 4 bursts
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    LatencyTuner tuner(*mStream);
+    mCallback.latencyTuner = &tuner;
+    int32_t initialBufferSize = mStream->getBufferSizeInFrames();
+    EXPECT_EQ(2 * kFramesPerBurst, initialBufferSize);
+
+    runFor(kRunMillis);
+    ASSERT_EQ(Result::OK, mStream->stop());
+    EXPECT_GT(mStream->getBufferSizeInFrames(), initialBufferSize);
+}
+
+TEST_F(StreamNull, CallbackReturnsStop) {
+    mCallback.stopAfterCallbacks = 5;
+    mBuilder.setDataCallback(&mCallback);
+    ASSERT_EQ(Result::OK, mBuilder.openStream(mStream));
+    ASSERT_EQ(Result::OK, mStream->requestStart());
+    StreamState nextState = StreamState::Unknown;
+    ASSERT_EQ(Result::OK, mStream->waitForStateChange(StreamState::Started, &nextState,
+                                                      kNanosPerSecond));
+    EXPECT_EQ(StreamState::Stopped, nextState);
+    EXPECT_EQ(5, mCallback.callbackCount.load());
+
+    // It can be started again.
+    mCallback.stopAfterCallbacks = -1;
+    runFor(20);
+    EXPECT_EQ(StreamState::Started, mStream->getState());
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sched.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+// Run in a new thread so the test thread keeps its placement.
+static EffectiveThreadPlacement applyInThread(const ThreadPlacement &placement) {
+    EffectiveThreadPlacement effective;
+    std::thread thread([&]() {
+        effective = applyThreadPlacement(placement);
+    });
+    thread.join();
+    return effective;
+}
+
+TEST(ThreadPlacement, DefaultChangesNothing) {
+    ThreadPlacement placement;
+    EXPECT_TRUE(placement.isDefault());
+    EffectiveThreadPlacement effective = applyInThread(placement);
+    EXPECT_EQ(Result::OK, effective.affinityResult);
+    EXPECT_EQ(Result::OK, effective.priorityResult);
+    EXPECT_NE(0u, effective.cpuMask);
+    EXPECT_EQ(SCHED_OTHER, effective.scheduler);
+}
+
+TEST(ThreadPlacement, PinToOneCpu) {
+    ThreadPlacement placement;
+    placement.cpuIds = {0};
+    EffectiveThreadPlacement effective = applyInThread(placement);
+    EXPECT_EQ(Result::OK, effective.affinityResult);
+    EXPECT_EQ(1u, effective.cpuMask);
+
+    placement.cpuIds = {100};
+    EXPECT_EQ(Result::ErrorOutOfRange, applyInThread(placement).affinityResult);
+}
+
+TEST(ThreadPlacement, CoreTypes) {
+    uint64_t allCpus = getCpuMaskForCoreType(CoreType::Any);
+    uint64_t efficiencyCpus = getCpuMaskForCoreType(CoreType::Efficiency);
+    uint64_t performanceCpus = getCpuMaskForCoreType(CoreType::Performance);
+    ASSERT_NE(0u, allCpus);
+    EXPECT_NE(0u, efficiencyCpus);
+    EXPECT_NE(0u, performanceCpus);
+    EXPECT_EQ(efficiencyCpus, efficiencyCpus & allCpus);
+    EXPECT_EQ(performanceCpus, performanceCpus & allCpus);
+
+    ThreadPlacement placement;
+    placement.coreType = CoreType::Efficiency;
+    EffectiveThreadPlacement effective = applyInThread(placement);
+    EXPECT_EQ(Result::OK, effective.affinityResult);
+    EXPECT_EQ(efficiencyCpus & effective.cpuMask, effective.cpuMask);
+}
+
+// Most processes may not use SCHED_FIFO, so accept either result but check the report.
+TEST(ThreadPlacement, Priority) {
+    ThreadPlacement placement;
+    placement.priority = 2;
+    EffectiveThreadPlacement effective = applyInThread(placement);
+    if (effective.priorityResult == Result::OK) {
+        EXPECT_EQ(SCHED_FIFO, effective.scheduler);
+        EXPECT_EQ(2, effective.priority);
+    } else {
+        EXPECT_EQ(SCHED_OTHER, effective.scheduler);
+    }
+}
+
+class PlacementCallback : public AudioStreamDataCallback {
+public:
+    DataCallbackResult onAudioReady(AudioStream * /* oboeStream */,
+                                    void * /* audioData */,
+                                    int32_t /* numFrames */) override {
+        cpuMask = 0;
+        cpu_set_t cpuSet;
+        if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0) {
+            for (int cpu = 0; cpu < 64; cpu++) {
+                if (CPU_ISSET(cpu, &cpuSet)) cpuMask |= 1ULL << cpu;
+            }
+        }
+        callbackCount++;
+        return DataCallbackResult::Continue;
+    }
+
+    std::atomic<uint64_t> cpuMask{0};
+    std::atomic<int32_t> callbackCount{0};
+};
+
+TEST(ThreadPlacement, CallbackThread) {
+    PlacementCallback callback;
+    ThreadPlacement placement;
+    placement.cpuIds = {0};
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)
+            ->setDataCallback(&callback)
+            ->setCallbackThreadPlacement(placement);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+    EXPECT_EQ(1u, stream->getCallbackThreadPlacement().cpuIds.size());
+    EXPECT_EQ(Result::ErrorInvalidState, stream->getEffectiveCallbackThreadPlacement().error());
+
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(Result::OK, stream->stop());
+    EXPECT_GT(callback.callbackCount.load(), 0);
+    // It was applied before the first callback.
+    EXPECT_EQ(1u, callback.cpuMask.load());
+    auto effective = stream->getEffectiveCallbackThreadPlacement();
+    ASSERT_TRUE(effective);
+    EXPECT_EQ(Result::OK, effective.value().affinityResult);
+    EXPECT_EQ(1u, effective.value().cpuMask);
+    stream->close();
+}
+
+// Nothing is applied or measured on the callback thread if no placement was requested.
+TEST(ThreadPlacement, DefaultCallbackThreadIsNotMeasured) {
+    PlacementCallback callback;
+    AudioStreamBuilder builder;
+    builder.setAudioApi(AudioApi::Null)
+            ->setDataCallback(&callback);
+    std::shared_ptr<AudioStream> stream;
+    ASSERT_EQ(Result::OK, builder.openStream(stream));
+
+    ASSERT_EQ(Result::OK, stream->requestStart());
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ASSERT_EQ(Result::OK, stream->stop());
+    EXPECT_GT(callback.callbackCount.load(), 0);
+    EXPECT_EQ(Result::ErrorInvalidState, stream->getEffectiveCallbackThreadPlacement().error());
+    stream->close();
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <oboe/Oboe.h>
+
+using namespace oboe;
+
+TEST(test_time_histogram, empty) {
+    TimeHistogram histogram;
+    EXPECT_EQ(0, histogram.getCount());
+    EXPECT_EQ(0, histogram.getPercentileNanos(50.0));
+    EXPECT_EQ(0, histogram.getMaxNanos());
+}
+
+TEST(test_time_histogram, percentiles) {
+    TimeHistogram histogram;
+    // 1 to 1000 microseconds.
+    for (int i = 1; i <= 1000; i++) {
+        histogram.add(i * kNanosPerMicrosecond);
+    }
+    EXPECT_EQ(1000, histogram.getCount());
+    EXPECT_EQ(1000 * kNanosPerMicrosecond, histogram.getMaxNanos());
+    // Bins are 1/8 of an octave wide so the result may be up to 12.5% high.
+    int64_t median = histogram.getPercentileNanos(50.0);
+    EXPECT_GE(median, 500 * kNanosPerMicrosecond);
+    EXPECT_LE(median, 563 * kNanosPerMicrosecond);
+    int64_t p99 = histogram.getPercentileNanos(99.0);
+    EXPECT_GE(p99, 990 * kNanosPerMicrosecond);
+    EXPECT_LE(p99, 1000 * kNanosPerMicrosecond); // limited by the maximum
+    EXPECT_EQ(2 * kNanosPerMicrosecond, histogram.getPercentileNanos(0.0));
+
+    histogram.reset();
+    EXPECT_EQ(0, histogram.getCount());
+}
+
+TEST(test_time_histogram, out_of_range) {
+    TimeHistogram histogram;
+    histogram.add(-5);
+    histogram.add(1000 * kNanosPerSecond);
+    EXPECT_EQ(2, histogram.getCount());
+    EXPECT_EQ(kNanosPerMicrosecond, histogram.getPercentileNanos(50.0));
+    EXPECT_EQ(1000 * kNanosPerSecond, histogram.getPercentileNanos(100.0));
+}